@@ -10,12 +10,16 @@
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
-#include <regex.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include "mods/input.h"
-#include "mods/json.h"
 #include "mods/qrcode.h"
 #include "mods/opts.h"
+#include "mods/pool.h"
+#include "mods/grep.h"
+#include "mods/frame.h"
 #include "mods/error.h"
 #include "ctrl_mods/btk_help.h"
 #include "ctrl_mods/btk_privkey.h"
@@ -25,31 +29,66 @@
 #include "ctrl_mods/btk_balance.h"
 #include "ctrl_mods/btk_config.h"
 #include "ctrl_mods/btk_version.h"
+#include "ctrl_mods/btk_chain.h"
+#include "ctrl_mods/btk_serve.h"
 
 #define BTK_CHECK_NEG(x, y)         if (x < 0) { error_log(y); error_log("Error [%s]:", command_str); error_print(); return EXIT_FAILURE; }
 #define BTK_CHECK_NULL(x, y)        if (x == NULL) { error_log(y); error_log("Error [%s]:", command_str); error_print(); return EXIT_FAILURE; }
 #define BTK_CHECK_FALSE(x, y)       if (!x) { error_log(y); error_log("Error [%s]:", command_str); error_print(); return EXIT_FAILURE; }
 #define BTK_CHECK_TRUE(x, y)        if (x) { error_log(y); error_log("Error [%s]:", command_str); error_print(); return EXIT_FAILURE; }
 
-static regex_t grep;
+// With parallel jobs, each worker thread gets this many input items per
+// batch so that thread wake-ups are amortized across many conversions.
+#define BTK_JOBS_BATCH_FACTOR       64
+
+// Without --stream, list and binary output is still written out once this
+// many items have accumulated, so memory stays bounded on large inputs.
+#define BTK_OUTPUT_FLUSH_COUNT      65536
+
+typedef struct btk_batch *btk_batch;
+struct btk_batch {
+	opts_p opts;
+	input_item *inputs;
+	output_item *outputs;
+	struct ErrorStack *errors;
+	int *results;
+	size_t len;
+	size_t max;
+};
+
+static grep_pattern grep = NULL;
+static Pool pool = NULL;
+static output_json json_pending = NULL;
+static int frames_started = 0;
+static size_t image_count = 0;
+static int (*command_main)(output_item *, opts_p, unsigned char *, size_t) = NULL;
 
 int btk_init(opts_p);
 int btk_cleanup(opts_p);
 int btk_print_output(output_item, opts_p);
+int btk_grep_match(char *);
+int btk_render_output(output_item *, opts_p);
+int btk_write_images(output_item *, opts_p);
+int btk_image_path(char *, size_t, opts_p);
+int btk_write_image(char *, char *, size_t);
+int btk_batch_new(btk_batch *, opts_p);
+int btk_batch_add(output_item *, btk_batch, input_item);
+int btk_batch_process(output_item *, btk_batch);
+int btk_batch_job(void *, size_t);
+void btk_batch_free(btk_batch);
 
 int main(int argc, char *argv[])
 {
 	int i, r = 0;
+	long l;
 	char command_str[BUFSIZ];
 	opts_p opts = NULL;
-	input_item input_head = NULL;
 	input_item input = NULL;
 	output_item output = NULL;
-	int output_offset = 0;
+	btk_batch batch = NULL;
 
 	int (*command_init)(opts_p) = NULL;
 	int (*command_requires_input)(opts_p) = NULL;
-	int (*command_main)(output_item *, opts_p, unsigned char *, size_t) = NULL;
 	int (*command_cleanup)(opts_p) = NULL;
 
 	// Assembling the original command string for logging purposes
@@ -124,6 +163,20 @@ int main(int argc, char *argv[])
 		command_init = &btk_version_init;
 		command_cleanup = &btk_version_cleanup;
 	}
+	else if (strcmp(opts->command, "chain") == 0)
+	{
+		command_main = &btk_chain_main;
+		command_requires_input = &btk_chain_requires_input;
+		command_init = &btk_chain_init;
+		command_cleanup = &btk_chain_cleanup;
+	}
+	else if (strcmp(opts->command, "serve") == 0)
+	{
+		command_main = &btk_serve_main;
+		command_requires_input = &btk_serve_requires_input;
+		command_init = &btk_serve_init;
+		command_cleanup = &btk_serve_cleanup;
+	}
 	else if (strcmp(opts->command, "help") == 0)
 	{
 		command_main = &btk_help_main;
@@ -146,8 +199,13 @@ int main(int argc, char *argv[])
 	r = command_init(opts);
 	BTK_CHECK_NEG(r, "Initialization error.");
 
+	r = btk_batch_new(&batch, opts);
+	BTK_CHECK_NEG(r, "Could not initialize input batch.");
+
 	if (command_requires_input(opts))
 	{
+		BTK_CHECK_TRUE(opts->count > 0, "The count option can only be used when creating keys.");
+
 		input_formats:
 
 		if (opts->input_count > 0)
@@ -157,27 +215,12 @@ int main(int argc, char *argv[])
 				input = input_new_item((unsigned char *)opts->input[i], strlen(opts->input[i]));
 				ERROR_CHECK_NULL(input, "Could not create new input item.");
 
-				output_offset = output_length(output);
-
-				r = command_main(&output, opts, input->data, input->len);
+				r = btk_batch_add(&output, batch, input);
 				BTK_CHECK_NEG(r, NULL);
-
-				r = output_append_input(output, input, output_offset);
-				ERROR_CHECK_NEG(r, "Could not append input to output list.");
-
-				// output_append_input() appends a copy, so we need to free the
-				// input list to prevent a memory leak.
-				input_free(input);
-
-				if (opts->output_stream)
-				{
-					r = btk_print_output(output, opts);
-					BTK_CHECK_NEG(r, "Error printing output.");
-
-					output_free(output);
-					output = NULL;
-				}
 			}
+
+			r = btk_batch_process(&output, batch);
+			BTK_CHECK_NEG(r, NULL);
 		}
 		else if (opts->input_format_binary)
 		{
@@ -187,6 +230,17 @@ int main(int argc, char *argv[])
 			r = command_main(&output, opts, input->data, input->len);
 			BTK_CHECK_NEG(r, NULL);
 
+			if (grep)
+			{
+				output = output_filter(output, &btk_grep_match);
+			}
+
+			r = btk_render_output(&output, opts);
+			BTK_CHECK_NEG(r, NULL);
+
+			r = btk_write_images(&output, opts);
+			BTK_CHECK_NEG(r, NULL);
+
 			if (opts->output_stream)
 			{
 				r = btk_print_output(output, opts);
@@ -203,70 +257,40 @@ int main(int argc, char *argv[])
 				// Ignore empty strings
 				if (input->len == 0)
 				{
-					free(input);
+					input_free(input);
 					input = NULL;
 
 					continue;
 				}
 
-				output_offset = output_length(output);
-
-				r = command_main(&output, opts, input->data, input->len);
+				r = btk_batch_add(&output, batch, input);
 				BTK_CHECK_NEG(r, NULL);
-
-				r = output_append_input(output, input, output_offset);
-				ERROR_CHECK_NEG(r, "Could not append input to output list.");
-
-				// output_append_input() appends a copy, so we need to free the
-				// input list to prevent a memory leak.
-				input_free(input);
-
-				if (opts->output_stream)
-				{
-					r = btk_print_output(output, opts);
-					BTK_CHECK_NEG(r, "Error printing output.");
-
-					output_free(output);
-					output = NULL;
-				}
 			}
 			BTK_CHECK_NEG(r, "Error getting list input.");
+
+			r = btk_batch_process(&output, batch);
+			BTK_CHECK_NEG(r, NULL);
 		}
 		else if (opts->input_format_json)
 		{
 			while ((r = input_get_json(&input)) > 0)
 			{
-				input_head = input;
-
-				while (input != NULL)
+				// Items are processed while the rest of the document is
+				// still being read.
+				if (r != INPUT_JSON_END)
 				{
-					output_offset = output_length(output);
-
-					r = command_main(&output, opts, input->data, input->len);
+					r = btk_batch_add(&output, batch, input);
 					BTK_CHECK_NEG(r, NULL);
 
-					r = output_append_input(output, input, output_offset);
-					ERROR_CHECK_NEG(r, "Coul dnot append input to output list.");
-
-					if (opts->output_stream)
-					{
-						r = btk_print_output(output, opts);
-						BTK_CHECK_NEG(r, "Error printing output.");
-
-						output_free(output);
-						output = NULL;
-					}
-
-					input = input->next;
+					continue;
 				}
 
-				// output_append_input() appends a copy, so we need to free the
-				// input list to prevent a memory leak.
-				input_free(input_head);
+				r = btk_batch_process(&output, batch);
+				BTK_CHECK_NEG(r, NULL);
 
 				// Always printf outfor for each json input structure.
 				// If output_stream is enabled, output would already be printed.
-				if (output)
+				if (output || json_pending)
 				{
 					r = btk_print_output(output, opts);
 					BTK_CHECK_NEG(r, "Error printing output.");
@@ -277,6 +301,18 @@ int main(int argc, char *argv[])
 			}
 			BTK_CHECK_NEG(r, "Error getting json input.");
 		}
+		else if (opts->input_format_frames)
+		{
+			while ((r = input_get_frame(&input)) > 0)
+			{
+				r = btk_batch_add(&output, batch, input);
+				BTK_CHECK_NEG(r, NULL);
+			}
+			BTK_CHECK_NEG(r, "Error getting frames input.");
+
+			r = btk_batch_process(&output, batch);
+			BTK_CHECK_NEG(r, NULL);
+		}
 		else
 		{
 			r = input_get_format();
@@ -293,6 +329,9 @@ int main(int argc, char *argv[])
 				case INPUT_FORMAT_JSON:
 					opts->input_format_json = 1;
 					break;
+				case INPUT_FORMAT_FRAMES:
+					opts->input_format_frames = 1;
+					break;
 				default:
 					BTK_CHECK_NEG(-1, "Could not reliably determine input format. Specify input format.");
 					break;
@@ -303,28 +342,52 @@ int main(int argc, char *argv[])
 	}
 	else
 	{
-		if (opts->output_stream)
+		if (opts->count > 0)
 		{
-			while (1)
+			// Items are generated in batches on the worker threads. With
+			// --stream, each batch is printed as soon as it completes.
+			for (l = 0; l < opts->count; l++)
 			{
-				r = command_main(&output, opts, NULL, 0);
+				r = btk_batch_add(&output, batch, NULL);
 				BTK_CHECK_NEG(r, NULL);
+			}
 
-				r = btk_print_output(output, opts);
-				BTK_CHECK_NEG(r, "Error printing output.");
-
-				output_free(output);
-				output = NULL;
+			r = btk_batch_process(&output, batch);
+			BTK_CHECK_NEG(r, NULL);
+		}
+		else if (opts->output_stream)
+		{
+			while (1)
+			{
+				// Items without input data still run through the batch so
+				// that output generation is spread across the worker threads.
+				do
+				{
+					r = btk_batch_add(&output, batch, NULL);
+					BTK_CHECK_NEG(r, NULL);
+				}
+				while (batch->len > 0);
 			}
 		}
 		else
 		{
 			r = command_main(&output, opts, NULL, 0);
 			BTK_CHECK_NEG(r, NULL);
+
+			if (grep)
+			{
+				output = output_filter(output, &btk_grep_match);
+			}
+
+			r = btk_render_output(&output, opts);
+			BTK_CHECK_NEG(r, NULL);
+
+			r = btk_write_images(&output, opts);
+			BTK_CHECK_NEG(r, NULL);
 		}
 	}
 	
-	if (output)
+	if (output || json_pending)
 	{
 		r = btk_print_output(output, opts);
 		BTK_CHECK_NEG(r, "Error printing output.");
@@ -332,6 +395,8 @@ int main(int argc, char *argv[])
 		output_free(output);
 	}
 
+	btk_batch_free(batch);
+
 	r = command_cleanup(opts);
 	BTK_CHECK_NEG(r, "Cleanup error.");
 
@@ -351,6 +416,7 @@ int btk_init(opts_p opts)
 	if (opts->input_format_binary) { i++; }
 	if (opts->input_format_list) { i++; }
 	if (opts->input_format_json) { i++; }
+	if (opts->input_format_frames) { i++; }
 	ERROR_CHECK_TRUE((i > 1), "Can not use multiple input formats.");
 
 	i = 0;
@@ -358,6 +424,9 @@ int btk_init(opts_p opts)
 	if (opts->output_format_list) { i++; }
 	if (opts->output_format_qrcode) { i++; }
 	if (opts->output_format_json) { i++; }
+	if (opts->output_format_frames) { i++; }
+	if (opts->output_format_svg) { i++; }
+	if (opts->output_format_pbm) { i++; }
 	ERROR_CHECK_TRUE((i > 1), "Can not use multiple output formats.");
 	if (i == 0)
 	{
@@ -365,19 +434,32 @@ int btk_init(opts_p opts)
 	}
 
 	ERROR_CHECK_TRUE(opts->output_format_binary && opts->output_grep, "Can not grep on binary formatted output.");
+	ERROR_CHECK_TRUE(opts->output_format_frames && opts->output_grep, "Can not grep on frames formatted output.");
+	if (opts->output_dir)
+	{
+		ERROR_CHECK_TRUE(!opts->output_format_svg && !opts->output_format_pbm, "Only use output directory option with SVG or PBM formatted output.");
+		ERROR_CHECK_TRUE(access(opts->output_dir, W_OK | X_OK) < 0, "Can not write to output directory.");
+	}
 	if (opts->trace)
 	{
 		ERROR_CHECK_FALSE(opts->output_format_json, "Only use trace option with JSON formatted output.");
 		ERROR_CHECK_TRUE(opts->input_format_binary, "Can not use trace option on binary formatted input.");
+		ERROR_CHECK_TRUE(opts->input_format_frames, "Can not use trace option on frames formatted input.");
 		ERROR_CHECK_TRUE(opts->create, "Can not use trace option with the create option.");
 	}
 
-	// Compile regex for grep here.
-
+	// Grep is applied to each item's output as soon as the command returns
+	// it, so rejected items are never added to the output list.
 	if (opts->output_grep)
 	{
-		r = regcomp(&grep, opts->output_grep, REG_ICASE|REG_NOSUB);
-		ERROR_CHECK_TRUE(r, "Could not compile regex for grep option.");
+		r = grep_new(&grep, opts->output_grep);
+		ERROR_CHECK_NEG(r, "Could not compile pattern for grep option.");
+	}
+
+	if (opts->jobs > 1)
+	{
+		r = pool_new(&pool, opts->jobs);
+		ERROR_CHECK_NEG(r, "Could not start worker threads.");
 	}
 
 	return 1;
@@ -387,147 +469,474 @@ int btk_cleanup(opts_p opts)
 {
 	if (opts->output_grep)
 	{
-		regfree(&grep);
+		grep_free(grep);
+		grep = NULL;
+	}
+
+	if (pool)
+	{
+		pool_free(pool);
+		pool = NULL;
 	}
 
 	return 1;
 }
 
-int btk_print_output(output_item output, opts_p opts)
+int btk_batch_new(btk_batch *batch, opts_p opts)
+{
+	assert(opts);
+
+	*batch = malloc(sizeof(**batch));
+	ERROR_CHECK_NULL(*batch, "Memory allocation error.");
+
+	(*batch)->opts = opts;
+	(*batch)->len = 0;
+	(*batch)->max = 1;
+
+	if (pool)
+	{
+		(*batch)->max = (size_t)pool_size(pool) * BTK_JOBS_BATCH_FACTOR;
+	}
+
+	(*batch)->inputs = malloc(sizeof(input_item) * (*batch)->max);
+	ERROR_CHECK_NULL((*batch)->inputs, "Memory allocation error.");
+
+	(*batch)->outputs = malloc(sizeof(output_item) * (*batch)->max);
+	ERROR_CHECK_NULL((*batch)->outputs, "Memory allocation error.");
+
+	(*batch)->errors = malloc(sizeof(struct ErrorStack) * (*batch)->max);
+	ERROR_CHECK_NULL((*batch)->errors, "Memory allocation error.");
+
+	(*batch)->results = malloc(sizeof(int) * (*batch)->max);
+	ERROR_CHECK_NULL((*batch)->results, "Memory allocation error.");
+
+	return 1;
+}
+
+int btk_batch_add(output_item *output, btk_batch batch, input_item input)
+{
+	assert(batch);
+
+	batch->inputs[batch->len++] = input;
+
+	if (batch->len == batch->max)
+	{
+		return btk_batch_process(output, batch);
+	}
+
+	return 1;
+}
+
+int btk_batch_process(output_item *output, btk_batch batch)
 {
 	int r;
-	size_t i;
-	char qrcode_str[BUFSIZ];
-	cJSON *json_output = NULL;
-	char *json_output_str = NULL;
+	size_t i, j;
 
-	assert(output);
+	assert(batch);
 
-	if (opts->output_format_list)
+	for (i = 0; i < batch->len; i++)
 	{
-		while(output)
+		batch->outputs[i] = NULL;
+	}
+
+	if (pool)
+	{
+		pool_run(pool, &btk_batch_job, batch, batch->len);
+	}
+	else
+	{
+		for (i = 0; i < batch->len; i++)
+		{
+			btk_batch_job(batch, i);
+		}
+	}
+
+	// Reassemble the results in input order. Image files are numbered in
+	// this order too, so they are written here.
+	for (i = 0; i < batch->len; i++)
+	{
+		if (batch->results[i] >= 0 && batch->outputs[i])
 		{
-			if (opts->output_grep)
+			batch->results[i] = btk_write_images(&(batch->outputs[i]), batch->opts);
+			if (batch->results[i] < 0)
 			{
-				r = regexec(&grep, (char *)(output->content), 0, NULL, 0);
-				if (r == REG_NOMATCH)
+				error_save(&(batch->errors[i]));
+			}
+		}
+
+		if (batch->results[i] < 0)
+		{
+			break;
+		}
+
+		if (batch->outputs[i])
+		{
+			// Streamed JSON is printed as one document per input item.
+			if (batch->opts->output_stream && batch->opts->output_format_json)
+			{
+				r = btk_print_output(batch->outputs[i], batch->opts);
+				if (r < 0)
 				{
-					output = output->next;
-					continue;
+					error_log("Error printing output.");
+					error_save(&(batch->errors[i]));
+					break;
 				}
+
+				output_free(batch->outputs[i]);
+			}
+			else
+			{
+				*output = output_append(*output, batch->outputs[i]);
 			}
+		}
 
-			printf("%s\n", (char *)(output->content));
+		input_free(batch->inputs[i]);
+	}
 
-			output = output->next;
+	if (i < batch->len)
+	{
+		error_restore(&(batch->errors[i]));
+
+		for (j = i; j < batch->len; j++)
+		{
+			output_free(batch->outputs[j]);
+			input_free(batch->inputs[j]);
 		}
 	}
-	else if (opts->output_format_qrcode)
+
+	// Streamed output is written out once per batch rather than once per
+	// input item.
+	if (*output && batch->opts->output_stream)
 	{
-		while(output)
+		r = btk_print_output(*output, batch->opts);
+		ERROR_CHECK_NEG(r, "Error printing output.");
+
+		output_free(*output);
+		*output = NULL;
+	}
+
+	// Large output is written out early. A JSON document is left open
+	// until btk_print_output() finishes it.
+	if (*output && output_length(*output) >= BTK_OUTPUT_FLUSH_COUNT)
+	{
+		if (batch->opts->output_format_json)
 		{
-			if (opts->output_grep)
+			if (json_pending == NULL)
 			{
-				r = regexec(&grep, (char *)(output->content), 0, NULL, 0);
-				if (r == REG_NOMATCH)
-				{
-					output = output->next;
-					continue;
-				}
+				r = output_json_new(&json_pending, STDOUT_FILENO, batch->opts->trace, NULL);
+				ERROR_CHECK_NEG(r, "Could not start JSON output.");
 			}
 
-			memset(qrcode_str, 0, BUFSIZ);
+			r = output_json_write(json_pending, *output);
+			ERROR_CHECK_NEG(r, "Could not write JSON output.");
+		}
+		else
+		{
+			r = btk_print_output(*output, batch->opts);
+			ERROR_CHECK_NEG(r, "Error printing output.");
+		}
+
+		output_free(*output);
+		*output = NULL;
+	}
+
+	if (i < batch->len)
+	{
+		batch->len = 0;
 
-			r = qrcode_from_str(qrcode_str, (char *)(output->content));
-			ERROR_CHECK_NEG(r, "Can not generate qr code.");
+		return -1;
+	}
 
-			printf("\n%s\n", qrcode_str);
+	batch->len = 0;
 
-			output = output->next;
+	return 1;
+}
+
+int btk_batch_job(void *arg, size_t i)
+{
+	int r;
+	btk_batch batch = arg;
+	input_item input = batch->inputs[i];
+
+	if (input)
+	{
+		r = command_main(&(batch->outputs[i]), batch->opts, input->data, input->len);
+	}
+	else
+	{
+		r = command_main(&(batch->outputs[i]), batch->opts, NULL, 0);
+	}
+
+	if (r >= 0 && grep)
+	{
+		batch->outputs[i] = output_filter(batch->outputs[i], &btk_grep_match);
+	}
+
+	if (r >= 0)
+	{
+		r = btk_render_output(&(batch->outputs[i]), batch->opts);
+	}
+
+	// Inputs are only needed for tracing output back to them.
+	if (r >= 0 && input && batch->outputs[i] && batch->opts->trace)
+	{
+		r = output_append_input(batch->outputs[i], input, 0);
+		if (r < 0)
+		{
+			error_log("Could not append input to output list.");
 		}
 	}
-	else if (opts->output_format_binary)
+
+	if (r < 0)
 	{
+		error_save(&(batch->errors[i]));
+	}
+
+	batch->results[i] = r;
+
+	return r;
+}
+
+void btk_batch_free(btk_batch batch)
+{
+	assert(batch);
+
+	free(batch->inputs);
+	free(batch->outputs);
+	free(batch->errors);
+	free(batch->results);
+	free(batch);
+}
+
+int btk_print_output(output_item output, opts_p opts)
+{
+	int r;
+
+	if (opts->output_format_list || opts->output_format_svg || opts->output_format_pbm)
+	{
+		r = output_write_list(output, STDOUT_FILENO, NULL);
+		ERROR_CHECK_NEG(r, "Could not write list output.");
+	}
+	else if (opts->output_format_qrcode)
+	{
+		// Codes were rendered by btk_render_output().
 		while(output)
 		{
-			for (i = 0; i < output->length; i++)
-			{
-				fputc(((unsigned char *)(output->content))[i], stdout);
-			}
+			printf("\n%s\n", (char *)(output->content));
 
 			output = output->next;
 		}
 	}
+	else if (opts->output_format_binary)
+	{
+		r = output_write_binary(output, STDOUT_FILENO);
+		ERROR_CHECK_NEG(r, "Could not write binary output.");
+	}
+	else if (opts->output_format_frames)
+	{
+		// Output items are already encoded as frames by the command.
+		if (!frames_started)
+		{
+			fflush(stdout);
+
+			r = write(STDOUT_FILENO, FRAME_MAGIC, FRAME_MAGIC_LENGTH);
+			ERROR_CHECK_TRUE(r != FRAME_MAGIC_LENGTH, "Could not write frames output.");
+
+			frames_started = 1;
+		}
+
+		r = output_write_binary(output, STDOUT_FILENO);
+		ERROR_CHECK_NEG(r, "Could not write frames output.");
+	}
 	else if (opts->output_format_json)
 	{
-		char output_item_str[BUFSIZ];
-		char input_item_str[BUFSIZ];
+		if (json_pending)
+		{
+			r = output_json_write(json_pending, output);
+			ERROR_CHECK_NEG(r, "Could not write JSON output.");
 
-		r = json_init_output(&json_output, opts->trace);
-		ERROR_CHECK_NEG(r, "Error initializing JSON output.");
+			r = output_json_end(json_pending);
+			ERROR_CHECK_NEG(r, "Could not write JSON output.");
 
-		while(output)
+			output_json_free(json_pending);
+			json_pending = NULL;
+		}
+		else
 		{
-			memset(output_item_str, 0, BUFSIZ);
-			memset(input_item_str, 0, BUFSIZ);
+			r = output_write_json(output, STDOUT_FILENO, opts->trace, NULL);
+			ERROR_CHECK_NEG(r, "Could not write JSON output.");
+		}
+	}
+	else
+	{
+		error_log("No output format specified.");
+		return -1;
+	}
 
-			memcpy(output_item_str, output->content, output->length);
+	return 1;
+}
 
-			if (opts->output_grep)
-			{
-				r = regexec(&grep, output_item_str, 0, NULL, 0);
-				if (r == REG_NOMATCH)
-				{
-					output = output->next;
-					continue;
-				}
-			}
+int btk_grep_match(char *str)
+{
+	return grep_match(grep, str);
+}
 
-			if (opts->trace && output->input)
-			{
-				input_item tmp;
-				tmp = output->input;
+/*
+ * QR codes are rendered on the thread that produced the output, straight
+ * after the command returns it. Each item is replaced by its rendered code,
+ * which for image formats is the content of the file btk_write_images()
+ * writes.
+ */
+int btk_render_output(output_item *output, opts_p opts)
+{
+	int r, format;
+	size_t len;
+	char *rendered;
+	output_item item, rendered_output = NULL;
 
-				while (tmp != NULL)
-				{
-					memset(input_item_str, 0, BUFSIZ);
-					memcpy(input_item_str, tmp->data, tmp->len);
+	assert(output);
+	assert(opts);
 
-					r = json_add_output(json_output, output_item_str, input_item_str);
-					ERROR_CHECK_NEG(r, "Output handling error.");
+	if (opts->output_format_qrcode)   { format = QRCODE_FORMAT_TEXT; }
+	else if (opts->output_format_svg) { format = QRCODE_FORMAT_SVG; }
+	else if (opts->output_format_pbm) { format = QRCODE_FORMAT_PBM; }
+	else                              { return 1; }
 
-					memset(output_item_str, 0, BUFSIZ);
-					memcpy(output_item_str, tmp->data, tmp->len);
+	for (item = *output; item; item = item->next)
+	{
+		r = qrcode_render(&rendered, &len, (char *)(item->content), format);
+		if (r < 0)
+		{
+			output_free(rendered_output);
+			error_log("Can not generate qr code.");
+			return -1;
+		}
 
-					tmp = tmp->input;
-				}
-			}
-			else
-			{
-				r = json_add_output(json_output, output_item_str, NULL);
-				ERROR_CHECK_NEG(r, "Output handling error.");
-			}
+		if (format == QRCODE_FORMAT_TEXT)
+		{
+			rendered_output = output_append_new_copy(rendered_output, rendered, len + 1);
+		}
+		else
+		{
+			rendered_output = output_append_new_copy(rendered_output, rendered, len);
+		}
 
-			output = output->next;
+		free(rendered);
+
+		if (rendered_output == NULL)
+		{
+			error_log("Could not write qr code.");
+			return -1;
 		}
+	}
+
+	output_free(*output);
+	*output = rendered_output;
 
-		if (json_output_size(json_output) > 0)
+	return 1;
+}
+
+/*
+ * Writes each rendered image to its own file and replaces the item by the
+ * file's path. Files are numbered in output order rather than named after
+ * what they encode, which may be a private key.
+ */
+int btk_write_images(output_item *output, opts_p opts)
+{
+	int r;
+	char path[PATH_MAX];
+	output_item item, written = NULL;
+
+	assert(output);
+	assert(opts);
+
+	if (!opts->output_format_svg && !opts->output_format_pbm)
+	{
+		return 1;
+	}
+
+	for (item = *output; item; item = item->next)
+	{
+		r = btk_image_path(path, sizeof(path), opts);
+		if (r >= 0)
+		{
+			r = btk_write_image(path, item->content, item->length);
+		}
+		if (r >= 0)
 		{
-			r = json_to_string(&json_output_str, json_output);
-			ERROR_CHECK_NEG(r, "Error converting output to JSON.");
+			written = output_append_new_copy(written, path, strlen(path) + 1);
+		}
+
+		if (r < 0 || written == NULL)
+		{
+			output_free(written);
+			error_log("Could not write qr code.");
+			return -1;
+		}
+
+		// Traced inputs stay with the item.
+		written->tail->input = item->input;
+		item->input = NULL;
+	}
+
+	output_free(*output);
+	*output = written;
+
+	return 1;
+}
+
+int btk_image_path(char *path, size_t path_size, opts_p opts)
+{
+	int r;
+
+	r = snprintf(path, path_size, "%s/%06zu.%s", opts->output_dir ? opts->output_dir : ".", ++image_count, opts->output_format_svg ? "svg" : "pbm");
+	ERROR_CHECK_TRUE(r < 0 || (size_t)r >= path_size, "Output file path too long.");
 
-			printf("%s\n", json_output_str);
+	return 1;
+}
 
-			free(json_output_str);
+int btk_write_image(char *path, char *data, size_t len)
+{
+	int fd;
+	ssize_t r;
+
+	// Images may encode private keys. An existing file is never replaced
+	// or written through, as it may be a link placed there by someone else.
+	fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd < 0 && errno == EEXIST)
+	{
+		error_log("Output file %s already exists.", path);
+		return -1;
+	}
+	if (fd < 0)
+	{
+		error_log("Could not open output file %s.", path);
+		return -1;
+	}
+
+	while (len > 0)
+	{
+		r = write(fd, data, len);
+		if (r < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (r < 0)
+		{
+			close(fd);
+			error_log("Could not write output file %s.", path);
+			return -1;
 		}
 
-		json_free(json_output);
+		data += r;
+		len -= r;
 	}
-	else
+
+	if (close(fd) < 0)
 	{
-		error_log("No output format specified.");
+		error_log("Could not write output file %s.", path);
 		return -1;
 	}
 
 	return 1;
-}
\ No newline at end of file
+}
@@ -15,51 +15,64 @@
 #include "mods/privkey.h"
 #include "mods/pubkey.h"
 #include "mods/address.h"
+#include "mods/network.h"
 #include "mods/input.h"
 #include "mods/base58.h"
 #include "mods/base32.h"
 #include "mods/output.h"
+#include "mods/frame.h"
 #include "mods/opts.h"
 #include "mods/error.h"
 
+int btk_address_get_frame(output_item *, opts_p, Network *, PubKey, PrivKey, unsigned char *, size_t);
+int btk_address_add_all(output_item *, opts_p, PubKey, unsigned char *, Network);
+int btk_address_add(output_item *, opts_p, char *);
+
 int btk_address_main(output_item *output, opts_p opts, unsigned char *input, size_t input_len)
 {
 	int r;
 	char input_str[BUFSIZ];
-	char output_str[BUFSIZ];
-	PubKey pubkey = NULL;
-	PrivKey privkey = NULL;
+	struct PubKey pubkey;
+	struct PrivKey privkey;
+	Network network;
 
 	assert(opts);
 
 	memset(input_str, 0, BUFSIZ);
-	memset(output_str, 0, BUFSIZ);
 
-	privkey = malloc(privkey_sizeof());
-	ERROR_CHECK_NULL(privkey, "Memory allocation error.");
+	// A WIF input selects the network for this and later items.
+	network = network_get();
 
-	pubkey = malloc(pubkey_sizeof());
-	ERROR_CHECK_NULL(pubkey, "Memory allocation error.");
+	if (opts->input_format_frames)
+	{
+		r = btk_address_get_frame(output, opts, &network, &pubkey, &privkey, input, input_len);
+		ERROR_CHECK_NEG(r, "Could not get public key from input frame.");
 
-	if (opts->input_type_wif)
+		// Hash160 frames are converted to addresses directly.
+		if (r == 0)
+		{
+			return 1;
+		}
+	}
+	else if (opts->input_type_wif)
 	{
 		memcpy(input_str, input, input_len);
 
-		r = privkey_from_wif(privkey, input_str);
+		r = privkey_from_wif(&privkey, input_str, &network);
 		ERROR_CHECK_NEG(r, "Could not calculate private key from input.");
-		r = pubkey_get(pubkey, privkey);
+		r = pubkey_get(&pubkey, &privkey);
 		ERROR_CHECK_NEG(r, "Could not calculate public key.");
 	}
 	else if (opts->input_type_hex)
 	{
 		memcpy(input_str, input, input_len);
 		
-		r = pubkey_from_hex(pubkey, input_str);
+		r = pubkey_from_hex(&pubkey, input_str);
 		ERROR_CHECK_NEG(r, "Could not calculate public key from input.");
 	}
 	else
 	{
-		r = pubkey_from_guess(pubkey, input, input_len);
+		r = pubkey_from_guess(&pubkey, input, input_len, &network);
 		if (r < 0)
 		{
 			error_clear();
@@ -67,43 +80,155 @@ int btk_address_main(output_item *output, opts_p opts, unsigned char *input, siz
 		}
 	}
 
-	if (opts->output_type_p2wpkh)
+	network_set(network);
+
+	r = btk_address_add_all(output, opts, &pubkey, NULL, network);
+	ERROR_CHECK_NEG(r, NULL);
+
+	return 1;
+}
+
+/*
+ * Returns 1 when a public key was read from the frame, or 0 when the frame
+ * held a hash160 and the addresses were already added to the output.
+ */
+int btk_address_get_frame(output_item *output, opts_p opts, Network *network, PubKey pubkey, PrivKey privkey, unsigned char *input, size_t input_len)
+{
+	int r, type;
+	unsigned char *payload;
+	size_t payload_len;
+	char input_str[BUFSIZ];
+
+	assert(opts);
+	assert(network);
+	assert(pubkey);
+	assert(privkey);
+	assert(input);
+
+	r = frame_decode(&type, &payload, &payload_len, input, input_len);
+	ERROR_CHECK_NEG(r, "Could not decode input frame.");
+
+	switch (type)
 	{
-		// Avoid uncompressed pubkey error if we are streaming and p2pkh is specified.
-		if (pubkey_is_compressed(pubkey) || !opts->output_stream || !opts->output_type_p2pkh)
-		{
-			r = address_get_p2wpkh(output_str, pubkey, 0);
-			ERROR_CHECK_NEG(r, "Could not calculate P2WPKH address.");
+		case FRAME_TYPE_PRIVKEY:
+			r = privkey_from_raw(privkey, payload, payload_len);
+			ERROR_CHECK_NEG(r, "Could not get private key from frame.");
 
-			*output = output_append_new_copy(*output, output_str, strlen(output_str) + 1);
-			ERROR_CHECK_NULL(*output, "Memory allocation error.");
-		}
+			r = pubkey_get(pubkey, privkey);
+			ERROR_CHECK_NEG(r, "Could not calculate public key.");
+			break;
+		case FRAME_TYPE_PUBKEY:
+			r = pubkey_from_raw(pubkey, payload, payload_len);
+			ERROR_CHECK_NEG(r, "Could not get public key from frame.");
+			break;
+		case FRAME_TYPE_STRING:
+			ERROR_CHECK_TRUE((payload_len == 0 || payload_len >= BUFSIZ), "Invalid string frame length.");
+			memset(input_str, 0, BUFSIZ);
+			memcpy(input_str, payload, payload_len);
+			r = pubkey_from_guess(pubkey, (unsigned char *)input_str, payload_len, network);
+			ERROR_CHECK_NEG(r, "Could not get public key from frame.");
+			break;
+		case FRAME_TYPE_HASH160:
+			ERROR_CHECK_TRUE(payload_len != 20, "Invalid hash160 frame length.");
+
+			r = btk_address_add_all(output, opts, NULL, payload, *network);
+			ERROR_CHECK_NEG(r, NULL);
+
+			return 0;
+		default:
+			error_log("Can not get public key from frame type %i.", type);
+			return -1;
 	}
 
-	if (opts->output_type_p2wpkh_v1)
+	return 1;
+}
+
+/*
+ * Adds every requested address type for one key. The hash160 is computed
+ * once and shared by the P2PKH and P2WPKH encodings. Either pubkey or hash
+ * is given; P2TR can only be derived from a public key.
+ */
+int btk_address_add_all(output_item *output, opts_p opts, PubKey pubkey, unsigned char *hash, Network network)
+{
+	int r;
+	int segwit = 1;
+	unsigned char rmd[20];
+	char output_str[BUFSIZ];
+
+	assert(opts);
+	assert(pubkey || hash);
+
+	memset(output_str, 0, BUFSIZ);
+
+	if (pubkey)
 	{
-		// Avoid uncompressed pubkey error if we are streaming and p2pkh is specified.
-		if (pubkey_is_compressed(pubkey) || !opts->output_stream || !opts->output_type_p2pkh)
+		if (opts->output_type_p2pkh || opts->output_type_p2wpkh)
 		{
-			r = address_get_p2wpkh(output_str, pubkey, 1);
-			ERROR_CHECK_NEG(r, "Could not calculate P2WPKH address.");
+			r = address_get_hash160(rmd, pubkey);
+			ERROR_CHECK_NEG(r, "Could not calculate hash160 of public key.");
+		}
+		hash = rmd;
 
-			*output = output_append_new_copy(*output, output_str, strlen(output_str) + 1);
-			ERROR_CHECK_NULL(*output, "Memory allocation error.");
+		// Avoid uncompressed pubkey error if we are streaming and p2pkh is specified.
+		segwit = pubkey_is_compressed(pubkey);
+		if (!segwit && opts->output_type_p2wpkh)
+		{
+			ERROR_CHECK_TRUE(!opts->output_stream || !opts->output_type_p2pkh, "Public key is uncompressed. Segwit addresses require a compressed public key.");
 		}
 	}
 
+	if (opts->output_type_p2wpkh && segwit)
+	{
+		r = address_p2wpkh_from_raw(output_str, hash, 20, 0, network);
+		ERROR_CHECK_NEG(r, "Could not calculate P2WPKH address.");
+
+		r = btk_address_add(output, opts, output_str);
+		ERROR_CHECK_NEG(r, NULL);
+	}
+
+	if (opts->output_type_p2tr)
+	{
+		ERROR_CHECK_NULL(pubkey, "P2TR addresses can not be calculated from a hash160.");
+
+		r = address_get_p2tr(output_str, pubkey, network);
+		ERROR_CHECK_NEG(r, "Could not calculate P2TR address.");
+
+		r = btk_address_add(output, opts, output_str);
+		ERROR_CHECK_NEG(r, NULL);
+	}
+
 	if (opts->output_type_p2pkh)
 	{
-		r = address_get_p2pkh(output_str, pubkey);
+		r = address_from_rmd160(output_str, hash, network);
 		ERROR_CHECK_NEG(r, "Could not calculate P2PKH address.");
 
-		*output = output_append_new_copy(*output, output_str, strlen(output_str) + 1);
-		ERROR_CHECK_NULL(*output, "Memory allocation error.");
+		r = btk_address_add(output, opts, output_str);
+		ERROR_CHECK_NEG(r, NULL);
 	}
 
-	free(pubkey);
-	free(privkey);
+	return 1;
+}
+
+int btk_address_add(output_item *output, opts_p opts, char *address)
+{
+	int r;
+	unsigned char output_frame[FRAME_HEADER_LENGTH + BUFSIZ];
+
+	assert(opts);
+	assert(address);
+
+	if (opts->output_format_frames)
+	{
+		r = frame_encode(output_frame, FRAME_TYPE_STRING, (unsigned char *)address, strlen(address));
+		ERROR_CHECK_NEG(r, "Could not encode address frame.");
+
+		*output = output_append_new_copy(*output, output_frame, r);
+	}
+	else
+	{
+		*output = output_append_new_copy(*output, address, strlen(address) + 1);
+	}
+	ERROR_CHECK_NULL(*output, "Memory allocation error.");
 
 	return 1;
 }
@@ -120,7 +245,7 @@ int btk_address_init(opts_p opts)
 	assert(opts);
 
 	// Default to P2PKH
-	if (!opts->output_type_p2pkh && !opts->output_type_p2wpkh && !opts->output_type_p2wpkh_v1)
+	if (!opts->output_type_p2pkh && !opts->output_type_p2wpkh && !opts->output_type_p2tr)
 	{
 		opts->output_type_p2pkh = 1;
 	}
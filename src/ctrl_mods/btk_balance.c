@@ -18,10 +18,12 @@
 #include <pthread.h>
 #include "mods/error.h"
 #include "mods/output.h"
+#include "mods/frame.h"
 #include "mods/balance.h"
 #include "mods/txoa.h"
 #include "mods/pubkey.h"
 #include "mods/address.h"
+#include "mods/network.h"
 #include "mods/opts.h"
 #include "mods/script.h"
 #include "mods/jsonrpc.h"
@@ -33,10 +35,35 @@
 #include "mods/utxokey.h"
 #include "mods/utxovalue.h"
 #include "mods/chainstate.h"
+#include "mods/snapshot.h"
+#include "mods/bech32.h"
+#include "mods/pool.h"
 
 #define CHAIN_STATUS_READY    1
 #define CHAIN_STATUS_FINAL    2
 
+// An update writes its changes after this long, even before it has the
+// blocks opts->commit_blocks asks for or fills opts->dbcache.
+#define UPDATE_COMMIT_SECONDS 30
+
+// Megabytes of unspent outputs an update keeps, unless --dbcache sets it.
+#define UPDATE_DBCACHE        450
+
+// Balances an update keeps in memory, so busy addresses are read once.
+#define UPDATE_BALANCE_CACHE  ((size_t)512 << 20)
+
+// Records each chainstate range decodes per round of the import.
+#define IMPORT_BATCH_SIZE     4096
+
+// Megabytes for summing balances during the import before spilling to
+// disk, unless --dbcache sets it.
+#define IMPORT_DBCACHE        1024
+
+// Range count, records processed and block height, then per range a done
+// flag, the key length and the last key it returned.
+#define IMPORT_CHECKPOINT_HEADER_LEN  (sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint64_t))
+#define IMPORT_CHECKPOINT_RANGE_LEN   (2 + CHAINSTATE_KEY_MAX)
+
 typedef struct blockchain *blockchain;
 struct blockchain {
 	int status;
@@ -48,12 +75,60 @@ struct blockchain {
 typedef struct thread_args *thread_args;
 struct thread_args {
 	int last_block;
+	int replay_block;
 	int block_count;
+	int commit_blocks;
+	size_t commit_memory;
 	blockchain bc_head;
 	blockchain bc_tail;
 	int bc_len;
 };
 
+/*
+ * Import state. Coin records come from one chainstate range per job, or
+ * from a snapshot file that the jobs take turns reading a batch from. Each
+ * round, every job decodes and classifies its next batch of records into
+ * one buffer set while the writer job stores the previous round's set, so
+ * decoding and database writes overlap. A chainstate import writes each
+ * set's range positions with its outputs, as a checkpoint to resume from.
+ */
+typedef struct import_record *import_record;
+struct import_record {
+	unsigned char tx_hash[UTXOKEY_TX_HASH_LENGTH];
+	uint64_t vout;
+	uint64_t amount;
+	uint64_t height;
+	char address[BECH32_ADDRESS_SIZE];
+};
+
+// Where a chainstate range was when a buffer set was filled.
+typedef struct import_position *import_position;
+struct import_position {
+	unsigned char key[CHAINSTATE_KEY_MAX];
+	size_t key_len;
+	int done;
+};
+
+typedef struct import_state *import_state;
+struct import_state {
+	int ranges_len;
+	ChainstateRange *ranges;
+	import_position positions[2];
+	unsigned char *checkpoint;
+	int snapshot;
+	pthread_mutex_t snapshot_lock;
+	struct UTXOValue *values;
+	import_record records[2];
+	size_t *records_len[2];
+	int *finished;
+	int fill;
+	size_t *counts;
+	size_t record_count;
+	size_t processed;
+	uint64_t block_height;
+	struct ErrorStack *errors;
+};
+
 static pthread_t download_thread;
 static pthread_t process_thread;
 
@@ -61,6 +136,16 @@ void *btk_balance_pthread(void *);
 int btk_balance_download(thread_args);
 int btk_balance_process(thread_args);
 void btk_balance_sleep(void);
+int btk_balance_import(opts_p);
+int btk_balance_import_run(Pool, int (*)(void *, size_t), import_state, size_t);
+int btk_balance_import_count(void *, size_t);
+int btk_balance_import_read(void *, size_t);
+int btk_balance_import_write(import_state);
+int btk_balance_import_checkpoint(import_state, int);
+int btk_balance_import_resume(import_state, unsigned char *, size_t);
+int btk_balance_import_reload(char *, uint64_t, void *);
+int btk_balance_import_address(char *, UTXOValue);
+int btk_balance_print_counts(void);
 
 int btk_balance_main(output_item *output, opts_p opts, unsigned char *input, size_t input_len)
 {
@@ -70,129 +155,13 @@ int btk_balance_main(output_item *output, opts_p opts, unsigned char *input, siz
 
 	(void)input_len;
 
-	if (opts->create_from_chainstate)
+	if (opts->create_from_chainstate || opts->create_from_snapshot)
 	{
-		size_t i = 0;
-		size_t record_count = 0;
-		uint64_t block_height = 0;
-		UTXOKey key;
-		UTXOValue value;
-
-		printf("Getting record count...");
-		fflush(stdout);
-
-		r = chainstate_get_record_count(&record_count);
-		ERROR_CHECK_NEG(r, "Could not get chainstate record count.");
-
-		printf("Done.\n");
-		fflush(stdout);
-
-		key = malloc(sizeof(*key));
-		ERROR_CHECK_NULL(key, "Memory allocation error.");
-
-		value = malloc(sizeof(*value));
-		ERROR_CHECK_NULL(key, "Memory allocation error.");
-
-		memset(key, 0, sizeof(*key));
-		memset(value, 0, sizeof(*value));
-
-		r = chainstate_seek_start();
-		ERROR_CHECK_NEG(r, "Could not set chainstate interator.");
-
-		while ((r = chainstate_get_next(key, value)) > 0)
-		{
-			uint64_t balance;
-			char address[BUFSIZ];
-			PubKey pubkey;
-
-			memset(address, 0, BUFSIZ);
-			balance = 0;
-
-			if (value->n_size == 0x00)
-			{
-				r = address_from_rmd160(address, value->script);
-				ERROR_CHECK_NEG(r, "Could not generate address from public key hash.");
-			}
-			else if (value->n_size == 0x01)
-			{
-				r = address_from_p2sh_script(address, value->script);
-				ERROR_CHECK_NEG(r, "Could not generate address from script hash.");
-			}
-			else if (value->n_size == 0x02 || value->n_size == 0x03)
-			{
-				pubkey = malloc(pubkey_sizeof());
-				ERROR_CHECK_NULL(pubkey, "Memory allocation error.");
-
-				r = pubkey_from_raw(pubkey, value->script, value->script_len);
-				ERROR_CHECK_NEG(r, "Can not get pubkey object from compressed public key.");
-
-				r = address_get_p2pkh(address, pubkey);
-				ERROR_CHECK_NEG(r, "Can not get address from pubkey.");
-
-				free(pubkey);
-			}
-			else if (value->n_size == 0x04 || value->n_size == 0x05)
-			{
-				pubkey = malloc(pubkey_sizeof());
-				ERROR_CHECK_NULL(pubkey, "Memory allocation error.");
-
-				r = pubkey_from_raw(pubkey, value->script, value->script_len);
-				ERROR_CHECK_NEG(r, "Can not get pubkey object from uncompressed public key.");
-
-				pubkey_uncompress(pubkey);
-
-				r = address_get_p2pkh(address, pubkey);
-				ERROR_CHECK_NEG(r, "Can not get address from pubkey.");
-
-				free(pubkey);
-			}
-			else
-			{
-				r = script_get_output_address(address, value->script, value->script_len, 0);
-				ERROR_CHECK_NEG(r, "Could not get address from utxo script.");
-			}
-
-			if (*address)
-			{
-				r = balance_get(&balance, address);
-				ERROR_CHECK_NEG(r, "Could not query balance database.");
-
-				balance += value->amount;
+		r = btk_balance_import(opts);
+		ERROR_CHECK_NEG(r, "Could not import chainstate.");
 
-				// TXOA Database
-				r = txoa_put(key->tx_hash, key->vout, address);
-				ERROR_CHECK_NEG(r, "Could not put entry in the txoa database.");
-
-				// Balance Database
-				r = balance_put(address, balance);
-				ERROR_CHECK_NEG(r, "Could not add entry to balance database.");
-			}
-
-			if (value->height > block_height)
-			{
-				block_height = value->height;
-			}
-
-			free(value->script);
-			value->script = NULL;
-			
-			memset(key, 0, sizeof(*key));
-			memset(value, 0, sizeof(*value));
-
-			i++;
-			printf("\rBuilding... [%zu/%zu] [%.2f%% Complete]", i, record_count, ((i / (float)record_count) * 100));
-			fflush(stdout);
-		}
-		ERROR_CHECK_NEG(r, "Could not get chainstate record.");
-
-		r = txoa_set_last_block(block_height);
-		ERROR_CHECK_NEG(r, "Could not set last block.");
-
-		printf("\n");
-		printf("Block height: %"PRId64"\n", block_height);
-
-		utxokey_free(key);
-		utxovalue_free(value);
+		r = btk_balance_print_counts();
+		ERROR_CHECK_NEG(r, NULL);
 	}
 	else if (opts->create || opts->update)
 	{
@@ -207,12 +176,36 @@ int btk_balance_main(output_item *output, opts_p opts, unsigned char *input, siz
 		args->bc_head = NULL;
 		args->bc_tail = NULL;
 		args->bc_len = 0;
+		args->commit_blocks = opts->commit_blocks;
+		args->commit_memory = (size_t)(opts->dbcache ? opts->dbcache : UPDATE_DBCACHE) << 20;
+
+		r = balance_cache_open(UPDATE_BALANCE_CACHE);
+		ERROR_CHECK_NEG(r, "Could not create balance cache.");
+
+		r = txoa_cache_open(args->commit_memory);
+		ERROR_CHECK_NEG(r, "Could not create txoa cache.");
 
 		if (opts->update)
 		{
+			int balance_last_block;
+
 			r = txoa_get_last_block(&(args->last_block));
 			ERROR_CHECK_NEG(r, "Could not get last block processed.");
 			ERROR_CHECK_FALSE(r, "Could not get last block processed. May need to recreate database.");
+
+			// Databases written before the balances had a last block
+			// have none to compare.
+			r = balance_get_last_block(&balance_last_block);
+			ERROR_CHECK_NEG(r, "Could not get last block processed.");
+			ERROR_CHECK_TRUE(r > 0 && balance_last_block < args->last_block, "Balance and txoa databases are at different blocks. May need to recreate database.");
+
+			// Balances are written first, so an update that stopped
+			// between the two writes leaves them ahead. Their blocks are
+			// replayed into the txoa database only.
+			if (r > 0)
+			{
+				args->replay_block = balance_last_block;
+			}
 		}
 
 		r = jsonrpc_init(opts->host_name, opts->host_service, opts->rpc_auth);
@@ -248,6 +241,9 @@ int btk_balance_main(output_item *output, opts_p opts, unsigned char *input, siz
 		free(args);
 
 		printf("\nComplete\n");
+
+		r = btk_balance_print_counts();
+		ERROR_CHECK_NEG(r, NULL);
 	}
 	else
 	{
@@ -258,9 +254,26 @@ int btk_balance_main(output_item *output, opts_p opts, unsigned char *input, siz
 
 		memset(address, 0, BUFSIZ);
 		memset(input_str, 0, BUFSIZ);
-		memcpy(input_str, input, input_len);
 		memset(output_str, 0, BUFSIZ);
 
+		if (opts->input_format_frames)
+		{
+			int type;
+			unsigned char *payload;
+			size_t payload_len;
+
+			r = frame_decode(&type, &payload, &payload_len, input, input_len);
+			ERROR_CHECK_NEG(r, "Could not decode input frame.");
+			ERROR_CHECK_TRUE(type != FRAME_TYPE_STRING, "Balance input frames must be strings.");
+			ERROR_CHECK_TRUE(payload_len >= BUFSIZ, "Input frame too large.");
+
+			memcpy(input_str, payload, payload_len);
+		}
+		else
+		{
+			memcpy(input_str, input, input_len);
+		}
+
 		if (opts->input_type_wif)
 		{
 			r = address_from_wif(address, input_str);
@@ -268,7 +281,7 @@ int btk_balance_main(output_item *output, opts_p opts, unsigned char *input, siz
 		}
 		else if (opts->input_type_string)
 		{
-			r = address_from_str(address, input_str);
+			r = address_from_str(address, input_str, network_get());
 			ERROR_CHECK_NEG(r, "Could not calculate address from private key.");
 		}
 		else
@@ -409,9 +422,16 @@ int btk_balance_download(thread_args args)
 	return 1;
 }
 
+/*
+ * Changes are held in memory across a group of blocks, then written with
+ * the group's last block number in the same batch, so the databases only
+ * ever hold whole blocks. Reads see the held changes.
+ */
 int btk_balance_process(thread_args args)
 {
 	int r;
+	int pending_blocks = 0;
+	time_t commit_time = time(NULL);
 
 	while (1)
 	{
@@ -420,6 +440,7 @@ int btk_balance_process(thread_args args)
 		blockchain tmp;
 		int status;
 		int block_num;
+		int replay;
 
 		while (args->bc_head == NULL || !args->bc_head->status)
 		{
@@ -429,6 +450,7 @@ int btk_balance_process(thread_args args)
 		status = args->bc_head->status;
 		block = args->bc_head->block;
 		block_num = args->bc_head->block_num;
+		replay = (block_num <= args->replay_block);
 
 		for (i = 0; i < block->tx_count; i++)
 		{
@@ -460,6 +482,11 @@ int btk_balance_process(thread_args args)
 					r = txoa_batch_delete(block->transactions[i]->inputs[j]->tx_hash, block->transactions[i]->inputs[j]->index);
 					ERROR_CHECK_NEG(r, "Could not delete txao entry after spending.");
 
+					if (replay)
+					{
+						continue;
+					}
+
 					// Get previous balance (if any)
 					r = balance_get(&prev_balance, address);
 					ERROR_CHECK_NEG(r, "Could not query balance database.");
@@ -469,7 +496,7 @@ int btk_balance_process(thread_args args)
 						r = balance_batch_put(address, prev_balance - amount);
 						ERROR_CHECK_NEG(r, "Could not add entry to balance database.");
 					}
-					else
+					else if (r > 0)
 					{
 						r = balance_batch_delete(address);
 						ERROR_CHECK_NEG(r, "Could not update address balance.");
@@ -477,12 +504,6 @@ int btk_balance_process(thread_args args)
 				}
 			}
 
-			r = txoa_batch_write();
-			ERROR_CHECK_NEG(r, "Could not batch write txao records.");
-
-			r = balance_batch_write();
-			ERROR_CHECK_NEG(r, "Could not batch write balance records.");
-
 			for (j = 0; j < block->transactions[i]->output_count; j++)
 			{
 				memset(address, 0, BUFSIZ);
@@ -490,7 +511,8 @@ int btk_balance_process(thread_args args)
 				r = script_get_output_address(address,
 							block->transactions[i]->outputs[j]->script_raw,
 							block->transactions[i]->outputs[j]->script_size,
-							block->transactions[i]->version);
+							block->transactions[i]->version,
+							network_main());
 				ERROR_CHECK_NEG(r, "Could not get address from output script.");
 
 				amount = block->transactions[i]->outputs[j]->amount;
@@ -503,25 +525,51 @@ int btk_balance_process(thread_args args)
 					r = txoa_batch_put(block->transactions[i]->txid, j, address, amount);
 					ERROR_CHECK_NEG(r, "Could not put entry in the txoa database.");
 
+					if (replay)
+					{
+						continue;
+					}
+
 					// Get previous balance (if any)
 					r = balance_get(&prev_balance, address);
 					ERROR_CHECK_NEG(r, "Could not query balance database.");
 
 					// Balance Database
-					r = balance_batch_put(address, amount + prev_balance);
+					if (r > 0)
+					{
+						r = balance_batch_put(address, amount + prev_balance);
+					}
+					else
+					{
+						r = balance_batch_insert(address, amount);
+					}
 					ERROR_CHECK_NEG(r, "Could not add entry to balance database.");
 				}
 			}
+		}
 
-			r = txoa_batch_write();
-			ERROR_CHECK_NEG(r, "Could not batch write txao records.");
+		pending_blocks++;
+
+		if (status == CHAIN_STATUS_FINAL || pending_blocks >= args->commit_blocks || balance_batch_memory() + txoa_batch_memory() >= args->commit_memory || time(NULL) - commit_time >= UPDATE_COMMIT_SECONDS)
+		{
+			if (!replay)
+			{
+				r = balance_batch_set_last_block(block_num);
+				ERROR_CHECK_NEG(r, "Could not set last block.");
+			}
 
 			r = balance_batch_write();
 			ERROR_CHECK_NEG(r, "Could not batch write balance records.");
-		}
 
-		r = txoa_set_last_block(block_num);
-		ERROR_CHECK_NEG(r, "Could not set last block.");
+			r = txoa_batch_set_last_block(block_num);
+			ERROR_CHECK_NEG(r, "Could not set last block.");
+
+			r = txoa_batch_write();
+			ERROR_CHECK_NEG(r, "Could not batch write txao records.");
+
+			pending_blocks = 0;
+			commit_time = time(NULL);
+		}
 
 		if (status == CHAIN_STATUS_FINAL)
 		{
@@ -547,6 +595,580 @@ int btk_balance_process(thread_args args)
 	return 1;
 }
 
+int btk_balance_import(opts_p opts)
+{
+	int r, i, jobs;
+	uint32_t checkpoint_ranges;
+	size_t j, total, checkpoint_len;
+	unsigned char *checkpoint = NULL;
+	Pool pool = NULL;
+	import_state state;
+
+	assert(opts);
+
+	jobs = opts->jobs;
+
+	// A resumed import splits the chainstate as the first attempt did.
+	if (opts->resume)
+	{
+		r = txoa_get_checkpoint(&checkpoint, &checkpoint_len);
+		ERROR_CHECK_NEG(r, "Could not get import checkpoint.");
+		ERROR_CHECK_NULL(checkpoint, "No import checkpoint found to resume from.");
+		ERROR_CHECK_TRUE(checkpoint_len < IMPORT_CHECKPOINT_HEADER_LEN, "Invalid import checkpoint.");
+
+		deserialize_uint32(&checkpoint_ranges, checkpoint, SERIALIZE_ENDIAN_LIT);
+		ERROR_CHECK_TRUE(checkpoint_ranges < 1 || checkpoint_ranges > 0x10000, "Invalid import checkpoint.");
+
+		jobs = (int)checkpoint_ranges;
+	}
+
+	state = malloc(sizeof(*state));
+	ERROR_CHECK_NULL(state, "Memory allocation error.");
+
+	memset(state, 0, sizeof(*state));
+
+	state->ranges_len = jobs;
+	state->ranges = calloc(jobs, sizeof(ChainstateRange));
+	state->positions[0] = calloc(jobs, sizeof(struct import_position));
+	state->positions[1] = calloc(jobs, sizeof(struct import_position));
+	state->checkpoint = malloc(IMPORT_CHECKPOINT_HEADER_LEN + (IMPORT_CHECKPOINT_RANGE_LEN * jobs));
+	state->values = calloc(IMPORT_BATCH_SIZE * jobs, sizeof(struct UTXOValue));
+	state->records[0] = malloc(sizeof(struct import_record) * IMPORT_BATCH_SIZE * jobs);
+	state->records[1] = malloc(sizeof(struct import_record) * IMPORT_BATCH_SIZE * jobs);
+	state->records_len[0] = calloc(jobs, sizeof(size_t));
+	state->records_len[1] = calloc(jobs, sizeof(size_t));
+	state->finished = calloc(jobs, sizeof(int));
+	state->counts = calloc(jobs, sizeof(size_t));
+	state->errors = malloc(sizeof(struct ErrorStack) * (jobs + 1));
+	ERROR_CHECK_NULL(state->ranges, "Memory allocation error.");
+	ERROR_CHECK_NULL(state->positions[0], "Memory allocation error.");
+	ERROR_CHECK_NULL(state->positions[1], "Memory allocation error.");
+	ERROR_CHECK_NULL(state->checkpoint, "Memory allocation error.");
+	ERROR_CHECK_NULL(state->values, "Memory allocation error.");
+	ERROR_CHECK_NULL(state->records[0], "Memory allocation error.");
+	ERROR_CHECK_NULL(state->records[1], "Memory allocation error.");
+	ERROR_CHECK_NULL(state->records_len[0], "Memory allocation error.");
+	ERROR_CHECK_NULL(state->records_len[1], "Memory allocation error.");
+	ERROR_CHECK_NULL(state->finished, "Memory allocation error.");
+	ERROR_CHECK_NULL(state->counts, "Memory allocation error.");
+	ERROR_CHECK_NULL(state->errors, "Memory allocation error.");
+
+	// One thread per range, plus one for the writer.
+	if (jobs > 1)
+	{
+		r = pool_new(&pool, jobs + 1);
+		ERROR_CHECK_NEG(r, "Could not start worker threads.");
+	}
+
+	// A snapshot states its coin count up front.
+	if (opts->create_from_snapshot)
+	{
+		state->snapshot = 1;
+		state->record_count = snapshot_get_coin_count();
+
+		pthread_mutex_init(&(state->snapshot_lock), NULL);
+	}
+	else
+	{
+		printf("Getting record count...");
+		fflush(stdout);
+
+		if (opts->count_exact)
+		{
+			r = btk_balance_import_run(pool, &btk_balance_import_count, state, jobs);
+			ERROR_CHECK_NEG(r, "Could not get chainstate record count.");
+
+			for (i = 0; i < jobs; i++)
+			{
+				state->record_count += state->counts[i];
+			}
+		}
+		else
+		{
+			r = chainstate_estimate_record_count(&(state->record_count));
+			ERROR_CHECK_NEG(r, "Could not estimate chainstate record count.");
+		}
+
+		printf("Done.\n");
+		fflush(stdout);
+
+		if (checkpoint)
+		{
+			r = btk_balance_import_resume(state, checkpoint, checkpoint_len);
+			ERROR_CHECK_NEG(r, "Could not resume from import checkpoint.");
+
+			free(checkpoint);
+		}
+		else
+		{
+			for (i = 0; i < jobs; i++)
+			{
+				r = chainstate_range_new(&(state->ranges[i]), i, jobs);
+				ERROR_CHECK_NEG(r, "Could not set chainstate iterator.");
+			}
+		}
+	}
+
+	r = balance_load_begin((size_t)(opts->dbcache ? opts->dbcache : IMPORT_DBCACHE) << 20);
+	ERROR_CHECK_NEG(r, "Could not start loading balances.");
+
+	// The outputs stored so far are exactly those before the checkpoint,
+	// so their balances are summed again from there.
+	if (opts->resume)
+	{
+		printf("Reading imported outputs...");
+		fflush(stdout);
+
+		r = txoa_scan(&btk_balance_import_reload, NULL);
+		ERROR_CHECK_NEG(r, "Could not read imported outputs.");
+
+		printf("Done.\n");
+		fflush(stdout);
+	}
+
+	// The first round only fills. Every round after that also writes the
+	// set filled the round before, until all ranges are drained.
+	state->fill = 0;
+	r = btk_balance_import_run(pool, &btk_balance_import_read, state, jobs);
+	ERROR_CHECK_NEG(r, "Could not get chainstate record.");
+
+	do
+	{
+		state->fill ^= 1;
+
+		r = btk_balance_import_run(pool, &btk_balance_import_read, state, jobs + 1);
+		ERROR_CHECK_NEG(r, "Could not import chainstate records.");
+
+		// An estimated count may come up short
+		if (state->processed > state->record_count)
+		{
+			state->record_count = state->processed;
+		}
+
+		printf("\rBuilding... [%zu/%zu] [%.2f%% Complete]", state->processed, state->record_count, ((state->processed / (float)state->record_count) * 100));
+		fflush(stdout);
+
+		total = 0;
+		for (i = 0; i < jobs; i++)
+		{
+			total += state->records_len[state->fill][i];
+		}
+	}
+	while (total > 0);
+
+	printf("\nWriting balances...");
+	fflush(stdout);
+
+	r = balance_load_end();
+	ERROR_CHECK_NEG(r, "Could not write balances.");
+
+	printf("Done.");
+
+	r = balance_batch_set_last_block(state->block_height);
+	ERROR_CHECK_NEG(r, "Could not set last block.");
+
+	r = balance_batch_write();
+	ERROR_CHECK_NEG(r, "Could not write to the balance database.");
+
+	r = txoa_batch_set_last_block(state->block_height);
+	ERROR_CHECK_NEG(r, "Could not set last block.");
+
+	if (!state->snapshot)
+	{
+		r = txoa_batch_delete_checkpoint();
+		ERROR_CHECK_NEG(r, "Could not delete import checkpoint.");
+	}
+
+	r = txoa_batch_write();
+	ERROR_CHECK_NEG(r, "Could not write to the txoa database.");
+
+	printf("\n");
+	printf("Block height: %"PRId64"\n", state->block_height);
+
+	if (pool)
+	{
+		pool_free(pool);
+	}
+
+	if (state->snapshot)
+	{
+		pthread_mutex_destroy(&(state->snapshot_lock));
+	}
+
+	for (i = 0; i < jobs; i++)
+	{
+		if (state->ranges[i])
+		{
+			chainstate_range_free(state->ranges[i]);
+		}
+	}
+
+	// Script buffers are reused from round to round
+	for (j = 0; j < (size_t)IMPORT_BATCH_SIZE * jobs; j++)
+	{
+		free(state->values[j].script);
+	}
+
+	free(state->ranges);
+	free(state->positions[0]);
+	free(state->positions[1]);
+	free(state->checkpoint);
+	free(state->values);
+	free(state->records[0]);
+	free(state->records[1]);
+	free(state->records_len[0]);
+	free(state->records_len[1]);
+	free(state->finished);
+	free(state->counts);
+	free(state->errors);
+	free(state);
+
+	return 1;
+}
+
+// Runs jobs on the pool, or in order on this thread without one, then
+// passes up the first error a job logged.
+int btk_balance_import_run(Pool pool, int (*job)(void *, size_t), import_state state, size_t count)
+{
+	int r;
+	size_t i;
+
+	for (i = 0; i < count; i++)
+	{
+		state->errors[i].n = 0;
+	}
+
+	if (pool)
+	{
+		r = pool_run(pool, job, state, count);
+	}
+	else
+	{
+		for (r = 1, i = 0; i < count && r >= 0; i++)
+		{
+			r = job(state, i);
+		}
+	}
+
+	if (r < 0)
+	{
+		for (i = 0; i < count; i++)
+		{
+			if (state->errors[i].n > 0)
+			{
+				error_restore(&(state->errors[i]));
+				break;
+			}
+		}
+
+		return -1;
+	}
+
+	return 1;
+}
+
+int btk_balance_import_count(void *arg, size_t i)
+{
+	int r;
+	size_t count = 0;
+	import_state state = arg;
+	ChainstateRange range = NULL;
+	size_t key_len, value_len;
+	const unsigned char *key, *value;
+
+	// Counting needs no decoding
+	r = chainstate_range_new(&range, (int)i, state->ranges_len);
+	if (r >= 0)
+	{
+		while ((r = chainstate_range_get_raw(&key, &key_len, &value, &value_len, range)) > 0)
+		{
+			count++;
+		}
+
+		chainstate_range_free(range);
+	}
+
+	if (r < 0)
+	{
+		error_save(&(state->errors[i]));
+		return -1;
+	}
+
+	state->counts[i] = count;
+
+	return 1;
+}
+
+// Jobs below ranges_len decode the next batch of their range into the fill
+// set. The last job, when there is one, writes out the other set.
+int btk_balance_import_read(void *arg, size_t i)
+{
+	int r = 1;
+	size_t j, n = 0;
+	import_state state = arg;
+	import_record records;
+	import_position position;
+	struct UTXOKey key;
+	struct UTXOValue *values;
+
+	if ((int)i == state->ranges_len)
+	{
+		r = btk_balance_import_write(state);
+		if (r < 0)
+		{
+			error_save(&(state->errors[i]));
+		}
+
+		return r;
+	}
+
+	records = state->records[state->fill] + (i * IMPORT_BATCH_SIZE);
+	values = state->values + (i * IMPORT_BATCH_SIZE);
+
+	// Read the whole batch first, so a snapshot is only locked while its
+	// records are decoded and not while they are classified.
+	if (state->snapshot)
+	{
+		pthread_mutex_lock(&(state->snapshot_lock));
+	}
+
+	while (!state->finished[i] && n < IMPORT_BATCH_SIZE)
+	{
+		if (state->snapshot)
+		{
+			r = snapshot_get_next(&key, &(values[n]));
+		}
+		else
+		{
+			r = chainstate_range_get_next(state->ranges[i], &key, &(values[n]));
+		}
+
+		if (r < 0)
+		{
+			break;
+		}
+		if (r == 0)
+		{
+			state->finished[i] = 1;
+			break;
+		}
+
+		memcpy(records[n].tx_hash, key.tx_hash, UTXOKEY_TX_HASH_LENGTH);
+		records[n].vout = key.vout;
+		records[n].amount = values[n].amount;
+		records[n].height = values[n].height;
+
+		n++;
+	}
+
+	if (state->snapshot)
+	{
+		pthread_mutex_unlock(&(state->snapshot_lock));
+	}
+	else if (r >= 0)
+	{
+		position = state->positions[state->fill] + i;
+		position->done = state->finished[i];
+
+		if (!position->done)
+		{
+			r = chainstate_range_get_key(position->key, &(position->key_len), state->ranges[i]);
+		}
+	}
+
+	for (j = 0; j < n; j++)
+	{
+		records[j].address[0] = '\0';
+
+		if (r >= 0)
+		{
+			r = btk_balance_import_address(records[j].address, &(values[j]));
+		}
+	}
+
+	state->records_len[state->fill][i] = n;
+
+	if (r < 0)
+	{
+		error_save(&(state->errors[i]));
+		return -1;
+	}
+
+	return 1;
+}
+
+int btk_balance_import_write(import_state state)
+{
+	int r, i;
+	size_t j;
+	import_record records;
+	int set = state->fill ^ 1;
+
+	for (i = 0; i < state->ranges_len; i++)
+	{
+		records = state->records[set] + (i * IMPORT_BATCH_SIZE);
+
+		for (j = 0; j < state->records_len[set][i]; j++)
+		{
+			if (records[j].address[0])
+			{
+				// TXOA Database
+				r = txoa_load_put(records[j].tx_hash, records[j].vout, records[j].address, records[j].amount);
+				ERROR_CHECK_NEG(r, "Could not put entry in the txoa database.");
+
+				// Balance Database
+				r = balance_load_add(records[j].address, records[j].amount);
+				ERROR_CHECK_NEG(r, "Could not add entry to balance database.");
+			}
+
+			if (records[j].height > state->block_height)
+			{
+				state->block_height = records[j].height;
+			}
+		}
+
+		state->processed += state->records_len[set][i];
+	}
+
+	// In the same batch, so a checkpoint always matches the stored outputs
+	if (!state->snapshot)
+	{
+		r = btk_balance_import_checkpoint(state, set);
+		ERROR_CHECK_NEG(r, NULL);
+	}
+
+	r = txoa_batch_write();
+	ERROR_CHECK_NEG(r, "Could not write to the txoa database.");
+
+	return 1;
+}
+
+int btk_balance_import_checkpoint(import_state state, int set)
+{
+	int r, i;
+	unsigned char *head;
+	import_position position;
+
+	head = state->checkpoint;
+	head = serialize_uint32(head, (uint32_t)state->ranges_len, SERIALIZE_ENDIAN_LIT);
+	head = serialize_uint64(head, (uint64_t)state->processed, SERIALIZE_ENDIAN_LIT);
+	head = serialize_uint64(head, state->block_height, SERIALIZE_ENDIAN_LIT);
+
+	for (i = 0; i < state->ranges_len; i++)
+	{
+		position = state->positions[set] + i;
+
+		head = serialize_uint8(head, (uint8_t)position->done, SERIALIZE_ENDIAN_LIT);
+		head = serialize_uint8(head, (uint8_t)position->key_len, SERIALIZE_ENDIAN_LIT);
+		head = serialize_uchar(head, position->key, position->key_len);
+	}
+
+	r = txoa_batch_put_checkpoint(state->checkpoint, head - state->checkpoint);
+	ERROR_CHECK_NEG(r, "Could not put import checkpoint in the txoa database.");
+
+	return 1;
+}
+
+// Restores the counters and starts each range after its checkpoint key.
+int btk_balance_import_resume(import_state state, unsigned char *checkpoint, size_t checkpoint_len)
+{
+	int r, i;
+	uint8_t done, key_len;
+	uint64_t processed;
+	unsigned char *head, *end;
+
+	head = checkpoint + sizeof(uint32_t);
+	end = checkpoint + checkpoint_len;
+
+	head = deserialize_uint64(&processed, head, SERIALIZE_ENDIAN_LIT);
+	head = deserialize_uint64(&(state->block_height), head, SERIALIZE_ENDIAN_LIT);
+
+	state->processed = (size_t)processed;
+
+	for (i = 0; i < state->ranges_len; i++)
+	{
+		ERROR_CHECK_TRUE(end - head < 2, "Invalid import checkpoint.");
+
+		head = deserialize_uint8(&done, head, SERIALIZE_ENDIAN_LIT);
+		head = deserialize_uint8(&key_len, head, SERIALIZE_ENDIAN_LIT);
+
+		ERROR_CHECK_TRUE(key_len > CHAINSTATE_KEY_MAX || end - head < key_len, "Invalid import checkpoint.");
+
+		if (done)
+		{
+			state->finished[i] = 1;
+		}
+		else if (key_len > 0)
+		{
+			r = chainstate_range_new_after(&(state->ranges[i]), i, state->ranges_len, head, key_len);
+			ERROR_CHECK_NEG(r, "Could not set chainstate iterator.");
+		}
+		else
+		{
+			r = chainstate_range_new(&(state->ranges[i]), i, state->ranges_len);
+			ERROR_CHECK_NEG(r, "Could not set chainstate iterator.");
+		}
+
+		head += key_len;
+	}
+
+	return 1;
+}
+
+int btk_balance_import_reload(char *address, uint64_t amount, void *arg)
+{
+	int r;
+
+	(void)arg;
+
+	r = balance_load_add(address, amount);
+	ERROR_CHECK_NEG(r, "Could not add entry to balance database.");
+
+	return 1;
+}
+
+int btk_balance_import_address(char *address, UTXOValue value)
+{
+	int r;
+	struct PubKey pubkey;
+
+	if (value->n_size == 0x00)
+	{
+		r = address_from_rmd160(address, value->script, network_main());
+		ERROR_CHECK_NEG(r, "Could not generate address from public key hash.");
+	}
+	else if (value->n_size == 0x01)
+	{
+		r = address_from_p2sh_script(address, value->script, network_main());
+		ERROR_CHECK_NEG(r, "Could not generate address from script hash.");
+	}
+	else if (value->n_size == 0x02 || value->n_size == 0x03)
+	{
+		r = pubkey_from_raw(&pubkey, value->script, value->script_len);
+		ERROR_CHECK_NEG(r, "Can not get pubkey object from compressed public key.");
+
+		r = address_get_p2pkh(address, &pubkey, network_main());
+		ERROR_CHECK_NEG(r, "Can not get address from pubkey.");
+	}
+	else if (value->n_size == 0x04 || value->n_size == 0x05)
+	{
+		r = pubkey_from_raw(&pubkey, value->script, value->script_len);
+		ERROR_CHECK_NEG(r, "Can not get pubkey object from uncompressed public key.");
+
+		pubkey_uncompress(&pubkey);
+
+		r = address_get_p2pkh(address, &pubkey, network_main());
+		ERROR_CHECK_NEG(r, "Can not get address from pubkey.");
+	}
+	else
+	{
+		r = script_get_output_address(address, value->script, value->script_len, 0, network_main());
+		ERROR_CHECK_NEG(r, "Could not get address from utxo script.");
+	}
+
+	return 1;
+}
+
 void btk_balance_sleep(void)
 {
 	struct timespec bcsleep;
@@ -556,11 +1178,30 @@ void btk_balance_sleep(void)
 	nanosleep(&bcsleep, NULL);
 }
 
+// The stored counts, so a finished run shows what the databases hold.
+int btk_balance_print_counts(void)
+{
+	int r;
+	size_t count;
+
+	r = balance_get_record_count(&count);
+	ERROR_CHECK_NEG(r, "Could not get balance record count.");
+
+	printf("Addresses: %zu\n", count);
+
+	r = txoa_get_record_count(&count);
+	ERROR_CHECK_NEG(r, "Could not get txoa record count.");
+
+	printf("Unspent outputs: %zu\n", count);
+
+	return 1;
+}
+
 int btk_balance_requires_input(opts_p opts)
 {
 	assert(opts);
 
-	if (opts->create || opts->create_from_chainstate || opts->update)
+	if (opts->create || opts->create_from_chainstate || opts->create_from_snapshot || opts->update)
 	{
 		return 0;
 	}
@@ -574,10 +1215,13 @@ int btk_balance_init(opts_p opts)
 
 	assert(opts);
 
+	ERROR_CHECK_TRUE(opts->output_format_frames, "Frames output format not supported for balance command.");
+
 	// Option sanity check.
 	int i = 0;
 	if (opts->create) { i++; }
 	if (opts->create_from_chainstate) { i++; }
+	if (opts->create_from_snapshot) { i++; }
 	if (opts->update) { i++; }
 	ERROR_CHECK_TRUE((i > 1), "Cannot use more than one create or update option.");
 
@@ -589,14 +1233,24 @@ int btk_balance_init(opts_p opts)
 
 	if (opts->create_from_chainstate)
 	{
-		r = chainstate_open(opts->chainstate_path);
+		r = chainstate_open(opts->chainstate_path, opts->direct_read);
 		ERROR_CHECK_NEG(r, "Could not open txoa database.");
 	}
+	ERROR_CHECK_TRUE(opts->direct_read && !opts->create_from_chainstate, "Only use direct read option with the create from chainstate option.");
+	ERROR_CHECK_TRUE(opts->resume && !opts->create_from_chainstate, "Only use resume option with the create from chainstate option.");
+
+	if (opts->create_from_snapshot)
+	{
+		r = snapshot_open(opts->create_from_snapshot, opts->use_mmap);
+		ERROR_CHECK_NEG(r, "Could not open snapshot file.");
+	}
+	ERROR_CHECK_TRUE(opts->use_mmap && !opts->create_from_snapshot, "Only use mmap option with the create from snapshot option.");
 
-	r = balance_open(opts->balance_path, (opts->create || opts->create_from_chainstate));
+	// A resumed import carries on in the databases it already created
+	r = balance_open(opts->balance_path, (opts->create || opts->create_from_chainstate || opts->create_from_snapshot) && !opts->resume);
 	ERROR_CHECK_NEG(r, "Could not open balance database.");
 
-	if (opts->create || opts->create_from_chainstate || opts->update)
+	if (opts->create || opts->create_from_chainstate || opts->create_from_snapshot || opts->update)
 	{
 		char *txoa_path = NULL;
 
@@ -609,7 +1263,7 @@ int btk_balance_init(opts_p opts)
 			strcat(txoa_path, "/txoa/");
 		}
 
-		r = txoa_open(txoa_path, (opts->create || opts->create_from_chainstate));
+		r = txoa_open(txoa_path, (opts->create || opts->create_from_chainstate || opts->create_from_snapshot) && !opts->resume);
 		ERROR_CHECK_NEG(r, "Could not open txoa database.");
 
 		if (txoa_path)
@@ -630,7 +1284,12 @@ int btk_balance_cleanup(opts_p opts)
 		chainstate_close();
 	}
 
-	if (opts->create || opts->update)
+	if (opts->create_from_snapshot)
+	{
+		snapshot_close();
+	}
+
+	if (opts->create || opts->create_from_chainstate || opts->create_from_snapshot || opts->update)
 	{
 		txoa_close();
 	}
@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "btk_chain.h"
+#include "btk_privkey.h"
+#include "btk_pubkey.h"
+#include "btk_address.h"
+#include "btk_balance.h"
+#include "mods/output.h"
+#include "mods/opts.h"
+#include "mods/error.h"
+
+#define CHAIN_STAGES_MAX       8
+#define CHAIN_STAGE_ARGS_MAX   64
+
+typedef struct chain_stage *chain_stage;
+struct chain_stage {
+	struct opts opts;
+	char *args;
+	int (*main)(output_item *, opts_p, unsigned char *, size_t);
+	int (*requires_input)(opts_p);
+	int (*init)(opts_p);
+	int (*cleanup)(opts_p);
+};
+
+static struct chain_stage stages[CHAIN_STAGES_MAX];
+static int stages_len = 0;
+
+// Commands that can be chained. A comma only ends a stage when one of
+// these follows it, so option values may contain commas.
+static char *stage_commands[] = { "privkey", "pubkey", "address", "balance", NULL };
+
+int btk_chain_run(output_item *, int, opts_p, unsigned char *, size_t);
+int btk_chain_stage_new(chain_stage, char *);
+char *btk_chain_stage_end(char *);
+
+int btk_chain_main(output_item *output, opts_p opts, unsigned char *input, size_t input_len)
+{
+	struct opts first;
+
+	assert(opts);
+
+	// The input format may be detected after init, so it is handed to the
+	// first stage here on a copy of its opts.
+	first = stages[0].opts;
+	first.input_format_frames = opts->input_format_frames;
+
+	return btk_chain_run(output, 0, &first, input, input_len);
+}
+
+/*
+ * Runs stage i on one input item and feeds each of its output items to the
+ * next stage. Stages before the last one write frames, so keys are passed
+ * along as raw bytes and never re-encoded as text.
+ */
+int btk_chain_run(output_item *output, int i, opts_p opts, unsigned char *input, size_t input_len)
+{
+	int r;
+	output_item stage_output = NULL;
+	output_item item;
+
+	if (i == stages_len - 1)
+	{
+		r = stages[i].main(output, opts, input, input_len);
+		ERROR_CHECK_NEG(r, NULL);
+
+		return 1;
+	}
+
+	r = stages[i].main(&stage_output, opts, input, input_len);
+	ERROR_CHECK_NEG(r, NULL);
+
+	for (item = stage_output; item != NULL; item = item->next)
+	{
+		r = btk_chain_run(output, i + 1, &(stages[i + 1].opts), item->content, item->length);
+		ERROR_CHECK_NEG(r, NULL);
+	}
+
+	output_free(stage_output);
+
+	return 1;
+}
+
+int btk_chain_stage_new(chain_stage stage, char *spec)
+{
+	int r, argc;
+	char *argv[CHAIN_STAGE_ARGS_MAX + 1];
+	char *tok, *tokstate;
+
+	assert(stage);
+	assert(spec);
+
+	// Option arguments point into this copy, so it lives as long as the stage.
+	stage->args = malloc(strlen(spec) + 1);
+	ERROR_CHECK_NULL(stage->args, "Memory allocation error.");
+
+	strcpy(stage->args, spec);
+
+	argc = 0;
+	argv[argc++] = "btk";
+
+	tok = strtok_r(stage->args, " ", &tokstate);
+	while (tok != NULL)
+	{
+		ERROR_CHECK_TRUE(argc >= CHAIN_STAGE_ARGS_MAX, "Too many chain stage options.");
+
+		argv[argc++] = tok;
+
+		tok = strtok_r(NULL, " ", &tokstate);
+	}
+	argv[argc] = NULL;
+
+	ERROR_CHECK_TRUE(argc < 2, "Empty chain stage.");
+
+	r = opts_init(&(stage->opts));
+	ERROR_CHECK_NEG(r, NULL);
+
+	r = opts_get(&(stage->opts), argc, argv);
+	ERROR_CHECK_NEG(r, "Could not get chain stage options.");
+
+	if (strcmp(stage->opts.command, "privkey") == 0)
+	{
+		stage->main = &btk_privkey_main;
+		stage->requires_input = &btk_privkey_requires_input;
+		stage->init = &btk_privkey_init;
+		stage->cleanup = &btk_privkey_cleanup;
+	}
+	else if (strcmp(stage->opts.command, "pubkey") == 0)
+	{
+		stage->main = &btk_pubkey_main;
+		stage->requires_input = &btk_pubkey_requires_input;
+		stage->init = &btk_pubkey_init;
+		stage->cleanup = &btk_pubkey_cleanup;
+	}
+	else if (strcmp(stage->opts.command, "address") == 0)
+	{
+		stage->main = &btk_address_main;
+		stage->requires_input = &btk_address_requires_input;
+		stage->init = &btk_address_init;
+		stage->cleanup = &btk_address_cleanup;
+	}
+	else if (strcmp(stage->opts.command, "balance") == 0)
+	{
+		stage->main = &btk_balance_main;
+		stage->requires_input = &btk_balance_requires_input;
+		stage->init = &btk_balance_init;
+		stage->cleanup = &btk_balance_cleanup;
+	}
+	else
+	{
+		error_log("Command '%s' can not be used in a chain.", stage->opts.command);
+		return -1;
+	}
+
+	ERROR_CHECK_TRUE(stage->opts.input_count > 0, "Chain stages do not take input items.");
+
+	ERROR_CHECK_TRUE(opts_io_count(&(stage->opts)) > 0, "Input and output options are set on the chain, not on its stages.");
+
+	r = opts_set_config(&(stage->opts));
+	ERROR_CHECK_NEG(r, "Could not set chain stage options from config.");
+
+	return 1;
+}
+
+/*
+ * Returns the comma that ends the stage at the start of list, or NULL if
+ * it is the last stage.
+ */
+char *btk_chain_stage_end(char *list)
+{
+	int i;
+	size_t len;
+	char *comma, *next;
+
+	assert(list);
+
+	for (comma = strchr(list, ','); comma != NULL; comma = strchr(comma + 1, ','))
+	{
+		next = comma + 1 + strspn(comma + 1, " ");
+
+		for (i = 0; stage_commands[i] != NULL; i++)
+		{
+			len = strlen(stage_commands[i]);
+
+			if (strncmp(next, stage_commands[i], len) == 0 && (next[len] == '\0' || next[len] == ' ' || next[len] == ','))
+			{
+				return comma;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+int btk_chain_requires_input(opts_p opts)
+{
+	assert(opts);
+
+	return stages[0].requires_input(&(stages[0].opts));
+}
+
+int btk_chain_init(opts_p opts)
+{
+	int i, j, r;
+	char *list, *end;
+
+	assert(opts);
+
+	ERROR_CHECK_TRUE(opts->input_count < 1, "Missing chain stage list.");
+
+	// The first non-option is the stage list, not an input item.
+	list = opts->input[0];
+	for (i = 1; i < opts->input_count; i++)
+	{
+		opts->input[i - 1] = opts->input[i];
+	}
+	opts->input_count--;
+
+	while (list != NULL)
+	{
+		ERROR_CHECK_TRUE(stages_len >= CHAIN_STAGES_MAX, "Too many chain stages.");
+
+		end = btk_chain_stage_end(list);
+		if (end != NULL)
+		{
+			*end = '\0';
+		}
+
+		r = btk_chain_stage_new(&(stages[stages_len]), list);
+		ERROR_CHECK_NEG(r, "Invalid chain stage.");
+
+		stages_len++;
+
+		list = (end != NULL) ? end + 1 : NULL;
+	}
+
+	ERROR_CHECK_TRUE(stages_len == 0, "Missing chain stage list.");
+
+	// Stage inits may open shared resources (e.g. the balance database),
+	// so each command may appear once.
+	for (i = 0; i < stages_len; i++)
+	{
+		for (j = i + 1; j < stages_len; j++)
+		{
+			if (strcmp(stages[i].opts.command, stages[j].opts.command) == 0)
+			{
+				error_log("Command '%s' appears more than once in the chain.", stages[i].opts.command);
+				return -1;
+			}
+		}
+	}
+
+	for (i = 0; i < stages_len; i++)
+	{
+		stages[i].opts.jobs = opts->jobs;
+
+		if (i == 0)
+		{
+			stages[i].opts.input_format_binary = opts->input_format_binary;
+			stages[i].opts.input_type_binary |= opts->input_type_binary;
+		}
+		else
+		{
+			stages[i].opts.input_format_frames = 1;
+		}
+
+		if (i < stages_len - 1)
+		{
+			stages[i].opts.output_format_frames = 1;
+		}
+		else
+		{
+			stages[i].opts.output_format_frames = opts->output_format_frames;
+			stages[i].opts.output_stream = opts->output_stream;
+		}
+
+		r = stages[i].init(&(stages[i].opts));
+		ERROR_CHECK_NEG(r, "Could not initialize chain stage.");
+	}
+
+	return 1;
+}
+
+int btk_chain_cleanup(opts_p opts)
+{
+	int r;
+
+	assert(opts);
+
+	while (stages_len > 0)
+	{
+		stages_len--;
+
+		r = stages[stages_len].cleanup(&(stages[stages_len].opts));
+		ERROR_CHECK_NEG(r, "Could not clean up chain stage.");
+
+		free(stages[stages_len].args);
+	}
+
+	return 1;
+}
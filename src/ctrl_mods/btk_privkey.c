@@ -17,6 +17,7 @@
 #include "mods/network.h"
 #include "mods/input.h"
 #include "mods/output.h"
+#include "mods/frame.h"
 #include "mods/error.h"
 #include "mods/opts.h"
 
@@ -24,51 +25,40 @@
 #define REHASH_MAX_SIZE        1000000
 #define HASH_WILDCARD          "*"
 
-int btk_privkey_get(PrivKey, unsigned char *, size_t);
-int btk_privkey_compression_add(output_item *, PrivKey);
-int btk_privkey_process_rehash(char *);
+int btk_privkey_get(PrivKey, opts_p, unsigned char *, size_t);
+int btk_privkey_get_frame(PrivKey, unsigned char *, size_t);
+int btk_privkey_compression_add(output_item *, opts_p, PrivKey);
+int btk_privkey_process_rehash(long int *, int *, opts_p, char *);
 int btk_privkey_process_rehash_comp(const void *, const void *);
 
-// Defaults
-static int input_type_wif = 0;
-static int input_type_hex = 0;
-static int input_type_raw = 0;
-static int input_type_string = 0;
-static int input_type_decimal = 0;
-static int input_type_binary = 0;
-static int input_type_sbd = 0;
-static int output_type_wif = 0;
-static int output_type_hex = 0;
-static int output_type_decimal = 0;
-static int output_type_raw = 0;
-static int compression_on = 0;
-static int compression_off = 0;
-static char *rehash = NULL;
-
-static int output_hashes_arr_len = 0;
-static long int output_hashes_arr[REHASHES_ARRAY_SIZE];
-
 int btk_privkey_main(output_item *output, opts_p opts, unsigned char *input, size_t input_len)
 {
 	int i, r;
-	PrivKey key = NULL;
+	struct PrivKey key;
 	long int hash_count;
+	int output_hashes_arr_len = 0;
+	long int output_hashes_arr[REHASHES_ARRAY_SIZE];
 
 	assert(opts);
 
-	key = malloc(privkey_sizeof());
-	ERROR_CHECK_NULL(key, "Memory allocation error.");
-
 	if (opts->create)
 	{
-		r = privkey_new(key);
+		r = privkey_new(&key);
 		ERROR_CHECK_NEG(r, "Could not generate a new private key.");
 	}
 	else
 	{
 		ERROR_CHECK_NULL(input, "Input required.");
 
-		r = btk_privkey_get(key, input, input_len);
+		// The input format may be detected after init, so check it here.
+		if (opts->input_format_frames)
+		{
+			r = btk_privkey_get_frame(&key, input, input_len);
+		}
+		else
+		{
+			r = btk_privkey_get(&key, opts, input, input_len);
+		}
 		ERROR_CHECK_NEG(r, "Could not get privkey from input.");
 	}
 
@@ -81,9 +71,9 @@ int btk_privkey_main(output_item *output, opts_p opts, unsigned char *input, siz
 		network_set_main();
 	}
 
-	if (rehash)
+	if (opts->rehash)
 	{
-		r = btk_privkey_process_rehash((char *)input);
+		r = btk_privkey_process_rehash(output_hashes_arr, &output_hashes_arr_len, opts, (char *)input);
 		ERROR_CHECK_NEG(r, "Error while processing rehash argument.");
 
 		// Perform rehash on key
@@ -97,28 +87,26 @@ int btk_privkey_main(output_item *output, opts_p opts, unsigned char *input, siz
 
 			while (hash_count > 0)
 			{
-				r = privkey_rehash(key);
+				r = privkey_rehash(&key);
 				ERROR_CHECK_NEG(r, "Unable to rehash private key.");
 
 				hash_count--;
 			}
 
-			r = btk_privkey_compression_add(output, key);
+			r = btk_privkey_compression_add(output, opts, &key);
 			ERROR_CHECK_NEG(r, "");
 		}
 	}
 	else
 	{
-		r = btk_privkey_compression_add(output, key);
+		r = btk_privkey_compression_add(output, opts, &key);
 		ERROR_CHECK_NEG(r, "");
 	}
 
-	free(key);
-
 	return 1;
 }
 
-int btk_privkey_get(PrivKey key, unsigned char *input, size_t input_len)
+int btk_privkey_get(PrivKey key, opts_p opts, unsigned char *input, size_t input_len)
 {
 	int r;
 	char input_str[BUFSIZ];
@@ -128,63 +116,66 @@ int btk_privkey_get(PrivKey key, unsigned char *input, size_t input_len)
 
 	memset(input_str, 0, BUFSIZ);
 
-	if (input_type_wif)
+	if (opts->input_type_wif)
 	{
 		memcpy(input_str, input, input_len);
-		r = privkey_from_wif(key, input_str);
+		r = privkey_from_wif(key, input_str, NULL);
 	}
-	else if (input_type_hex)
+	else if (opts->input_type_hex)
 	{
 		memcpy(input_str, input, input_len);
 		r = privkey_from_hex(key, input_str);
 	}
-	else if (input_type_string)
+	else if (opts->input_type_string)
 	{
 		memcpy(input_str, input, input_len);
 		r = privkey_from_str(key, input_str);
 	}
-	else if (input_type_decimal)
+	else if (opts->input_type_decimal)
 	{
 		memcpy(input_str, input, input_len);
 		r = privkey_from_dec(key, input_str);
 	}
-	else if (input_type_sbd)
+	else if (opts->input_type_sbd)
 	{
 		memcpy(input_str, input, input_len);
 		r = privkey_from_sbd(key, input_str);
 	}
-	else if (input_type_raw)
+	else if (opts->input_type_raw)
 	{
 		r = privkey_from_raw(key, input, input_len);
 	}
-	else if (input_type_binary)
+	else if (opts->input_type_binary)
 	{
 		r = privkey_from_blob(key, input, input_len);
 	}
 	else
 	{
 		r = privkey_from_guess(key, input, input_len);
-		if (r > 0)
+
+		// Remembering a guessed input type is only safe when items are
+		// processed one at a time.
+		if (r > 0 && opts->jobs <= 1)
 		{
 			switch(r)
 			{
 				case PRIVKEY_GUESS_DECIMAL:
-					input_type_decimal = 1;
+					opts->input_type_decimal = 1;
 					break;
 				case PRIVKEY_GUESS_HEX:
-					input_type_hex = 1;
+					opts->input_type_hex = 1;
 					break;
 				case PRIVKEY_GUESS_WIF:
-					input_type_wif = 1;
+					opts->input_type_wif = 1;
 					break;
 				case PRIVKEY_GUESS_STRING:
-					input_type_string = 1;
+					opts->input_type_string = 1;
 					break;
 				case PRIVKEY_GUESS_RAW:
-					input_type_raw = 1;
+					opts->input_type_raw = 1;
 					break;
 				case PRIVKEY_GUESS_BLOB:
-					input_type_binary = 1;
+					opts->input_type_binary = 1;
 					break;
 			}
 		}
@@ -200,15 +191,56 @@ int btk_privkey_get(PrivKey key, unsigned char *input, size_t input_len)
 	return 1;
 }
 
-int btk_privkey_compression_add(output_item *output, PrivKey key)
+int btk_privkey_get_frame(PrivKey key, unsigned char *input, size_t input_len)
+{
+	int r, type;
+	unsigned char *payload;
+	size_t payload_len;
+	char input_str[BUFSIZ];
+
+	assert(key);
+	assert(input);
+
+	r = frame_decode(&type, &payload, &payload_len, input, input_len);
+	ERROR_CHECK_NEG(r, "Could not decode input frame.");
+
+	switch (type)
+	{
+		case FRAME_TYPE_PRIVKEY:
+			r = privkey_from_raw(key, payload, payload_len);
+			ERROR_CHECK_NEG(r, "Could not get private key from frame.");
+			break;
+		case FRAME_TYPE_STRING:
+			ERROR_CHECK_TRUE((payload_len == 0 || payload_len >= BUFSIZ), "Invalid string frame length.");
+			memset(input_str, 0, BUFSIZ);
+			memcpy(input_str, payload, payload_len);
+			r = privkey_from_guess(key, (unsigned char *)input_str, payload_len);
+			ERROR_CHECK_NEG(r, "Could not get private key from frame.");
+			break;
+		default:
+			error_log("Can not get private key from frame type %i.", type);
+			return -1;
+	}
+
+	if (privkey_is_zero(key))
+	{
+		error_log("Key value cannot be zero.");
+		return -1;
+	}
+
+	return 1;
+}
+
+int btk_privkey_compression_add(output_item *output, opts_p opts, PrivKey key)
 {
 	int r;
 	int comp_on, comp_off;
 	char output_str[BUFSIZ];
 	unsigned char output_raw[BUFSIZ];
+	unsigned char output_frame[FRAME_HEADER_LENGTH + PRIVKEY_LENGTH + 1];
 
-	comp_on = compression_on;
-	comp_off = compression_off;
+	comp_on = opts->compression_on;
+	comp_off = opts->compression_off;
 
 	comp_again:
 
@@ -223,7 +255,18 @@ int btk_privkey_compression_add(output_item *output, PrivKey key)
 
 	}
 
-	if (output_type_raw)
+	if (opts->output_format_frames)
+	{
+		r = privkey_to_raw(output_raw, key, 1);
+		ERROR_CHECK_NEG(r, "Could not convert private key to raw data.");
+
+		r = frame_encode(output_frame, FRAME_TYPE_PRIVKEY, output_raw, r);
+		ERROR_CHECK_NEG(r, "Could not encode private key frame.");
+
+		*output = output_append_new_copy(*output, output_frame, r);
+		ERROR_CHECK_NULL(*output, "Memory allocation error.");
+	}
+	else if (opts->output_type_raw)
 	{
 		memset(output_raw, 0, BUFSIZ);
 
@@ -235,18 +278,18 @@ int btk_privkey_compression_add(output_item *output, PrivKey key)
 	}
 	else
 	{
-		if (output_type_wif)
+		if (opts->output_type_wif)
 		{
 			memset(output_str, 0, BUFSIZ);
 
-			r = privkey_to_wif(output_str, key);
+			r = privkey_to_wif(output_str, key, network_get());
 			ERROR_CHECK_NEG(r, "Could not convert private key to WIF format.");
 
 			*output = output_append_new_copy(*output, output_str, strlen(output_str) + 1);
 			ERROR_CHECK_NULL(*output, "Memory allocation error.");
 		}
 		
-		if (output_type_hex)
+		if (opts->output_type_hex)
 		{
 			memset(output_str, 0, BUFSIZ);
 
@@ -257,7 +300,7 @@ int btk_privkey_compression_add(output_item *output, PrivKey key)
 			ERROR_CHECK_NULL(*output, "Memory allocation error.");
 		}
 		
-		if (output_type_decimal)
+		if (opts->output_type_decimal)
 		{
 			memset(output_str, 0, BUFSIZ);
 
@@ -286,20 +329,22 @@ int btk_privkey_compression_add(output_item *output, PrivKey key)
 	return 1;
 }
 
-int btk_privkey_process_rehash(char *input_str)
+int btk_privkey_process_rehash(long int *output_hashes_arr, int *output_hashes_arr_len, opts_p opts, char *input_str)
 {
 	int i, j;
-	int output_hashes_len = 0;
 	char *tok;
 	char *tokend;
+	char *tokstate;
+	char rehash_str[BUFSIZ];
 	long int tmp;
 
-	// Save a pointer to the start of output_hashes so that it can be reset
-	// for list processing.
-	output_hashes_len = strlen(rehash);
+	// Tokenize a copy so the rehash option stays intact for the next item
+	// in the input list, which may be processed on another thread.
+	memset(rehash_str, 0, BUFSIZ);
+	strncpy(rehash_str, opts->rehash, BUFSIZ - 1);
 
 	i = 0;
-	tok = strtok(rehash, ",");
+	tok = strtok_r(rehash_str, ",", &tokstate);
 	while (tok != NULL)
 	{
 		if (i + 1 > REHASHES_ARRAY_SIZE)
@@ -327,7 +372,7 @@ int btk_privkey_process_rehash(char *input_str)
 		}
 		else if (strcmp(tok, HASH_WILDCARD) == 0)
 		{
-			if (!input_type_string && !input_type_decimal)
+			if (!opts->input_type_string && !opts->input_type_decimal)
 			{
 				error_log("Can not use wildcard '%s' with current input type.", HASH_WILDCARD);
 				return -1;
@@ -336,6 +381,12 @@ int btk_privkey_process_rehash(char *input_str)
 			tokend = input_str;
 			while (*tokend != '\0')
 			{
+				if (i + 1 > REHASHES_ARRAY_SIZE)
+				{
+					error_log("Rehash list too long.");
+					return -1;
+				}
+
 				tmp = strtol(input_str, &tokend, 10);
 				if (tmp < 0)
 				{
@@ -360,37 +411,27 @@ int btk_privkey_process_rehash(char *input_str)
 			return -1;
 		}
 
-		tok = strtok(NULL, ",");
+		tok = strtok_r(NULL, ",", &tokstate);
 	}
 
 	qsort(output_hashes_arr, i, sizeof(long int), btk_privkey_process_rehash_comp);
 
-	output_hashes_arr_len = i;
+	*output_hashes_arr_len = i;
 
 	// Get rid of dups
-	for (i = 0; i < output_hashes_arr_len-1; i++)
+	for (i = 0; i < *output_hashes_arr_len-1; i++)
 	{
 		if (output_hashes_arr[i] == output_hashes_arr[i+1])
 		{
-			for (j = i; j < output_hashes_arr_len-1; j++)
+			for (j = i; j < *output_hashes_arr_len-1; j++)
 			{
 				output_hashes_arr[j] = output_hashes_arr[j+1];
 			}
-			output_hashes_arr_len--;
+			(*output_hashes_arr_len)--;
 			i--;
 		}
 	}
 
-	// Undo the strtok changes to output_hashes for use in next item in input
-	// list (if exists).
-	for (i = 0; i < output_hashes_len; i++)
-	{
-		if (rehash[i] == '\0')
-		{
-			rehash[i] = ',';
-		}
-	}
-
 	return 1;
 }
 
@@ -415,31 +456,16 @@ int btk_privkey_init(opts_p opts)
 {
 	assert(opts);
 
-	if (opts->input_type_wif) { input_type_wif =  opts->input_type_wif; }
-	if (opts->input_type_hex) { input_type_hex =  opts->input_type_hex; }
-	if (opts->input_type_raw) { input_type_raw =  opts->input_type_raw; }
-	if (opts->input_type_string) { input_type_string =  opts->input_type_string; }
-	if (opts->input_type_decimal) { input_type_decimal =  opts->input_type_decimal; }
-	if (opts->input_type_binary) { input_type_binary =  opts->input_type_binary; }
-	if (opts->input_type_sbd) { input_type_sbd =  opts->input_type_sbd; }
-	if (opts->output_type_wif) { output_type_wif = opts->output_type_wif; }
-	if (opts->output_type_hex) { output_type_hex = opts->output_type_hex; }
-	if (opts->output_type_decimal) { output_type_decimal = opts->output_type_decimal; }
-	if (opts->output_type_raw) { output_type_raw = opts->output_type_raw; }
-	if (opts->compression_on) { compression_on = opts->compression_on; }
-	if (opts->compression_off) { compression_off = opts->compression_off; }
-	if (opts->rehash) { rehash = opts->rehash; }
-
-	if (output_type_raw && (output_type_wif || output_type_hex || output_type_decimal))
+	if (opts->output_type_raw && (opts->output_type_wif || opts->output_type_hex || opts->output_type_decimal))
 	{
 		error_log("Can not use raw output type in combination with other output types.");
 		return -1;
 	}
 
 	// Default to wif if no output type specified.
-	if (!output_type_wif && !output_type_hex && !output_type_decimal && !output_type_raw)
+	if (!opts->output_type_wif && !opts->output_type_hex && !opts->output_type_decimal && !opts->output_type_raw)
 	{
-		output_type_wif = 1;
+		opts->output_type_wif = 1;
 	}
 
 	return 1;
@@ -13,56 +13,65 @@
 #include <assert.h>
 #include "mods/privkey.h"
 #include "mods/pubkey.h"
+#include "mods/network.h"
 #include "mods/input.h"
 #include "mods/output.h"
+#include "mods/frame.h"
 #include "mods/opts.h"
 #include "mods/error.h"
 
-static int compression_on = 0;
-static int compression_off = 0;
+int btk_pubkey_get_frame(PubKey, PrivKey, int *, unsigned char *, size_t);
 
 int btk_pubkey_main(output_item *output, opts_p opts, unsigned char *input, size_t input_len)
 {
 	int r;
+	int compression_on, compression_off;
+	int from_privkey;
 	char input_str[BUFSIZ];
 	char output_str[BUFSIZ];
-	PubKey pubkey = NULL;
-	PrivKey privkey = NULL;
+	unsigned char output_raw[PUBKEY_UNCOMPRESSED_LENGTH + 1];
+	unsigned char output_frame[FRAME_HEADER_LENGTH + PUBKEY_UNCOMPRESSED_LENGTH + 1];
+	struct PubKey pubkey;
+	struct PrivKey privkey;
+	Network network;
 
 	assert(opts);
 
-	if (opts->compression_on) { compression_on = opts->compression_on; }
-	if (opts->compression_off) { compression_off = opts->compression_off; }
+	// A WIF input selects the network for later chain stages.
+	network = network_get();
+
+	compression_on = opts->compression_on;
+	compression_off = opts->compression_off;
+	from_privkey = opts->input_type_wif;
 
 	memset(input_str, 0, BUFSIZ);
 	memset(output_str, 0, BUFSIZ);
 
-	privkey = malloc(privkey_sizeof());
-	ERROR_CHECK_NULL(privkey, "Memory allocation error.");
-
-	pubkey = malloc(pubkey_sizeof());
-	ERROR_CHECK_NULL(pubkey, "Memory allocation error.");
-
-	if (opts->input_type_wif)
+	if (opts->input_format_frames)
+	{
+		r = btk_pubkey_get_frame(&pubkey, &privkey, &from_privkey, input, input_len);
+		ERROR_CHECK_NEG(r, "Could not get public key from input frame.");
+	}
+	else if (opts->input_type_wif)
 	{
 		memcpy(input_str, input, input_len);
 
-		r = privkey_from_wif(privkey, input_str);
+		r = privkey_from_wif(&privkey, input_str, &network);
 		ERROR_CHECK_NEG(r, "Could not calculate private key from input.");
 
-		r = pubkey_get(pubkey, privkey);
+		r = pubkey_get(&pubkey, &privkey);
 		ERROR_CHECK_NEG(r, "Could not calculate public key.");
 	}
 	else if (opts->input_type_hex)
 	{
 		memcpy(input_str, input, input_len);
 
-		r = pubkey_from_hex(pubkey, input_str);
+		r = pubkey_from_hex(&pubkey, input_str);
 		ERROR_CHECK_NEG(r, "Could not calculate private key from input.");
 	}
 	else
 	{
-		r = pubkey_from_guess(pubkey, input, input_len);
+		r = pubkey_from_guess(&pubkey, input, input_len, &network);
 		if (r < 0)
 		{
 			error_clear();
@@ -70,15 +79,17 @@ int btk_pubkey_main(output_item *output, opts_p opts, unsigned char *input, size
 		}
 	}
 
-	if (opts->input_type_wif)
+	network_set(network);
+
+	if (from_privkey)
 	{
-		if (privkey_is_compressed(privkey))
+		if (privkey_is_compressed(&privkey))
 		{
-			pubkey_compress(pubkey);
+			pubkey_compress(&pubkey);
 		}
 		else
 		{
-			pubkey_uncompress(pubkey);
+			pubkey_uncompress(&pubkey);
 		}
 	}
 
@@ -86,23 +97,37 @@ int btk_pubkey_main(output_item *output, opts_p opts, unsigned char *input, size
 
 	if (compression_on)
 	{
-		pubkey_compress(pubkey);
+		pubkey_compress(&pubkey);
 
 	}
 	else if (compression_off)
 	{
-		pubkey_uncompress(pubkey);
+		pubkey_uncompress(&pubkey);
 	}
 	
-	r = pubkey_to_hex(output_str, pubkey);
-	ERROR_CHECK_NEG(r, "Could not get output.");
+	if (opts->output_format_frames)
+	{
+		r = pubkey_to_raw(output_raw, &pubkey);
+		ERROR_CHECK_NEG(r, "Could not get output.");
 
-	*output = output_append_new_copy(*output, output_str, strlen(output_str) + 1);
-	ERROR_CHECK_NULL(*output, "Memory allocation error.");
+		r = frame_encode(output_frame, FRAME_TYPE_PUBKEY, output_raw, r);
+		ERROR_CHECK_NEG(r, "Could not encode public key frame.");
+
+		*output = output_append_new_copy(*output, output_frame, r);
+		ERROR_CHECK_NULL(*output, "Memory allocation error.");
+	}
+	else
+	{
+		r = pubkey_to_hex(output_str, &pubkey);
+		ERROR_CHECK_NEG(r, "Could not get output.");
+
+		*output = output_append_new_copy(*output, output_str, strlen(output_str) + 1);
+		ERROR_CHECK_NULL(*output, "Memory allocation error.");
+	}
 
 	if (compression_on && compression_off)
 	{
-		if (pubkey_is_compressed(pubkey))
+		if (pubkey_is_compressed(&pubkey))
 		{
 			compression_on = 0;
 		}
@@ -113,9 +138,51 @@ int btk_pubkey_main(output_item *output, opts_p opts, unsigned char *input, size
 
 		goto compression_again;
 	}
-	
-	free(pubkey);
-	free(privkey);
+
+	return 1;
+}
+
+int btk_pubkey_get_frame(PubKey pubkey, PrivKey privkey, int *from_privkey, unsigned char *input, size_t input_len)
+{
+	int r, type;
+	unsigned char *payload;
+	size_t payload_len;
+	char input_str[BUFSIZ];
+
+	assert(pubkey);
+	assert(privkey);
+	assert(from_privkey);
+	assert(input);
+
+	r = frame_decode(&type, &payload, &payload_len, input, input_len);
+	ERROR_CHECK_NEG(r, "Could not decode input frame.");
+
+	switch (type)
+	{
+		case FRAME_TYPE_PRIVKEY:
+			r = privkey_from_raw(privkey, payload, payload_len);
+			ERROR_CHECK_NEG(r, "Could not get private key from frame.");
+
+			r = pubkey_get(pubkey, privkey);
+			ERROR_CHECK_NEG(r, "Could not calculate public key.");
+
+			*from_privkey = 1;
+			break;
+		case FRAME_TYPE_PUBKEY:
+			r = pubkey_from_raw(pubkey, payload, payload_len);
+			ERROR_CHECK_NEG(r, "Could not get public key from frame.");
+			break;
+		case FRAME_TYPE_STRING:
+			ERROR_CHECK_TRUE((payload_len == 0 || payload_len >= BUFSIZ), "Invalid string frame length.");
+			memset(input_str, 0, BUFSIZ);
+			memcpy(input_str, payload, payload_len);
+			r = pubkey_from_guess(pubkey, (unsigned char *)input_str, payload_len, NULL);
+			ERROR_CHECK_NEG(r, "Could not get public key from frame.");
+			break;
+		default:
+			error_log("Can not get public key from frame type %i.", type);
+			return -1;
+	}
 
 	return 1;
 }
@@ -0,0 +1,751 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <assert.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "btk_serve.h"
+#include "btk_privkey.h"
+#include "btk_pubkey.h"
+#include "btk_address.h"
+#include "btk_balance.h"
+#include "btk_version.h"
+#include "mods/balance.h"
+#include "mods/network.h"
+#include "mods/output.h"
+#include "mods/opts.h"
+#include "mods/error.h"
+#include "mods/cJSON/cJSON.h"
+
+#define SERVE_LISTEN_BACKLOG          64
+#define SERVE_PARAMS_MAX              256
+#define SERVE_CONNECTIONS_MAX         64
+#define SERVE_BACKOFF_MS              100
+
+// JSON-RPC 2.0 error codes
+#define SERVE_ERROR_PARSE             -32700
+#define SERVE_ERROR_INVALID_REQUEST   -32600
+#define SERVE_ERROR_METHOD            -32601
+#define SERVE_ERROR_COMMAND           -32000
+
+// opts_get keeps its option tables in file scope and uses getopt.
+static pthread_mutex_t opts_lock = PTHREAD_MUTEX_INITIALIZER;
+static int balance_ready = 0;
+
+// SIGINT and SIGTERM write to the pipe to wake the accept loop. Requests
+// still running are waited for before the databases are closed.
+static int stop_pipe[2] = { -1, -1 };
+static pthread_mutex_t run_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t run_done = PTHREAD_COND_INITIALIZER;
+static int run_count = 0;
+static int conn_count = 0;
+static int stopping = 0;
+
+void *btk_serve_connection(void *);
+void btk_serve_connection_end(void);
+int btk_serve_write(int, char *, size_t);
+char *btk_serve_request(char *);
+char *btk_serve_response(cJSON *, cJSON *, int, char *);
+int btk_serve_run(cJSON *, char *, cJSON *);
+void btk_serve_stop(int);
+
+int btk_serve_main(output_item *output, opts_p opts, unsigned char *input, size_t input_len)
+{
+	int r, nfds, timeout, backoff, conn_max;
+	int fd = -1, *conn;
+	char c;
+	struct stat st;
+	struct sockaddr_un addr;
+	struct sigaction action;
+	struct pollfd fds[2];
+	struct rlimit limit;
+	pthread_t thread;
+
+	assert(opts);
+
+	(void)output;
+	(void)input;
+	(void)input_len;
+
+	// A client closing its connection early should not end the server.
+	signal(SIGPIPE, SIG_IGN);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	ERROR_CHECK_TRUE(strlen(opts->socket_path) >= sizeof(addr.sun_path), "Socket path is too long.");
+	strcpy(addr.sun_path, opts->socket_path);
+
+	// Replace a socket left behind by a previous server, but nothing else.
+	if (stat(opts->socket_path, &st) == 0)
+	{
+		ERROR_CHECK_FALSE(S_ISSOCK(st.st_mode), "Socket path exists and is not a socket.");
+
+		r = unlink(opts->socket_path);
+		ERROR_CHECK_NEG(r, "Could not remove old socket.");
+	}
+
+	// Leave half of the descriptors for the commands the requests run.
+	conn_max = SERVE_CONNECTIONS_MAX;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur / 2 < (rlim_t)conn_max)
+	{
+		conn_max = (limit.rlim_cur / 2 > 0) ? (int)(limit.rlim_cur / 2) : 1;
+	}
+
+	r = pipe(stop_pipe);
+	ERROR_CHECK_NEG(r, "Could not create pipe.");
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = &btk_serve_stop;
+	sigemptyset(&action.sa_mask);
+
+	r = sigaction(SIGINT, &action, NULL);
+	if (r < 0)
+	{
+		error_log("Could not set signal handler.");
+		goto cleanup;
+	}
+
+	r = sigaction(SIGTERM, &action, NULL);
+	if (r < 0)
+	{
+		error_log("Could not set signal handler.");
+		goto cleanup;
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		r = -1;
+		error_log("Could not create socket.");
+		goto cleanup;
+	}
+
+	r = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	if (r < 0)
+	{
+		// Not ours to remove.
+		close(fd);
+		fd = -1;
+
+		error_log("Could not bind socket.");
+		goto cleanup;
+	}
+
+	r = listen(fd, SERVE_LISTEN_BACKLOG);
+	if (r < 0)
+	{
+		error_log("Could not listen on socket.");
+		goto cleanup;
+	}
+
+	fds[0].fd = stop_pipe[0];
+	fds[0].events = POLLIN;
+	fds[1].fd = fd;
+	fds[1].events = POLLIN;
+
+	backoff = 0;
+
+	while (1)
+	{
+		// Past the connection limit, or out of descriptors or memory,
+		// leave new connections in the backlog for a while.
+		pthread_mutex_lock(&run_lock);
+		nfds = (backoff || conn_count >= conn_max) ? 1 : 2;
+		pthread_mutex_unlock(&run_lock);
+
+		timeout = (nfds == 1) ? SERVE_BACKOFF_MS : -1;
+		backoff = 0;
+
+		fds[1].revents = 0;
+
+		r = poll(fds, nfds, timeout);
+		if (r < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			error_log("Could not wait for connections.");
+			goto cleanup;
+		}
+
+		if (fds[0].revents)
+		{
+			r = read(stop_pipe[0], &c, 1);
+			(void)r;
+
+			break;
+		}
+
+		if (!fds[1].revents)
+		{
+			continue;
+		}
+
+		conn = malloc(sizeof(int));
+		if (conn == NULL)
+		{
+			backoff = 1;
+			continue;
+		}
+
+		*conn = accept(fd, NULL, NULL);
+		if (*conn < 0)
+		{
+			free(conn);
+
+			if (errno == EINTR || errno == ECONNABORTED)
+			{
+				continue;
+			}
+			if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+			{
+				backoff = 1;
+				continue;
+			}
+
+			r = -1;
+			error_log("Could not accept connection.");
+			goto cleanup;
+		}
+
+		pthread_mutex_lock(&run_lock);
+		conn_count++;
+		pthread_mutex_unlock(&run_lock);
+
+		// Each connection gets its own thread and answers its requests in
+		// the order they arrive.
+		r = pthread_create(&thread, NULL, &btk_serve_connection, conn);
+		if (r > 0)
+		{
+			close(*conn);
+			free(conn);
+
+			btk_serve_connection_end();
+
+			backoff = 1;
+			continue;
+		}
+
+		pthread_detach(thread);
+	}
+
+	r = 1;
+
+	cleanup:
+
+	if (fd >= 0)
+	{
+		close(fd);
+		unlink(opts->socket_path);
+	}
+
+	// Connections still open get an error for any further requests.
+	pthread_mutex_lock(&run_lock);
+	stopping = 1;
+	while (run_count > 0)
+	{
+		pthread_cond_wait(&run_done, &run_lock);
+	}
+	pthread_mutex_unlock(&run_lock);
+
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+
+	close(stop_pipe[0]);
+	close(stop_pipe[1]);
+
+	return r;
+}
+
+void *btk_serve_connection(void *arg)
+{
+	int r, fd;
+	char *line = NULL;
+	char *response;
+	size_t line_size = 0;
+	ssize_t line_len;
+	FILE *in;
+
+	fd = *(int *)arg;
+	free(arg);
+
+	// Responses are written to the descriptor directly, so a connection
+	// holds only the one descriptor it was accepted with.
+	in = fdopen(fd, "r");
+	if (in == NULL)
+	{
+		close(fd);
+		btk_serve_connection_end();
+
+		return NULL;
+	}
+
+	// Requests are newline delimited. A client may write several before
+	// reading any responses.
+	while ((line_len = getline(&line, &line_size, in)) > 0)
+	{
+		if (strspn(line, " \t\r\n") == (size_t)line_len)
+		{
+			continue;
+		}
+
+		response = btk_serve_request(line);
+		if (response == NULL)
+		{
+			continue;
+		}
+
+		r = btk_serve_write(fd, response, strlen(response));
+		if (r > 0)
+		{
+			r = btk_serve_write(fd, "\n", 1);
+		}
+		free(response);
+
+		if (r < 0)
+		{
+			break;
+		}
+	}
+
+	free(line);
+	fclose(in);
+
+	btk_serve_connection_end();
+
+	return NULL;
+}
+
+void btk_serve_connection_end(void)
+{
+	pthread_mutex_lock(&run_lock);
+	conn_count--;
+	pthread_mutex_unlock(&run_lock);
+}
+
+// Writes all of buf, or returns an error.
+int btk_serve_write(int fd, char *buf, size_t len)
+{
+	ssize_t r;
+	size_t sent;
+
+	for (sent = 0; sent < len; sent += r)
+	{
+		r = write(fd, buf + sent, len - sent);
+		if (r < 0 && errno == EINTR)
+		{
+			r = 0;
+		}
+		else if (r <= 0)
+		{
+			return -1;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * Handles one JSON-RPC request and returns the response text, or NULL
+ * for a notification (a request without an id).
+ */
+char *btk_serve_request(char *line)
+{
+	int r;
+	char *response;
+	char *message;
+	char message_str[BUFSIZ];
+	cJSON *request, *id, *method, *params, *result;
+
+	request = cJSON_Parse(line);
+	if (request == NULL)
+	{
+		return btk_serve_response(NULL, NULL, SERVE_ERROR_PARSE, "Parse error.");
+	}
+
+	id = cJSON_GetObjectItemCaseSensitive(request, "id");
+	method = cJSON_GetObjectItemCaseSensitive(request, "method");
+	params = cJSON_GetObjectItemCaseSensitive(request, "params");
+
+	if (!cJSON_IsObject(request) || !cJSON_IsString(method) || (params != NULL && !cJSON_IsArray(params)))
+	{
+		response = btk_serve_response(id, NULL, SERVE_ERROR_INVALID_REQUEST, "Invalid request.");
+		cJSON_Delete(request);
+		return response;
+	}
+
+	if (strcmp(method->valuestring, "privkey") != 0 &&
+	    strcmp(method->valuestring, "pubkey") != 0 &&
+	    strcmp(method->valuestring, "address") != 0 &&
+	    strcmp(method->valuestring, "balance") != 0 &&
+	    strcmp(method->valuestring, "version") != 0)
+	{
+		response = (id) ? btk_serve_response(id, NULL, SERVE_ERROR_METHOD, "Method not found.") : NULL;
+		cJSON_Delete(request);
+		return response;
+	}
+
+	result = cJSON_CreateArray();
+	if (result == NULL)
+	{
+		cJSON_Delete(request);
+		return NULL;
+	}
+
+	r = btk_serve_run(result, method->valuestring, params);
+	if (r < 0)
+	{
+		// Same order as error_print(), most recent message first.
+		memset(message_str, 0, BUFSIZ);
+		while ((message = error_get()) != NULL)
+		{
+			if (*message == '\0')
+			{
+				continue;
+			}
+
+			if (*message_str)
+			{
+				strncat(message_str, " ", BUFSIZ - 1 - strlen(message_str));
+			}
+			strncat(message_str, message, BUFSIZ - 1 - strlen(message_str));
+		}
+		error_clear();
+
+		cJSON_Delete(result);
+		response = (id) ? btk_serve_response(id, NULL, SERVE_ERROR_COMMAND, message_str) : NULL;
+	}
+	else
+	{
+		response = (id) ? btk_serve_response(id, result, 0, NULL) : NULL;
+		if (!id)
+		{
+			cJSON_Delete(result);
+		}
+	}
+
+	cJSON_Delete(request);
+
+	return response;
+}
+
+/*
+ * Builds a response object. The result is consumed; the id is copied.
+ */
+char *btk_serve_response(cJSON *id, cJSON *result, int code, char *message)
+{
+	char *response;
+	cJSON *jobj, *error;
+
+	jobj = cJSON_CreateObject();
+	if (jobj == NULL)
+	{
+		cJSON_Delete(result);
+		return NULL;
+	}
+
+	cJSON_AddStringToObject(jobj, "jsonrpc", "2.0");
+
+	if (result)
+	{
+		cJSON_AddItemToObject(jobj, "result", result);
+	}
+	else
+	{
+		error = cJSON_CreateObject();
+		cJSON_AddNumberToObject(error, "code", code);
+		cJSON_AddStringToObject(error, "message", message);
+		cJSON_AddItemToObject(jobj, "error", error);
+	}
+
+	if (id)
+	{
+		cJSON_AddItemToObject(jobj, "id", cJSON_Duplicate(id, 1));
+	}
+	else
+	{
+		cJSON_AddNullToObject(jobj, "id");
+	}
+
+	response = cJSON_PrintUnformatted(jobj);
+
+	cJSON_Delete(jobj);
+
+	return response;
+}
+
+/*
+ * Runs a command with the request params as its command line arguments
+ * and adds each output item to the result array.
+ */
+int btk_serve_run(cJSON *result, char *method, cJSON *params)
+{
+	int i, r, argc;
+	char *argv[SERVE_PARAMS_MAX + 3];
+	struct opts opts;
+	struct opts config;
+	cJSON *param;
+	output_item output = NULL;
+	output_item item;
+	int (*command_main)(output_item *, opts_p, unsigned char *, size_t) = NULL;
+	int (*command_requires_input)(opts_p) = NULL;
+	int (*command_init)(opts_p) = NULL;
+
+	assert(result);
+	assert(method);
+
+	argc = 0;
+	argv[argc++] = "btk";
+	argv[argc++] = method;
+
+	cJSON_ArrayForEach(param, params)
+	{
+		ERROR_CHECK_FALSE(cJSON_IsString(param), "Params must be strings.");
+		ERROR_CHECK_TRUE(argc >= SERVE_PARAMS_MAX + 2, "Too many params.");
+
+		argv[argc++] = param->valuestring;
+	}
+	argv[argc] = NULL;
+
+	pthread_mutex_lock(&run_lock);
+	r = (stopping) ? -1 : 1;
+	if (r > 0)
+	{
+		run_count++;
+	}
+	pthread_mutex_unlock(&run_lock);
+
+	ERROR_CHECK_NEG(r, "Server is shutting down.");
+
+	pthread_mutex_lock(&opts_lock);
+
+	r = opts_init(&opts);
+	if (r > 0)
+	{
+		r = opts_get(&opts, argc, argv);
+		if (r < 0)
+		{
+			error_log("Invalid params.");
+		}
+	}
+
+	// Options the request leaves out come from the config file, as they
+	// would on the command line. Keep a copy to tell which ones it set.
+	config = opts;
+	if (r > 0)
+	{
+		r = opts_set_config(&opts);
+		if (r < 0)
+		{
+			error_log("Could not set opts from config.");
+		}
+	}
+
+	pthread_mutex_unlock(&opts_lock);
+
+	if (r < 0)
+	{
+		goto cleanup;
+	}
+	r = -1;
+
+	if (opts_io_count(&opts) > 0)
+	{
+		error_log("Input and output format options are not available over rpc.");
+		goto cleanup;
+	}
+
+	if (strcmp(method, "privkey") == 0)
+	{
+		command_main = &btk_privkey_main;
+		command_requires_input = &btk_privkey_requires_input;
+		command_init = &btk_privkey_init;
+	}
+	else if (strcmp(method, "pubkey") == 0)
+	{
+		command_main = &btk_pubkey_main;
+		command_requires_input = &btk_pubkey_requires_input;
+		command_init = &btk_pubkey_init;
+	}
+	else if (strcmp(method, "address") == 0)
+	{
+		command_main = &btk_address_main;
+		command_requires_input = &btk_address_requires_input;
+		command_init = &btk_address_init;
+	}
+	else if (strcmp(method, "balance") == 0)
+	{
+		// The database was opened once when the server started.
+		if (!balance_ready)
+		{
+			error_log("Balance database is not available.");
+			goto cleanup;
+		}
+		if (opts.create || opts.create_from_chainstate || opts.create_from_snapshot || opts.update)
+		{
+			error_log("Balance database can not be built over rpc.");
+			goto cleanup;
+		}
+
+		command_main = &btk_balance_main;
+		command_requires_input = &btk_balance_requires_input;
+	}
+	else if (strcmp(method, "version") == 0)
+	{
+		command_main = &btk_version_main;
+		command_requires_input = &btk_version_requires_input;
+		command_init = &btk_version_init;
+	}
+
+	// Requests on one connection share a thread, so start each from the
+	// defaults a new process would have.
+	network_set_main();
+
+	if (command_init && command_init(&opts) < 0)
+	{
+		error_log("Initialization error.");
+		goto cleanup;
+	}
+
+	if (command_requires_input(&opts))
+	{
+		if (opts.input_count == 0)
+		{
+			error_log("Input required.");
+			goto cleanup;
+		}
+
+		for (i = 0; i < opts.input_count; i++)
+		{
+			if (command_main(&output, &opts, (unsigned char *)opts.input[i], strlen(opts.input[i])) < 0)
+			{
+				goto cleanup;
+			}
+		}
+	}
+	else if (command_main(&output, &opts, NULL, 0) < 0)
+	{
+		goto cleanup;
+	}
+
+	for (item = output; item != NULL; item = item->next)
+	{
+		if (item->length == 0 || ((char *)item->content)[item->length - 1] != '\0')
+		{
+			error_log("Output item is not a string.");
+			goto cleanup;
+		}
+
+		param = cJSON_CreateString(item->content);
+		if (param == NULL)
+		{
+			error_log("Memory allocation error.");
+			goto cleanup;
+		}
+
+		cJSON_AddItemToArray(result, param);
+	}
+
+	r = 1;
+
+	cleanup:
+
+	output_free(output);
+	free(opts.input);
+
+	// Only the values read from the config file were allocated.
+	if (opts.host_name != config.host_name)
+	{
+		free(opts.host_name);
+	}
+	if (opts.rpc_auth != config.rpc_auth)
+	{
+		free(opts.rpc_auth);
+	}
+	if (opts.balance_path != config.balance_path)
+	{
+		free(opts.balance_path);
+	}
+	if (opts.chainstate_path != config.chainstate_path)
+	{
+		free(opts.chainstate_path);
+	}
+
+	pthread_mutex_lock(&run_lock);
+	run_count--;
+	pthread_cond_signal(&run_done);
+	pthread_mutex_unlock(&run_lock);
+
+	return r;
+}
+
+int btk_serve_requires_input(opts_p opts)
+{
+	assert(opts);
+
+	return 0;
+}
+
+int btk_serve_init(opts_p opts)
+{
+	int r;
+
+	assert(opts);
+
+	ERROR_CHECK_NULL(opts->socket_path, "Missing socket option.");
+
+	// Balance queries are served only when the database can be opened.
+	r = balance_open(opts->balance_path, false);
+	if (r < 0)
+	{
+		error_clear();
+	}
+	else
+	{
+		balance_ready = 1;
+	}
+
+	return 1;
+}
+
+int btk_serve_cleanup(opts_p opts)
+{
+	assert(opts);
+
+	if (balance_ready)
+	{
+		balance_close();
+	}
+
+	return 1;
+}
+
+void btk_serve_stop(int sig)
+{
+	int r;
+	char c = 0;
+
+	(void)sig;
+
+	r = write(stop_pipe[1], &c, 1);
+	(void)r;
+}
\ No newline at end of file
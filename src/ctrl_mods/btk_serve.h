@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#ifndef BTK_SERVE_H
+#define BTK_SERVE_H 1
+
+#include "mods/output.h"
+#include "mods/opts.h"
+
+int btk_serve_main(output_item *, opts_p, unsigned char *, size_t);
+int btk_serve_requires_input(opts_p);
+int btk_serve_init(opts_p);
+int btk_serve_cleanup(opts_p);
+
+#endif
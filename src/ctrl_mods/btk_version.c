@@ -44,6 +44,8 @@ int btk_version_init(opts_p opts)
 {
 	assert(opts);
 
+	ERROR_CHECK_TRUE(opts->output_format_frames, "Frames output format not supported for version command.");
+
 	return 1;
 }
 
@@ -0,0 +1,442 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "libbtk.h"
+#include "mods/privkey.h"
+#include "mods/pubkey.h"
+#include "mods/address.h"
+#include "mods/script.h"
+#include "mods/balance.h"
+#include "mods/network.h"
+#include "mods/error.h"
+
+#define LIBBTK_ERROR_SIZE    (ERROR_LIST_MAX * ERROR_LENGTH_MAX)
+
+// Each public function runs its internal counterpart and, on failure,
+// moves the error stack into this buffer for libbtk_error().
+#define LIBBTK_RETURN(x)     do { int _r = (x); if (_r < 0) { libbtk_error_save(); } return _r; } while (0)
+
+static __thread char error_str[LIBBTK_ERROR_SIZE];
+static int balance_ready = 0;
+
+static void libbtk_error_save(void);
+static Network libbtk_network_get(int);
+static int libbtk_address_copy(char *, size_t, char *);
+static int privkey_from_wif_r(unsigned char *, int *, int *, const char *);
+static int privkey_to_wif_r(char *, size_t, const unsigned char *, int, int);
+static int pubkey_get_r(unsigned char *, size_t, const unsigned char *, int);
+static int address_from_pubkey_r(char *, size_t, const unsigned char *, size_t, int, int (*)(char *, PubKey, Network));
+static int address_p2tr_batch_r(char *, size_t, const unsigned char *, size_t, size_t, int);
+static int address_from_hash160_r(char *, size_t, const unsigned char *, int);
+static int script_address_r(char *, size_t, const unsigned char *, size_t, int);
+static int balance_open_r(const char *);
+static int balance_get_r(uint64_t *, const char *);
+
+int libbtk_api_version(void)
+{
+	return LIBBTK_API_VERSION;
+}
+
+const char *libbtk_error(void)
+{
+	return error_str;
+}
+
+int libbtk_privkey_from_wif(unsigned char *privkey, int *compressed, int *network, const char *wif)
+{
+	LIBBTK_RETURN(privkey_from_wif_r(privkey, compressed, network, wif));
+}
+
+int libbtk_privkey_to_wif(char *wif, size_t wif_size, const unsigned char *privkey, int compressed, int network)
+{
+	LIBBTK_RETURN(privkey_to_wif_r(wif, wif_size, privkey, compressed, network));
+}
+
+int libbtk_pubkey_get(unsigned char *pubkey, size_t pubkey_size, const unsigned char *privkey, int compressed)
+{
+	LIBBTK_RETURN(pubkey_get_r(pubkey, pubkey_size, privkey, compressed));
+}
+
+int libbtk_address_p2pkh(char *address, size_t address_size, const unsigned char *pubkey, size_t pubkey_len, int network)
+{
+	LIBBTK_RETURN(address_from_pubkey_r(address, address_size, pubkey, pubkey_len, network, &address_get_p2pkh));
+}
+
+int libbtk_address_p2wpkh(char *address, size_t address_size, const unsigned char *pubkey, size_t pubkey_len, int network)
+{
+	LIBBTK_RETURN(address_from_pubkey_r(address, address_size, pubkey, pubkey_len, network, &address_get_p2wpkh));
+}
+
+int libbtk_address_p2tr(char *address, size_t address_size, const unsigned char *pubkey, size_t pubkey_len, int network)
+{
+	LIBBTK_RETURN(address_from_pubkey_r(address, address_size, pubkey, pubkey_len, network, &address_get_p2tr));
+}
+
+int libbtk_address_p2tr_batch(char *addresses, size_t address_size, const unsigned char *pubkeys, size_t pubkey_len, size_t count, int network)
+{
+	LIBBTK_RETURN(address_p2tr_batch_r(addresses, address_size, pubkeys, pubkey_len, count, network));
+}
+
+int libbtk_address_from_hash160(char *address, size_t address_size, const unsigned char *hash160, int network)
+{
+	LIBBTK_RETURN(address_from_hash160_r(address, address_size, hash160, network));
+}
+
+int libbtk_script_type(const unsigned char *script, size_t script_len)
+{
+	if (script == NULL)
+	{
+		return LIBBTK_SCRIPT_UNKNOWN;
+	}
+
+	return script_get_output_type((unsigned char *)script, script_len);
+}
+
+int libbtk_script_address(char *address, size_t address_size, const unsigned char *script, size_t script_len, int network)
+{
+	LIBBTK_RETURN(script_address_r(address, address_size, script, script_len, network));
+}
+
+int libbtk_balance_open(const char *path)
+{
+	LIBBTK_RETURN(balance_open_r(path));
+}
+
+int libbtk_balance_get(uint64_t *balance, const char *address)
+{
+	LIBBTK_RETURN(balance_get_r(balance, address));
+}
+
+void libbtk_balance_close(void)
+{
+	if (balance_ready)
+	{
+		balance_close();
+		balance_ready = 0;
+	}
+}
+
+static void libbtk_error_save(void)
+{
+	char *message;
+
+	// Same order as error_print(), most recent message first.
+	memset(error_str, 0, LIBBTK_ERROR_SIZE);
+	while ((message = error_get()) != NULL)
+	{
+		if (*message == '\0')
+		{
+			continue;
+		}
+
+		if (*error_str)
+		{
+			strncat(error_str, " ", LIBBTK_ERROR_SIZE - 1 - strlen(error_str));
+		}
+		strncat(error_str, message, LIBBTK_ERROR_SIZE - 1 - strlen(error_str));
+	}
+
+	error_clear();
+}
+
+static Network libbtk_network_get(int network)
+{
+	switch (network)
+	{
+		case LIBBTK_NETWORK_MAIN:
+			return network_main();
+		case LIBBTK_NETWORK_TEST:
+			return network_test();
+	}
+
+	error_log("Invalid network.");
+
+	return NULL;
+}
+
+static int libbtk_address_copy(char *address, size_t address_size, char *str)
+{
+	ERROR_CHECK_TRUE(strlen(str) >= address_size, "Address buffer is too small.");
+
+	strcpy(address, str);
+
+	return 1;
+}
+
+static int privkey_from_wif_r(unsigned char *privkey, int *compressed, int *network, const char *wif)
+{
+	int r;
+	char wif_str[BUFSIZ];
+	struct PrivKey key;
+	Network wif_network = NULL;
+
+	ERROR_CHECK_NULL(privkey, "Missing private key buffer.");
+	ERROR_CHECK_NULL(wif, "Missing WIF string.");
+	ERROR_CHECK_TRUE(strlen(wif) >= BUFSIZ, "WIF string is too long.");
+
+	strcpy(wif_str, wif);
+
+	r = privkey_from_wif(&key, wif_str, &wif_network);
+	ERROR_CHECK_NEG(r, "Could not get private key from WIF string.");
+
+	privkey_to_raw(privkey, &key, 0);
+
+	if (compressed)
+	{
+		*compressed = privkey_is_compressed(&key);
+	}
+
+	if (network)
+	{
+		*network = (wif_network == network_test()) ? LIBBTK_NETWORK_TEST : LIBBTK_NETWORK_MAIN;
+	}
+
+	return 1;
+}
+
+static int privkey_to_wif_r(char *wif, size_t wif_size, const unsigned char *privkey, int compressed, int network)
+{
+	int r;
+	char wif_str[BUFSIZ];
+	struct PrivKey key;
+	Network params = NULL;
+
+	ERROR_CHECK_NULL(wif, "Missing WIF buffer.");
+	ERROR_CHECK_NULL(privkey, "Missing private key.");
+
+	params = libbtk_network_get(network);
+	ERROR_CHECK_NULL(params, NULL);
+
+	r = privkey_from_raw(&key, (unsigned char *)privkey, LIBBTK_PRIVKEY_LENGTH);
+	ERROR_CHECK_NEG(r, "Invalid private key.");
+	ERROR_CHECK_TRUE(privkey_is_zero(&key), "Invalid private key.");
+
+	if (compressed)
+	{
+		privkey_compress(&key);
+	}
+	else
+	{
+		privkey_uncompress(&key);
+	}
+
+	memset(wif_str, 0, BUFSIZ);
+
+	r = privkey_to_wif(wif_str, &key, params);
+	ERROR_CHECK_NEG(r, "Could not convert private key to WIF format.");
+
+	ERROR_CHECK_TRUE(strlen(wif_str) >= wif_size, "WIF buffer is too small.");
+	strcpy(wif, wif_str);
+
+	return 1;
+}
+
+static int pubkey_get_r(unsigned char *pubkey, size_t pubkey_size, const unsigned char *privkey, int compressed)
+{
+	int r;
+	unsigned char raw[LIBBTK_PUBKEY_UNCOMPRESSED_LENGTH];
+	struct PrivKey key;
+	struct PubKey pub;
+
+	ERROR_CHECK_NULL(pubkey, "Missing public key buffer.");
+	ERROR_CHECK_NULL(privkey, "Missing private key.");
+
+	r = privkey_from_raw(&key, (unsigned char *)privkey, LIBBTK_PRIVKEY_LENGTH);
+	ERROR_CHECK_NEG(r, "Invalid private key.");
+	ERROR_CHECK_TRUE(privkey_is_zero(&key), "Invalid private key.");
+
+	r = pubkey_get(&pub, &key);
+	ERROR_CHECK_NEG(r, "Could not calculate public key.");
+
+	if (compressed)
+	{
+		pubkey_compress(&pub);
+	}
+	else
+	{
+		pubkey_uncompress(&pub);
+	}
+
+	r = pubkey_to_raw(raw, &pub);
+	ERROR_CHECK_NEG(r, "Could not calculate public key.");
+	ERROR_CHECK_TRUE((size_t)r > pubkey_size, "Public key buffer is too small.");
+
+	memcpy(pubkey, raw, r);
+
+	return r;
+}
+
+/*
+ * Shared by the address functions that take a serialized public key.
+ */
+static int address_from_pubkey_r(char *address, size_t address_size, const unsigned char *pubkey, size_t pubkey_len, int network, int (*get_address)(char *, PubKey, Network))
+{
+	int r;
+	char address_str[BUFSIZ];
+	struct PubKey pub;
+	Network params = NULL;
+
+	ERROR_CHECK_NULL(address, "Missing address buffer.");
+	ERROR_CHECK_NULL(pubkey, "Missing public key.");
+	ERROR_CHECK_TRUE(pubkey_len == 0, "Missing public key.");
+
+	params = libbtk_network_get(network);
+	ERROR_CHECK_NULL(params, NULL);
+
+	memset(address_str, 0, BUFSIZ);
+
+	r = pubkey_from_raw(&pub, (unsigned char *)pubkey, pubkey_len);
+	ERROR_CHECK_NEG(r, "Invalid public key.");
+
+	r = get_address(address_str, &pub, params);
+	ERROR_CHECK_NEG(r, "Could not calculate address.");
+
+	return libbtk_address_copy(address, address_size, address_str);
+}
+
+static int address_p2tr_batch_r(char *addresses, size_t address_size, const unsigned char *pubkeys, size_t pubkey_len, size_t count, int network)
+{
+	int r;
+	size_t k;
+	struct PubKey *keys;
+	Network params = NULL;
+
+	ERROR_CHECK_NULL(addresses, "Missing address buffer.");
+	ERROR_CHECK_NULL(pubkeys, "Missing public keys.");
+	ERROR_CHECK_TRUE(pubkey_len == 0, "Missing public keys.");
+	ERROR_CHECK_TRUE(address_size < LIBBTK_ADDRESS_SIZE, "Address buffer is too small.");
+
+	params = libbtk_network_get(network);
+	ERROR_CHECK_NULL(params, NULL);
+
+	if (count == 0)
+	{
+		return 1;
+	}
+
+	keys = malloc(count * sizeof(*keys));
+	ERROR_CHECK_NULL(keys, "Memory allocation error.");
+
+	for (k = 0; k < count; ++k)
+	{
+		r = pubkey_from_raw(&keys[k], (unsigned char *)pubkeys + (k * pubkey_len), pubkey_len);
+		if (r < 0)
+		{
+			free(keys);
+			error_log("Invalid public key at index %zu.", k);
+			return -1;
+		}
+	}
+
+	r = address_get_p2tr_batch(addresses, address_size, keys, count, params);
+
+	free(keys);
+
+	ERROR_CHECK_NEG(r, "Could not calculate P2TR addresses.");
+
+	return 1;
+}
+
+static int address_from_hash160_r(char *address, size_t address_size, const unsigned char *hash160, int network)
+{
+	int r;
+	char address_str[BUFSIZ];
+	Network params = NULL;
+
+	ERROR_CHECK_NULL(address, "Missing address buffer.");
+	ERROR_CHECK_NULL(hash160, "Missing hash160.");
+
+	params = libbtk_network_get(network);
+	ERROR_CHECK_NULL(params, NULL);
+
+	memset(address_str, 0, BUFSIZ);
+
+	r = address_from_rmd160(address_str, (unsigned char *)hash160, params);
+	ERROR_CHECK_NEG(r, "Could not calculate P2PKH address.");
+
+	return libbtk_address_copy(address, address_size, address_str);
+}
+
+static int script_address_r(char *address, size_t address_size, const unsigned char *script, size_t script_len, int network)
+{
+	int r;
+	char address_str[BUFSIZ];
+	Network params = NULL;
+
+	ERROR_CHECK_NULL(address, "Missing address buffer.");
+	ERROR_CHECK_NULL(script, "Missing script.");
+
+	if (script_len == 0)
+	{
+		return 0;
+	}
+
+	params = libbtk_network_get(network);
+	ERROR_CHECK_NULL(params, NULL);
+
+	memset(address_str, 0, BUFSIZ);
+
+	r = script_get_output_address(address_str, (unsigned char *)script, script_len, 0, params);
+	ERROR_CHECK_NEG(r, "Could not get address from script.");
+
+	// No address for this script type.
+	if (r == 0)
+	{
+		return 0;
+	}
+
+	r = libbtk_address_copy(address, address_size, address_str);
+	ERROR_CHECK_NEG(r, NULL);
+
+	return 1;
+}
+
+static int balance_open_r(const char *path)
+{
+	int r;
+	char path_str[BUFSIZ];
+
+	ERROR_CHECK_TRUE(balance_ready, "Balance database is already open.");
+
+	if (path)
+	{
+		ERROR_CHECK_TRUE(strlen(path) >= BUFSIZ, "Balance database path is too long.");
+		strcpy(path_str, path);
+	}
+
+	r = balance_open((path) ? path_str : NULL, false);
+	ERROR_CHECK_NEG(r, "Could not open balance database.");
+
+	balance_ready = 1;
+
+	return 1;
+}
+
+static int balance_get_r(uint64_t *balance, const char *address)
+{
+	int r;
+	char address_str[BUFSIZ];
+
+	ERROR_CHECK_NULL(balance, "Missing balance.");
+	ERROR_CHECK_NULL(address, "Missing address.");
+	ERROR_CHECK_FALSE(balance_ready, "Balance database is not open.");
+	ERROR_CHECK_TRUE(strlen(address) >= BUFSIZ, "Address is too long.");
+
+	strcpy(address_str, address);
+
+	*balance = 0;
+
+	r = balance_get(balance, address_str);
+	ERROR_CHECK_NEG(r, "Could not query balance database.");
+
+	return 1;
+}
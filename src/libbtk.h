@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#ifndef LIBBTK_H
+#define LIBBTK_H 1
+
+/*
+ * Public interface of libbtk.a and libbtk.so.
+ *
+ * All output goes to buffers owned by the caller. Functions return a
+ * negative value on error, after which libbtk_error() describes the
+ * failure for the calling thread.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LIBBTK_API_VERSION                   1
+
+#define LIBBTK_NETWORK_MAIN                  0
+#define LIBBTK_NETWORK_TEST                  1
+
+#define LIBBTK_PRIVKEY_LENGTH                32
+#define LIBBTK_PUBKEY_COMPRESSED_LENGTH      33
+#define LIBBTK_PUBKEY_UNCOMPRESSED_LENGTH    65
+#define LIBBTK_HASH160_LENGTH                20
+
+// Buffer sizes, including the terminating null character.
+#define LIBBTK_WIF_SIZE                      53
+#define LIBBTK_ADDRESS_SIZE                  91
+
+#define LIBBTK_SCRIPT_UNKNOWN                0
+#define LIBBTK_SCRIPT_P2PK                   1
+#define LIBBTK_SCRIPT_P2PKH                  2
+#define LIBBTK_SCRIPT_P2SH                   3
+#define LIBBTK_SCRIPT_P2WPKH                 4
+#define LIBBTK_SCRIPT_P2WSH                  5
+#define LIBBTK_SCRIPT_P2TR                   6
+
+int libbtk_api_version(void);
+const char *libbtk_error(void);
+
+// Keys
+int libbtk_privkey_from_wif(unsigned char *privkey, int *compressed, int *network, const char *wif);
+int libbtk_privkey_to_wif(char *wif, size_t wif_size, const unsigned char *privkey, int compressed, int network);
+int libbtk_pubkey_get(unsigned char *pubkey, size_t pubkey_size, const unsigned char *privkey, int compressed);
+
+// Addresses
+int libbtk_address_p2pkh(char *address, size_t address_size, const unsigned char *pubkey, size_t pubkey_len, int network);
+int libbtk_address_p2wpkh(char *address, size_t address_size, const unsigned char *pubkey, size_t pubkey_len, int network);
+int libbtk_address_p2tr(char *address, size_t address_size, const unsigned char *pubkey, size_t pubkey_len, int network);
+// Derives count P2TR addresses together, much faster per key than single
+// calls. Keys are packed back to back, pubkey_len bytes each, and each
+// address is written to its own slot of address_size bytes.
+int libbtk_address_p2tr_batch(char *addresses, size_t address_size, const unsigned char *pubkeys, size_t pubkey_len, size_t count, int network);
+int libbtk_address_from_hash160(char *address, size_t address_size, const unsigned char *hash160, int network);
+
+// Output scripts
+int libbtk_script_type(const unsigned char *script, size_t script_len);
+int libbtk_script_address(char *address, size_t address_size, const unsigned char *script, size_t script_len, int network);
+
+// Balance database
+int libbtk_balance_open(const char *path);
+int libbtk_balance_get(uint64_t *balance, const char *address);
+void libbtk_balance_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
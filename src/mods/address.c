@@ -9,6 +9,7 @@
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
+#include "address.h"
 #include "pubkey.h"
 #include "privkey.h"
 #include "bech32.h"
@@ -17,45 +18,22 @@
 #include "crypto.h"
 #include "error.h"
 
-#define ADDRESS_VERSION_BIT_MAINNET      0x00
-#define ADDRESS_VERSION_BIT_MAINNET_P2SH 0x05
-#define ADDRESS_VERSION_BIT_TESTNET      0x6F
-
-int address_get_p2pkh(char *address, PubKey key)
+/*
+ * Hash160 of the serialized public key. P2PKH and P2WPKH addresses are
+ * both derived from it, so callers that want several of them compute it
+ * once and encode it with address_from_rmd160 and address_p2wpkh_from_raw.
+ */
+int address_get_hash160(unsigned char *hash, PubKey key)
 {
 	int r;
 	size_t len;
-	unsigned char *data;
+	unsigned char data[PUBKEY_UNCOMPRESSED_LENGTH + 1];
 	unsigned char sha[32];
-	unsigned char rmd[20];
-	unsigned char rmd_bit[21];
-	char base58[21 * 2];
 
-	assert(address);
+	assert(hash);
 	assert(key);
 
-	if (pubkey_is_compressed(key))
-	{
-		len = PUBKEY_COMPRESSED_LENGTH + 1;
-	}
-	else
-	{
-		len = PUBKEY_UNCOMPRESSED_LENGTH + 1;
-	}
-
-	data = malloc(len);
-	if (data == NULL)
-	{
-		error_log("Memory allocation error.");
-		return -1;
-	}
-
-	r = pubkey_to_raw(data, key);
-	if (r < 0)
-	{
-		error_log("Could not get raw public key data.");
-		return -1;
-	}
+	len = pubkey_to_raw(data, key);
 
 	// RMD(SHA(data))
 	r = crypto_get_sha256(sha, data, len);
@@ -64,51 +42,42 @@ int address_get_p2pkh(char *address, PubKey key)
 		error_log("Could not generate SHA256 hash from public key data.");
 		return -1;
 	}
-	r = crypto_get_rmd160(rmd, sha, 32);
+	r = crypto_get_rmd160(hash, sha, 32);
 	if (r < 0)
 	{
 		error_log("Could not generate RMD160 hash from public key data.");
 		return -1;
 	}
 
-	// Set address version bit
-	if (network_is_main())
-	{
-		rmd_bit[0] = ADDRESS_VERSION_BIT_MAINNET;
-	}
-	else if (network_is_test())
-	{
-		rmd_bit[0] = ADDRESS_VERSION_BIT_TESTNET;
-	}
-	
-	// Append rmd data
-	memcpy(rmd_bit + 1, rmd, 20);
-	
-	r = base58check_encode(base58, rmd_bit, 21);
-	if (r < 0)
-	{
-		error_log("Could not generate address from public key data.");
-		return -1;
-	}
+	return 1;
+}
+
+int address_get_p2pkh(char *address, PubKey key, Network network)
+{
+	int r;
+	unsigned char rmd[20];
 
-	strcpy(address, base58);
+	assert(address);
+	assert(key);
+	assert(network);
+
+	r = address_get_hash160(rmd, key);
+	ERROR_CHECK_NEG(r, NULL);
 
-	free(data);
+	r = address_from_rmd160(address, rmd, network);
+	ERROR_CHECK_NEG(r, NULL);
 
 	return 1;
 }
 
-int address_get_p2wpkh(char *address, PubKey key, int version)
+int address_get_p2wpkh(char *address, PubKey key, Network network)
 {
 	int r;
-	int data_len;
-	unsigned char *data;
-	unsigned char sha[32];
 	unsigned char rmd[20];
 
 	assert(address);
 	assert(key);
-	assert(version == 0 || version == 1);  // 0 is bech32, 1 is bech32m (taproot)
+	assert(network);
 
 	if (!pubkey_is_compressed(key))
 	{
@@ -116,43 +85,63 @@ int address_get_p2wpkh(char *address, PubKey key, int version)
 		return -1;
 	}
 
-	data_len = PUBKEY_COMPRESSED_LENGTH + 1;
-	data = malloc(data_len);
-	if (data == NULL)
-	{
-		error_log("Memory allocation error.");
-		return -1;
-	}
+	r = address_get_hash160(rmd, key);
+	ERROR_CHECK_NEG(r, NULL);
 
-	r = pubkey_to_raw(data, key);
+	r = bech32_get_address(address, rmd, 20, 0, network);
 	if (r < 0)
 	{
-		error_log("Could not get raw public key data.");
+		error_log("Could not generate bech32 address from public key data.");
 		return -1;
 	}
 
-	// RMD(SHA(data))
-	r = crypto_get_sha256(sha, data, data_len);
-	if (r < 0)
-	{
-		error_log("Could not generate SHA256 hash from public key data.");
-		return -1;
-	}
-	r = crypto_get_rmd160(rmd, sha, 32);
+	return 1;
+}
+
+int address_get_p2tr(char *address, PubKey key, Network network)
+{
+	return address_get_p2tr_batch(address, BECH32_ADDRESS_SIZE, key, 1, network);
+}
+
+/*
+ * Writes the P2TR addresses of count keys to consecutive slots of
+ * address_size bytes. The output keys are derived together, which is much
+ * faster per key than one call per key.
+ */
+int address_get_p2tr_batch(char *addresses, size_t address_size, PubKey keys, size_t count, Network network)
+{
+	int r;
+	size_t k;
+	unsigned char *output_keys;
+
+	assert(addresses);
+	assert(keys);
+	assert(network);
+	assert(address_size >= BECH32_ADDRESS_SIZE);
+
+	output_keys = malloc(count * 32);
+	ERROR_CHECK_NULL(output_keys, "Memory allocation error.");
+
+	r = pubkey_get_taproot_batch(output_keys, keys, count);
 	if (r < 0)
 	{
-		error_log("Could not generate RMD160 hash from public key data.");
+		free(output_keys);
+		error_log("Could not calculate taproot output keys.");
 		return -1;
 	}
 
-	r = bech32_get_address(address, rmd, 20, version);
-	if (r < 0)
+	for (k = 0; k < count; ++k)
 	{
-		error_log("Could not generate bech32 address from public key data.");
-		return -1;
+		r = bech32_get_address(addresses + (k * address_size), output_keys + (k * 32), 32, 1, network);
+		if (r < 0)
+		{
+			free(output_keys);
+			error_log("Could not generate bech32m address from public key data.");
+			return -1;
+		}
 	}
 
-	free(data);
+	free(output_keys);
 
 	return 1;
 }
@@ -160,116 +149,78 @@ int address_get_p2wpkh(char *address, PubKey key, int version)
 int address_from_wif(char *address, char *wif)
 {
 	int r;
-	PubKey pubkey = NULL;
-	PrivKey privkey = NULL;
+	struct PubKey pubkey;
+	struct PrivKey privkey;
+	Network network = NULL;
 
 	assert(address);
 	assert(wif);
 
-	privkey = malloc(privkey_sizeof());
-	if (privkey == NULL)
-	{
-		error_log("Memory allocation error.");
-		return -1;
-	}
-
-	pubkey = malloc(pubkey_sizeof());
-	if (pubkey == NULL)
-	{
-		error_log("Memory allocation error.");
-		return -1;
-	}
-
-	r = privkey_from_wif(privkey, wif);
+	r = privkey_from_wif(&privkey, wif, &network);
 	if (r < 0)
 	{
 		error_log("Could not calculate private key from input.");
 		return -1;
 	}
 
-	r = pubkey_get(pubkey, privkey);
+	r = pubkey_get(&pubkey, &privkey);
 	if (r < 0)
 	{
 		error_log("Could not calculate public key.");
 		return -1;
 	}
 
-	r = address_get_p2pkh(address, pubkey);
+	r = address_get_p2pkh(address, &pubkey, network);
 	if (r < 0)
 	{
 		error_log("Could not calculate public key address.");
 		return -1;
 	}
 
-	free(privkey);
-	free(pubkey);
-
 	return 1;
 }
 
-int address_from_str(char *address, char *str)
+int address_from_str(char *address, char *str, Network network)
 {
 	int r;
-	PubKey pubkey = NULL;
-	PrivKey privkey = NULL;
+	struct PubKey pubkey;
+	struct PrivKey privkey;
 
 	assert(address);
 	assert(str);
 
-	privkey = malloc(privkey_sizeof());
-	if (privkey == NULL)
-	{
-		error_log("Memory allocation error.");
-		return -1;
-	}
-
-	pubkey = malloc(pubkey_sizeof());
-	if (pubkey == NULL)
-	{
-		error_log("Memory allocation error.");
-		return -1;
-	}
-
-	r = privkey_from_str(privkey, str);
+	r = privkey_from_str(&privkey, str);
 	if (r < 0)
 	{
 		error_log("Could not calculate private key from input.");
 		return -1;
 	}
 
-	r = pubkey_get(pubkey, privkey);
+	r = pubkey_get(&pubkey, &privkey);
 	if (r < 0)
 	{
 		error_log("Could not calculate public key.");
 		return -1;
 	}
 
-	r = address_get_p2pkh(address, pubkey);
+	r = address_get_p2pkh(address, &pubkey, network);
 	if (r < 0)
 	{
 		error_log("Could not calculate public key address.");
 		return -1;
 	}
 
-	free(privkey);
-	free(pubkey);
-
 	return 1;
 }
 
-int address_from_rmd160(char *address, unsigned char *hash)
+int address_from_rmd160(char *address, unsigned char *hash, Network network)
 {
 	int r;
 	unsigned char rmd_bit[21];
 
-	if (network_is_main())
-	{
-		rmd_bit[0] = ADDRESS_VERSION_BIT_MAINNET;
-	}
-	else if (network_is_test())
-	{
-		rmd_bit[0] = ADDRESS_VERSION_BIT_TESTNET;
-	}
+	assert(network);
+
+	rmd_bit[0] = network->p2pkh_prefix;
 
 	memcpy(rmd_bit + 1, hash, 20);
 
@@ -279,17 +230,17 @@ int address_from_rmd160(char *address, unsigned char *hash)
 	return 1;
 }
 
-int address_p2wpkh_from_raw(char *address, unsigned char *data, size_t len, int witver)
+int address_p2wpkh_from_raw(char *address, unsigned char *data, size_t len, int witver, Network network)
 {
 	int r;
 
-	r = bech32_get_address(address, data, len, witver);
+	r = bech32_get_address(address, data, len, witver, network);
 	ERROR_CHECK_NEG(r, "Could not generate P2WPKH (bech32) address.");
 
 	return 1;
 }
 
-int address_from_sha256(char *address, unsigned char *hash)
+int address_from_sha256(char *address, unsigned char *hash, Network network)
 {
 	int r;
 	unsigned char rmd[20];
@@ -297,18 +248,20 @@ int address_from_sha256(char *address, unsigned char *hash)
 	r = crypto_get_rmd160(rmd, hash, 32);
 	ERROR_CHECK_NEG(r, "Could not generate RMD160 hash from public key data.");
 
-	r = address_from_rmd160(address, rmd);
+	r = address_from_rmd160(address, rmd, network);
 	ERROR_CHECK_NEG(r, "Could not get address from RMD160 hash.");
 
 	return 1;
 }
 
-int address_from_p2sh_script(char *address, unsigned char *script)
+int address_from_p2sh_script(char *address, unsigned char *script, Network network)
 {
 	int r;
 	unsigned char rmd_bit[21];
 
-	rmd_bit[0] = ADDRESS_VERSION_BIT_MAINNET_P2SH;
+	assert(network);
+
+	rmd_bit[0] = network->p2sh_prefix;
 
 	memcpy(rmd_bit + 1, script, 20);
 
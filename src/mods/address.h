@@ -10,14 +10,18 @@
 
 #include <stddef.h>
 #include "pubkey.h"
+#include "network.h"
 
-int address_get_p2pkh(char *, PubKey);
-int address_get_p2wpkh(char *, PubKey, int);
+int address_get_hash160(unsigned char *, PubKey);
+int address_get_p2pkh(char *, PubKey, Network);
+int address_get_p2wpkh(char *, PubKey, Network);
+int address_get_p2tr(char *, PubKey, Network);
+int address_get_p2tr_batch(char *, size_t, PubKey, size_t, Network);
 int address_from_wif(char *, char *);
-int address_from_str(char *, char *);
-int address_from_rmd160(char *, unsigned char *);
-int address_p2wpkh_from_raw(char *, unsigned char *, size_t, int);
-int address_from_sha256(char *, unsigned char *);
-int address_from_p2sh_script(char *, unsigned char *);
+int address_from_str(char *, char *, Network);
+int address_from_rmd160(char *, unsigned char *, Network);
+int address_p2wpkh_from_raw(char *, unsigned char *, size_t, int, Network);
+int address_from_sha256(char *, unsigned char *, Network);
+int address_from_p2sh_script(char *, unsigned char *, Network);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,448 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "aggregate.h"
+#include "error.h"
+
+#define AGGREGATE_SLOTS_MIN     65536
+#define AGGREGATE_KEYS_MIN      (1024 * 1024)
+
+/*
+ * Sums values by key. Keys live back to back in one buffer and the table
+ * only holds offsets into it, so each distinct key costs its length plus
+ * one table slot. When the table and keys would outgrow the memory budget,
+ * the sums are sorted by key and spilled to a temporary file as a run.
+ * aggregate_merge() then merges the runs, adding up keys that appear in
+ * more than one, and hands out every key once in sorted order.
+ */
+struct aggregate_entry {
+	uint64_t hash;
+	uint64_t value;
+	uint32_t key_offset;
+	uint32_t key_len;           // Zero for an empty slot
+};
+
+struct Aggregate {
+	size_t budget;
+	struct aggregate_entry *slots;
+	size_t slots_len;
+	size_t used;
+	unsigned char *keys;
+	size_t keys_len;
+	size_t keys_size;
+	FILE **runs;
+	size_t runs_len;
+};
+
+struct aggregate_source {
+	FILE *file;
+	unsigned char key[AGGREGATE_KEY_MAX];
+	size_t key_len;
+	uint64_t value;
+	int valid;
+};
+
+static __thread const unsigned char *sort_keys;
+
+static uint64_t aggregate_hash(const unsigned char *, size_t);
+static int aggregate_grow(Aggregate);
+static size_t aggregate_sort(Aggregate);
+static int aggregate_compare(const void *, const void *);
+static int aggregate_spill(Aggregate);
+static void aggregate_reset(Aggregate);
+static int aggregate_source_next(struct aggregate_source *);
+
+int aggregate_new(Aggregate *agg, size_t budget)
+{
+	assert(agg);
+
+	*agg = malloc(sizeof(struct Aggregate));
+	ERROR_CHECK_NULL(*agg, "Memory allocation error.");
+
+	memset(*agg, 0, sizeof(struct Aggregate));
+
+	(*agg)->budget = budget;
+
+	(*agg)->slots_len = AGGREGATE_SLOTS_MIN;
+	(*agg)->slots = calloc((*agg)->slots_len, sizeof(struct aggregate_entry));
+	ERROR_CHECK_NULL((*agg)->slots, "Memory allocation error.");
+
+	(*agg)->keys_size = AGGREGATE_KEYS_MIN;
+	(*agg)->keys = malloc((*agg)->keys_size);
+	ERROR_CHECK_NULL((*agg)->keys, "Memory allocation error.");
+
+	return 1;
+}
+
+int aggregate_add(Aggregate agg, const unsigned char *key, size_t key_len, uint64_t value)
+{
+	int r;
+	size_t i, mask;
+	uint64_t hash;
+	struct aggregate_entry *slot;
+
+	assert(agg);
+	assert(key);
+	assert(key_len > 0);
+
+	ERROR_CHECK_TRUE(key_len > AGGREGATE_KEY_MAX, "Aggregate key too long.");
+
+	hash = aggregate_hash(key, key_len);
+	mask = agg->slots_len - 1;
+
+	for (i = hash & mask; agg->slots[i].key_len; i = (i + 1) & mask)
+	{
+		slot = &(agg->slots[i]);
+		if (slot->hash == hash && slot->key_len == key_len && memcmp(agg->keys + slot->key_offset, key, key_len) == 0)
+		{
+			slot->value += value;
+			return 1;
+		}
+	}
+
+	// New key. Make room first, which may move it to another slot.
+	if (agg->keys_len + key_len > agg->keys_size || (agg->used + 1) * 10 > agg->slots_len * 7)
+	{
+		r = aggregate_grow(agg);
+		ERROR_CHECK_NEG(r, NULL);
+
+		mask = agg->slots_len - 1;
+		for (i = hash & mask; agg->slots[i].key_len; i = (i + 1) & mask)
+			;
+	}
+
+	memcpy(agg->keys + agg->keys_len, key, key_len);
+
+	slot = &(agg->slots[i]);
+	slot->hash = hash;
+	slot->value = value;
+	slot->key_offset = (uint32_t)agg->keys_len;
+	slot->key_len = (uint32_t)key_len;
+
+	agg->keys_len += key_len;
+	agg->used++;
+
+	return 1;
+}
+
+/*
+ * Calls put() for every key in ascending byte order with the total of its
+ * values. The aggregate is empty afterwards.
+ */
+int aggregate_merge(Aggregate agg, int (*put)(const unsigned char *, size_t, uint64_t, void *), void *arg)
+{
+	int r, c;
+	size_t i, n, len;
+	uint64_t value;
+	struct aggregate_entry *entry;
+	struct aggregate_source *sources, *min;
+	unsigned char key[AGGREGATE_KEY_MAX];
+
+	assert(agg);
+	assert(put);
+
+	// Everything fit in memory.
+	if (agg->runs_len == 0)
+	{
+		n = aggregate_sort(agg);
+
+		for (i = 0; i < n; i++)
+		{
+			entry = &(agg->slots[i]);
+
+			r = put(agg->keys + entry->key_offset, entry->key_len, entry->value, arg);
+			ERROR_CHECK_NEG(r, NULL);
+		}
+
+		aggregate_reset(agg);
+
+		return 1;
+	}
+
+	if (agg->used > 0)
+	{
+		r = aggregate_spill(agg);
+		ERROR_CHECK_NEG(r, NULL);
+	}
+
+	sources = calloc(agg->runs_len, sizeof(struct aggregate_source));
+	ERROR_CHECK_NULL(sources, "Memory allocation error.");
+
+	for (i = 0; i < agg->runs_len; i++)
+	{
+		rewind(agg->runs[i]);
+
+		sources[i].file = agg->runs[i];
+
+		r = aggregate_source_next(&(sources[i]));
+		ERROR_CHECK_NEG(r, "Could not read aggregate run.");
+	}
+
+	// There are only a handful of runs, so a linear scan for the smallest
+	// key is cheaper than keeping a heap.
+	while (1)
+	{
+		min = NULL;
+		for (i = 0; i < agg->runs_len; i++)
+		{
+			if (!sources[i].valid)
+			{
+				continue;
+			}
+
+			if (min)
+			{
+				len = (min->key_len < sources[i].key_len) ? min->key_len : sources[i].key_len;
+				c = memcmp(sources[i].key, min->key, len);
+				if (c > 0 || (c == 0 && sources[i].key_len >= min->key_len))
+				{
+					continue;
+				}
+			}
+
+			min = &(sources[i]);
+		}
+
+		if (min == NULL)
+		{
+			break;
+		}
+
+		len = min->key_len;
+		memcpy(key, min->key, len);
+		value = 0;
+
+		for (i = 0; i < agg->runs_len; i++)
+		{
+			if (sources[i].valid && sources[i].key_len == len && memcmp(sources[i].key, key, len) == 0)
+			{
+				value += sources[i].value;
+
+				r = aggregate_source_next(&(sources[i]));
+				ERROR_CHECK_NEG(r, "Could not read aggregate run.");
+			}
+		}
+
+		r = put(key, len, value, arg);
+		ERROR_CHECK_NEG(r, NULL);
+	}
+
+	for (i = 0; i < agg->runs_len; i++)
+	{
+		fclose(agg->runs[i]);
+	}
+
+	free(sources);
+	free(agg->runs);
+
+	agg->runs = NULL;
+	agg->runs_len = 0;
+
+	return 1;
+}
+
+void aggregate_free(Aggregate agg)
+{
+	size_t i;
+
+	assert(agg);
+
+	for (i = 0; i < agg->runs_len; i++)
+	{
+		fclose(agg->runs[i]);
+	}
+
+	free(agg->runs);
+	free(agg->slots);
+	free(agg->keys);
+	free(agg);
+}
+
+// FNV-1a
+static uint64_t aggregate_hash(const unsigned char *key, size_t len)
+{
+	size_t i;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	for (i = 0; i < len; i++)
+	{
+		hash ^= key[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+// Doubles whichever of the table or key buffer is full, or spills if that
+// would go over the memory budget.
+static int aggregate_grow(Aggregate agg)
+{
+	size_t i, j, mask, slots_len, keys_size;
+	size_t memory;
+	struct aggregate_entry *slots;
+	unsigned char *keys;
+
+	slots_len = agg->slots_len;
+	keys_size = agg->keys_size;
+
+	if ((agg->used + 1) * 10 > agg->slots_len * 7)
+	{
+		slots_len *= 2;
+	}
+	if (agg->keys_len + AGGREGATE_KEY_MAX > agg->keys_size)
+	{
+		keys_size *= 2;
+	}
+
+	memory = slots_len * sizeof(struct aggregate_entry) + keys_size;
+	if ((memory > agg->budget || keys_size > UINT32_MAX) && agg->used > 0)
+	{
+		return aggregate_spill(agg);
+	}
+
+	if (keys_size != agg->keys_size)
+	{
+		keys = realloc(agg->keys, keys_size);
+		ERROR_CHECK_NULL(keys, "Memory allocation error.");
+
+		agg->keys = keys;
+		agg->keys_size = keys_size;
+	}
+
+	if (slots_len != agg->slots_len)
+	{
+		slots = calloc(slots_len, sizeof(struct aggregate_entry));
+		ERROR_CHECK_NULL(slots, "Memory allocation error.");
+
+		mask = slots_len - 1;
+		for (i = 0; i < agg->slots_len; i++)
+		{
+			if (agg->slots[i].key_len == 0)
+			{
+				continue;
+			}
+
+			for (j = agg->slots[i].hash & mask; slots[j].key_len; j = (j + 1) & mask)
+				;
+
+			slots[j] = agg->slots[i];
+		}
+
+		free(agg->slots);
+
+		agg->slots = slots;
+		agg->slots_len = slots_len;
+	}
+
+	return 1;
+}
+
+// Packs the used slots to the front of the table in key order. The table
+// is no longer a valid hash table afterwards.
+static size_t aggregate_sort(Aggregate agg)
+{
+	size_t i, n = 0;
+
+	for (i = 0; i < agg->slots_len; i++)
+	{
+		if (agg->slots[i].key_len)
+		{
+			agg->slots[n++] = agg->slots[i];
+		}
+	}
+
+	sort_keys = agg->keys;
+	qsort(agg->slots, n, sizeof(struct aggregate_entry), &aggregate_compare);
+
+	return n;
+}
+
+static int aggregate_compare(const void *a, const void *b)
+{
+	int c;
+	const struct aggregate_entry *x = a;
+	const struct aggregate_entry *y = b;
+
+	c = memcmp(sort_keys + x->key_offset, sort_keys + y->key_offset, (x->key_len < y->key_len) ? x->key_len : y->key_len);
+	if (c != 0)
+	{
+		return c;
+	}
+
+	return (x->key_len > y->key_len) - (x->key_len < y->key_len);
+}
+
+// Run records are a length byte, the key, then the native 64 bit value.
+static int aggregate_spill(Aggregate agg)
+{
+	size_t i, n;
+	FILE *file, **runs;
+	struct aggregate_entry *entry;
+
+	n = aggregate_sort(agg);
+
+	runs = realloc(agg->runs, sizeof(FILE *) * (agg->runs_len + 1));
+	ERROR_CHECK_NULL(runs, "Memory allocation error.");
+
+	agg->runs = runs;
+
+	file = tmpfile();
+	ERROR_CHECK_NULL(file, "Could not create temporary file for aggregate run.");
+
+	agg->runs[agg->runs_len++] = file;
+
+	for (i = 0; i < n; i++)
+	{
+		entry = &(agg->slots[i]);
+
+		fputc((int)entry->key_len, file);
+		fwrite(agg->keys + entry->key_offset, 1, entry->key_len, file);
+		fwrite(&(entry->value), sizeof(uint64_t), 1, file);
+	}
+
+	ERROR_CHECK_TRUE(fflush(file) != 0 || ferror(file), "Could not write aggregate run.");
+
+	aggregate_reset(agg);
+
+	return 1;
+}
+
+static void aggregate_reset(Aggregate agg)
+{
+	memset(agg->slots, 0, agg->slots_len * sizeof(struct aggregate_entry));
+
+	agg->used = 0;
+	agg->keys_len = 0;
+}
+
+static int aggregate_source_next(struct aggregate_source *source)
+{
+	int c;
+
+	c = fgetc(source->file);
+	if (c == EOF)
+	{
+		source->valid = 0;
+		return 0;
+	}
+
+	source->key_len = (size_t)c;
+
+	if (fread(source->key, 1, source->key_len, source->file) != source->key_len || fread(&(source->value), sizeof(uint64_t), 1, source->file) != 1)
+	{
+		error_log("Aggregate run is truncated.");
+		return -1;
+	}
+
+	source->valid = 1;
+
+	return 1;
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#ifndef AGGREGATE_H
+#define AGGREGATE_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define AGGREGATE_KEY_MAX    255
+
+typedef struct Aggregate *Aggregate;
+
+int aggregate_new(Aggregate *, size_t);
+int aggregate_add(Aggregate, const unsigned char *, size_t, uint64_t);
+int aggregate_merge(Aggregate, int (*)(const unsigned char *, size_t, uint64_t, void *), void *);
+void aggregate_free(Aggregate);
+
+#endif
\ No newline at end of file
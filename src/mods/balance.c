@@ -14,14 +14,50 @@
 #include "mods/error.h"
 #include "mods/database.h"
 #include "mods/serialize.h"
+#include "mods/aggregate.h"
+#include "mods/cache.h"
 
 #define BALANCE_DEFAULT_PATH             ".btk/balance"
+#define BALANCE_LOAD_BATCH_SIZE          100000
+
+// Keys are reversed addresses, which never contain an underscore.
+#define BALANCE_RECORD_COUNT_KEY         "__record_count"
+#define BALANCE_LAST_BLOCK_KEY           "__last_block"
 
 static DBRef dbref = NULL;
+static Aggregate load = NULL;
+static size_t load_batch_len = 0;
+static size_t load_count = 0;
+
+/*
+ * Batch changes wait in a write-back cache until balance_batch_write(),
+ * so that balance_get() sees them and many blocks can be written in one
+ * batch. After balance_cache_open(), balances read from the database are
+ * cached too, and written ones stay cached, until a write finds the cache
+ * over its limit. Busy addresses are then read from disk only once.
+ */
+static Cache cache = NULL;
+static size_t cache_limit = 0;
+
+/*
+ * The number of balances is stored in the database and kept current by
+ * the batch functions, which write the change along with the batch. A
+ * database created before there was a counter has none, and is counted
+ * by iterating.
+ */
+static int record_count_known = 0;
+static uint64_t record_count = 0;
+static int64_t record_count_change = 0;
+
+static int balance_load_put(const unsigned char *, size_t, uint64_t, void *);
+static int balance_record_count_put(void);
+static int balance_cache_write(const unsigned char *, size_t, const unsigned char *, size_t, void *);
 
 int balance_open(char *path, bool create)
 {
 	int r;
+	unsigned char *value = NULL;
+	size_t value_len = 0;
 	
 	if (path == NULL)
 	{
@@ -41,6 +77,24 @@ int balance_open(char *path, bool create)
 	r = database_open(&dbref, path, create);
 	ERROR_CHECK_NEG(r, "Could not open the database.");
 
+	record_count = 0;
+	record_count_change = 0;
+	record_count_known = create;
+
+	if (!create)
+	{
+		r = database_get(&value, &value_len, dbref, (unsigned char *)BALANCE_RECORD_COUNT_KEY, strlen(BALANCE_RECORD_COUNT_KEY));
+		ERROR_CHECK_NEG(r, "Could not get record count from balance database.");
+
+		if (value && value_len == sizeof(uint64_t))
+		{
+			deserialize_uint64(&record_count, value, SERIALIZE_ENDIAN_LIT);
+			record_count_known = 1;
+		}
+
+		free(value);
+	}
+
 	return 1;
 }
 
@@ -48,12 +102,38 @@ void balance_close(void)
 {
 	assert(dbref);
 
+	if (cache)
+	{
+		cache_free(cache);
+		cache = NULL;
+	}
+	cache_limit = 0;
+
 	database_close(dbref);
 	free(dbref);
 
 	dbref = NULL;
 }
 
+// Caches balances for updates, up to about limit bytes of them. Not for
+// a database that other threads read.
+int balance_cache_open(size_t limit)
+{
+	int r;
+
+	assert(dbref);
+
+	if (!cache)
+	{
+		r = cache_new(&cache);
+		ERROR_CHECK_NEG(r, NULL);
+	}
+
+	cache_limit = limit;
+
+	return 1;
+}
+
 int balance_get(uint64_t *sats, char *address)
 {
 	int r, i;
@@ -61,6 +141,7 @@ int balance_get(uint64_t *sats, char *address)
 	char address_reverse[BUFSIZ];
 	size_t serialized_value_len = 0;
 	unsigned char *serialized_value = NULL;
+	const unsigned char *cached_value;
 
 	memset(address_reverse, 0, BUFSIZ);
 
@@ -70,9 +151,32 @@ int balance_get(uint64_t *sats, char *address)
 		address_reverse[i] = address[len - 1 - i];
 	}
 
+	if (cache && cache_get(&cached_value, &serialized_value_len, cache, (unsigned char *)address_reverse, len) > 0)
+	{
+		if (!cached_value)
+		{
+			return 0;
+		}
+
+		deserialize_uint64(sats, (unsigned char *)cached_value, SERIALIZE_ENDIAN_BIG);
+
+		return 1;
+	}
+
 	r = database_get(&serialized_value, &serialized_value_len, dbref, (unsigned char *)address_reverse, strlen(address_reverse));
 	ERROR_CHECK_NEG(r, "Could not get value from balance database.");
 
+	// Also remember when there is no balance
+	if (cache)
+	{
+		r = cache_put(cache, (unsigned char *)address_reverse, len, serialized_value, serialized_value_len, 0);
+		if (r < 0)
+		{
+			free(serialized_value);
+			return -1;
+		}
+	}
+
 	if (!serialized_value)
 	{
 		return 0;
@@ -149,13 +253,33 @@ int balance_batch_put(char *address, uint64_t sats)
 	}
 
 	serialize_uint64(serialized, sats, SERIALIZE_ENDIAN_BIG);
-	
-	r = database_batch_put(dbref, (unsigned char *)address_reverse, strlen(address_reverse), serialized, sizeof(uint64_t));
+
+	if (!cache)
+	{
+		r = cache_new(&cache);
+		ERROR_CHECK_NEG(r, NULL);
+	}
+
+	r = cache_put(cache, (unsigned char *)address_reverse, len, serialized, sizeof(uint64_t), CACHE_DIRTY);
 	ERROR_CHECK_NEG(r, "Could not execute batch put.");
 
 	return 1;
 }
 
+// Like balance_batch_put(), for an address that has no balance yet.
+int balance_batch_insert(char *address, uint64_t sats)
+{
+	int r;
+
+	r = balance_batch_put(address, sats);
+	ERROR_CHECK_NEG(r, NULL);
+
+	record_count_change++;
+
+	return 1;
+}
+
+// The address must have a balance.
 int balance_batch_delete(char *address)
 {
 	int r, i;
@@ -170,9 +294,17 @@ int balance_batch_delete(char *address)
 		address_reverse[i] = address[len - 1 - i];
 	}
 
-	r = database_batch_delete(dbref, (unsigned char *)address_reverse, strlen(address_reverse));
+	if (!cache)
+	{
+		r = cache_new(&cache);
+		ERROR_CHECK_NEG(r, NULL);
+	}
+
+	r = cache_put(cache, (unsigned char *)address_reverse, len, NULL, 0, CACHE_DIRTY);
 	ERROR_CHECK_NEG(r, "Could not delete txao entry after spending.");
 
+	record_count_change--;
+
 	return 1;
 }
 
@@ -182,9 +314,81 @@ int balance_batch_write(void)
 
 	assert(dbref);
 
+	if (cache)
+	{
+		r = cache_flush(cache, &balance_cache_write, NULL);
+		ERROR_CHECK_NEG(r, NULL);
+	}
+
+	if (record_count_known && record_count_change != 0)
+	{
+		record_count += record_count_change;
+
+		r = balance_record_count_put();
+		ERROR_CHECK_NEG(r, NULL);
+	}
+	record_count_change = 0;
+
 	r = database_batch_write(dbref);
 	ERROR_CHECK_NEG(r, "Could not execute batch write.");
 
+	if (cache && cache_memory(cache) > cache_limit)
+	{
+		cache_clear(cache);
+	}
+
+	return 1;
+}
+
+// Memory held by batch changes not yet written.
+size_t balance_batch_memory(void)
+{
+	if (!cache)
+	{
+		return 0;
+	}
+
+	return cache_dirty_memory(cache);
+}
+
+// The last block the balances include, written with the next batch.
+int balance_batch_set_last_block(int block_num)
+{
+	int r;
+	unsigned char value[sizeof(uint32_t)];
+
+	assert(dbref);
+
+	serialize_uint32(value, (uint32_t)block_num, SERIALIZE_ENDIAN_LIT);
+
+	r = database_batch_put(dbref, (unsigned char *)BALANCE_LAST_BLOCK_KEY, strlen(BALANCE_LAST_BLOCK_KEY), value, sizeof(uint32_t));
+	ERROR_CHECK_NEG(r, "Could not put last block in balance database.");
+
+	return 1;
+}
+
+// Returns 0 for a database that has no last block recorded.
+int balance_get_last_block(int *block_num)
+{
+	int r;
+	unsigned char *value = NULL;
+	size_t value_len = 0;
+
+	assert(block_num);
+	assert(dbref);
+
+	r = database_get(&value, &value_len, dbref, (unsigned char *)BALANCE_LAST_BLOCK_KEY, strlen(BALANCE_LAST_BLOCK_KEY));
+	ERROR_CHECK_NEG(r, "Could not get last block from balance database.");
+
+	if (!value)
+	{
+		return 0;
+	}
+
+	deserialize_uint32((uint32_t *)block_num, value, SERIALIZE_ENDIAN_LIT);
+
+	free(value);
+
 	return 1;
 }
 
@@ -192,22 +396,171 @@ int balance_get_record_count(size_t *count)
 {
 	int r;
 	size_t c = 0;
+	DBCursor cursor;
+	size_t key_len, value_len;
+	const unsigned char *key, *value;
 
 	assert(count);
 	assert(dbref);
 
-	database_iter_reset(dbref);
+	if (record_count_known)
+	{
+		*count = record_count + record_count_change;
+		return 1;
+	}
 
-	r = database_iter_seek_start(dbref);
-	ERROR_CHECK_NEG(r, "Unable to seek to first record in chainstate database.");
+	r = database_cursor_new(&cursor, dbref, NULL, 0, NULL, 0);
+	ERROR_CHECK_NEG(r, "Could not create balance cursor.");
 
-	while ((r = database_iter_next(dbref)) > 0)
+	while ((r = database_cursor_get(&key, &key_len, &value, &value_len, cursor)) > 0)
 	{
-		c++;
+		// Skip the named keys
+		if (key_len > 0 && key[0] != '_')
+		{
+			c++;
+		}
+
+		database_cursor_next(cursor);
 	}
-	ERROR_CHECK_NEG(r, "Could not iterate.");
+
+	database_cursor_free(cursor);
+
+	ERROR_CHECK_NEG(r, "Could not read balance database.");
 
 	*count = c;
 
+	return 1;
+}
+
+/*
+ * Bulk loading for a newly created database. Amounts are summed per
+ * address in memory, spilling to temporary files past memory_budget bytes,
+ * and balance_load_end() writes every balance once, in key order, in large
+ * write batches. Nothing is read back from the database.
+ */
+int balance_load_begin(size_t memory_budget)
+{
+	int r;
+
+	assert(dbref);
+	assert(load == NULL);
+
+	r = aggregate_new(&load, memory_budget);
+	ERROR_CHECK_NEG(r, "Could not create balance aggregate.");
+
+	load_batch_len = 0;
+	load_count = 0;
+
+	return 1;
+}
+
+int balance_load_add(char *address, uint64_t sats)
+{
+	int r, i;
+	int len;
+	unsigned char address_reverse[AGGREGATE_KEY_MAX];
+
+	assert(load);
+	assert(address);
+
+	len = strlen(address);
+	ERROR_CHECK_TRUE(len == 0 || len > AGGREGATE_KEY_MAX, "Invalid address length.");
+
+	for (i = 0; i < len; i++)
+	{
+		address_reverse[i] = address[len - 1 - i];
+	}
+
+	r = aggregate_add(load, address_reverse, len, sats);
+	ERROR_CHECK_NEG(r, "Could not add to balance aggregate.");
+
+	return 1;
+}
+
+int balance_load_end(void)
+{
+	int r;
+
+	assert(load);
+
+	r = aggregate_merge(load, &balance_load_put, NULL);
+	ERROR_CHECK_NEG(r, "Could not merge balance aggregate.");
+
+	// Every address is written once. A resumed load may overwrite some
+	// from an attempt that was cut short, but writes the same set.
+	record_count = load_count;
+	record_count_change = 0;
+	record_count_known = 1;
+
+	r = balance_record_count_put();
+	ERROR_CHECK_NEG(r, NULL);
+
+	// The count is always in the last batch
+	r = database_batch_write(dbref);
+	ERROR_CHECK_NEG(r, "Could not execute batch write.");
+
+	load_batch_len = 0;
+
+	aggregate_free(load);
+	load = NULL;
+
+	return 1;
+}
+
+static int balance_load_put(const unsigned char *key, size_t key_len, uint64_t sats, void *arg)
+{
+	int r;
+	unsigned char serialized[sizeof(uint64_t)];
+
+	(void)arg;
+
+	serialize_uint64(serialized, sats, SERIALIZE_ENDIAN_BIG);
+
+	r = database_batch_put(dbref, (unsigned char *)key, key_len, serialized, sizeof(uint64_t));
+	ERROR_CHECK_NEG(r, "Could not execute batch put.");
+
+	load_count++;
+
+	if (++load_batch_len >= BALANCE_LOAD_BATCH_SIZE)
+	{
+		r = database_batch_write(dbref);
+		ERROR_CHECK_NEG(r, "Could not execute batch write.");
+
+		load_batch_len = 0;
+	}
+
+	return 1;
+}
+
+static int balance_record_count_put(void)
+{
+	int r;
+	unsigned char serialized[sizeof(uint64_t)];
+
+	serialize_uint64(serialized, record_count, SERIALIZE_ENDIAN_LIT);
+
+	r = database_batch_put(dbref, (unsigned char *)BALANCE_RECORD_COUNT_KEY, strlen(BALANCE_RECORD_COUNT_KEY), serialized, sizeof(uint64_t));
+	ERROR_CHECK_NEG(r, "Could not put record count in balance database.");
+
+	return 1;
+}
+
+static int balance_cache_write(const unsigned char *key, size_t key_len, const unsigned char *value, size_t value_len, void *arg)
+{
+	int r;
+
+	(void)arg;
+
+	if (value)
+	{
+		r = database_batch_put(dbref, (unsigned char *)key, key_len, (unsigned char *)value, value_len);
+		ERROR_CHECK_NEG(r, "Could not execute batch put.");
+	}
+	else
+	{
+		r = database_batch_delete(dbref, (unsigned char *)key, key_len);
+		ERROR_CHECK_NEG(r, "Could not execute batch delete.");
+	}
+
 	return 1;
 }
\ No newline at end of file
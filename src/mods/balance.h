@@ -8,17 +8,27 @@
 #ifndef BALANCE_H
 #define BALANCE_H 1
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
 int balance_open(char *, bool);
 void balance_close(void);
+int balance_cache_open(size_t);
 int balance_get(uint64_t *, char *);
 int balance_put(char *, uint64_t);
 int balance_delete(char *);
 int balance_batch_put(char *, uint64_t);
+int balance_batch_insert(char *, uint64_t);
 int balance_batch_delete(char *address);
 int balance_batch_write(void);
+size_t balance_batch_memory(void);
+int balance_batch_set_last_block(int);
+int balance_get_last_block(int *);
+
+int balance_load_begin(size_t);
+int balance_load_add(char *, uint64_t);
+int balance_load_end(void);
 
 int balance_get_record_count(size_t *);
 
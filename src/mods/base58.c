@@ -6,100 +6,114 @@
  */
 
 #include <string.h>
-#include <stdlib.h>
 #include <assert.h>
-#include <gmp.h>
-#ifdef GMP_H_MISSING
-#   include "GMP/mini-gmp.h"
-#endif
+#include "base58.h"
 #include "error.h"
 
 #define BASE58_CODE_STRING_LENGTH 58
 
+// Base58 digits needed for BASE58_DATA_MAX bytes, log(256) / log(58) ~ 1.37
+#define BASE58_DIGITS_MAX         (BASE58_DATA_MAX * 138 / 100 + 1)
+
 static char *code_string = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
 
+/*
+ * Both conversions work on fixed size buffers on the stack, with digits
+ * kept least significant first, so no big number allocations are made.
+ */
 int base58_encode(char *output, unsigned char *input, size_t input_len)
 {
-	int i, j;
-	char t;
-	mpz_t x, r, d;
+	size_t i, j, zeros, len;
+	unsigned int carry;
+	unsigned char digits[BASE58_DIGITS_MAX];
 
 	assert(output);
 	assert(input);
 	assert(input_len);
 
-	mpz_init(x);
-	mpz_init(r);
-	mpz_init(d);
+	ERROR_CHECK_TRUE(input_len > BASE58_DATA_MAX, "Input is too long to encode to base58.");
 
-	mpz_set_ui(d, 58);
+	for (zeros = 0; zeros < input_len && input[zeros] == 0; ++zeros)
+		;
 
-	// Base58 encode
-	mpz_import(x, input_len, 1, sizeof(*input), 1, 0, input);
-	for (i = 0; mpz_cmp_ui(x, 0) > 0; ++i)
+	len = 0;
+	for (i = zeros; i < input_len; ++i)
 	{
-		mpz_tdiv_qr(x, r, x, d);
-		output[i] = code_string[mpz_get_ui(r)];
+		carry = input[i];
+		for (j = 0; j < len; ++j)
+		{
+			carry += (unsigned int)digits[j] << 8;
+			digits[j] = carry % 58;
+			carry /= 58;
+		}
+		while (carry > 0)
+		{
+			digits[len++] = carry % 58;
+			carry /= 58;
+		}
 	}
-	for (j = 0; input[j] == 0; ++j, ++i)
+
+	// Each leading zero byte is encoded as the first code character.
+	for (i = 0; i < zeros; ++i)
 	{
 		output[i] = code_string[0];
 	}
-	output[i] = '\0';
-	
-	// Reverse result
-	for (i = 0, j = strlen(output) - 1; i < j; ++i, --j)
+	for (j = 0; j < len; ++j)
 	{
-		t = output[i];
-		output[i] = output[j];
-		output[j] = t;
+		output[i++] = code_string[digits[len - 1 - j]];
 	}
-	
-	mpz_clear(x);
-	mpz_clear(r);
-	mpz_clear(d);
+	output[i] = '\0';
 
 	return 1;
 }
 
+/*
+ * Leading zero bytes are not restored, so the returned length is that of
+ * the decoded value without them.
+ */
 int base58_decode(unsigned char *output, char *input)
 {
-	int i, j;
-	size_t r, input_len;
-	mpz_t x, b;
-	
+	size_t i, j, k, len;
+	unsigned int carry;
+	unsigned char bytes[BASE58_DATA_MAX];
+
 	assert(input);
 	assert(output);
 
-	input_len = strlen(input);
-	
-	mpz_init(x);
-	mpz_init(b);
-	
-	mpz_set_ui(b, 58);
-	mpz_set_ui(x, 0);
-	
-	for (i = 0; i < (int)input_len; ++i)
+	len = 0;
+	for (i = 0; input[i]; ++i)
 	{
 		for (j = 0; j < BASE58_CODE_STRING_LENGTH && code_string[j] != input[i]; ++j)
 			;
 
 		if (j >= BASE58_CODE_STRING_LENGTH)
 		{
-			error_log("Input contains invalid base58 character at index %i (0x%02x).", i, input[i]);
+			error_log("Input contains invalid base58 character at index %i (0x%02x).", (int)i, input[i]);
 			return -1;
 		}
 
-		mpz_mul(x, b, x);
-		mpz_add_ui(x, x, j);
+		carry = j;
+		for (k = 0; k < len; ++k)
+		{
+			carry += (unsigned int)bytes[k] * 58;
+			bytes[k] = carry & 0xFF;
+			carry >>= 8;
+		}
+		while (carry > 0)
+		{
+			ERROR_CHECK_TRUE(len >= BASE58_DATA_MAX, "Input is too long to decode from base58.");
+
+			bytes[len++] = carry & 0xFF;
+			carry >>= 8;
+		}
+	}
+
+	for (i = 0; i < len; ++i)
+	{
+		output[i] = bytes[len - 1 - i];
 	}
 
-	mpz_export(output, &r, 1, 1, 1, 0, x);
-	
-	mpz_clear(x);
-	mpz_clear(b);
-	
-	return (int)r;
+	return (int)len;
 }
 
 int base58_ischar(char c)
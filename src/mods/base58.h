@@ -8,6 +8,11 @@
 #ifndef BASE58_H
 #define BASE58_H 1
 
+#include <stddef.h>
+
+// Largest binary value, in bytes, that can be encoded or decoded.
+#define BASE58_DATA_MAX 128
+
 int base58_encode(char *, unsigned char *, size_t);
 int base58_decode(unsigned char *, char *);
 int base58_ischar(char);
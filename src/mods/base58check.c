@@ -5,7 +5,6 @@
  * under the terms of the GPL License. See LICENSE for more details.
  */
 
-#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <assert.h>
@@ -19,18 +18,13 @@
 int base58check_encode(char *output, unsigned char *input, size_t input_len) {
 	int i, r;
 	uint32_t checksum;
-	unsigned char *input_check;
+	unsigned char input_check[BASE58_DATA_MAX];
 	
 	assert(output);
 	assert(input);
 	assert(input_len);
-	
-	input_check = malloc(input_len + CHECKSUM_LENGTH);
-	if (input_check == NULL)
-	{
-		error_log("Memory allocation error.");
-		return -1;
-	}
+
+	ERROR_CHECK_TRUE(input_len + CHECKSUM_LENGTH > BASE58_DATA_MAX, "Input is too long to encode to base58check.");
 	
 	memcpy(input_check, input, input_len);
 	
@@ -53,8 +47,6 @@ int base58check_encode(char *output, unsigned char *input, size_t input_len) {
 		return -1;
 	}
 	
-	free(input_check);
-	
 	return 1;
 }
 
@@ -11,17 +11,14 @@
 #include <assert.h>
 #include "bech32.h"
 #include "base32.h"
-#include "network.h"
 #include "error.h"
 
-#define BECH32_PREFIX_MAINNET         "bc"
-#define BECH32_PREFIX_TESTNET         "tb"
 #define BECH32_SEPARATOR              '1'
 #define BECH32_CHECKSUM_LENGTH        6
 
 static uint32_t bech32_polymod_step(uint8_t value, uint32_t chk);
 
-int bech32_get_address(char *output, unsigned char *data, size_t data_len, int witver)
+int bech32_get_address(char *output, unsigned char *data, size_t data_len, int witver, Network network)
 {
 	int i, l, c, r;
 	char *hrp;
@@ -30,18 +27,12 @@ int bech32_get_address(char *output, unsigned char *data, size_t data_len, int w
 	assert(output);
 	assert(data);
 	assert(data_len);
+	assert(network);
 
 	chk = 1;
 
 	// Get human readable part (hrp)
-	if (network_is_main())
-	{
-		hrp = BECH32_PREFIX_MAINNET;
-	}
-	else if (network_is_test())
-	{
-		hrp = BECH32_PREFIX_TESTNET;
-	}
+	hrp = network->bech32_hrp;
 
 	// hrp
 	l = strlen(hrp);
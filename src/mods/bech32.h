@@ -9,7 +9,11 @@
 #define BECH32_H 1
 
 #include <stddef.h>
+#include "network.h"
 
-int bech32_get_address(char *, unsigned char *, size_t, int);
+// Longest valid address (BIP173) plus the terminating null character
+#define BECH32_ADDRESS_SIZE    91
+
+int bech32_get_address(char *, unsigned char *, size_t, int, Network);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,402 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "cache.h"
+#include "error.h"
+
+#define CACHE_BUCKETS_MIN       4096
+
+/*
+ * A write-back cache of database records. Each key holds its latest
+ * value, or none when it is known not to be in the database, so reads
+ * can look here first and see writes that are not stored yet. Changed
+ * entries are dirty until cache_flush() hands them out in key order, and
+ * stay cached after that until cache_clear(). A fresh entry is known not
+ * to be in the database, so deleting it before a flush only drops it.
+ * Entries are chained per bucket and allocated with their key and value
+ * inline.
+ */
+struct cache_entry {
+	struct cache_entry *next;
+	uint64_t hash;
+	size_t key_len;
+	size_t value_len;
+	size_t value_size;
+	int deleted;
+	int flags;
+	unsigned char data[];       // The key, then the value
+};
+
+struct Cache {
+	struct cache_entry **buckets;
+	size_t buckets_len;
+	size_t len;
+	size_t dirty_len;
+	size_t memory;
+	size_t dirty_memory;
+};
+
+static uint64_t cache_hash(const unsigned char *, size_t);
+static struct cache_entry **cache_find(Cache, const unsigned char *, size_t, uint64_t);
+static int cache_grow(Cache);
+static int cache_compare(const void *, const void *);
+
+int cache_new(Cache *cache)
+{
+	assert(cache);
+
+	*cache = malloc(sizeof(struct Cache));
+	ERROR_CHECK_NULL(*cache, "Memory allocation error.");
+
+	(*cache)->buckets_len = CACHE_BUCKETS_MIN;
+	(*cache)->buckets = calloc((*cache)->buckets_len, sizeof(struct cache_entry *));
+	ERROR_CHECK_NULL((*cache)->buckets, "Memory allocation error.");
+
+	(*cache)->len = 0;
+	(*cache)->dirty_len = 0;
+	(*cache)->memory = (*cache)->buckets_len * sizeof(struct cache_entry *);
+	(*cache)->dirty_memory = 0;
+
+	return 1;
+}
+
+// Returns 1 if the key is cached, with value set to NULL if it is not in
+// the database, or 0 if only the database knows. The value is valid until
+// the next change to the cache.
+int cache_get(const unsigned char **value, size_t *value_len, Cache cache, const unsigned char *key, size_t key_len)
+{
+	struct cache_entry **link;
+
+	assert(value);
+	assert(value_len);
+	assert(cache);
+	assert(key);
+
+	link = cache_find(cache, key, key_len, cache_hash(key, key_len));
+	if (*link == NULL)
+	{
+		return 0;
+	}
+
+	if ((*link)->deleted)
+	{
+		*value = NULL;
+		*value_len = 0;
+	}
+	else
+	{
+		*value = (*link)->data + (*link)->key_len;
+		*value_len = (*link)->value_len;
+	}
+
+	return 1;
+}
+
+// Sets the value of a key, or deletes it when value is NULL. With
+// CACHE_DIRTY in flags it is a change to write, otherwise it caches what
+// the database holds. CACHE_FRESH says the key is new to the database,
+// and is ignored when the cache knows otherwise.
+int cache_put(Cache cache, const unsigned char *key, size_t key_len, const unsigned char *value, size_t value_len, int flags)
+{
+	int r;
+	size_t size;
+	uint64_t hash;
+	struct cache_entry **link, *entry;
+
+	assert(cache);
+	assert(key);
+
+	if (value == NULL)
+	{
+		value_len = 0;
+	}
+
+	hash = cache_hash(key, key_len);
+	link = cache_find(cache, key, key_len, hash);
+
+	if (*link && !((*link)->flags & CACHE_FRESH) && ((*link)->flags & CACHE_DIRTY || !(*link)->deleted))
+	{
+		flags &= ~CACHE_FRESH;
+	}
+
+	// Never written, so there is nothing to delete
+	if (*link && value == NULL && (flags & CACHE_DIRTY) && ((*link)->flags & CACHE_FRESH))
+	{
+		entry = *link;
+		*link = entry->next;
+
+		size = sizeof(struct cache_entry) + entry->key_len + entry->value_size;
+
+		cache->len--;
+		cache->memory -= size;
+		if (entry->flags & CACHE_DIRTY)
+		{
+			cache->dirty_len--;
+			cache->dirty_memory -= size;
+		}
+
+		free(entry);
+
+		return 1;
+	}
+
+	if (*link == NULL)
+	{
+		if (cache->len >= cache->buckets_len)
+		{
+			r = cache_grow(cache);
+			ERROR_CHECK_NEG(r, NULL);
+
+			link = cache_find(cache, key, key_len, hash);
+		}
+
+		entry = malloc(sizeof(struct cache_entry) + key_len + value_len);
+		ERROR_CHECK_NULL(entry, "Memory allocation error.");
+
+		entry->next = NULL;
+		entry->hash = hash;
+		entry->key_len = key_len;
+		entry->value_size = value_len;
+		entry->flags = 0;
+		memcpy(entry->data, key, key_len);
+
+		*link = entry;
+
+		cache->len++;
+		cache->memory += sizeof(struct cache_entry) + key_len + value_len;
+	}
+	else if ((*link)->value_size < value_len)
+	{
+		entry = realloc(*link, sizeof(struct cache_entry) + key_len + value_len);
+		ERROR_CHECK_NULL(entry, "Memory allocation error.");
+
+		cache->memory += value_len - entry->value_size;
+		if (entry->flags & CACHE_DIRTY)
+		{
+			cache->dirty_memory += value_len - entry->value_size;
+		}
+		entry->value_size = value_len;
+
+		*link = entry;
+	}
+
+	entry = *link;
+
+	size = sizeof(struct cache_entry) + entry->key_len + entry->value_size;
+	if ((flags & CACHE_DIRTY) && !(entry->flags & CACHE_DIRTY))
+	{
+		cache->dirty_len++;
+		cache->dirty_memory += size;
+	}
+	else if (!(flags & CACHE_DIRTY) && (entry->flags & CACHE_DIRTY))
+	{
+		cache->dirty_len--;
+		cache->dirty_memory -= size;
+	}
+
+	entry->flags = flags;
+	entry->deleted = (value == NULL);
+	entry->value_len = value_len;
+	if (value_len > 0)
+	{
+		memcpy(entry->data + key_len, value, value_len);
+	}
+
+	return 1;
+}
+
+/*
+ * Calls put() for every dirty key in ascending byte order, with a NULL
+ * value for deleted keys. The entries stay cached, as clean ones.
+ */
+int cache_flush(Cache cache, int (*put)(const unsigned char *, size_t, const unsigned char *, size_t, void *), void *arg)
+{
+	int r = 1;
+	size_t i, n;
+	struct cache_entry *entry, **entries;
+
+	assert(cache);
+	assert(put);
+
+	if (cache->dirty_len == 0)
+	{
+		return 1;
+	}
+
+	entries = malloc(sizeof(struct cache_entry *) * cache->dirty_len);
+	ERROR_CHECK_NULL(entries, "Memory allocation error.");
+
+	for (n = 0, i = 0; i < cache->buckets_len; i++)
+	{
+		for (entry = cache->buckets[i]; entry; entry = entry->next)
+		{
+			if (entry->flags & CACHE_DIRTY)
+			{
+				entries[n++] = entry;
+			}
+		}
+	}
+
+	qsort(entries, n, sizeof(struct cache_entry *), &cache_compare);
+
+	for (i = 0; i < n && r >= 0; i++)
+	{
+		entry = entries[i];
+		r = put(entry->data, entry->key_len, entry->deleted ? NULL : entry->data + entry->key_len, entry->value_len, arg);
+	}
+
+	if (r < 0)
+	{
+		free(entries);
+		return -1;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		entries[i]->flags &= ~(CACHE_DIRTY | CACHE_FRESH);
+	}
+
+	free(entries);
+
+	cache->dirty_len = 0;
+	cache->dirty_memory = 0;
+
+	return 1;
+}
+
+// Drops every entry. Dirty ones are lost, so flush first.
+void cache_clear(Cache cache)
+{
+	size_t i;
+	struct cache_entry *entry, *next;
+
+	assert(cache);
+
+	for (i = 0; i < cache->buckets_len; i++)
+	{
+		for (entry = cache->buckets[i]; entry; entry = next)
+		{
+			next = entry->next;
+			free(entry);
+		}
+
+		cache->buckets[i] = NULL;
+	}
+
+	cache->len = 0;
+	cache->dirty_len = 0;
+	cache->memory = cache->buckets_len * sizeof(struct cache_entry *);
+	cache->dirty_memory = 0;
+}
+
+// Bytes held by the cache, as an estimate that leaves out malloc overhead.
+size_t cache_memory(Cache cache)
+{
+	assert(cache);
+
+	return cache->memory;
+}
+
+// The part of cache_memory() held by dirty entries.
+size_t cache_dirty_memory(Cache cache)
+{
+	assert(cache);
+
+	return cache->dirty_memory;
+}
+
+void cache_free(Cache cache)
+{
+	assert(cache);
+
+	cache_clear(cache);
+
+	free(cache->buckets);
+	free(cache);
+}
+
+static uint64_t cache_hash(const unsigned char *key, size_t len)
+{
+	size_t i;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	for (i = 0; i < len; i++)
+	{
+		hash ^= key[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+// Returns the link that points to the key's entry, or the empty link at
+// the end of its bucket's chain.
+static struct cache_entry **cache_find(Cache cache, const unsigned char *key, size_t key_len, uint64_t hash)
+{
+	struct cache_entry **link;
+
+	link = &(cache->buckets[hash & (cache->buckets_len - 1)]);
+
+	while (*link)
+	{
+		if ((*link)->hash == hash && (*link)->key_len == key_len && memcmp((*link)->data, key, key_len) == 0)
+		{
+			break;
+		}
+
+		link = &((*link)->next);
+	}
+
+	return link;
+}
+
+static int cache_grow(Cache cache)
+{
+	size_t i, buckets_len;
+	struct cache_entry **buckets, *entry, *next;
+
+	buckets_len = cache->buckets_len * 2;
+	buckets = calloc(buckets_len, sizeof(struct cache_entry *));
+	ERROR_CHECK_NULL(buckets, "Memory allocation error.");
+
+	for (i = 0; i < cache->buckets_len; i++)
+	{
+		for (entry = cache->buckets[i]; entry; entry = next)
+		{
+			next = entry->next;
+			entry->next = buckets[entry->hash & (buckets_len - 1)];
+			buckets[entry->hash & (buckets_len - 1)] = entry;
+		}
+	}
+
+	free(cache->buckets);
+
+	cache->memory += (buckets_len - cache->buckets_len) * sizeof(struct cache_entry *);
+	cache->buckets = buckets;
+	cache->buckets_len = buckets_len;
+
+	return 1;
+}
+
+static int cache_compare(const void *a, const void *b)
+{
+	int c;
+	const struct cache_entry *x = *(const struct cache_entry **)a;
+	const struct cache_entry *y = *(const struct cache_entry **)b;
+
+	c = memcmp(x->data, y->data, (x->key_len < y->key_len) ? x->key_len : y->key_len);
+	if (c != 0)
+	{
+		return c;
+	}
+
+	return (x->key_len > y->key_len) - (x->key_len < y->key_len);
+}
\ No newline at end of file
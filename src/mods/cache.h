@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The entry is a change that has not been written yet.
+#define CACHE_DIRTY          0x01
+// The key has never been written to the database.
+#define CACHE_FRESH          0x02
+
+typedef struct Cache *Cache;
+
+int cache_new(Cache *);
+int cache_get(const unsigned char **, size_t *, Cache, const unsigned char *, size_t);
+int cache_put(Cache, const unsigned char *, size_t, const unsigned char *, size_t, int);
+int cache_flush(Cache, int (*)(const unsigned char *, size_t, const unsigned char *, size_t, void *), void *);
+void cache_clear(Cache);
+size_t cache_memory(Cache);
+size_t cache_dirty_memory(Cache);
+void cache_free(Cache);
+
+#endif
\ No newline at end of file
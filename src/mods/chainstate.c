@@ -12,20 +12,51 @@
 #include <assert.h>
 #include "error.h"
 #include "database.h"
+#include "ldb.h"
 #include "utxokey.h"
 #include "utxovalue.h"
+#include "chainstate.h"
 
 #define CHAINSTATE_DEFAULT_PATH             ".bitcoin/chainstate"
 #define CHAINSTATE_OFUSCATE_KEY_KEY         "\016\000obfuscate_key"
 #define CHAINSTATE_OFUSCATE_KEY_KEY_LENGTH  15
+#define CHAINSTATE_COIN_PREFIX              'C'
+#define CHAINSTATE_RANGE_KEY_LENGTH         3
+#define CHAINSTATE_SAMPLE_RANGES            1024
+
+/*
+ * A range covers the coin records whose txid starts with a span of 16 bit
+ * prefixes. Txids are uniformly distributed, so equal spans hold about the
+ * same number of records and can be read in parallel.
+ */
+struct ChainstateRange {
+	DBCursor cursor;
+	LDBRange ldb_range;
+	unsigned char *value;
+	size_t value_size;
+	int advance;
+	const unsigned char *key;
+	size_t key_len;
+};
 
 static DBRef dbref = NULL;
+static LDB ldb = NULL;
 static unsigned char *obfuscate_key = NULL;
 static size_t obfuscate_key_len = 0;
+static uint64_t obfuscate_word = 0;
+
+static int chainstate_deobfuscate(unsigned char **, size_t *, const unsigned char *, size_t);
 
-int chainstate_open(char *path)
+/*
+ * With direct set, the database files are read by ldb.c rather than
+ * through LevelDB, so ranges are decoded in parallel. Only ranges are
+ * available then, and the node must not be running, since it may compact
+ * files away while they are read.
+ */
+int chainstate_open(char *path, bool direct)
 {
 	int r;
+	size_t i;
 
 	if (path == NULL)
 	{
@@ -42,10 +73,20 @@ int chainstate_open(char *path)
 		strcat(path, CHAINSTATE_DEFAULT_PATH);
 	}
 
-	r = database_open(&dbref, path, false);
-	ERROR_CHECK_NEG(r, "Could not open chainstate database.");
+	if (direct)
+	{
+		r = ldb_open(&ldb, path);
+		ERROR_CHECK_NEG(r, "Could not read chainstate database files.");
+
+		r = ldb_get(&obfuscate_key, &obfuscate_key_len, ldb, (unsigned char *)CHAINSTATE_OFUSCATE_KEY_KEY, CHAINSTATE_OFUSCATE_KEY_KEY_LENGTH);
+	}
+	else
+	{
+		r = database_open(&dbref, path, false);
+		ERROR_CHECK_NEG(r, "Could not open chainstate database.");
 
-	r = database_get(&obfuscate_key, &obfuscate_key_len, dbref, (unsigned char *)CHAINSTATE_OFUSCATE_KEY_KEY, CHAINSTATE_OFUSCATE_KEY_KEY_LENGTH);
+		r = database_get(&obfuscate_key, &obfuscate_key_len, dbref, (unsigned char *)CHAINSTATE_OFUSCATE_KEY_KEY, CHAINSTATE_OFUSCATE_KEY_KEY_LENGTH);
+	}
 	ERROR_CHECK_NEG(r, "Could not get obfuscate key from chainstate database.");
 	ERROR_CHECK_NULL(obfuscate_key, "No obfuscate key returned from chainstate database");
 
@@ -53,90 +94,325 @@ int chainstate_open(char *path)
 	obfuscate_key++;
 	obfuscate_key_len -= 1;
 
+	ERROR_CHECK_TRUE(obfuscate_key_len == 0, "Invalid obfuscate key in chainstate database.");
+
+	// The key repeated over a word, when it divides one evenly, which
+	// Core's eight byte key always does.
+	if (sizeof(uint64_t) % obfuscate_key_len == 0)
+	{
+		for (i = 0; i < sizeof(uint64_t); i++)
+		{
+			((unsigned char *)&obfuscate_word)[i] = obfuscate_key[i % obfuscate_key_len];
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * Estimates the coin count without reading the whole database. Records
+ * in a small slice of txid prefixes are counted, then scaled up by the
+ * share of the database's size that slice takes on disk. Txids are
+ * uniform, so the slice's share of the prefixes is the fallback when
+ * sizes are not available.
+ */
+int chainstate_estimate_record_count(size_t *count)
+{
+	int r;
+	size_t n = 0;
+	size_t key_len, value_len;
+	uint64_t sample_size = 0, total_size = 0;
+	const unsigned char *key, *value;
+	unsigned char start[1] = { CHAINSTATE_COIN_PREFIX };
+	unsigned char end[1] = { CHAINSTATE_COIN_PREFIX + 1 };
+	unsigned char sample_end[CHAINSTATE_RANGE_KEY_LENGTH];
+	ChainstateRange range;
+
+	assert(count);
+	assert(dbref || ldb);
+
+	r = chainstate_range_new(&range, 0, CHAINSTATE_SAMPLE_RANGES);
+	ERROR_CHECK_NEG(r, "Could not create chainstate sample range.");
+
+	while ((r = chainstate_range_get_raw(&key, &key_len, &value, &value_len, range)) > 0)
+	{
+		n++;
+	}
+
+	chainstate_range_free(range);
+
+	ERROR_CHECK_NEG(r, "Could not read chainstate sample range.");
+
+	if (dbref)
+	{
+		sample_end[0] = CHAINSTATE_COIN_PREFIX;
+		sample_end[1] = (0x10000 / CHAINSTATE_SAMPLE_RANGES) >> 8;
+		sample_end[2] = (0x10000 / CHAINSTATE_SAMPLE_RANGES) & 0xFF;
+
+		r = database_approximate_size(&sample_size, dbref, start, 1, sample_end, CHAINSTATE_RANGE_KEY_LENGTH);
+		ERROR_CHECK_NEG(r, "Could not get chainstate sample size.");
+
+		r = database_approximate_size(&total_size, dbref, start, 1, end, 1);
+		ERROR_CHECK_NEG(r, "Could not get chainstate size.");
+	}
+
+	if (sample_size > 0 && total_size >= sample_size)
+	{
+		*count = (size_t)((double)n * total_size / sample_size);
+	}
+	else
+	{
+		*count = n * CHAINSTATE_SAMPLE_RANGES;
+	}
+
 	return 1;
 }
 
-int chainstate_seek_start(void)
+int chainstate_range_new(ChainstateRange *range, int index, int count)
+{
+	return chainstate_range_new_after(range, index, count, NULL, 0);
+}
+
+// Starts the range just past a key of it, as from chainstate_range_get_key(),
+// to carry on from where an earlier pass stopped.
+int chainstate_range_new_after(ChainstateRange *range, int index, int count, unsigned char *after, size_t after_len)
 {
 	int r;
+	unsigned int prefix;
+	size_t start_len = CHAINSTATE_RANGE_KEY_LENGTH;
+	size_t end_len = CHAINSTATE_RANGE_KEY_LENGTH;
+	unsigned char start[CHAINSTATE_KEY_MAX + 1];
+	unsigned char end[CHAINSTATE_RANGE_KEY_LENGTH];
+
+	assert(dbref || ldb);
+	assert(range);
+	assert(count > 0 && count <= 0x10000);
+	assert(index >= 0 && index < count);
+
+	// Coin keys are 'C', the txid, then the output index. Txid bytes are
+	// stored in internal order, so the prefix is simply the first two.
+	prefix = (unsigned int)(((unsigned long)index << 16) / count);
+	start[0] = CHAINSTATE_COIN_PREFIX;
+	start[1] = prefix >> 8;
+	start[2] = prefix & 0xFF;
+
+	if (index + 1 < count)
+	{
+		prefix = (unsigned int)(((unsigned long)(index + 1) << 16) / count);
+		end[0] = CHAINSTATE_COIN_PREFIX;
+		end[1] = prefix >> 8;
+		end[2] = prefix & 0xFF;
+	}
+	else
+	{
+		end[0] = CHAINSTATE_COIN_PREFIX + 1;
+		end_len = 1;
+	}
+
+	// The smallest key after the given one
+	if (after)
+	{
+		ERROR_CHECK_TRUE(after_len > CHAINSTATE_KEY_MAX, "Invalid chainstate key.");
 
-	assert(dbref);
+		memcpy(start, after, after_len);
+		start[after_len] = 0;
+		start_len = after_len + 1;
+	}
 
-	r = database_iter_seek_start(dbref);
-	ERROR_CHECK_NEG(r, "Unable to seek to first record in chainstate database.");
+	*range = malloc(sizeof(struct ChainstateRange));
+	ERROR_CHECK_NULL(*range, "Memory allocation error.");
 
-	// Skip past first two records because they have specific uses.
-	database_iter_next(dbref);
-	database_iter_next(dbref);
+	(*range)->key = NULL;
+	(*range)->key_len = 0;
+	(*range)->cursor = NULL;
+	(*range)->ldb_range = NULL;
+	(*range)->value = NULL;
+	(*range)->value_size = 0;
+	(*range)->advance = 0;
+
+	if (ldb)
+	{
+		r = ldb_range_new(&((*range)->ldb_range), ldb, start, start_len, end, end_len);
+	}
+	else
+	{
+		r = database_cursor_new(&((*range)->cursor), dbref, start, start_len, end, end_len);
+	}
+	ERROR_CHECK_NEG(r, "Could not create chainstate cursor.");
 
 	return 1;
 }
 
-int chainstate_get_next(UTXOKey key, UTXOValue value)
+// Gets the next record of the range as it is stored, with the value
+// de-obfuscated. Returns zero at the end of the range. The key and value
+// belong to the range and are valid until the next call.
+int chainstate_range_get_raw(const unsigned char **key, size_t *key_len, const unsigned char **value, size_t *value_len, ChainstateRange range)
 {
 	int r;
-	size_t i;
-	size_t serialized_key_len = 0;
-	size_t serialized_value_len = 0;
-	unsigned char *serialized_key = NULL;
-	unsigned char *serialized_value = NULL;
+	const unsigned char *raw_value;
 
 	assert(key);
+	assert(key_len);
 	assert(value);
+	assert(value_len);
+	assert(range);
 
-	r = database_iter_get(&serialized_key, &serialized_key_len, &serialized_value, &serialized_value_len, dbref);
-	ERROR_CHECK_NEG(r, "Could not get data from database.");
+	// Step past the record handed out last time only now, so its key can
+	// point into the cursor until then.
+	if (range->advance)
+	{
+		if (range->ldb_range)
+		{
+			r = ldb_range_next(range->ldb_range);
+			ERROR_CHECK_NEG(r, "Could not read chainstate database files.");
+		}
+		else
+		{
+			database_cursor_next(range->cursor);
+		}
+
+		range->advance = 0;
+	}
+
+	if (range->ldb_range)
+	{
+		r = ldb_range_get(key, key_len, &raw_value, value_len, range->ldb_range);
+		ERROR_CHECK_NEG(r, "Could not read chainstate database files.");
+	}
+	else
+	{
+		r = database_cursor_get(key, key_len, &raw_value, value_len, range->cursor);
+	}
+	if (r == 0)
+	{
+		return 0;
+	}
+
+	r = chainstate_deobfuscate(&(range->value), &(range->value_size), raw_value, *value_len);
+	ERROR_CHECK_NEG(r, NULL);
+
+	*value = range->value;
+	range->advance = 1;
+	range->key = *key;
+	range->key_len = *key_len;
+
+	return 1;
+}
 
-	// De-obfuscate the value
-	for (i = 0; i < serialized_value_len; i++)
+// Returns zero at the end of the range. Decodes into the script buffer
+// value already has, as described for utxovalue_decode().
+int chainstate_range_get_next(ChainstateRange range, UTXOKey key, UTXOValue value)
+{
+	int r;
+	size_t key_len, value_len;
+	const unsigned char *raw_key, *raw_value;
+
+	assert(range);
+	assert(key);
+	assert(value);
+
+	r = chainstate_range_get_raw(&raw_key, &key_len, &raw_value, &value_len, range);
+	if (r <= 0)
 	{
-		serialized_value[i] ^= obfuscate_key[i % obfuscate_key_len];
+		return r;
 	}
 
-	r = utxokey_from_raw(key, serialized_key);
+	r = utxokey_from_raw(key, (unsigned char *)raw_key);
 	ERROR_CHECK_NEG(r, "Could not deserialize key data.");
 
-	r = utxovalue_from_raw(value, serialized_value);
+	r = utxovalue_decode(value, raw_value, value_len);
 	ERROR_CHECK_NEG(r, "Could not deserialize value data.");
 
-	free(serialized_key);
-	free(serialized_value);
+	return 1;
+}
+
+// Copies the key of the record the range returned last, which can be
+// passed to chainstate_range_new_after() later. Returns zero before the
+// first record and after the last.
+int chainstate_range_get_key(unsigned char *key, size_t *key_len, ChainstateRange range)
+{
+	assert(key);
+	assert(key_len);
+	assert(range);
 
-	r = database_iter_next(dbref);
-	ERROR_CHECK_NEG(r, "Could not set chainstate iter to next record.")
-	if (r == 0)
+	if (!range->advance)
 	{
-		// End of database
 		return 0;
 	}
 
+	ERROR_CHECK_TRUE(range->key_len > CHAINSTATE_KEY_MAX, "Invalid chainstate key.");
+
+	memcpy(key, range->key, range->key_len);
+	*key_len = range->key_len;
+
 	return 1;
 }
 
-int chainstate_get_record_count(size_t *count)
+void chainstate_range_free(ChainstateRange range)
 {
-	int r;
-	size_t c = 0;
+	assert(range);
+
+	if (range->ldb_range)
+	{
+		ldb_range_free(range->ldb_range);
+	}
+	else
+	{
+		database_cursor_free(range->cursor);
+	}
+
+	free(range->value);
+	free(range);
+}
 
-	assert(dbref);
+/*
+ * XORs a value with the obfuscate key into a buffer that grows as needed.
+ * Whole words at a time when the key repeats evenly over one. The loads
+ * and stores go through memcpy, which compiles to plain word moves that
+ * the compiler is free to vectorize.
+ */
+static int chainstate_deobfuscate(unsigned char **output, size_t *output_size, const unsigned char *input, size_t len)
+{
+	size_t i = 0;
+	uint64_t word;
 
-	r = database_iter_seek_start(dbref);
-	ERROR_CHECK_NEG(r, "Unable to seek to first record in chainstate database.");
+	if (len > *output_size || *output == NULL)
+	{
+		free(*output);
+
+		*output_size = len > BUFSIZ ? len * 2 : BUFSIZ;
+		*output = malloc(*output_size);
+		ERROR_CHECK_NULL(*output, "Memory allocation error.");
+	}
 
-	while ((r = database_iter_next(dbref)) > 0)
+	if (obfuscate_word)
 	{
-		c++;
+		for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t))
+		{
+			memcpy(&word, input + i, sizeof(uint64_t));
+			word ^= obfuscate_word;
+			memcpy(*output + i, &word, sizeof(uint64_t));
+		}
 	}
-	ERROR_CHECK_NEG(r, "Could not iterate.");
 
-	*count = c;
+	for (; i < len; i++)
+	{
+		(*output)[i] = input[i] ^ obfuscate_key[i % obfuscate_key_len];
+	}
 
 	return 1;
 }
 
 void chainstate_close(void)
 {
-	assert(dbref);
+	assert(dbref || ldb);
+
+	if (ldb)
+	{
+		ldb_close(ldb);
+		ldb = NULL;
+		return;
+	}
 
 	database_close(dbref);
 	free(dbref);
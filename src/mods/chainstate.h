@@ -8,14 +8,25 @@
 #ifndef CHAINSTATE_H
 #define CHAINSTATE_H 1
 
+#include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include "utxokey.h"
 #include "utxovalue.h"
 
-int chainstate_open(char *);
-int chainstate_seek_start(void);
-int chainstate_get_next(UTXOKey, UTXOValue);
-int chainstate_get_record_count(size_t *);
+// The type byte, the txid, and the output index as a varint
+#define CHAINSTATE_KEY_MAX 48
+
+typedef struct ChainstateRange *ChainstateRange;
+
+int chainstate_open(char *, bool);
+int chainstate_estimate_record_count(size_t *);
+int chainstate_range_new(ChainstateRange *, int, int);
+int chainstate_range_new_after(ChainstateRange *, int, int, unsigned char *, size_t);
+int chainstate_range_get_raw(const unsigned char **, size_t *, const unsigned char **, size_t *, ChainstateRange);
+int chainstate_range_get_next(ChainstateRange, UTXOKey, UTXOValue);
+int chainstate_range_get_key(unsigned char *, size_t *, ChainstateRange);
+void chainstate_range_free(ChainstateRange);
 void chainstate_close(void);
 
 #endif
\ No newline at end of file
@@ -19,6 +19,38 @@
 #include "crypto.h"
 #include "error.h"
 
+#ifndef EVP_H_MISSING
+#  include <pthread.h>
+
+/*
+ * Digest contexts are reused per thread and the legacy provider (for
+ * RIPEMD160) is loaded once, so hashing does not allocate on every call.
+ */
+static __thread EVP_MD_CTX *thread_ctx = NULL;
+
+static EVP_MD_CTX *crypto_get_ctx(void)
+{
+	if (thread_ctx == NULL)
+	{
+		thread_ctx = EVP_MD_CTX_new();
+	}
+
+	return thread_ctx;
+}
+
+#  ifndef PROVIDER_H_MISSING
+static pthread_once_t legacy_once = PTHREAD_ONCE_INIT;
+
+// Loading a provider explicitly stops the default one from loading on
+// its own, so both are loaded.
+static void crypto_load_legacy(void)
+{
+	OSSL_PROVIDER_load(NULL, "default");
+	OSSL_PROVIDER_load(NULL, "legacy");
+}
+#  endif
+#endif
+
 int crypto_get_sha256(unsigned char *output, unsigned char *input, size_t input_len)
 {
 	assert(output);
@@ -30,14 +62,12 @@ int crypto_get_sha256(unsigned char *output, unsigned char *input, size_t input_
 	SHA256_Update(&sha256, input, input_len);
 	SHA256_Final(output, &sha256);
 # else
-	EVP_MD_CTX *mdctx;
 	unsigned int output_len;
-	mdctx = EVP_MD_CTX_new();
+	EVP_MD_CTX *mdctx = crypto_get_ctx();
 	ERROR_CHECK_NULL(mdctx, "Memory allocation error.");
 	EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL);
 	EVP_DigestUpdate(mdctx, input, input_len);
 	EVP_DigestFinal_ex(mdctx, output, &output_len);
-	EVP_MD_CTX_free(mdctx);
 # endif
 	
 	return 1;
@@ -56,46 +86,140 @@ int crypto_get_rmd160(unsigned char *output, unsigned char *input, size_t input_
 	RIPEMD160_Final(output, &rmd160);
 # else
 	int r;
-	EVP_MD_CTX *mdctx;
 	unsigned int output_len;
+	EVP_MD_CTX *mdctx;
 #   ifndef PROVIDER_H_MISSING
-		OSSL_PROVIDER *prov = OSSL_PROVIDER_load(NULL, "legacy");
+		pthread_once(&legacy_once, crypto_load_legacy);
 #   endif
-	mdctx = EVP_MD_CTX_new();
+	mdctx = crypto_get_ctx();
 	ERROR_CHECK_NULL(mdctx, "Memory allocation error.");
 	r = EVP_DigestInit_ex(mdctx, EVP_ripemd160(), NULL);
 	ERROR_CHECK_FALSE(r, "Could not initialize rmd digest.");
 	EVP_DigestUpdate(mdctx, input, input_len);
 	EVP_DigestFinal_ex(mdctx, output, &output_len);
-	EVP_MD_CTX_free(mdctx);
-#   ifndef PROVIDER_H_MISSING
-		OSSL_PROVIDER_unload(prov);
-#   endif
 # endif
 
 	return 1;
 }
 
-int crypto_get_checksum(uint32_t *output, unsigned char *data, size_t len)
+/*
+ * BIP340 tagged hash: SHA256(SHA256(tag) || SHA256(tag) || input).
+ *
+ * The tag prefix is exactly one SHA256 block, so the digest state after
+ * it is computed once per tag and thread and copied for each hash.
+ */
+#define CRYPTO_TAGS_MAX    8
+
+struct crypto_midstate {
+	const char *tag;
+# ifdef EVP_H_MISSING
+	SHA256_CTX ctx;
+# else
+	EVP_MD_CTX *ctx;
+# endif
+};
+
+static __thread struct crypto_midstate midstates[CRYPTO_TAGS_MAX];
+static __thread int midstates_len = 0;
+
+static struct crypto_midstate *crypto_get_midstate(const char *tag)
 {
-	int r;
-	unsigned char *sha1, *sha2;
+	int i, r;
+	unsigned char tag_hash[32];
+	struct crypto_midstate *m;
 
-	assert(output);
-	assert(data);
+	for (i = 0; i < midstates_len; ++i)
+	{
+		if (strcmp(midstates[i].tag, tag) == 0)
+		{
+			return &midstates[i];
+		}
+	}
 
-	sha1 = malloc(32);
-	if (sha1 == NULL)
+	if (midstates_len == CRYPTO_TAGS_MAX)
 	{
-		error_log("Memory allocation error.");
-		return -1;
+		error_log("Too many hash tags.");
+		return NULL;
 	}
-	sha2 = malloc(32);
-	if (sha2 == NULL)
+
+	r = crypto_get_sha256(tag_hash, (unsigned char *)tag, strlen(tag));
+	if (r < 0)
+	{
+		error_log("Could not generate SHA256 hash for tag.");
+		return NULL;
+	}
+
+	m = &midstates[midstates_len];
+
+# ifdef EVP_H_MISSING
+	SHA256_Init(&m->ctx);
+	SHA256_Update(&m->ctx, tag_hash, 32);
+	SHA256_Update(&m->ctx, tag_hash, 32);
+# else
+	m->ctx = EVP_MD_CTX_new();
+	if (m->ctx == NULL)
 	{
 		error_log("Memory allocation error.");
-		return -1;
+		return NULL;
 	}
+	EVP_DigestInit_ex(m->ctx, EVP_sha256(), NULL);
+	EVP_DigestUpdate(m->ctx, tag_hash, 32);
+	EVP_DigestUpdate(m->ctx, tag_hash, 32);
+# endif
+
+	// Tags are string literals of the callers.
+	m->tag = tag;
+	midstates_len++;
+
+	return m;
+}
+
+/*
+ * Hashes count inputs of input_len bytes each, stored back to back, into
+ * count 32 byte outputs.
+ */
+int crypto_get_tagged_hash_batch(unsigned char *output, const char *tag, unsigned char *input, size_t input_len, size_t count)
+{
+	size_t i;
+	struct crypto_midstate *m;
+
+	assert(output);
+	assert(tag);
+	assert(input);
+
+	m = crypto_get_midstate(tag);
+	ERROR_CHECK_NULL(m, "Could not get tagged hash state.");
+
+# ifdef EVP_H_MISSING
+	SHA256_CTX sha256;
+	for (i = 0; i < count; ++i)
+	{
+		sha256 = m->ctx;
+		SHA256_Update(&sha256, input + (i * input_len), input_len);
+		SHA256_Final(output + (i * 32), &sha256);
+	}
+# else
+	unsigned int output_len;
+	EVP_MD_CTX *mdctx = crypto_get_ctx();
+	ERROR_CHECK_NULL(mdctx, "Memory allocation error.");
+	for (i = 0; i < count; ++i)
+	{
+		EVP_MD_CTX_copy_ex(mdctx, m->ctx);
+		EVP_DigestUpdate(mdctx, input + (i * input_len), input_len);
+		EVP_DigestFinal_ex(mdctx, output + (i * 32), &output_len);
+	}
+# endif
+
+	return 1;
+}
+
+int crypto_get_checksum(uint32_t *output, unsigned char *data, size_t len)
+{
+	int r;
+	unsigned char sha1[32], sha2[32];
+
+	assert(output);
+	assert(data);
 
 	r = crypto_get_sha256(sha1, data, len);
 	if (r < 0)
@@ -119,8 +243,5 @@ int crypto_get_checksum(uint32_t *output, unsigned char *data, size_t len)
 	*output <<= 8;
 	*output += sha2[3];
 	
-	free(sha1);
-	free(sha2);
-	
 	return 1;
 }
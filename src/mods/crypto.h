@@ -8,10 +8,12 @@
 #ifndef CRYPTO_H
 #define CRYPTO_H 1
 
+#include <stddef.h>
 #include <stdint.h>
 
 int crypto_get_sha256(unsigned char *, unsigned char *, size_t);
 int crypto_get_rmd160(unsigned char *, unsigned char *, size_t);
+int crypto_get_tagged_hash_batch(unsigned char *, const char *, unsigned char *, size_t, size_t);
 int crypto_get_checksum(uint32_t *, unsigned char *, size_t);
 
 #endif
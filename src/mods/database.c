@@ -24,6 +24,17 @@ struct DBRef {
 	leveldb_readoptions_t *roptions;
 };
 
+/*
+ * A cursor walks the keys in [start, end) with its own iterator, so
+ * several cursors over one database can be read from different threads.
+ */
+struct DBCursor {
+	leveldb_iterator_t *db_iter;
+	leveldb_readoptions_t *roptions;
+	unsigned char *end;
+	size_t end_len;
+};
+
 int database_open(DBRef *ref, char *location, bool create)
 {
 	char *err = NULL;
@@ -277,4 +288,117 @@ void database_close(DBRef ref)
 	leveldb_writebatch_destroy(ref->batch);
 	leveldb_readoptions_destroy(ref->roptions);
 	leveldb_close(ref->db);
+}
+
+// The approximate bytes on disk of the keys from start up to end. Data
+// not yet flushed from the log is not included.
+int database_approximate_size(uint64_t *size, DBRef ref, unsigned char *start, size_t start_len, unsigned char *end, size_t end_len)
+{
+	const char *start_key[1], *end_key[1];
+	size_t start_key_len[1], end_key_len[1];
+
+	assert(size);
+	assert(ref);
+	assert(start);
+	assert(end);
+
+	start_key[0] = (char *)start;
+	start_key_len[0] = start_len;
+	end_key[0] = (char *)end;
+	end_key_len[0] = end_len;
+
+	leveldb_approximate_sizes(ref->db, 1, start_key, start_key_len, end_key, end_key_len, size);
+
+	return 1;
+}
+
+int database_cursor_new(DBCursor *cursor, DBRef ref, unsigned char *start, size_t start_len, unsigned char *end, size_t end_len)
+{
+	assert(cursor);
+	assert(ref);
+
+	*cursor = malloc(sizeof(struct DBCursor) + end_len);
+	ERROR_CHECK_NULL(*cursor, "Memory allocation error.");
+
+	(*cursor)->end = NULL;
+	(*cursor)->end_len = end_len;
+	if (end)
+	{
+		(*cursor)->end = (unsigned char *)(*cursor) + sizeof(struct DBCursor);
+		memcpy((*cursor)->end, end, end_len);
+	}
+
+	// A full scan would otherwise push every block through the block
+	// cache and evict whatever the other readers need.
+	(*cursor)->roptions = leveldb_readoptions_create();
+	leveldb_readoptions_set_fill_cache((*cursor)->roptions, 0);
+
+	(*cursor)->db_iter = leveldb_create_iterator(ref->db, (*cursor)->roptions);
+
+	if (start)
+	{
+		leveldb_iter_seek((*cursor)->db_iter, (char *)start, start_len);
+	}
+	else
+	{
+		leveldb_iter_seek_to_first((*cursor)->db_iter);
+	}
+
+	return 1;
+}
+
+// Points key and value at the current record. They stay valid until the
+// cursor moves. Returns zero once the cursor is past the end of its range.
+int database_cursor_get(const unsigned char **key, size_t *key_len, const unsigned char **value, size_t *value_len, DBCursor cursor)
+{
+	int c;
+	size_t len;
+
+	assert(cursor);
+
+	if (!leveldb_iter_valid(cursor->db_iter))
+	{
+		return 0;
+	}
+
+	*key = (const unsigned char *)leveldb_iter_key(cursor->db_iter, key_len);
+
+	if (cursor->end)
+	{
+		// Same ordering as the default bytewise comparator.
+		len = (*key_len < cursor->end_len) ? *key_len : cursor->end_len;
+		c = memcmp(*key, cursor->end, len);
+		if (c > 0 || (c == 0 && *key_len >= cursor->end_len))
+		{
+			return 0;
+		}
+	}
+
+	*value = (const unsigned char *)leveldb_iter_value(cursor->db_iter, value_len);
+
+	return 1;
+}
+
+int database_cursor_next(DBCursor cursor)
+{
+	assert(cursor);
+
+	if (!leveldb_iter_valid(cursor->db_iter))
+	{
+		return 0;
+	}
+
+	leveldb_iter_next(cursor->db_iter);
+
+	return 1;
+}
+
+void database_cursor_free(DBCursor cursor)
+{
+	assert(cursor);
+
+	leveldb_iter_destroy(cursor->db_iter);
+	leveldb_readoptions_destroy(cursor->roptions);
+
+	free(cursor);
 }
\ No newline at end of file
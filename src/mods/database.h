@@ -8,9 +8,12 @@
 #ifndef DATABASE_H
 #define DATABASE_H 1
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 typedef struct DBRef *DBRef;
+typedef struct DBCursor *DBCursor;
 
 int database_open(DBRef *, char *, bool);
 int database_is_open(DBRef);
@@ -23,10 +26,16 @@ int database_iter_reset(DBRef);
 int database_get(unsigned char **, size_t *, DBRef, unsigned char *, size_t);
 int database_put(DBRef, unsigned char *, size_t, unsigned char *, size_t);
 int database_delete(DBRef, unsigned char *, size_t);
+int database_approximate_size(uint64_t *, DBRef, unsigned char *, size_t, unsigned char *, size_t);
 void database_close(DBRef);
 
 int database_batch_put(DBRef, unsigned char *, size_t, unsigned char *, size_t);
 int database_batch_delete(DBRef, unsigned char *, size_t);
 int database_batch_write(DBRef);
 
+int database_cursor_new(DBCursor *, DBRef, unsigned char *, size_t, unsigned char *, size_t);
+int database_cursor_get(const unsigned char **, size_t *, const unsigned char **, size_t *, DBCursor);
+int database_cursor_next(DBCursor);
+void database_cursor_free(DBCursor);
+
 #endif
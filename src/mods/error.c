@@ -8,17 +8,23 @@
 #include <stdio.h>
 #include <stddef.h>
 #include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+#include "error.h"
 
-#define ERROR_LIST_MAX		20
-#define ERROR_LENGTH_MAX	200
-
-static char error_stack[ERROR_LIST_MAX][ERROR_LENGTH_MAX];
-static int N = 0;
+static __thread char error_stack[ERROR_LIST_MAX][ERROR_LENGTH_MAX];
+static __thread int N = 0;
 
 void error_log(char *error, ...)
 {
 	va_list argList;
 
+	// A NULL message passes an error up without adding to the stack.
+	if (error == NULL)
+	{
+		return;
+	}
+
 	if (N < ERROR_LIST_MAX)
 	{
 		va_start(argList, error);
@@ -53,4 +59,26 @@ char *error_get(void)
 void error_clear(void)
 {
 	N = 0;
-}
\ No newline at end of file
+}
+
+void error_save(ErrorStack saved)
+{
+	assert(saved);
+
+	memcpy(saved->stack, error_stack, sizeof(error_stack));
+	saved->n = N;
+
+	N = 0;
+}
+
+void error_restore(ErrorStack saved)
+{
+	int i;
+
+	assert(saved);
+
+	for (i = 0; i < saved->n && N < ERROR_LIST_MAX; i++)
+	{
+		memcpy(error_stack[N++], saved->stack[i], ERROR_LENGTH_MAX);
+	}
+}
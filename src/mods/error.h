@@ -8,6 +8,9 @@
 #ifndef ERROR_H
 #define ERROR_H 1
 
+#define ERROR_LIST_MAX		20
+#define ERROR_LENGTH_MAX	200
+
 #define ERROR_CHECK_NEG(x, y)            if (x < 0) { error_log(y); return -1; }
 #define ERROR_CHECK_NULL(x, y)           if (x == NULL) { error_log(y); return -1; }
 #define ERROR_CHECK_FALSE(x, y)          if (!x) { error_log(y); return -1; }
@@ -17,9 +20,19 @@
 #define ERROR_THREAD_CHECK_NEG(x, y)     if (x < 0) { error_log(y); r = -1; return &r; }
 #define ERROR_THREAD_CHECK_NULL(x, y)    if (x == NULL) { error_log(y); r = -1; return &r; }
 
+// Each thread logs to its own error stack. A stack can be saved on one
+// thread and restored on another to report errors from worker threads.
+typedef struct ErrorStack *ErrorStack;
+struct ErrorStack {
+	char stack[ERROR_LIST_MAX][ERROR_LENGTH_MAX];
+	int n;
+};
+
 void error_log(char *, ...);
 void error_print(void);
 char *error_get(void);
 void error_clear(void);
+void error_save(ErrorStack);
+void error_restore(ErrorStack);
 
-#endif
\ No newline at end of file
+#endif
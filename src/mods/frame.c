@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "frame.h"
+#include "error.h"
+
+int frame_encode(unsigned char *frame, int type, unsigned char *payload, size_t payload_len)
+{
+	assert(frame);
+	assert(payload);
+
+	ERROR_CHECK_FALSE(frame_type_valid(type), "Invalid frame type.");
+	ERROR_CHECK_TRUE(payload_len > FRAME_PAYLOAD_MAX, "Frame payload too large.");
+
+	frame[0] = (unsigned char)type;
+	frame[1] = (unsigned char)(payload_len >> 8);
+	frame[2] = (unsigned char)(payload_len & 0xFF);
+
+	memcpy(frame + FRAME_HEADER_LENGTH, payload, payload_len);
+
+	return FRAME_HEADER_LENGTH + payload_len;
+}
+
+int frame_decode(int *type, unsigned char **payload, size_t *payload_len, unsigned char *frame, size_t frame_len)
+{
+	assert(type);
+	assert(payload);
+	assert(payload_len);
+	assert(frame);
+
+	ERROR_CHECK_TRUE(frame_len < FRAME_HEADER_LENGTH, "Frame is too short.");
+
+	*type = frame[0];
+	*payload_len = ((size_t)frame[1] << 8) | frame[2];
+	*payload = frame + FRAME_HEADER_LENGTH;
+
+	ERROR_CHECK_FALSE(frame_type_valid(*type), "Invalid frame type.");
+	ERROR_CHECK_TRUE(frame_len != FRAME_HEADER_LENGTH + *payload_len, "Frame length does not match its payload.");
+
+	return 1;
+}
+
+int frame_type_valid(int type)
+{
+	switch (type)
+	{
+		case FRAME_TYPE_PRIVKEY:
+		case FRAME_TYPE_PUBKEY:
+		case FRAME_TYPE_HASH160:
+		case FRAME_TYPE_STRING:
+			return 1;
+	}
+
+	return 0;
+}
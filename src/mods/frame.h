@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#ifndef FRAME_H
+#define FRAME_H 1
+
+#include <stddef.h>
+
+/*
+ * A frames stream starts with FRAME_MAGIC, followed by records made of a
+ * one byte type, a two byte big endian payload length and the payload.
+ * The magic may appear again between records, so streams can be
+ * concatenated.
+ */
+#define FRAME_MAGIC                 "\xF0" "BTK"
+#define FRAME_MAGIC_LENGTH          4
+#define FRAME_HEADER_LENGTH         3
+#define FRAME_PAYLOAD_MAX           65535
+
+#define FRAME_TYPE_PRIVKEY          0x01    // 32 byte key + compression flag
+#define FRAME_TYPE_PUBKEY           0x02    // 33 or 65 byte public key
+#define FRAME_TYPE_HASH160          0x03    // 20 byte RMD160(SHA256(pubkey))
+#define FRAME_TYPE_STRING           0x04    // Text, e.g. an address
+
+int frame_encode(unsigned char *, int, unsigned char *, size_t);
+int frame_decode(int *, unsigned char **, size_t *, unsigned char *, size_t);
+int frame_type_valid(int);
+
+#endif
@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <regex.h>
+#include <assert.h>
+#include "grep.h"
+#include "error.h"
+
+#define GREP_LITERAL_MAX    256
+
+/*
+ * Patterns are case-insensitive POSIX basic regular expressions. The usual
+ * vanity and triage filters, a plain string optionally anchored with ^
+ * and/or $, are matched by comparing case-folded bytes directly. Anything
+ * else goes to regexec().
+ */
+enum grep_type {
+	GREP_TYPE_REGEX,
+	GREP_TYPE_SUBSTRING,
+	GREP_TYPE_PREFIX,
+	GREP_TYPE_SUFFIX,
+	GREP_TYPE_EXACT
+};
+
+struct grep_pattern {
+	enum grep_type type;
+	regex_t regex;
+	size_t literal_len;
+	unsigned char literal[GREP_LITERAL_MAX];
+};
+
+static unsigned char fold[256];
+
+static int grep_parse_literal(grep_pattern, const char *);
+static int grep_compare(const unsigned char *, const unsigned char *, size_t);
+
+int grep_new(grep_pattern *grep, const char *pattern)
+{
+	int r, i;
+
+	assert(grep);
+	assert(pattern);
+
+	*grep = malloc(sizeof(**grep));
+	ERROR_CHECK_NULL(*grep, "Memory allocation error.");
+
+	// Same folding as REG_ICASE in the C locale
+	for (i = 0; i < 256; ++i)
+	{
+		fold[i] = (i >= 'A' && i <= 'Z') ? i + ('a' - 'A') : i;
+	}
+
+	if (grep_parse_literal(*grep, pattern))
+	{
+		return 1;
+	}
+
+	(*grep)->type = GREP_TYPE_REGEX;
+
+	r = regcomp(&((*grep)->regex), pattern, REG_ICASE|REG_NOSUB);
+	if (r != 0)
+	{
+		free(*grep);
+		*grep = NULL;
+		error_log("Could not compile regex for grep option.");
+		return -1;
+	}
+
+	return 1;
+}
+
+int grep_match(grep_pattern grep, const char *str)
+{
+	size_t i, len;
+	const unsigned char *s = (const unsigned char *)str;
+
+	assert(grep);
+	assert(str);
+
+	switch (grep->type)
+	{
+		case GREP_TYPE_PREFIX:
+			return strnlen(str, grep->literal_len) == grep->literal_len && grep_compare(s, grep->literal, grep->literal_len);
+		case GREP_TYPE_SUFFIX:
+			len = strlen(str);
+			return len >= grep->literal_len && grep_compare(s + len - grep->literal_len, grep->literal, grep->literal_len);
+		case GREP_TYPE_EXACT:
+			len = strlen(str);
+			return len == grep->literal_len && grep_compare(s, grep->literal, len);
+		case GREP_TYPE_SUBSTRING:
+			len = strlen(str);
+			if (len < grep->literal_len)
+			{
+				return 0;
+			}
+			for (i = 0; i <= len - grep->literal_len; ++i)
+			{
+				if (fold[s[i]] == grep->literal[0] && grep_compare(s + i, grep->literal, grep->literal_len))
+				{
+					return 1;
+				}
+			}
+			return 0;
+		default:
+			return regexec(&(grep->regex), str, 0, NULL, 0) != REG_NOMATCH;
+	}
+}
+
+void grep_free(grep_pattern grep)
+{
+	if (grep == NULL)
+	{
+		return;
+	}
+
+	if (grep->type == GREP_TYPE_REGEX)
+	{
+		regfree(&(grep->regex));
+	}
+
+	free(grep);
+}
+
+/*
+ * Returns 1 and sets up a literal match if the pattern is a plain string
+ * with optional ^ and $ anchors. Escaped special characters count as
+ * plain characters.
+ */
+static int grep_parse_literal(grep_pattern grep, const char *pattern)
+{
+	int prefix = 0, suffix = 0;
+	size_t len = 0;
+	const unsigned char *p = (const unsigned char *)pattern;
+
+	if (*p == '^')
+	{
+		prefix = 1;
+		p++;
+	}
+
+	while (*p)
+	{
+		if (*p == '$' && *(p + 1) == '\0')
+		{
+			suffix = 1;
+			break;
+		}
+
+		if (*p == '\\')
+		{
+			p++;
+			if (*p == '\0' || !strchr(".[]*^$\\", *p))
+			{
+				return 0;
+			}
+		}
+		else if (strchr(".[*^$", *p) || *p >= 0x80)
+		{
+			return 0;
+		}
+
+		if (len == GREP_LITERAL_MAX)
+		{
+			return 0;
+		}
+
+		grep->literal[len++] = fold[*p];
+		p++;
+	}
+
+	// An empty pattern matches everything, which regexec handles.
+	if (len == 0)
+	{
+		return 0;
+	}
+
+	grep->literal_len = len;
+
+	if (prefix && suffix)
+	{
+		grep->type = GREP_TYPE_EXACT;
+	}
+	else if (prefix)
+	{
+		grep->type = GREP_TYPE_PREFIX;
+	}
+	else if (suffix)
+	{
+		grep->type = GREP_TYPE_SUFFIX;
+	}
+	else
+	{
+		grep->type = GREP_TYPE_SUBSTRING;
+	}
+
+	return 1;
+}
+
+// literal is already folded.
+static int grep_compare(const unsigned char *s, const unsigned char *literal, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; ++i)
+	{
+		if (fold[s[i]] != literal[i])
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
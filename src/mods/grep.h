@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#ifndef GREP_H
+#define GREP_H 1
+
+typedef struct grep_pattern *grep_pattern;
+
+int grep_new(grep_pattern *, const char *);
+int grep_match(grep_pattern, const char *);
+void grep_free(grep_pattern);
+
+#endif
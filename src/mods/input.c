@@ -12,14 +12,46 @@
 #include <string.h>
 #include <limits.h>
 #include <errno.h>
+#include <assert.h>
 #include "mods/input.h"
+#include "mods/frame.h"
 #include "mods/error.h"
-#include "mods/json.h"
-#include "mods/cJSON/cJSON.h"
+
+#define INPUT_BUFFER_SIZE   65536
+#define INPUT_JSON_DEPTH    100
+#define INPUT_ERROR         -2
+
+struct input_json_level {
+	char *key;
+	size_t key_len;
+	int is_array;
+	int count;
+};
 
 static unsigned char *pre_buffer = NULL;
 static size_t pre_buffer_len = 0;
 
+// Buffered stdin for list and JSON input.
+static unsigned char read_buffer[INPUT_BUFFER_SIZE];
+static size_t read_pos = 0;
+static size_t read_len = 0;
+
+// JSON tokenizer state, kept between calls to input_get_json().
+static struct input_json_level json_stack[INPUT_JSON_DEPTH];
+static int json_depth = 0;
+static unsigned char *json_token = NULL;
+static size_t json_token_max = 0;
+
+static int input_getc(void);
+static void input_ungetc(void);
+static int input_json_skip_space(void);
+static int input_json_push(char *, size_t, int);
+static int input_json_token_put(size_t *, unsigned char);
+static int input_json_hex4(unsigned int *);
+static int input_json_string(size_t *);
+static int input_json_literal(const char *);
+static int input_json_scalar(size_t *, int);
+
 int input_get(input_item *input)
 {
 	ssize_t r;
@@ -80,58 +112,39 @@ int input_get(input_item *input)
 
 int input_get_line(input_item *input)
 {
-	ssize_t r;
+	int c;
 	size_t i = 0;
-	char c;
 	unsigned char *buffer;
 
 	buffer = malloc(BUFSIZ);
 	ERROR_CHECK_NULL(buffer, "Memory allocation error.");
 
-	memset(buffer, 0, BUFSIZ);
-
-	if (pre_buffer)
-	{
-		// We assume pre buffer contains a full line.
-		if (pre_buffer[pre_buffer_len - 1] == '\n')
-		{
-			pre_buffer_len--;
-		}
-
-		(*input) = input_new_item(pre_buffer, pre_buffer_len);
-		ERROR_CHECK_NULL((*input), "Could not create new input item.");
-
-		free(pre_buffer);
-		pre_buffer = NULL;
-
-		return 1;
-	}
-
-	while ((r = read(STDIN_FILENO, &c, 1)) > 0)
+	while ((c = input_getc()) >= 0)
 	{
 		if (c == '\n')
 		{
 			break;
 		}
 
-		*(buffer + i) = c;
-		i++;
+		buffer[i++] = c;
 
 		if (i == BUFSIZ)
 		{
+			free(buffer);
 			error_log("Did not find a new line before buffer filled.");
 			return -1;
 		}
 	}
 
-	if (r < 0)
+	if (c == INPUT_ERROR)
 	{
-		error_log("Input read error. Errno: %i", errno);
+		free(buffer);
 		return -1;
 	}
 
-	if (r == 0 && i == 0)
+	if (c == EOF && i == 0)
 	{
+		free(buffer);
 		return 0;
 	}
 
@@ -143,79 +156,164 @@ int input_get_line(input_item *input)
 	return 1;
 }
 
+/*
+ * Returns the next element of a JSON array in the input stream as soon as
+ * it has been read, without reading the rest of the document. The keys of
+ * the objects enclosing the array are chained on the item's input list,
+ * innermost key first. Returns INPUT_JSON_END when a top level array or
+ * object is closed, and 0 at end of input.
+ */
 int input_get_json(input_item *input)
 {
-	ssize_t r;
-	static char *buffer = NULL;
-	static int buffer_len = 0;
-	int buffer_max = BUFSIZ;
-	int json_len = 0;
-	const char *parse_end;
-	cJSON *jobj;
-
-	if (buffer == NULL)
+	int r, c;
+	size_t len;
+	input_item tmp;
+	struct input_json_level *level;
+
+	while (1)
 	{
-		buffer = malloc(buffer_max + 1);
-		ERROR_CHECK_NULL(buffer, "Memory allocation error.");
+		c = input_json_skip_space();
+		ERROR_CHECK_TRUE(c == INPUT_ERROR, NULL);
 
-		memset(buffer, 0, buffer_max + 1);
+		if (json_depth == 0)
+		{
+			if (c == EOF)
+			{
+				return 0;
+			}
 
-		if (pre_buffer)
+			ERROR_CHECK_TRUE((c != '[' && c != '{'), "Input JSON must be in array format.");
+
+			r = input_json_push(NULL, 0, (c == '['));
+			ERROR_CHECK_NEG(r, NULL);
+
+			continue;
+		}
+
+		ERROR_CHECK_TRUE(c == EOF, "Invalid JSON. Unexpected end of input.");
+
+		level = &(json_stack[json_depth - 1]);
+
+		if (c == ((level->is_array) ? ']' : '}'))
 		{
-			memcpy(buffer, pre_buffer, pre_buffer_len);
-			buffer_len = pre_buffer_len;
+			free(level->key);
+			json_depth--;
 
-			free(pre_buffer);
-			pre_buffer = NULL;
+			if (json_depth == 0)
+			{
+				return INPUT_JSON_END;
+			}
+
+			continue;
 		}
-	}
 
-	r = read(STDIN_FILENO, buffer + buffer_len, buffer_max - buffer_len);
-	if (r < 0)
-	{
-		error_log("Input read error. Errno: %i", errno);
-		return -1;
-	}
+		if (level->count > 0)
+		{
+			ERROR_CHECK_TRUE(c != ',', "Invalid JSON. Expected ','.");
 
-	if (buffer_len == 0 && r == 0)
-	{
-		free(buffer);
-		buffer = NULL;
+			c = input_json_skip_space();
+			ERROR_CHECK_TRUE(c == INPUT_ERROR, NULL);
+		}
 
-		return 0;
-	}
+		level->count++;
 
-	jobj = cJSON_ParseWithLengthOpts(buffer, buffer_max, &parse_end, 0);
-	if (jobj == NULL)
-	{
-		error_log("Invalid JSON.");
-		return -1;
+		if (level->is_array)
+		{
+			r = input_json_scalar(&len, c);
+			ERROR_CHECK_NEG(r, "Could not convert input item to string.");
+
+			(*input) = input_new_item(json_token, len);
+			ERROR_CHECK_NULL((*input), "Could not create new input item.");
+
+			// Chain the keys of the enclosing objects, innermost first.
+			tmp = (*input);
+			for (r = json_depth - 1; r >= 0; r--)
+			{
+				if (json_stack[r].key)
+				{
+					tmp->input = input_new_item((unsigned char *)json_stack[r].key, json_stack[r].key_len);
+					ERROR_CHECK_NULL(tmp->input, "Could not create new input item.");
+
+					tmp = tmp->input;
+				}
+			}
+
+			return 1;
+		}
+
+		ERROR_CHECK_TRUE(c != '"', "Invalid JSON. Expected object key.");
+
+		r = input_json_string(&len);
+		ERROR_CHECK_NEG(r, NULL);
+
+		c = input_json_skip_space();
+		ERROR_CHECK_TRUE(c != ':', "Invalid JSON. Expected ':'.");
+
+		c = input_json_skip_space();
+		ERROR_CHECK_TRUE((c != '[' && c != '{'), "JSON is not an arry or an object.");
+
+		r = input_json_push((char *)json_token, len, (c == '['));
+		ERROR_CHECK_NEG(r, NULL);
 	}
+}
+
+/*
+ * Reads the next record of a frames stream. The input item holds the whole
+ * record, header included, so it can be handed to frame_decode().
+ */
+int input_get_frame(input_item *input)
+{
+	int c, i;
+	size_t len;
+	unsigned char frame[FRAME_HEADER_LENGTH + FRAME_PAYLOAD_MAX];
 
-	if (!cJSON_IsArray(jobj) && !cJSON_IsObject(jobj))
+	while (1)
 	{
-		error_log("Input JSON must be in array format.");
-		return -1;
+		c = input_getc();
+		ERROR_CHECK_TRUE(c == INPUT_ERROR, NULL);
+
+		if (c == EOF)
+		{
+			return 0;
+		}
+
+		// Skip the stream magic, which may repeat in concatenated streams.
+		if (c == (unsigned char)FRAME_MAGIC[0])
+		{
+			for (i = 1; i < FRAME_MAGIC_LENGTH; i++)
+			{
+				ERROR_CHECK_TRUE(input_getc() != (unsigned char)FRAME_MAGIC[i], "Invalid frame stream header.");
+			}
+
+			continue;
+		}
+
+		break;
 	}
 
-	// Advance parse_end past any white spaces
-	while (isspace(*parse_end))
+	ERROR_CHECK_FALSE(frame_type_valid(c), "Invalid frame type.");
+
+	frame[0] = c;
+	for (i = 1; i < FRAME_HEADER_LENGTH; i++)
 	{
-		parse_end++;
-	}
+		c = input_getc();
+		ERROR_CHECK_TRUE(c < 0, "Incomplete frame header.");
 
-	json_len = parse_end - buffer;
+		frame[i] = c;
+	}
 
-	// shift remaining buffer back to start of pointer
-	memcpy(buffer, buffer + json_len, buffer_max - json_len);
-	memset(buffer + (buffer_max - json_len), 0, json_len);
+	len = ((size_t)frame[1] << 8) | frame[2];
 
-	buffer_len = strlen(buffer);
+	for (i = 0; (size_t)i < len; i++)
+	{
+		c = input_getc();
+		ERROR_CHECK_TRUE(c < 0, "Incomplete frame payload.");
 
-	r = input_parse_from_json(input, jobj);
-	ERROR_CHECK_NEG(r, "Could not parse json input object.");
+		frame[FRAME_HEADER_LENGTH + i] = c;
+	}
 
-	json_free(jobj);
+	(*input) = input_new_item(frame, FRAME_HEADER_LENGTH + len);
+	ERROR_CHECK_NULL((*input), "Could not create new input item.");
 
 	return 1;
 }
@@ -236,6 +334,24 @@ int input_get_format(void)
 		pre_buffer[pre_buffer_len] = c;
 		pre_buffer_len++;
 
+		if (pre_buffer_len == 1 && c == (unsigned char)FRAME_MAGIC[0])
+		{
+			while (pre_buffer_len < FRAME_MAGIC_LENGTH && (r = read(STDIN_FILENO, &c, 1)) > 0)
+			{
+				pre_buffer[pre_buffer_len++] = c;
+			}
+
+			if (pre_buffer_len == FRAME_MAGIC_LENGTH && memcmp(pre_buffer, FRAME_MAGIC, FRAME_MAGIC_LENGTH) == 0)
+			{
+				format = INPUT_FORMAT_FRAMES;
+			}
+			else
+			{
+				format = INPUT_FORMAT_BINARY;
+			}
+			break;
+		}
+
 		if (c <= 6 || (c >= 14 && c <= 31) || c >= 126)
 		{
 			format = INPUT_FORMAT_BINARY;
@@ -268,95 +384,273 @@ int input_get_format(void)
 	return format;
 }
 
-int input_parse_from_json(input_item *input, cJSON *jobj)
+static int input_getc(void)
 {
-	int r;
-	static int i = 0;
-	static char *(input_list[100]);
+	ssize_t r;
 
-	if (cJSON_IsArray(jobj))
+	if (read_pos == read_len)
 	{
-		int j = 0;
-		cJSON *item;
+		// Bytes consumed by input_get_format() come first.
+		if (pre_buffer)
+		{
+			memcpy(read_buffer, pre_buffer, pre_buffer_len);
+			read_len = pre_buffer_len;
 
-		if (jobj->string)
+			free(pre_buffer);
+			pre_buffer = NULL;
+		}
+		else
 		{
-			input_list[i++] = jobj->string;
+			do
+			{
+				r = read(STDIN_FILENO, read_buffer, INPUT_BUFFER_SIZE);
+			}
+			while (r < 0 && errno == EINTR);
+
+			if (r < 0)
+			{
+				error_log("Input read error. Errno: %i", errno);
+				return INPUT_ERROR;
+			}
+
+			read_len = r;
 		}
 
-		while ((item = cJSON_GetArrayItem(jobj, j++)) != NULL)
+		read_pos = 0;
+
+		if (read_len == 0)
 		{
-			char string[BUFSIZ];
-			input_item new = NULL;
-			input_item tmp;
-			input_item tmp_head;
+			return EOF;
+		}
+	}
 
-			tmp_head = NULL;
-			tmp = NULL;
+	return read_buffer[read_pos++];
+}
 
-			memset(string, 0, BUFSIZ);
+static void input_ungetc(void)
+{
+	assert(read_pos > 0);
 
-			r = json_input_to_string(string, item);
-			ERROR_CHECK_NEG(r, "Could not convert input item to string.");
+	read_pos--;
+}
 
-			new = input_new_item((unsigned char *)string, strlen(string));
-			ERROR_CHECK_NULL(new, "Could not create new input item.");
+static int input_json_skip_space(void)
+{
+	int c;
 
-			for (int k = i - 1; k >= 0; k--)
-			{
-				if (tmp == NULL)
-				{
-					tmp = input_new_item((unsigned char *)input_list[k], strlen(input_list[k]));
-					ERROR_CHECK_NULL(tmp, "Could not create new input item.");
+	while ((c = input_getc()) >= 0 && isspace(c))
+		;
 
-					tmp_head = tmp;
-				}
-				else
-				{
-					tmp->input = input_new_item((unsigned char *)input_list[k], strlen(input_list[k]));
-					ERROR_CHECK_NULL(tmp->input, "Could not create new input item.");
+	return c;
+}
 
-					tmp = tmp->input;
-				}
-			}
-			new->input = tmp_head;
+static int input_json_push(char *key, size_t key_len, int is_array)
+{
+	ERROR_CHECK_TRUE(json_depth == INPUT_JSON_DEPTH, "JSON input is nested too deeply.");
 
-			(*input) = input_append_item((*input), new);
-		}
+	json_stack[json_depth].key = NULL;
+	json_stack[json_depth].key_len = key_len;
+	json_stack[json_depth].is_array = is_array;
+	json_stack[json_depth].count = 0;
+
+	if (key)
+	{
+		json_stack[json_depth].key = malloc(key_len + 1);
+		ERROR_CHECK_NULL(json_stack[json_depth].key, "Memory allocation error.");
+
+		memcpy(json_stack[json_depth].key, key, key_len);
+		json_stack[json_depth].key[key_len] = '\0';
+	}
+
+	json_depth++;
 
-		if (jobj->string)
+	return 1;
+}
+
+static int input_json_token_put(size_t *len, unsigned char c)
+{
+	if (*len == json_token_max)
+	{
+		json_token_max = (json_token_max) ? json_token_max * 2 : BUFSIZ;
+
+		json_token = realloc(json_token, json_token_max);
+		ERROR_CHECK_NULL(json_token, "Memory allocation error.");
+	}
+
+	json_token[(*len)++] = c;
+
+	return 1;
+}
+
+static int input_json_hex4(unsigned int *value)
+{
+	int c, i;
+
+	*value = 0;
+
+	for (i = 0; i < 4; i++)
+	{
+		c = input_getc();
+		ERROR_CHECK_FALSE((c >= 0 && isxdigit(c)), "Invalid JSON. Bad unicode escape.");
+
+		*value = (*value << 4) | ((c <= '9') ? c - '0' : (tolower(c) - 'a') + 10);
+	}
+
+	return 1;
+}
+
+// Reads a string, after its opening quote, into json_token.
+static int input_json_string(size_t *len)
+{
+	int r, c;
+	unsigned int cp, low;
+
+	*len = 0;
+
+	while ((c = input_getc()) != '"')
+	{
+		ERROR_CHECK_TRUE(c < 0, "Invalid JSON. Unterminated string.");
+
+		if (c == '\\')
 		{
-			i--;
+			c = input_getc();
+			switch (c)
+			{
+				case '"':
+				case '\\':
+				case '/':
+					break;
+				case 'b': c = '\b'; break;
+				case 'f': c = '\f'; break;
+				case 'n': c = '\n'; break;
+				case 'r': c = '\r'; break;
+				case 't': c = '\t'; break;
+				case 'u':
+					r = input_json_hex4(&cp);
+					ERROR_CHECK_NEG(r, NULL);
+
+					if (cp >= 0xD800 && cp <= 0xDBFF)
+					{
+						ERROR_CHECK_FALSE((input_getc() == '\\' && input_getc() == 'u'), "Invalid JSON. Bad surrogate pair.");
+
+						r = input_json_hex4(&low);
+						ERROR_CHECK_NEG(r, NULL);
+						ERROR_CHECK_FALSE((low >= 0xDC00 && low <= 0xDFFF), "Invalid JSON. Bad surrogate pair.");
+
+						cp = 0x10000 + (((cp & 0x3FF) << 10) | (low & 0x3FF));
+					}
+
+					// Encode as UTF-8
+					if (cp < 0x80)
+					{
+						r = input_json_token_put(len, cp);
+					}
+					else if (cp < 0x800)
+					{
+						r = input_json_token_put(len, 0xC0 | (cp >> 6));
+						r = (r < 0) ? r : input_json_token_put(len, 0x80 | (cp & 0x3F));
+					}
+					else if (cp < 0x10000)
+					{
+						r = input_json_token_put(len, 0xE0 | (cp >> 12));
+						r = (r < 0) ? r : input_json_token_put(len, 0x80 | ((cp >> 6) & 0x3F));
+						r = (r < 0) ? r : input_json_token_put(len, 0x80 | (cp & 0x3F));
+					}
+					else
+					{
+						r = input_json_token_put(len, 0xF0 | (cp >> 18));
+						r = (r < 0) ? r : input_json_token_put(len, 0x80 | ((cp >> 12) & 0x3F));
+						r = (r < 0) ? r : input_json_token_put(len, 0x80 | ((cp >> 6) & 0x3F));
+						r = (r < 0) ? r : input_json_token_put(len, 0x80 | (cp & 0x3F));
+					}
+					ERROR_CHECK_NEG(r, NULL);
+
+					continue;
+				default:
+					error_log("Invalid JSON. Bad escape sequence.");
+					return -1;
+			}
 		}
+
+		r = input_json_token_put(len, c);
+		ERROR_CHECK_NEG(r, NULL);
 	}
-	else if (cJSON_IsObject(jobj))
+
+	return 1;
+}
+
+static int input_json_literal(const char *rest)
+{
+	while (*rest)
 	{
-		int j = 0;
-		cJSON *item;
+		ERROR_CHECK_TRUE(input_getc() != *rest, "Invalid JSON.");
+		rest++;
+	}
 
-		if (jobj->string)
+	return 1;
+}
+
+// Reads an array element starting with c into json_token, as a string.
+// Bools become 1 or 0 and numbers are truncated to an int, the same way
+// cJSON input was converted.
+static int input_json_scalar(size_t *len, int c)
+{
+	int r;
+	double number;
+	char number_str[BUFSIZ];
+	size_t i = 0;
+
+	if (c == '"')
+	{
+		return input_json_string(len);
+	}
+	else if (c == 't' || c == 'f')
+	{
+		r = input_json_literal((c == 't') ? "rue" : "alse");
+		ERROR_CHECK_NEG(r, NULL);
+
+		*len = 0;
+
+		return input_json_token_put(len, (c == 't') ? '1' : '0');
+	}
+	else if (c == '-' || isdigit(c))
+	{
+		while (c >= 0 && (isdigit(c) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E'))
 		{
-			input_list[i++] = jobj->string;
+			ERROR_CHECK_TRUE(i == BUFSIZ - 1, "Invalid JSON. Number too long.");
+
+			number_str[i++] = c;
+			c = input_getc();
 		}
+		number_str[i] = '\0';
 
-		while ((item = cJSON_GetArrayItem(jobj, j++)) != NULL)
+		ERROR_CHECK_TRUE(c == INPUT_ERROR, NULL);
+		if (c >= 0)
 		{
-			r = input_parse_from_json(input, item);
-			ERROR_CHECK_NEG(r, "Could not traverse json input object.");
+			input_ungetc();
 		}
 
-		if (jobj->string)
+		number = strtod(number_str, NULL);
+		if (number >= INT_MAX)
 		{
-			i--;
+			error_log("Integer too large. Wrap large numbers in quotes.");
+			return -1;
 		}
-	}
-	else
-	{
-		error_log("JSON is not an arry or an object.");
-		return -1;
+
+		sprintf(number_str, "%i", (number <= (double)INT_MIN) ? INT_MIN : (int)number);
+
+		*len = 0;
+		for (i = 0; number_str[i] != '\0'; i++)
+		{
+			r = input_json_token_put(len, number_str[i]);
+			ERROR_CHECK_NEG(r, NULL);
+		}
+
+		return 1;
 	}
 
-	return 1;
+	error_log("JSON array contained an object of an unsupported type.");
+	return -1;
 }
 
 input_item input_new_item(unsigned char *data, size_t len)
@@ -8,11 +8,14 @@
 #ifndef INPUT_H
 #define INPUT_H 1
 
-#include "mods/cJSON/cJSON.h"
+#include <stddef.h>
 
 #define INPUT_FORMAT_BINARY 1
 #define INPUT_FORMAT_LIST   2
 #define INPUT_FORMAT_JSON   3
+#define INPUT_FORMAT_FRAMES 4
+
+#define INPUT_JSON_END      2
 
 typedef struct input_item *input_item;
 struct input_item {
@@ -25,8 +28,8 @@ struct input_item {
 int input_get(input_item *);
 int input_get_line(input_item *);
 int input_get_json(input_item *);
+int input_get_frame(input_item *);
 int input_get_format(void);
-int input_parse_from_json(input_item *, cJSON *);
 input_item input_new_item(unsigned char *, size_t);
 input_item input_copy_item(input_item);
 input_item input_append_item(input_item, input_item);
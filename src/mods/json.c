@@ -15,90 +15,6 @@
 #include "mods/error.h"
 #include "mods/cJSON/cJSON.h"
 
-int json_init_output(cJSON **jobj, int trace_flag)
-{
-	if (trace_flag)
-	{
-		*jobj = cJSON_CreateObject();
-		ERROR_CHECK_NULL(*jobj, "Could not create JSON trace object.");
-	}
-	else
-	{
-		*jobj = cJSON_CreateArray();
-		ERROR_CHECK_NULL(*jobj, "Could not create JSON output array.");
-	}
-
-	return 1;
-}
-
-int json_add_output(cJSON *jobj, char *output, char *input)
-{
-	cJSON *json_string_output = NULL;
-	cJSON *json_array_output = NULL;
-	cJSON *input_object = NULL;
-	cJSON *output_object = NULL;
-	cJSON *output_object_parent = NULL;
-
-	assert(jobj);
-	assert(output);
-
-	if (cJSON_GetObjectItem(jobj, output))
-	{
-		assert(input);
-
-		output_object = cJSON_DetachItemFromObject(jobj, output);
-		ERROR_CHECK_NULL(output_object, "Could not detach existing output object.");
-
-		if ((input_object = cJSON_GetObjectItem(jobj, input)))
-		{
-			cJSON_AddItemToObject(input_object, output, output_object);
-		}
-		else
-		{
-			output_object_parent = cJSON_CreateObject();
-			ERROR_CHECK_NULL(output_object_parent, "Could not create parent output object.");
-
-			cJSON_AddItemToObject(output_object_parent, output, output_object);
-
-			cJSON_AddItemToObject(jobj, input, output_object_parent);
-		}
-	}
-	else if (input && (json_array_output = cJSON_GetObjectItem(jobj, input)))
-	{
-		assert(cJSON_IsArray(json_array_output));
-
-		json_string_output = cJSON_CreateString(output);
-		ERROR_CHECK_NULL(json_string_output, "Could not generate JSON output string.");
-
-		cJSON_AddItemToArray(json_array_output, json_string_output);
-	}
-	else if (input)
-	{
-		assert(*input);
-		assert(cJSON_IsObject(jobj));
-
-		json_array_output = cJSON_CreateArray();
-		ERROR_CHECK_NULL(json_array_output, "Could not generate JSON output array.");
-
-		json_string_output = cJSON_CreateString(output);
-		ERROR_CHECK_NULL(json_string_output, "Could not generate JSON output string.");
-
-		cJSON_AddItemToArray(json_array_output, json_string_output);
-		cJSON_AddItemToObject(jobj, input, json_array_output);
-	}
-	else
-	{
-		assert(cJSON_IsArray(jobj));
-
-		json_string_output = cJSON_CreateString(output);
-		ERROR_CHECK_NULL(json_string_output, "Could not generate JSON output string.");
-
-		cJSON_AddItemToArray(jobj, json_string_output);
-	}
-
-	return 1;
-}
-
 int json_input_valid(cJSON *jobj)
 {
 	assert(jobj);
@@ -186,17 +102,6 @@ int json_input_to_string(char *string, cJSON *item)
 	return 1;
 }
 
-int json_output_size(cJSON *jobj)
-{
-	assert(jobj);
-	assert(cJSON_IsArray(jobj) || cJSON_IsObject(jobj));
-
-	return cJSON_GetArraySize(jobj);
-}
-
-
-
-
 int json_init_object(cJSON **jobj)
 {
 	*jobj = cJSON_CreateObject();
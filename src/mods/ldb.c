@@ -0,0 +1,1571 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ldb.h"
+#include "error.h"
+
+#define LDB_TABLE_MAGIC          0xdb4775248b80fb57ULL
+#define LDB_FOOTER_LENGTH        48
+#define LDB_BLOCK_TRAILER_LENGTH 5
+#define LDB_BLOCK_NO_COMPRESSION 0
+#define LDB_LOG_BLOCK_SIZE       32768
+#define LDB_LOG_HEADER_LENGTH    7
+#define LDB_LOG_FULL             1
+#define LDB_LOG_FIRST            2
+#define LDB_LOG_MIDDLE           3
+#define LDB_LOG_LAST             4
+#define LDB_TRAILER_LENGTH       8
+#define LDB_TYPE_DELETION        0
+#define LDB_TYPE_VALUE           1
+#define LDB_LEVELS               7
+#define LDB_CRC_MASK_DELTA       0xa282ead8UL
+#define LDB_COMPARATOR           "leveldb.BytewiseComparator"
+#define LDB_PATH_MAX             4096
+
+// Version edit tags in the manifest
+#define LDB_EDIT_COMPARATOR      1
+#define LDB_EDIT_LOG_NUMBER      2
+#define LDB_EDIT_NEXT_FILE       3
+#define LDB_EDIT_LAST_SEQUENCE   4
+#define LDB_EDIT_COMPACT_POINTER 5
+#define LDB_EDIT_DELETED_FILE    6
+#define LDB_EDIT_NEW_FILE        7
+#define LDB_EDIT_PREV_LOG_NUMBER 9
+
+/*
+ * Reads a LevelDB database straight from its files, without the library
+ * or its single iterator thread. The manifest names the table files that
+ * make up the current version, and the write-ahead logs hold whatever was
+ * written since the last of them. Logs are replayed into a sorted table
+ * in memory when the database is opened. The table files are mapped read
+ * only, so each range reads its blocks independently of the others.
+ *
+ * Every key is stored with the sequence number of the write that made it.
+ * A range merges the level 0 files, which may overlap, one source per
+ * deeper level, whose files do not, and the logs. Sources are ordered by
+ * user key and then newest sequence first, so the first version seen of
+ * a key is the live one, and a deletion hides the older versions below.
+ *
+ * Only uncompressed tables are read, which is how Bitcoin Core and this
+ * program create them.
+ */
+struct ldb_file {
+	int level;
+	uint64_t number;
+	uint64_t size;
+	unsigned char *smallest;
+	size_t smallest_len;
+	unsigned char *largest;
+	size_t largest_len;
+};
+
+struct ldb_entry {
+	const unsigned char *key;
+	size_t key_len;
+	const unsigned char *value;
+	size_t value_len;
+	uint64_t sequence;
+	int type;
+};
+
+struct LDB {
+	char *path;
+	struct ldb_file *files;
+	size_t files_len;
+	size_t files_size;
+	struct ldb_entry *entries;
+	size_t entries_len;
+	size_t entries_size;
+	void **buffers;
+	size_t buffers_len;
+	size_t buffers_size;
+	uint64_t log_number;
+	uint64_t prev_log_number;
+};
+
+struct ldb_block {
+	const unsigned char *data;
+	size_t restarts;
+	uint32_t restarts_len;
+	size_t offset;
+	size_t next;
+	unsigned char *key;
+	size_t key_len;
+	size_t key_size;
+	const unsigned char *value;
+	size_t value_len;
+	int valid;
+};
+
+struct ldb_table {
+	unsigned char *map;
+	size_t map_len;
+	struct ldb_block index;
+	struct ldb_block block;
+	int valid;
+};
+
+struct ldb_source {
+	struct ldb_file *files;
+	size_t files_len;
+	size_t file;
+	struct ldb_table table;
+	int table_open;
+	int memory;
+	size_t entry;
+	int valid;
+	const unsigned char *key;
+	size_t key_len;
+	const unsigned char *value;
+	size_t value_len;
+	uint64_t sequence;
+	int type;
+};
+
+struct LDBRange {
+	LDB ldb;
+	struct ldb_source *sources;
+	size_t sources_len;
+	size_t *heap;
+	size_t heap_len;
+	unsigned char *start;
+	size_t start_len;
+	unsigned char *end;
+	size_t end_len;
+	unsigned char *last;
+	size_t last_len;
+	size_t last_size;
+	int has_last;
+	int ready;
+};
+
+static uint32_t crc_table[256];
+
+static void ldb_crc_init(void);
+static uint32_t ldb_crc(const unsigned char *, size_t, uint32_t);
+static const unsigned char *ldb_varint(uint64_t *, const unsigned char *, const unsigned char *);
+static const unsigned char *ldb_string(const unsigned char **, size_t *, const unsigned char *, const unsigned char *);
+static uint32_t ldb_fixed32(const unsigned char *);
+static uint64_t ldb_fixed64(const unsigned char *);
+static int ldb_compare(const unsigned char *, size_t, const unsigned char *, size_t);
+static int ldb_read_file(unsigned char **, size_t *, char *);
+static int ldb_keep(LDB, void *);
+static int ldb_log_read(LDB, unsigned char *, size_t, int (*)(LDB, const unsigned char *, size_t));
+static int ldb_manifest_record(LDB, const unsigned char *, size_t);
+static int ldb_log_record(LDB, const unsigned char *, size_t);
+static int ldb_entry_compare(const void *, const void *);
+static int ldb_file_compare(const void *, const void *);
+static int ldb_block_init(struct ldb_block *, const unsigned char *, size_t);
+static int ldb_block_parse(struct ldb_block *);
+static int ldb_block_seek(struct ldb_block *, const unsigned char *, size_t);
+static int ldb_table_open(struct ldb_table *, LDB, struct ldb_file *);
+static int ldb_table_load(struct ldb_table *);
+static int ldb_table_seek(struct ldb_table *, const unsigned char *, size_t);
+static int ldb_table_next(struct ldb_table *);
+static void ldb_table_close(struct ldb_table *);
+static int ldb_source_seek(struct ldb_source *, LDB, const unsigned char *, size_t);
+static int ldb_source_next(struct ldb_source *, LDB);
+static void ldb_source_set(struct ldb_source *, LDB);
+static int ldb_source_less(struct ldb_source *, struct ldb_source *);
+static void ldb_heap_down(LDBRange, size_t);
+
+int ldb_open(LDB *ldb, char *path)
+{
+	int r;
+	size_t i, len;
+	uint64_t number;
+	char filename[LDB_PATH_MAX];
+	unsigned char *data;
+	size_t data_len;
+	DIR *dir;
+	struct dirent *ent;
+	uint64_t *logs = NULL;
+	size_t logs_len = 0, logs_size = 0;
+
+	assert(ldb);
+	assert(path);
+
+	ldb_crc_init();
+
+	*ldb = calloc(1, sizeof(struct LDB));
+	ERROR_CHECK_NULL(*ldb, "Memory allocation error.");
+
+	(*ldb)->path = path;
+
+	// The current manifest is named in CURRENT
+	r = snprintf(filename, LDB_PATH_MAX, "%s/CURRENT", path);
+	ERROR_CHECK_TRUE(r >= LDB_PATH_MAX, "Database path too long.");
+
+	r = ldb_read_file(&data, &data_len, filename);
+	ERROR_CHECK_NEG(r, "Could not read CURRENT file.");
+
+	for (len = 0; len < data_len && data[len] != '\n'; len++)
+		;
+	if (len == 0 || len == data_len || len + strlen(path) + 2 > LDB_PATH_MAX)
+	{
+		free(data);
+		error_log("Invalid CURRENT file in %s.", path);
+		return -1;
+	}
+
+	sprintf(filename, "%s/", path);
+	strncat(filename, (char *)data, len);
+	free(data);
+
+	r = ldb_read_file(&data, &data_len, filename);
+	ERROR_CHECK_NEG(r, "Could not read manifest file.");
+
+	r = ldb_log_read(*ldb, data, data_len, &ldb_manifest_record);
+	free(data);
+	ERROR_CHECK_NEG(r, "Could not read manifest.");
+
+	qsort((*ldb)->files, (*ldb)->files_len, sizeof(struct ldb_file), &ldb_file_compare);
+
+	// Logs the manifest has not yet seen flushed to a table. Replay them
+	// oldest first, though sequence numbers settle the order anyway.
+	dir = opendir(path);
+	if (dir == NULL)
+	{
+		error_log("Could not open database directory %s. Errno %i.", path, errno);
+		return -1;
+	}
+
+	while ((ent = readdir(dir)) != NULL)
+	{
+		len = strlen(ent->d_name);
+		if (len < 5 || strcmp(ent->d_name + len - 4, ".log") != 0 || strspn(ent->d_name, "0123456789") != len - 4)
+		{
+			continue;
+		}
+
+		number = strtoull(ent->d_name, NULL, 10);
+		if (number < (*ldb)->log_number && number != (*ldb)->prev_log_number)
+		{
+			continue;
+		}
+
+		if (logs_len == logs_size)
+		{
+			logs_size = logs_size ? logs_size * 2 : 4;
+			logs = realloc(logs, logs_size * sizeof(uint64_t));
+			ERROR_CHECK_NULL(logs, "Memory allocation error.");
+		}
+		logs[logs_len++] = number;
+	}
+	closedir(dir);
+
+	for (i = 0; i < logs_len; i++)
+	{
+		snprintf(filename, LDB_PATH_MAX, "%s/%06llu.log", path, (unsigned long long)logs[i]);
+
+		r = ldb_read_file(&data, &data_len, filename);
+		ERROR_CHECK_NEG(r, "Could not read log file.");
+
+		r = ldb_keep(*ldb, data);
+		ERROR_CHECK_NEG(r, NULL);
+
+		r = ldb_log_read(*ldb, data, data_len, &ldb_log_record);
+		ERROR_CHECK_NEG(r, "Could not read log.");
+	}
+
+	free(logs);
+
+	qsort((*ldb)->entries, (*ldb)->entries_len, sizeof(struct ldb_entry), &ldb_entry_compare);
+
+	return 1;
+}
+
+// Gets the value of a single key. The value is set to NULL if the key
+// does not exist, otherwise it is allocated and the caller frees it.
+int ldb_get(unsigned char **value, size_t *value_len, LDB ldb, unsigned char *key, size_t key_len)
+{
+	int r;
+	LDBRange range;
+	unsigned char *end;
+	const unsigned char *k, *v;
+	size_t k_len, v_len;
+
+	assert(value);
+	assert(value_len);
+	assert(ldb);
+	assert(key);
+
+	*value = NULL;
+	*value_len = 0;
+
+	// The smallest key after this one
+	end = malloc(key_len + 1);
+	ERROR_CHECK_NULL(end, "Memory allocation error.");
+
+	memcpy(end, key, key_len);
+	end[key_len] = 0;
+
+	r = ldb_range_new(&range, ldb, key, key_len, end, key_len + 1);
+	free(end);
+	ERROR_CHECK_NEG(r, NULL);
+
+	r = ldb_range_get(&k, &k_len, &v, &v_len, range);
+	if (r > 0)
+	{
+		*value = malloc(v_len ? v_len : 1);
+		ERROR_CHECK_NULL(*value, "Memory allocation error.");
+
+		memcpy(*value, v, v_len);
+		*value_len = v_len;
+	}
+
+	ldb_range_free(range);
+
+	ERROR_CHECK_NEG(r, "Could not read key from database.");
+
+	return 1;
+}
+
+size_t ldb_file_count(LDB ldb)
+{
+	assert(ldb);
+
+	return ldb->files_len;
+}
+
+void ldb_close(LDB ldb)
+{
+	size_t i;
+
+	assert(ldb);
+
+	for (i = 0; i < ldb->files_len; i++)
+	{
+		free(ldb->files[i].smallest);
+		free(ldb->files[i].largest);
+	}
+
+	for (i = 0; i < ldb->buffers_len; i++)
+	{
+		free(ldb->buffers[i]);
+	}
+
+	free(ldb->files);
+	free(ldb->entries);
+	free(ldb->buffers);
+	free(ldb);
+}
+
+// Iterates the live keys from start, up to but not including end. Either
+// bound may be NULL.
+int ldb_range_new(LDBRange *range, LDB ldb, unsigned char *start, size_t start_len, unsigned char *end, size_t end_len)
+{
+	int r;
+	size_t i, n;
+	struct ldb_file *file;
+
+	assert(range);
+	assert(ldb);
+
+	*range = calloc(1, sizeof(struct LDBRange));
+	ERROR_CHECK_NULL(*range, "Memory allocation error.");
+
+	(*range)->ldb = ldb;
+
+	if (start)
+	{
+		(*range)->start = malloc(start_len ? start_len : 1);
+		ERROR_CHECK_NULL((*range)->start, "Memory allocation error.");
+		memcpy((*range)->start, start, start_len);
+		(*range)->start_len = start_len;
+	}
+
+	if (end)
+	{
+		(*range)->end = malloc(end_len ? end_len : 1);
+		ERROR_CHECK_NULL((*range)->end, "Memory allocation error.");
+		memcpy((*range)->end, end, end_len);
+		(*range)->end_len = end_len;
+	}
+
+	// At most one source per file, plus the logs
+	(*range)->sources = calloc(ldb->files_len + 1, sizeof(struct ldb_source));
+	ERROR_CHECK_NULL((*range)->sources, "Memory allocation error.");
+
+	(*range)->heap = malloc((ldb->files_len + 1) * sizeof(size_t));
+	ERROR_CHECK_NULL((*range)->heap, "Memory allocation error.");
+
+	n = 0;
+	for (i = 0; i < ldb->files_len; i++)
+	{
+		file = &(ldb->files[i]);
+
+		if (start && ldb_compare(file->largest, file->largest_len, start, start_len) < 0)
+		{
+			continue;
+		}
+		if (end && ldb_compare(file->smallest, file->smallest_len, end, end_len) >= 0)
+		{
+			continue;
+		}
+
+		// Files in a level above zero are sorted and do not overlap, so
+		// those in the range are adjacent and one source reads them in
+		// turn.
+		if (file->level > 0 && n > 0 && (*range)->sources[n - 1].files[0].level == file->level)
+		{
+			(*range)->sources[n - 1].files_len++;
+			continue;
+		}
+
+		(*range)->sources[n].files = &(ldb->files[i]);
+		(*range)->sources[n].files_len = 1;
+		n++;
+	}
+
+	if (ldb->entries_len > 0)
+	{
+		(*range)->sources[n].memory = 1;
+		n++;
+	}
+
+	(*range)->sources_len = n;
+
+	for (i = 0; i < n; i++)
+	{
+		r = ldb_source_seek(&((*range)->sources[i]), ldb, start, start_len);
+		ERROR_CHECK_NEG(r, "Could not seek database file.");
+
+		if ((*range)->sources[i].valid)
+		{
+			(*range)->heap[(*range)->heap_len++] = i;
+		}
+	}
+
+	for (i = (*range)->heap_len / 2; i-- > 0; )
+	{
+		ldb_heap_down(*range, i);
+	}
+
+	return 1;
+}
+
+// Gets the current key and value. Returns zero at the end of the range.
+// Both stay valid until the next call to ldb_range_next().
+int ldb_range_get(const unsigned char **key, size_t *key_len, const unsigned char **value, size_t *value_len, LDBRange range)
+{
+	int r;
+	struct ldb_source *s;
+
+	assert(key);
+	assert(key_len);
+	assert(value);
+	assert(value_len);
+	assert(range);
+
+	while (!range->ready)
+	{
+		if (range->heap_len == 0)
+		{
+			return 0;
+		}
+
+		s = &(range->sources[range->heap[0]]);
+
+		if (range->end && ldb_compare(s->key, s->key_len, range->end, range->end_len) >= 0)
+		{
+			range->heap_len = 0;
+			return 0;
+		}
+
+		if (range->has_last && ldb_compare(s->key, s->key_len, range->last, range->last_len) == 0)
+		{
+			// An older version
+			r = ldb_range_next(range);
+			ERROR_CHECK_NEG(r, NULL);
+			continue;
+		}
+
+		if (s->key_len > range->last_size)
+		{
+			free(range->last);
+
+			range->last_size = s->key_len * 2;
+			range->last = malloc(range->last_size);
+			ERROR_CHECK_NULL(range->last, "Memory allocation error.");
+		}
+
+		memcpy(range->last, s->key, s->key_len);
+		range->last_len = s->key_len;
+		range->has_last = 1;
+
+		if (s->type == LDB_TYPE_VALUE)
+		{
+			range->ready = 1;
+			break;
+		}
+
+		r = ldb_range_next(range);
+		ERROR_CHECK_NEG(r, NULL);
+	}
+
+	s = &(range->sources[range->heap[0]]);
+
+	*key = s->key;
+	*key_len = s->key_len;
+	*value = s->value;
+	*value_len = s->value_len;
+
+	return 1;
+}
+
+int ldb_range_next(LDBRange range)
+{
+	int r;
+	struct ldb_source *s;
+
+	assert(range);
+
+	range->ready = 0;
+
+	if (range->heap_len == 0)
+	{
+		return 0;
+	}
+
+	s = &(range->sources[range->heap[0]]);
+
+	r = ldb_source_next(s, range->ldb);
+	ERROR_CHECK_NEG(r, "Could not read database file.");
+
+	if (!s->valid)
+	{
+		range->heap[0] = range->heap[--range->heap_len];
+	}
+
+	ldb_heap_down(range, 0);
+
+	return 1;
+}
+
+void ldb_range_free(LDBRange range)
+{
+	size_t i;
+
+	assert(range);
+
+	for (i = 0; i < range->sources_len; i++)
+	{
+		if (range->sources[i].table_open)
+		{
+			ldb_table_close(&(range->sources[i].table));
+		}
+	}
+
+	free(range->sources);
+	free(range->heap);
+	free(range->start);
+	free(range->end);
+	free(range->last);
+	free(range);
+}
+
+static void ldb_crc_init(void)
+{
+	uint32_t i, j, c;
+
+	if (crc_table[1])
+	{
+		return;
+	}
+
+	// CRC-32C, the Castagnoli polynomial, reflected
+	for (i = 0; i < 256; i++)
+	{
+		c = i;
+		for (j = 0; j < 8; j++)
+		{
+			c = (c & 1) ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+		}
+		crc_table[i] = c;
+	}
+}
+
+static uint32_t ldb_crc(const unsigned char *data, size_t len, uint32_t crc)
+{
+	crc = ~crc;
+	while (len--)
+	{
+		crc = crc_table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+	}
+
+	return ~crc;
+}
+
+static const unsigned char *ldb_varint(uint64_t *value, const unsigned char *p, const unsigned char *end)
+{
+	int shift;
+
+	*value = 0;
+	for (shift = 0; shift <= 63 && p < end; shift += 7)
+	{
+		*value |= (uint64_t)(*p & 0x7F) << shift;
+		if ((*p++ & 0x80) == 0)
+		{
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+static const unsigned char *ldb_string(const unsigned char **str, size_t *len, const unsigned char *p, const unsigned char *end)
+{
+	uint64_t n;
+
+	p = ldb_varint(&n, p, end);
+	if (p == NULL || n > (uint64_t)(end - p))
+	{
+		return NULL;
+	}
+
+	*str = p;
+	*len = n;
+
+	return p + n;
+}
+
+static uint32_t ldb_fixed32(const unsigned char *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t ldb_fixed64(const unsigned char *p)
+{
+	return (uint64_t)ldb_fixed32(p) | ((uint64_t)ldb_fixed32(p + 4) << 32);
+}
+
+static int ldb_compare(const unsigned char *a, size_t a_len, const unsigned char *b, size_t b_len)
+{
+	int r;
+
+	r = memcmp(a, b, a_len < b_len ? a_len : b_len);
+	if (r != 0)
+	{
+		return r;
+	}
+
+	return (a_len > b_len) - (a_len < b_len);
+}
+
+static int ldb_read_file(unsigned char **data, size_t *len, char *path)
+{
+	int fd;
+	ssize_t r;
+	struct stat st;
+	size_t n = 0;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		error_log("Could not open file %s. Errno %i.", path, errno);
+		return -1;
+	}
+
+	if (fstat(fd, &st) < 0)
+	{
+		close(fd);
+		error_log("Could not stat file %s. Errno %i.", path, errno);
+		return -1;
+	}
+
+	*data = malloc(st.st_size ? st.st_size : 1);
+	if (*data == NULL)
+	{
+		close(fd);
+		error_log("Memory allocation error.");
+		return -1;
+	}
+
+	while (n < (size_t)st.st_size)
+	{
+		r = read(fd, *data + n, st.st_size - n);
+		if (r < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (r <= 0)
+		{
+			break;
+		}
+		n += r;
+	}
+
+	close(fd);
+
+	if (n != (size_t)st.st_size)
+	{
+		free(*data);
+		*data = NULL;
+		error_log("Could not read file %s.", path);
+		return -1;
+	}
+
+	*len = n;
+
+	return 1;
+}
+
+// Keeps a buffer until the database is closed.
+static int ldb_keep(LDB ldb, void *buffer)
+{
+	if (ldb->buffers_len == ldb->buffers_size)
+	{
+		ldb->buffers_size = ldb->buffers_size ? ldb->buffers_size * 2 : 8;
+		ldb->buffers = realloc(ldb->buffers, ldb->buffers_size * sizeof(void *));
+		ERROR_CHECK_NULL(ldb->buffers, "Memory allocation error.");
+	}
+
+	ldb->buffers[ldb->buffers_len++] = buffer;
+
+	return 1;
+}
+
+/*
+ * Logs and manifests share a format. The file is cut into fixed size
+ * blocks, and a record that does not fit in the rest of one is split in
+ * fragments across the next. A record is passed on whole, either in place
+ * or reassembled into a buffer kept until close. A torn record at the
+ * end of the file is what a crash leaves behind, so it ends the log
+ * quietly, like LevelDB's own recovery.
+ */
+static int ldb_log_read(LDB ldb, unsigned char *data, size_t len, int (*record)(LDB, const unsigned char *, size_t))
+{
+	int r;
+	int type;
+	uint32_t crc;
+	size_t pos = 0, left, n;
+	unsigned char *buffer = NULL;
+	size_t buffer_len = 0;
+
+	while (pos + LDB_LOG_HEADER_LENGTH <= len)
+	{
+		left = LDB_LOG_BLOCK_SIZE - (pos % LDB_LOG_BLOCK_SIZE);
+		if (left < LDB_LOG_HEADER_LENGTH)
+		{
+			// Block trailer
+			pos += left;
+			continue;
+		}
+
+		n = data[pos + 4] | ((size_t)data[pos + 5] << 8);
+		type = data[pos + 6];
+
+		if (type == 0 && n == 0)
+		{
+			// Preallocated space
+			pos += left;
+			continue;
+		}
+
+		if (n > left - LDB_LOG_HEADER_LENGTH)
+		{
+			free(buffer);
+			error_log("Log record crosses a block boundary.");
+			return -1;
+		}
+
+		if (pos + LDB_LOG_HEADER_LENGTH + n > len)
+		{
+			// Torn record at the end of the file
+			break;
+		}
+
+		// The checksum covers the type and the fragment
+		crc = ldb_crc(data + pos + LDB_LOG_HEADER_LENGTH, n, ldb_crc(data + pos + 6, 1, 0));
+		crc = ((crc >> 15) | (crc << 17)) + LDB_CRC_MASK_DELTA;
+		if (crc != ldb_fixed32(data + pos))
+		{
+			free(buffer);
+			error_log("Log record checksum mismatch.");
+			return -1;
+		}
+
+		switch (type)
+		{
+			case LDB_LOG_FULL:
+				r = record(ldb, data + pos + LDB_LOG_HEADER_LENGTH, n);
+				ERROR_CHECK_NEG(r, NULL);
+				break;
+			case LDB_LOG_FIRST:
+				free(buffer);
+				buffer = NULL;
+				buffer_len = 0;
+				// fall through
+			case LDB_LOG_MIDDLE:
+			case LDB_LOG_LAST:
+				if (type != LDB_LOG_FIRST && buffer == NULL)
+				{
+					// Fragment of a record that began before the file
+					break;
+				}
+				buffer = realloc(buffer, buffer_len + n + 1);
+				ERROR_CHECK_NULL(buffer, "Memory allocation error.");
+				memcpy(buffer + buffer_len, data + pos + LDB_LOG_HEADER_LENGTH, n);
+				buffer_len += n;
+				if (type == LDB_LOG_LAST)
+				{
+					r = ldb_keep(ldb, buffer);
+					ERROR_CHECK_NEG(r, NULL);
+					r = record(ldb, buffer, buffer_len);
+					ERROR_CHECK_NEG(r, NULL);
+					buffer = NULL;
+					buffer_len = 0;
+				}
+				break;
+			default:
+				free(buffer);
+				error_log("Unknown log record type %i.", type);
+				return -1;
+		}
+
+		pos += LDB_LOG_HEADER_LENGTH + n;
+	}
+
+	free(buffer);
+
+	return 1;
+}
+
+static int ldb_manifest_record(LDB ldb, const unsigned char *p, size_t len)
+{
+	size_t i;
+	uint64_t tag, level, number, size;
+	const unsigned char *end = p + len;
+	const unsigned char *str, *smallest, *largest;
+	size_t str_len, smallest_len, largest_len;
+	struct ldb_file *file;
+
+	while (p && p < end)
+	{
+		p = ldb_varint(&tag, p, end);
+		if (p == NULL)
+		{
+			break;
+		}
+
+		switch (tag)
+		{
+			case LDB_EDIT_COMPARATOR:
+				p = ldb_string(&str, &str_len, p, end);
+				if (p && (str_len != strlen(LDB_COMPARATOR) || memcmp(str, LDB_COMPARATOR, str_len) != 0))
+				{
+					error_log("Unsupported database comparator.");
+					return -1;
+				}
+				break;
+			case LDB_EDIT_LOG_NUMBER:
+				p = ldb_varint(&(ldb->log_number), p, end);
+				break;
+			case LDB_EDIT_PREV_LOG_NUMBER:
+				p = ldb_varint(&(ldb->prev_log_number), p, end);
+				break;
+			case LDB_EDIT_NEXT_FILE:
+			case LDB_EDIT_LAST_SEQUENCE:
+				p = ldb_varint(&number, p, end);
+				break;
+			case LDB_EDIT_COMPACT_POINTER:
+				p = ldb_varint(&level, p, end);
+				if (p)
+				{
+					p = ldb_string(&str, &str_len, p, end);
+				}
+				break;
+			case LDB_EDIT_DELETED_FILE:
+				p = ldb_varint(&level, p, end);
+				if (p)
+				{
+					p = ldb_varint(&number, p, end);
+				}
+				if (p == NULL)
+				{
+					break;
+				}
+				for (i = 0; i < ldb->files_len; i++)
+				{
+					if (ldb->files[i].number == number && ldb->files[i].level == (int)level)
+					{
+						free(ldb->files[i].smallest);
+						free(ldb->files[i].largest);
+						ldb->files[i] = ldb->files[--ldb->files_len];
+						break;
+					}
+				}
+				break;
+			case LDB_EDIT_NEW_FILE:
+				p = ldb_varint(&level, p, end);
+				if (p)
+				{
+					p = ldb_varint(&number, p, end);
+				}
+				if (p)
+				{
+					p = ldb_varint(&size, p, end);
+				}
+				if (p)
+				{
+					p = ldb_string(&smallest, &smallest_len, p, end);
+				}
+				if (p)
+				{
+					p = ldb_string(&largest, &largest_len, p, end);
+				}
+				if (p == NULL || level >= LDB_LEVELS || smallest_len < LDB_TRAILER_LENGTH || largest_len < LDB_TRAILER_LENGTH)
+				{
+					p = NULL;
+					break;
+				}
+
+				if (ldb->files_len == ldb->files_size)
+				{
+					ldb->files_size = ldb->files_size ? ldb->files_size * 2 : 64;
+					ldb->files = realloc(ldb->files, ldb->files_size * sizeof(struct ldb_file));
+					ERROR_CHECK_NULL(ldb->files, "Memory allocation error.");
+				}
+
+				// Bounds are kept as user keys
+				file = &(ldb->files[ldb->files_len++]);
+				file->level = (int)level;
+				file->number = number;
+				file->size = size;
+				file->smallest_len = smallest_len - LDB_TRAILER_LENGTH;
+				file->largest_len = largest_len - LDB_TRAILER_LENGTH;
+				file->smallest = malloc(file->smallest_len + 1);
+				file->largest = malloc(file->largest_len + 1);
+				ERROR_CHECK_NULL(file->smallest, "Memory allocation error.");
+				ERROR_CHECK_NULL(file->largest, "Memory allocation error.");
+				memcpy(file->smallest, smallest, file->smallest_len);
+				memcpy(file->largest, largest, file->largest_len);
+				break;
+			default:
+				p = NULL;
+				break;
+		}
+	}
+
+	if (p == NULL)
+	{
+		error_log("Invalid manifest record.");
+		return -1;
+	}
+
+	return 1;
+}
+
+// A write batch: its first sequence number, a count, then the puts and
+// deletes, each taking the next sequence number.
+static int ldb_log_record(LDB ldb, const unsigned char *p, size_t len)
+{
+	uint64_t sequence;
+	uint32_t i, count;
+	const unsigned char *end = p + len;
+	struct ldb_entry *entry;
+
+	if (len < 12)
+	{
+		error_log("Invalid log record.");
+		return -1;
+	}
+
+	sequence = ldb_fixed64(p);
+	count = ldb_fixed32(p + 8);
+	p += 12;
+
+	for (i = 0; i < count; i++)
+	{
+		if (ldb->entries_len == ldb->entries_size)
+		{
+			ldb->entries_size = ldb->entries_size ? ldb->entries_size * 2 : 1024;
+			ldb->entries = realloc(ldb->entries, ldb->entries_size * sizeof(struct ldb_entry));
+			ERROR_CHECK_NULL(ldb->entries, "Memory allocation error.");
+		}
+
+		entry = &(ldb->entries[ldb->entries_len]);
+		entry->sequence = sequence + i;
+		entry->value = NULL;
+		entry->value_len = 0;
+
+		if (p >= end)
+		{
+			break;
+		}
+		entry->type = *p++;
+
+		p = ldb_string(&(entry->key), &(entry->key_len), p, end);
+		if (p && entry->type == LDB_TYPE_VALUE)
+		{
+			p = ldb_string(&(entry->value), &(entry->value_len), p, end);
+		}
+		if (p == NULL || entry->type > LDB_TYPE_VALUE)
+		{
+			break;
+		}
+
+		ldb->entries_len++;
+	}
+
+	if (i < count)
+	{
+		error_log("Invalid write batch in log.");
+		return -1;
+	}
+
+	return 1;
+}
+
+static int ldb_entry_compare(const void *a, const void *b)
+{
+	int r;
+	const struct ldb_entry *x = a, *y = b;
+
+	r = ldb_compare(x->key, x->key_len, y->key, y->key_len);
+	if (r != 0)
+	{
+		return r;
+	}
+
+	return (x->sequence < y->sequence) - (x->sequence > y->sequence);
+}
+
+static int ldb_file_compare(const void *a, const void *b)
+{
+	const struct ldb_file *x = a, *y = b;
+
+	if (x->level != y->level)
+	{
+		return x->level - y->level;
+	}
+
+	if (x->level == 0)
+	{
+		return (x->number > y->number) - (x->number < y->number);
+	}
+
+	return ldb_compare(x->smallest, x->smallest_len, y->smallest, y->smallest_len);
+}
+
+/*
+ * A block is a run of entries sharing a prefix with the key before them,
+ * then an array of restart points, offsets of entries stored whole.
+ */
+static int ldb_block_init(struct ldb_block *block, const unsigned char *data, size_t size)
+{
+	if (size < 4)
+	{
+		return -1;
+	}
+
+	block->data = data;
+	block->restarts_len = ldb_fixed32(data + size - 4);
+	if (block->restarts_len == 0 || block->restarts_len > (size - 4) / 4)
+	{
+		return -1;
+	}
+
+	block->restarts = size - 4 - (size_t)block->restarts_len * 4;
+	block->offset = 0;
+	block->next = 0;
+	block->key_len = 0;
+	block->valid = 0;
+
+	return 1;
+}
+
+// Decodes the entry at block->next
+static int ldb_block_parse(struct ldb_block *block)
+{
+	uint64_t shared, unshared, value_len;
+	const unsigned char *p, *end;
+
+	block->offset = block->next;
+	if (block->offset >= block->restarts)
+	{
+		block->valid = 0;
+		return 1;
+	}
+
+	p = block->data + block->offset;
+	end = block->data + block->restarts;
+
+	p = ldb_varint(&shared, p, end);
+	if (p)
+	{
+		p = ldb_varint(&unshared, p, end);
+	}
+	if (p)
+	{
+		p = ldb_varint(&value_len, p, end);
+	}
+	if (p == NULL || shared > block->key_len || unshared > (uint64_t)(end - p) || value_len > (uint64_t)(end - p) - unshared)
+	{
+		return -1;
+	}
+
+	if (shared + unshared > block->key_size)
+	{
+		block->key_size = (shared + unshared) * 2;
+		block->key = realloc(block->key, block->key_size);
+		if (block->key == NULL)
+		{
+			return -1;
+		}
+	}
+
+	memcpy(block->key + shared, p, unshared);
+	block->key_len = shared + unshared;
+	block->value = p + unshared;
+	block->value_len = value_len;
+	block->next = (block->value + value_len) - block->data;
+	block->valid = 1;
+
+	if (block->key_len < LDB_TRAILER_LENGTH)
+	{
+		return -1;
+	}
+
+	return 1;
+}
+
+// Positions the block at the first entry whose user key is not less than
+// the target.
+static int ldb_block_seek(struct ldb_block *block, const unsigned char *target, size_t target_len)
+{
+	int r;
+	uint32_t lo, hi, mid;
+
+	lo = 0;
+	hi = block->restarts_len - 1;
+
+	// The last restart point with a key before the target
+	while (target && lo < hi)
+	{
+		mid = lo + (hi - lo + 1) / 2;
+
+		block->next = ldb_fixed32(block->data + block->restarts + (size_t)mid * 4);
+		block->key_len = 0;
+		r = ldb_block_parse(block);
+		if (r < 0 || !block->valid)
+		{
+			return -1;
+		}
+
+		if (ldb_compare(block->key, block->key_len - LDB_TRAILER_LENGTH, target, target_len) < 0)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+
+	block->next = ldb_fixed32(block->data + block->restarts + (size_t)lo * 4);
+	block->key_len = 0;
+
+	while (1)
+	{
+		r = ldb_block_parse(block);
+		if (r < 0)
+		{
+			return -1;
+		}
+		if (!block->valid || !target || ldb_compare(block->key, block->key_len - LDB_TRAILER_LENGTH, target, target_len) >= 0)
+		{
+			break;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * A table ends with a fixed size footer pointing at its index block. The
+ * index has an entry for each data block, keyed by a key at or after the
+ * block's last one, so the first index entry not before a target leads to
+ * the block that may hold it.
+ */
+static int ldb_table_open(struct ldb_table *table, LDB ldb, struct ldb_file *file)
+{
+	int r, fd;
+	char filename[LDB_PATH_MAX];
+	struct stat st;
+	uint64_t offset, size;
+	const unsigned char *p, *end;
+
+	memset(table, 0, sizeof(struct ldb_table));
+
+	snprintf(filename, LDB_PATH_MAX, "%s/%06llu.ldb", ldb->path, (unsigned long long)file->number);
+
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0 && errno == ENOENT)
+	{
+		// Older releases named tables .sst
+		snprintf(filename, LDB_PATH_MAX, "%s/%06llu.sst", ldb->path, (unsigned long long)file->number);
+		fd = open(filename, O_RDONLY | O_CLOEXEC);
+	}
+	if (fd < 0)
+	{
+		error_log("Could not open table file %s. Errno %i.", filename, errno);
+		return -1;
+	}
+
+	r = fstat(fd, &st);
+	if (r < 0 || (size_t)st.st_size < LDB_FOOTER_LENGTH)
+	{
+		close(fd);
+		error_log("Invalid table file %s.", filename);
+		return -1;
+	}
+
+	table->map_len = st.st_size;
+	table->map = mmap(NULL, table->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (table->map == MAP_FAILED)
+	{
+		table->map = NULL;
+		error_log("Could not map table file %s. Errno %i.", filename, errno);
+		return -1;
+	}
+
+	madvise(table->map, table->map_len, MADV_SEQUENTIAL);
+
+	p = table->map + table->map_len - LDB_FOOTER_LENGTH;
+	end = table->map + table->map_len;
+	if (ldb_fixed64(end - 8) != LDB_TABLE_MAGIC)
+	{
+		error_log("Bad magic number in table file %s.", filename);
+		return -1;
+	}
+
+	// Skip the metaindex handle
+	p = ldb_varint(&offset, p, end);
+	if (p)
+	{
+		p = ldb_varint(&size, p, end);
+	}
+	if (p)
+	{
+		p = ldb_varint(&offset, p, end);
+	}
+	if (p)
+	{
+		p = ldb_varint(&size, p, end);
+	}
+	if (p == NULL || offset > table->map_len || size + LDB_BLOCK_TRAILER_LENGTH > table->map_len - offset)
+	{
+		error_log("Invalid footer in table file %s.", filename);
+		return -1;
+	}
+
+	r = ldb_block_init(&(table->index), table->map + offset, size);
+	if (r < 0)
+	{
+		error_log("Invalid index block in table file %s.", filename);
+		return -1;
+	}
+
+	return 1;
+}
+
+// Loads the data block the index is at, verifying its checksum.
+static int ldb_table_load(struct ldb_table *table)
+{
+	int r;
+	uint32_t crc;
+	uint64_t offset, size;
+	const unsigned char *p, *end;
+
+	end = table->index.value + table->index.value_len;
+
+	p = ldb_varint(&offset, table->index.value, end);
+	if (p)
+	{
+		p = ldb_varint(&size, p, end);
+	}
+	if (p == NULL || offset > table->map_len || size + LDB_BLOCK_TRAILER_LENGTH > table->map_len - offset)
+	{
+		error_log("Invalid block handle in table.");
+		return -1;
+	}
+
+	p = table->map + offset;
+
+	if (p[size] != LDB_BLOCK_NO_COMPRESSION)
+	{
+		error_log("Compressed table blocks are not supported.");
+		return -1;
+	}
+
+	crc = ldb_crc(p, size + 1, 0);
+	crc = ((crc >> 15) | (crc << 17)) + LDB_CRC_MASK_DELTA;
+	if (crc != ldb_fixed32(p + size + 1))
+	{
+		error_log("Table block checksum mismatch.");
+		return -1;
+	}
+
+	r = ldb_block_init(&(table->block), p, size);
+	if (r < 0)
+	{
+		error_log("Invalid data block in table.");
+		return -1;
+	}
+
+	return 1;
+}
+
+static int ldb_table_seek(struct ldb_table *table, const unsigned char *target, size_t target_len)
+{
+	int r;
+
+	r = ldb_block_seek(&(table->index), target, target_len);
+	ERROR_CHECK_TRUE(r < 0, "Invalid index block in table.");
+
+	while (table->index.valid)
+	{
+		r = ldb_table_load(table);
+		ERROR_CHECK_NEG(r, NULL);
+
+		r = ldb_block_seek(&(table->block), target, target_len);
+		ERROR_CHECK_TRUE(r < 0, "Invalid data block in table.");
+
+		if (table->block.valid)
+		{
+			table->valid = 1;
+			return 1;
+		}
+
+		r = ldb_block_parse(&(table->index));
+		ERROR_CHECK_TRUE(r < 0, "Invalid index block in table.");
+	}
+
+	table->valid = 0;
+
+	return 1;
+}
+
+static int ldb_table_next(struct ldb_table *table)
+{
+	int r;
+
+	r = ldb_block_parse(&(table->block));
+	ERROR_CHECK_TRUE(r < 0, "Invalid data block in table.");
+
+	while (!table->block.valid)
+	{
+		r = ldb_block_parse(&(table->index));
+		ERROR_CHECK_TRUE(r < 0, "Invalid index block in table.");
+
+		if (!table->index.valid)
+		{
+			table->valid = 0;
+			return 1;
+		}
+
+		r = ldb_table_load(table);
+		ERROR_CHECK_NEG(r, NULL);
+
+		r = ldb_block_parse(&(table->block));
+		ERROR_CHECK_TRUE(r < 0, "Invalid data block in table.");
+	}
+
+	return 1;
+}
+
+static void ldb_table_close(struct ldb_table *table)
+{
+	if (table->map)
+	{
+		munmap(table->map, table->map_len);
+	}
+
+	free(table->index.key);
+	free(table->block.key);
+
+	table->map = NULL;
+	table->index.key = NULL;
+	table->block.key = NULL;
+}
+
+static int ldb_source_seek(struct ldb_source *source, LDB ldb, const unsigned char *target, size_t target_len)
+{
+	int r;
+	size_t lo, hi, mid;
+	struct ldb_entry *e;
+
+	if (source->memory)
+	{
+		lo = 0;
+		hi = ldb->entries_len;
+		while (target && lo < hi)
+		{
+			mid = lo + (hi - lo) / 2;
+			e = &(ldb->entries[mid]);
+			if (ldb_compare(e->key, e->key_len, target, target_len) < 0)
+			{
+				lo = mid + 1;
+			}
+			else
+			{
+				hi = mid;
+			}
+		}
+
+		source->entry = lo;
+		ldb_source_set(source, ldb);
+
+		return 1;
+	}
+
+	for (source->file = 0; source->file < source->files_len; source->file++)
+	{
+		r = ldb_table_open(&(source->table), ldb, &(source->files[source->file]));
+		source->table_open = 1;
+		ERROR_CHECK_NEG(r, NULL);
+
+		r = ldb_table_seek(&(source->table), target, target_len);
+		ERROR_CHECK_NEG(r, NULL);
+
+		if (source->table.valid)
+		{
+			break;
+		}
+
+		ldb_table_close(&(source->table));
+		source->table_open = 0;
+	}
+
+	ldb_source_set(source, ldb);
+
+	return 1;
+}
+
+static int ldb_source_next(struct ldb_source *source, LDB ldb)
+{
+	int r;
+
+	if (source->memory)
+	{
+		source->entry++;
+		ldb_source_set(source, ldb);
+
+		return 1;
+	}
+
+	r = ldb_table_next(&(source->table));
+	ERROR_CHECK_NEG(r, NULL);
+
+	// On to the next file of the level
+	while (!source->table.valid)
+	{
+		ldb_table_close(&(source->table));
+		source->table_open = 0;
+
+		if (++source->file == source->files_len)
+		{
+			break;
+		}
+
+		r = ldb_table_open(&(source->table), ldb, &(source->files[source->file]));
+		source->table_open = 1;
+		ERROR_CHECK_NEG(r, NULL);
+
+		r = ldb_table_seek(&(source->table), NULL, 0);
+		ERROR_CHECK_NEG(r, NULL);
+	}
+
+	ldb_source_set(source, ldb);
+
+	return 1;
+}
+
+static void ldb_source_set(struct ldb_source *source, LDB ldb)
+{
+	uint64_t tag;
+	struct ldb_entry *e;
+	struct ldb_block *b;
+
+	if (source->memory)
+	{
+		source->valid = source->entry < ldb->entries_len;
+		if (source->valid)
+		{
+			e = &(ldb->entries[source->entry]);
+			source->key = e->key;
+			source->key_len = e->key_len;
+			source->value = e->value;
+			source->value_len = e->value_len;
+			source->sequence = e->sequence;
+			source->type = e->type;
+		}
+		return;
+	}
+
+	source->valid = source->table_open && source->table.valid;
+	if (source->valid)
+	{
+		b = &(source->table.block);
+		tag = ldb_fixed64(b->key + b->key_len - LDB_TRAILER_LENGTH);
+		source->key = b->key;
+		source->key_len = b->key_len - LDB_TRAILER_LENGTH;
+		source->value = b->value;
+		source->value_len = b->value_len;
+		source->sequence = tag >> 8;
+		source->type = tag & 0xFF;
+	}
+}
+
+static int ldb_source_less(struct ldb_source *a, struct ldb_source *b)
+{
+	int r;
+
+	r = ldb_compare(a->key, a->key_len, b->key, b->key_len);
+	if (r != 0)
+	{
+		return r < 0;
+	}
+
+	return a->sequence > b->sequence;
+}
+
+static void ldb_heap_down(LDBRange range, size_t i)
+{
+	size_t c, t;
+
+	while ((c = 2 * i + 1) < range->heap_len)
+	{
+		if (c + 1 < range->heap_len && ldb_source_less(&(range->sources[range->heap[c + 1]]), &(range->sources[range->heap[c]])))
+		{
+			c++;
+		}
+		if (!ldb_source_less(&(range->sources[range->heap[c]]), &(range->sources[range->heap[i]])))
+		{
+			break;
+		}
+
+		t = range->heap[i];
+		range->heap[i] = range->heap[c];
+		range->heap[c] = t;
+		i = c;
+	}
+}
\ No newline at end of file
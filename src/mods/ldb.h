@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#ifndef LDB_H
+#define LDB_H 1
+
+#include <stddef.h>
+
+typedef struct LDB *LDB;
+typedef struct LDBRange *LDBRange;
+
+int ldb_open(LDB *, char *);
+int ldb_get(unsigned char **, size_t *, LDB, unsigned char *, size_t);
+size_t ldb_file_count(LDB);
+void ldb_close(LDB);
+
+int ldb_range_new(LDBRange *, LDB, unsigned char *, size_t, unsigned char *, size_t);
+int ldb_range_get(const unsigned char **, size_t *, const unsigned char **, size_t *, LDBRange);
+int ldb_range_next(LDBRange);
+void ldb_range_free(LDBRange);
+
+#endif
\ No newline at end of file
@@ -52,6 +52,12 @@ leveldb_readoptions_t* leveldb_readoptions_create()
 	return NULL;
 }
 
+void leveldb_readoptions_set_fill_cache(leveldb_readoptions_t *stub, unsigned char c)
+{
+	(void)c;
+	(void)stub;
+}
+
 leveldb_iterator_t* leveldb_create_iterator(leveldb_t* db, const leveldb_readoptions_t* options)
 {
 	(void)db;
@@ -199,6 +205,22 @@ void leveldb_iter_destroy(leveldb_iterator_t* stub)
 	(void)stub;
 }
 
+void leveldb_approximate_sizes(leveldb_t* db, int num_ranges, const char* const* range_start_key, const size_t* range_start_key_len, const char* const* range_limit_key, const size_t* range_limit_key_len, uint64_t* sizes)
+{
+	int i;
+
+	(void)db;
+	(void)range_start_key;
+	(void)range_start_key_len;
+	(void)range_limit_key;
+	(void)range_limit_key_len;
+
+	for (i = 0; i < num_ranges; i++)
+	{
+		sizes[i] = 0;
+	}
+}
+
 void leveldb_close(leveldb_t* db)
 {
 	(void)db;
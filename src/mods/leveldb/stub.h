@@ -8,6 +8,9 @@
 #ifndef STUB_H
 #define STUB_H 1
 
+#include <stddef.h>
+#include <stdint.h>
+
 typedef struct leveldb_t leveldb_t;
 typedef struct leveldb_cache_t leveldb_cache_t;
 typedef struct leveldb_comparator_t leveldb_comparator_t;
@@ -34,6 +37,7 @@ void leveldb_options_set_error_if_exists(leveldb_options_t*, unsigned char);
 void leveldb_options_set_filter_policy(leveldb_options_t*, leveldb_filterpolicy_t*);
 leveldb_t* leveldb_open(const leveldb_options_t* options, const char* name, char** errptr);
 leveldb_readoptions_t* leveldb_readoptions_create();
+void leveldb_readoptions_set_fill_cache(leveldb_readoptions_t*, unsigned char);
 leveldb_iterator_t* leveldb_create_iterator(leveldb_t* db, const leveldb_readoptions_t* options);
 leveldb_filterpolicy_t* leveldb_filterpolicy_create_bloom(int bits_per_key);
 void leveldb_iter_seek_to_first(leveldb_iterator_t*);
@@ -55,6 +59,7 @@ void leveldb_writebatch_destroy(leveldb_writebatch_t*);
 void leveldb_writeoptions_destroy(leveldb_writeoptions_t*);
 void leveldb_readoptions_destroy(leveldb_readoptions_t*);
 void leveldb_iter_destroy(leveldb_iterator_t*);
+void leveldb_approximate_sizes(leveldb_t* db, int num_ranges, const char* const* range_start_key, const size_t* range_start_key_len, const char* const* range_limit_key, const size_t* range_limit_key_len, uint64_t* sizes);
 void leveldb_close(leveldb_t* db);
 
 #endif
\ No newline at end of file
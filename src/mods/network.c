@@ -5,29 +5,78 @@
  * under the terms of the GPL License. See LICENSE for more details.
  */
 
+#include <stddef.h>
+#include <assert.h>
 #include "network.h"
 
-#define MAINNET 1;
-#define TESTNET 2;
+static const struct Network mainnet = {
+	.p2pkh_prefix = 0x00,
+	.p2sh_prefix  = 0x05,
+	.wif_prefix   = 0x80,
+	.bech32_hrp   = "bc"
+};
 
-static int network_type = MAINNET;
+static const struct Network testnet = {
+	.p2pkh_prefix = 0x6F,
+	.p2sh_prefix  = 0xC4,
+	.wif_prefix   = 0xEF,
+	.bech32_hrp   = "tb"
+};
+
+static __thread Network network_current = &mainnet;
+
+Network network_main(void)
+{
+	return &mainnet;
+}
+
+Network network_test(void)
+{
+	return &testnet;
+}
+
+Network network_from_wif_prefix(unsigned char prefix)
+{
+	if (prefix == mainnet.wif_prefix)
+	{
+		return &mainnet;
+	}
+	else if (prefix == testnet.wif_prefix)
+	{
+		return &testnet;
+	}
+
+	return NULL;
+}
+
+Network network_get(void)
+{
+	return network_current;
+}
+
+void network_set(Network network)
+{
+	assert(network);
+
+	network_current = network;
+}
 
 void network_set_main(void)
 {
-	network_type = MAINNET;
+	network_current = &mainnet;
 }
 
 void network_set_test(void)
 {
-	network_type = TESTNET;
+	network_current = &testnet;
 }
 
 int network_is_main(void)
 {
-	return network_type == MAINNET;
+	return network_current == &mainnet;
 }
 
 int network_is_test(void)
 {
-	return network_type == TESTNET;
-}
\ No newline at end of file
+	return network_current == &testnet;
+}
@@ -8,6 +8,25 @@
 #ifndef NETWORK_H
 #define NETWORK_H 1
 
+/*
+ * Encoding parameters of a bitcoin network. Encoders take one of these
+ * explicitly, so conversions do not depend on process or thread state.
+ */
+typedef const struct Network *Network;
+struct Network {
+	unsigned char p2pkh_prefix;
+	unsigned char p2sh_prefix;
+	unsigned char wif_prefix;
+	char *bech32_hrp;
+};
+
+Network network_main(void);
+Network network_test(void);
+Network network_from_wif_prefix(unsigned char);
+
+// The calling thread's current network, used by the commands.
+Network network_get(void);
+void network_set(Network);
 void network_set_main(void);
 void network_set_test(void);
 int network_is_main(void);
@@ -22,13 +22,20 @@
 #define OPTS_OUTPUT_TYPE     (struct opt_info){"out-type",   "WXDR"}
 #define OPTS_STREAM          (struct opt_info){"stream",     "S"}
 #define OPTS_GREP            (struct opt_info){"grep",       "G:"}
+#define OPTS_OUTPUT_DIR      (struct opt_info){"out-dir",    ""}
 #define OPTS_COMPRESSED      (struct opt_info){"compressed", "CU"}
 #define OPTS_REHASH          (struct opt_info){"rehash",     ""}
 #define OPTS_HOSTNAME        (struct opt_info){"hostname",   "h:"}
 #define OPTS_PORT            (struct opt_info){"port",       "p:"}
 #define OPTS_CREATE          (struct opt_info){"create",     ""}
 #define OPTS_CREATE_CHAINSTATE (struct opt_info){"create-from-chainstate",     ""}
+#define OPTS_CREATE_SNAPSHOT (struct opt_info){"create-from-snapshot",       ""}
+#define OPTS_MMAP            (struct opt_info){"mmap",       ""}
+#define OPTS_DIRECT_READ     (struct opt_info){"direct-read", ""}
+#define OPTS_RESUME          (struct opt_info){"resume",     ""}
 #define OPTS_UPDATE          (struct opt_info){"update",     ""}
+#define OPTS_COMMIT_BLOCKS   (struct opt_info){"commit-blocks", ""}
+#define OPTS_DBCACHE         (struct opt_info){"dbcache",    ""}
 #define OPTS_CHAINSTATE_PATH (struct opt_info){"chainstate-path",    ""}
 #define OPTS_BALANCE_PATH    (struct opt_info){"balance-path",   ""}
 #define OPTS_BECH32          (struct opt_info){"bech32",     ""}
@@ -41,6 +48,9 @@
 #define OPTS_DUMP            (struct opt_info){"dump",       ""}
 #define OPTS_TRACE           (struct opt_info){"trace",      ""}
 #define OPTS_TEST            (struct opt_info){"test",       ""}
+#define OPTS_JOBS            (struct opt_info){"jobs",       ""}
+#define OPTS_SOCKET          (struct opt_info){"socket",     ""}
+#define OPTS_COUNT           (struct opt_info){"count",      ""}
 #define OPTS_MAX             30
 
 struct opt_info {
@@ -50,6 +60,7 @@ struct opt_info {
 
 static struct option longopts[OPTS_MAX];
 static char shortopts[OPTS_MAX];
+static int longopts_count = 0;
 
 int opts_add(struct opt_info, int);
 int opts_process_long(opts_p, const char *, char *);
@@ -61,6 +72,7 @@ int opts_init(opts_p opts)
 	opts->input_format_list = 0;
 	opts->input_format_binary = 0;
 	opts->input_format_json = 0;
+	opts->input_format_frames = 0;
 	opts->input_type_wif = 0;
 	opts->input_type_hex = 0;
 	opts->input_type_raw = 0;
@@ -72,15 +84,19 @@ int opts_init(opts_p opts)
 	opts->output_format_qrcode = 0;
 	opts->output_format_binary = 0;
 	opts->output_format_json = 0;
+	opts->output_format_frames = 0;
+	opts->output_format_svg = 0;
+	opts->output_format_pbm = 0;
 	opts->output_type_wif = 0;
 	opts->output_type_hex = 0;
 	opts->output_type_decimal = 0;
 	opts->output_type_raw = 0;
 	opts->output_type_p2pkh = 0;
 	opts->output_type_p2wpkh = 0;
-	opts->output_type_p2wpkh_v1 = 0;
+	opts->output_type_p2tr = 0;
 	opts->output_stream = 0;
 	opts->output_grep = NULL;
+	opts->output_dir = NULL;
 	opts->compression_on = 0;
 	opts->compression_off = 0;
 	opts->network_test = 0;
@@ -89,7 +105,13 @@ int opts_init(opts_p opts)
 	opts->host_service = NULL;
 	opts->create = 0;
 	opts->create_from_chainstate = 0;
+	opts->create_from_snapshot = NULL;
+	opts->use_mmap = 0;
+	opts->direct_read = 0;
+	opts->resume = 0;
 	opts->update = 0;
+	opts->commit_blocks = 100;
+	opts->dbcache = 0;
 	opts->chainstate_path = NULL;
 	opts->balance_path = NULL;
 	opts->rpc_auth = NULL;
@@ -98,21 +120,24 @@ int opts_init(opts_p opts)
 	opts->dump = 0;
 	opts->trace = 0;
 	opts->test = 0;
+	opts->jobs = 1;
+	opts->socket_path = NULL;
+	opts->count = 0;
+	opts->count_exact = 0;
 	opts->command = NULL;
 	opts->input = NULL;
 	opts->input_count = 0;
 
 	memset(longopts, 0, OPTS_MAX * sizeof(*longopts));
 	memset(shortopts, 0, OPTS_MAX);
+	longopts_count = 0;
 
 	return 1;
 }
 
 int opts_add(struct opt_info info, int has_arg)
 {
-	static int i = 0;
-
-	longopts[i++] = (struct option){info.longopt, has_arg, NULL, 0};
+	longopts[longopts_count++] = (struct option){info.longopt, has_arg, NULL, 0};
 	strcat(shortopts, info.shortopt);
 
 	return 1;
@@ -141,8 +166,11 @@ int opts_get(opts_p opts, int argc, char *argv[])
 		opts_add(OPTS_STREAM, no_argument);
 		opts_add(OPTS_REHASH, required_argument);
 		opts_add(OPTS_GREP, required_argument);
+		opts_add(OPTS_OUTPUT_DIR, required_argument);
 		opts_add(OPTS_TESTNET, no_argument);
 		opts_add(OPTS_TRACE, no_argument);
+		opts_add(OPTS_JOBS, required_argument);
+		opts_add(OPTS_COUNT, required_argument);
 	}
 	else if (strcmp(opts->command, "pubkey") == 0)
 	{
@@ -153,7 +181,9 @@ int opts_get(opts_p opts, int argc, char *argv[])
 		opts_add(OPTS_COMPRESSED, required_argument);
 		opts_add(OPTS_STREAM, no_argument);
 		opts_add(OPTS_GREP, required_argument);
+		opts_add(OPTS_OUTPUT_DIR, required_argument);
 		opts_add(OPTS_TRACE, no_argument);
+		opts_add(OPTS_JOBS, required_argument);
 	}
 	else if (strcmp(opts->command, "address") == 0)
 	{
@@ -165,7 +195,9 @@ int opts_get(opts_p opts, int argc, char *argv[])
 		opts_add(OPTS_LEGACY, no_argument);
 		opts_add(OPTS_STREAM, no_argument);
 		opts_add(OPTS_GREP, required_argument);
+		opts_add(OPTS_OUTPUT_DIR, required_argument);
 		opts_add(OPTS_TRACE, no_argument);
+		opts_add(OPTS_JOBS, required_argument);
 	}
 	else if (strcmp(opts->command, "balance") == 0)
 	{
@@ -176,13 +208,40 @@ int opts_get(opts_p opts, int argc, char *argv[])
 		opts_add(OPTS_PORT, required_argument);
 		opts_add(OPTS_CREATE, no_argument);
 		opts_add(OPTS_CREATE_CHAINSTATE, no_argument);
+		opts_add(OPTS_CREATE_SNAPSHOT, required_argument);
+		opts_add(OPTS_MMAP, no_argument);
+		opts_add(OPTS_DIRECT_READ, no_argument);
+		opts_add(OPTS_RESUME, no_argument);
+		opts_add(OPTS_COUNT, required_argument);
 		opts_add(OPTS_UPDATE, no_argument);
+		opts_add(OPTS_COMMIT_BLOCKS, required_argument);
+		opts_add(OPTS_DBCACHE, required_argument);
 		opts_add(OPTS_CHAINSTATE_PATH, required_argument);
 		opts_add(OPTS_BALANCE_PATH, required_argument);
 		opts_add(OPTS_STREAM, no_argument);
 		opts_add(OPTS_GREP, required_argument);
+		opts_add(OPTS_OUTPUT_DIR, required_argument);
 		opts_add(OPTS_RPC_AUTH, required_argument);
 		opts_add(OPTS_TRACE, no_argument);
+		opts_add(OPTS_JOBS, required_argument);
+	}
+	else if (strcmp(opts->command, "chain") == 0)
+	{
+		// Stage options are given with the stage list and parsed by the
+		// chain command itself.
+		opts_add(OPTS_INPUT_FORMAT, required_argument);
+		opts_add(OPTS_OUTPUT_FORMAT, required_argument);
+		opts_add(OPTS_STREAM, no_argument);
+		opts_add(OPTS_GREP, required_argument);
+		opts_add(OPTS_OUTPUT_DIR, required_argument);
+		opts_add(OPTS_TRACE, no_argument);
+		opts_add(OPTS_JOBS, required_argument);
+		opts_add(OPTS_COUNT, required_argument);
+	}
+	else if (strcmp(opts->command, "serve") == 0)
+	{
+		opts_add(OPTS_SOCKET, required_argument);
+		opts_add(OPTS_BALANCE_PATH, required_argument);
 	}
 	else if (strcmp(opts->command, "node") == 0)
 	{
@@ -217,6 +276,10 @@ int opts_get(opts_p opts, int argc, char *argv[])
 		shortopts[i] = shortopts[i-1];
 	shortopts[0] = ':';
 
+	// Opts may be parsed more than once per process (e.g. chain stages),
+	// so make getopt start over.
+	optind = 0;
+
 	while ((o = getopt_long(argc, argv, shortopts, longopts, &opt_index)) != -1)
 	{
 		// Processing long opts
@@ -388,7 +451,7 @@ int opts_set_config(opts_p opts)
 	ERROR_CHECK_NEG(r, "Could not load config.");
 
 	// Set opts on a per command basis.
-	if (strcmp(opts->command, "balance") == 0)
+	if (strcmp(opts->command, "balance") == 0 || strcmp(opts->command, "serve") == 0)
 	{
 		if (!opts->host_name && config_exists("hostname"))
 		{
@@ -432,6 +495,31 @@ int opts_set_config(opts_p opts)
 	return 1;
 }
 
+int opts_io_count(opts_p opts)
+{
+	int i = 0;
+
+	assert(opts);
+
+	if (opts->input_format_list) { i++; }
+	if (opts->input_format_binary) { i++; }
+	if (opts->input_format_json) { i++; }
+	if (opts->input_format_frames) { i++; }
+	if (opts->output_format_list) { i++; }
+	if (opts->output_format_qrcode) { i++; }
+	if (opts->output_format_binary) { i++; }
+	if (opts->output_format_json) { i++; }
+	if (opts->output_format_frames) { i++; }
+	if (opts->output_format_svg) { i++; }
+	if (opts->output_format_pbm) { i++; }
+	if (opts->output_dir) { i++; }
+	if (opts->output_stream) { i++; }
+	if (opts->output_grep) { i++; }
+	if (opts->trace) { i++; }
+
+	return i;
+}
+
 int opts_process_long(opts_p opts, const char *optname, char *optarg)
 {
 	if (strcmp(optname, OPTS_INPUT_FORMAT.longopt) == 0)
@@ -439,6 +527,7 @@ int opts_process_long(opts_p opts, const char *optname, char *optarg)
 		if (strcmp(optarg, "list") == 0)        { opts->input_format_list = 1; }
 		else if (strcmp(optarg, "binary") == 0) { opts->input_format_binary = 1; opts->input_type_binary = 1; }
 		else if (strcmp(optarg, "json") == 0)   { opts->input_format_json = 1; }
+		else if (strcmp(optarg, "frames") == 0) { opts->input_format_frames = 1; }
 		else
 		{
 			error_log("Invalid argument for option --%s.", optname);
@@ -468,6 +557,9 @@ int opts_process_long(opts_p opts, const char *optname, char *optarg)
 		else if (strcmp(optarg, "binary") == 0)     { opts->output_format_binary = 1; }
 		else if (strcmp(optarg, "qrcode") == 0)     { opts->output_format_qrcode = 1; }
 		else if (strcmp(optarg, "json") == 0)       { opts->output_format_json = 1; }
+		else if (strcmp(optarg, "frames") == 0)     { opts->output_format_frames = 1; }
+		else if (strcmp(optarg, "svg") == 0)        { opts->output_format_svg = 1; }
+		else if (strcmp(optarg, "pbm") == 0)        { opts->output_format_pbm = 1; }
 		else
 		{
 			error_log("Invalid argument for option --%s.", optname);
@@ -499,6 +591,12 @@ int opts_process_long(opts_p opts, const char *optname, char *optarg)
 		opts->output_grep = optarg;
 	}
 
+	else if (strcmp(optname, OPTS_OUTPUT_DIR.longopt) == 0)
+	{
+		ERROR_CHECK_TRUE(opts->output_dir, "Can not use output directory option more than once.");
+		opts->output_dir = optarg;
+	}
+
 	else if (strcmp(optname, OPTS_COMPRESSED.longopt) == 0)
 	{
 		if (strcmp(optarg, "true") == 0)            { opts->compression_on = 1; }
@@ -538,6 +636,27 @@ int opts_process_long(opts_p opts, const char *optname, char *optarg)
 		opts->create_from_chainstate = 1;
 	}
 
+	else if (strcmp(optname, OPTS_CREATE_SNAPSHOT.longopt) == 0)
+	{
+		ERROR_CHECK_TRUE(opts->create_from_snapshot, "Can not use create from snapshot option more than once.");
+		opts->create_from_snapshot = optarg;
+	}
+
+	else if (strcmp(optname, OPTS_MMAP.longopt) == 0)
+	{
+		opts->use_mmap = 1;
+	}
+
+	else if (strcmp(optname, OPTS_DIRECT_READ.longopt) == 0)
+	{
+		opts->direct_read = 1;
+	}
+
+	else if (strcmp(optname, OPTS_RESUME.longopt) == 0)
+	{
+		opts->resume = 1;
+	}
+
 	else if (strcmp(optname, OPTS_UPDATE.longopt) == 0)
 	{
 		opts->update = 1;
@@ -567,7 +686,7 @@ int opts_process_long(opts_p opts, const char *optname, char *optarg)
 
 	else if (strcmp(optname, OPTS_BECH32M.longopt) == 0)
 	{
-		opts->output_type_p2wpkh_v1 = 1;
+		opts->output_type_p2tr = 1;
 	}
 
 	else if (strcmp(optname, OPTS_TESTNET.longopt) == 0)
@@ -608,5 +727,77 @@ int opts_process_long(opts_p opts, const char *optname, char *optarg)
 		opts->test = 1;
 	}
 
+	else if (strcmp(optname, OPTS_JOBS.longopt) == 0)
+	{
+		char *end;
+
+		opts->jobs = (int)strtol(optarg, &end, 10);
+		if (*end != '\0' || opts->jobs < 1)
+		{
+			error_log("Invalid argument for option --%s. Must be a positive number.", optname);
+			return -1;
+		}
+	}
+
+	else if (strcmp(optname, OPTS_COMMIT_BLOCKS.longopt) == 0)
+	{
+		char *end;
+
+		opts->commit_blocks = (int)strtol(optarg, &end, 10);
+		if (*end != '\0' || opts->commit_blocks < 1)
+		{
+			error_log("Invalid argument for option --%s. Must be a positive number.", optname);
+			return -1;
+		}
+	}
+
+	else if (strcmp(optname, OPTS_DBCACHE.longopt) == 0)
+	{
+		char *end;
+
+		opts->dbcache = (int)strtol(optarg, &end, 10);
+		if (*end != '\0' || opts->dbcache < 1)
+		{
+			error_log("Invalid argument for option --%s. Must be a positive number.", optname);
+			return -1;
+		}
+	}
+
+	else if (strcmp(optname, OPTS_SOCKET.longopt) == 0)
+	{
+		ERROR_CHECK_TRUE(opts->socket_path, "Can not use socket option more than once.");
+		opts->socket_path = optarg;
+	}
+
+	// Balance counts records, the others say how many keys to create.
+	else if (strcmp(optname, OPTS_COUNT.longopt) == 0 && strcmp(opts->command, "balance") == 0)
+	{
+		if (strcmp(optarg, "exact") == 0)
+		{
+			opts->count_exact = 1;
+		}
+		else if (strcmp(optarg, "estimate") == 0)
+		{
+			opts->count_exact = 0;
+		}
+		else
+		{
+			error_log("Invalid argument for option --%s. Must be exact or estimate.", optname);
+			return -1;
+		}
+	}
+
+	else if (strcmp(optname, OPTS_COUNT.longopt) == 0)
+	{
+		char *end;
+
+		opts->count = strtol(optarg, &end, 10);
+		if (*end != '\0' || opts->count < 1)
+		{
+			error_log("Invalid argument for option --%s. Must be a positive number.", optname);
+			return -1;
+		}
+	}
+
 	return 1;
 }
\ No newline at end of file
@@ -13,6 +13,7 @@ struct opts {
 	int input_format_list;
 	int input_format_binary;
 	int input_format_json;
+	int input_format_frames;
 	int input_type_wif;
 	int input_type_hex;
 	int input_type_raw;
@@ -24,15 +25,19 @@ struct opts {
 	int output_format_qrcode;
 	int output_format_binary;
 	int output_format_json;
+	int output_format_frames;
+	int output_format_svg;
+	int output_format_pbm;
 	int output_type_wif;
 	int output_type_hex;
 	int output_type_decimal;
 	int output_type_raw;
 	int output_type_p2pkh;
 	int output_type_p2wpkh;
-	int output_type_p2wpkh_v1;
+	int output_type_p2tr;
 	int output_stream;
 	char *output_grep;
+	char *output_dir;
 	int compression_on;
 	int compression_off;
 	int network_test;
@@ -41,7 +46,13 @@ struct opts {
 	char *host_service;
 	int create;
 	int create_from_chainstate;
+	char *create_from_snapshot;
+	int use_mmap;
+	int direct_read;
+	int resume;
 	int update;
+	int commit_blocks;
+	int dbcache;
 	char *chainstate_path;
 	char *balance_path;
 	char *rpc_auth;
@@ -50,6 +61,10 @@ struct opts {
 	int dump;
 	int trace;
 	int test;
+	int jobs;
+	char *socket_path;
+	long count;
+	int count_exact;
 	char *command;
 	char **input;
 	int input_count;
@@ -58,5 +73,6 @@ struct opts {
 int opts_init(opts_p);
 int opts_get(opts_p, int, char **);
 int opts_set_config(opts_p);
+int opts_io_count(opts_p);
 
 #endif
@@ -10,32 +10,106 @@
 #include <unistd.h>
 #include <ctype.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
 #include <assert.h>
+#include <sys/uio.h>
 #include "mods/input.h"
 #include "mods/output.h"
 #include "mods/error.h"
 
-output_item output_new(void *content, size_t length)
+// Arena chunks start small so that short lists (one per input item) stay
+// cheap, and double in size up to the max as a list grows.
+#define OUTPUT_ARENA_MIN    256
+#define OUTPUT_ARENA_MAX    65536
+
+#ifndef IOV_MAX
+#define IOV_MAX             1024
+#endif
+
+#define OUTPUT_BUFFER_SIZE  65536
+#define OUTPUT_JSON_DEPTH   64
+
+// Items and their content are carved out of a chain of arena chunks owned
+// by the head of the list, so appending does not malloc per item and
+// freeing a list releases a handful of chunks.
+struct output_arena {
+	size_t size;
+	size_t used;
+	output_arena next;
+	unsigned char data[];
+};
+
+// Small write buffer for output that has to be formatted (JSON) rather
+// than written straight out of the arena.
+struct output_buffer {
+	int fd;
+	size_t len;
+	char data[OUTPUT_BUFFER_SIZE];
+};
+
+struct output_json {
+	int trace;
+	int (*filter)(char *);
+	int started;
+	int depth;
+	char *path[OUTPUT_JSON_DEPTH];
+	size_t path_len[OUTPUT_JSON_DEPTH];
+	struct output_buffer buffer;
+};
+
+static void *output_arena_alloc(output_arena *, size_t);
+static int output_writev(int, struct iovec *, int);
+static int output_buffer_put(struct output_buffer *, const char *, size_t);
+static int output_buffer_indent(struct output_buffer *, int);
+static int output_buffer_string(struct output_buffer *, const char *, size_t);
+static int output_buffer_flush(struct output_buffer *);
+
+static void *output_arena_alloc(output_arena *arena, size_t size)
 {
-	output_item item;
+	size_t chunk_size;
+	void *ptr;
+	output_arena chunk;
 
-	assert(content);
+	assert(arena);
+
+	// Keep allocations aligned for the output_item structs.
+	size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
 
-	item = malloc(sizeof *item);
-	if (item)
+	if (*arena == NULL || (*arena)->size - (*arena)->used < size)
 	{
-		item->content = content;
-		item->length = length;
-		item->input = NULL;
-		item->next = NULL;
+		chunk_size = (*arena) ? (*arena)->size * 2 : OUTPUT_ARENA_MIN;
+		if (chunk_size > OUTPUT_ARENA_MAX)
+		{
+			chunk_size = OUTPUT_ARENA_MAX;
+		}
+		if (chunk_size < size)
+		{
+			chunk_size = size;
+		}
+
+		chunk = malloc(sizeof(*chunk) + chunk_size);
+		if (chunk == NULL)
+		{
+			return NULL;
+		}
+
+		chunk->size = chunk_size;
+		chunk->used = 0;
+		chunk->next = *arena;
+
+		*arena = chunk;
 	}
 
-	return item;
+	ptr = (*arena)->data + (*arena)->used;
+	(*arena)->used += size;
+
+	return ptr;
 }
 
 output_item output_append(output_item x, output_item y)
 {
-	output_item head;
+	output_arena arena;
 
 	assert(y);
 
@@ -44,47 +118,158 @@ output_item output_append(output_item x, output_item y)
 		return y;
 	}
 
-	head = x;
+	x->tail->next = y;
+	x->tail = y->tail;
+	x->count += y->count;
 
-	while(x->next != NULL)
+	// The arena chunks of y now belong to x. The newest chunk of y becomes
+	// the current chunk of x so it is reused for subsequent appends.
+	if (y->arena)
 	{
-		x = x->next;
+		arena = y->arena;
+		while (arena->next != NULL)
+		{
+			arena = arena->next;
+		}
+		arena->next = x->arena;
+		x->arena = y->arena;
 	}
 
-	x->next = y;
+	y->tail = NULL;
+	y->count = 0;
+	y->arena = NULL;
 
-	return head;
+	return x;
 }
 
 output_item output_append_new(output_item head, void *content, size_t length)
 {
 	output_item item;
 
-	item = output_new(content, length);
+	assert(content);
 
+	item = output_append_new_copy(head, content, length);
 	if (item == NULL)
 	{
 		return NULL;
 	}
 
-	head = output_append(head, item);
+	free(content);
 
-	return head;
+	return item;
 }
 
 output_item output_append_new_copy(output_item head, void *content, size_t length)
 {
-	void *tmp;
+	output_arena arena = NULL;
+	output_item item;
+
+	assert(content);
+
+	if (head)
+	{
+		arena = head->arena;
+	}
+
+	item = output_arena_alloc(&arena, sizeof(*item) + length);
+	if (item == NULL)
+	{
+		return NULL;
+	}
+
+	item->content = (unsigned char *)item + sizeof(*item);
+	item->length = length;
+	item->input = NULL;
+	item->next = NULL;
+	item->tail = item;
+	item->count = 1;
+	item->arena = NULL;
+
+	memcpy(item->content, content, length);
+
+	if (head == NULL)
+	{
+		item->arena = arena;
+
+		return item;
+	}
+
+	head->arena = arena;
+	head->tail->next = item;
+	head->tail = item;
+	head->count++;
+
+	return head;
+}
+
+/*
+ * Unlinks the items that filter rejects and returns the new head, or NULL
+ * when nothing is left. Rejected items stay in the arena, which moves to
+ * the new head, and are released along with the list.
+ */
+output_item output_filter(output_item list, int (*filter)(char *))
+{
+	size_t count = 0;
+	output_arena arena, arena_next;
+	output_item item, next, head = NULL, tail = NULL;
+
+	assert(filter);
 
-	tmp = malloc(length);
-	if (tmp == NULL)
+	if (list == NULL)
 	{
 		return NULL;
 	}
 
-	memcpy(tmp, content, length);
+	arena = list->arena;
+
+	for (item = list; item != NULL; item = next)
+	{
+		next = item->next;
+
+		if (filter((char *)(item->content)))
+		{
+			if (tail)
+			{
+				tail->next = item;
+			}
+			else
+			{
+				head = item;
+			}
+			tail = item;
+			count++;
+		}
+		else
+		{
+			input_free(item->input);
+			item->input = NULL;
+		}
+	}
+
+	if (head == NULL)
+	{
+		while (arena != NULL)
+		{
+			arena_next = arena->next;
+			free(arena);
+			arena = arena_next;
+		}
+
+		return NULL;
+	}
+
+	tail->next = NULL;
+
+	if (head != list)
+	{
+		list->arena = NULL;
+		list->tail = NULL;
+		list->count = 0;
+	}
 
-	head = output_append_new(head, tmp, length);
+	head->arena = arena;
+	head->tail = tail;
+	head->count = count;
 
 	return head;
 }
@@ -128,31 +313,455 @@ size_t output_size(output_item list)
 
 size_t output_length(output_item list)
 {
-	size_t len = 0;
-
 	if (list == NULL)
 	{
 		return 0;
 	}
 
+	return list->count;
+}
+
+int output_write_list(output_item list, int fd, int (*filter)(char *))
+{
+	int r, i = 0;
+	struct iovec iov[IOV_MAX];
+
+	// Anything already buffered in stdio must come first.
+	fflush(stdout);
+
+	while (list != NULL)
+	{
+		if (filter == NULL || filter((char *)(list->content)))
+		{
+			iov[i].iov_base = list->content;
+			iov[i].iov_len = strlen((char *)(list->content));
+			i++;
+			iov[i].iov_base = "\n";
+			iov[i].iov_len = 1;
+			i++;
+
+			if (i >= IOV_MAX - 1)
+			{
+				r = output_writev(fd, iov, i);
+				ERROR_CHECK_NEG(r, "Could not write output.");
+
+				i = 0;
+			}
+		}
+
+		list = list->next;
+	}
+
+	if (i > 0)
+	{
+		r = output_writev(fd, iov, i);
+		ERROR_CHECK_NEG(r, "Could not write output.");
+	}
+
+	return 1;
+}
+
+int output_write_binary(output_item list, int fd)
+{
+	int r, i = 0;
+	struct iovec iov[IOV_MAX];
+
+	fflush(stdout);
+
 	while (list != NULL)
 	{
-		len++;
+		iov[i].iov_base = list->content;
+		iov[i].iov_len = list->length;
+		i++;
+
+		if (i == IOV_MAX)
+		{
+			r = output_writev(fd, iov, i);
+			ERROR_CHECK_NEG(r, "Could not write output.");
+
+			i = 0;
+		}
+
 		list = list->next;
 	}
 
-	return len;
+	if (i > 0)
+	{
+		r = output_writev(fd, iov, i);
+		ERROR_CHECK_NEG(r, "Could not write output.");
+	}
+
+	return 1;
+}
+
+int output_write_json(output_item list, int fd, int trace, int (*filter)(char *))
+{
+	int r;
+	output_json json;
+
+	r = output_json_new(&json, fd, trace, filter);
+	ERROR_CHECK_NEG(r, NULL);
+
+	r = output_json_write(json, list);
+	r = (r < 0) ? r : output_json_end(json);
+
+	output_json_free(json);
+
+	return r;
+}
+
+int output_json_new(output_json *json, int fd, int trace, int (*filter)(char *))
+{
+	assert(json);
+
+	*json = malloc(sizeof(**json));
+	ERROR_CHECK_NULL(*json, "Memory allocation error.");
+
+	(*json)->trace = trace;
+	(*json)->filter = filter;
+	(*json)->started = 0;
+	(*json)->depth = 0;
+	(*json)->buffer.fd = fd;
+	(*json)->buffer.len = 0;
+
+	return 1;
+}
+
+// Without trace, output is a flat array. With trace, each output string is
+// placed in an array keyed by its input, nested under the keys of that
+// input's own inputs. Outputs of the same input are adjacent in the list,
+// so the nesting is written out as the list is walked and only the keys of
+// the last item need to be remembered between calls.
+int output_json_write(output_json json, output_item list)
+{
+	int r, i, depth, common;
+	input_item tmp;
+	input_item path[OUTPUT_JSON_DEPTH];
+
+	assert(json);
+
+	fflush(stdout);
+
+	for (; list != NULL; list = list->next)
+	{
+		if (json->filter && !json->filter((char *)(list->content)))
+		{
+			continue;
+		}
+
+		depth = 0;
+
+		if (json->trace)
+		{
+			for (tmp = list->input; tmp != NULL; tmp = tmp->input)
+			{
+				ERROR_CHECK_TRUE(depth == OUTPUT_JSON_DEPTH, "Input trace is nested too deeply.");
+				depth++;
+			}
+			ERROR_CHECK_TRUE(depth == 0, "Trace output requires input.");
+
+			// Outermost input first.
+			i = depth;
+			for (tmp = list->input; tmp != NULL; tmp = tmp->input)
+			{
+				path[--i] = tmp;
+			}
+		}
+
+		if (!json->started)
+		{
+			json->started = 1;
+			common = 0;
+
+			r = output_buffer_put(&(json->buffer), (json->trace) ? "{" : "[", 1);
+			ERROR_CHECK_NEG(r, NULL);
+		}
+		else
+		{
+			for (common = 0; common < depth && common < json->depth; common++)
+			{
+				if (path[common]->len != json->path_len[common] || memcmp(path[common]->data, json->path[common], path[common]->len) != 0)
+				{
+					break;
+				}
+			}
+
+			// The innermost key holds an array, so it can only be shared
+			// with a path of the same depth.
+			if (depth != json->depth && (common == depth || common == json->depth))
+			{
+				common--;
+			}
+
+			// Close everything below the shared keys.
+			for (i = json->depth; i > common; i--)
+			{
+				r = output_buffer_put(&(json->buffer), "\n", 1);
+				r = (r < 0) ? r : output_buffer_indent(&(json->buffer), i);
+				r = (r < 0) ? r : output_buffer_put(&(json->buffer), (i == json->depth) ? "]" : "}", 1);
+				ERROR_CHECK_NEG(r, NULL);
+
+				free(json->path[i - 1]);
+			}
+			json->depth = common;
+
+			r = output_buffer_put(&(json->buffer), ",", 1);
+			ERROR_CHECK_NEG(r, NULL);
+		}
+
+		// Open the keys that are not shared with the previous item.
+		for (i = common; i < depth; i++)
+		{
+			r = output_buffer_put(&(json->buffer), "\n", 1);
+			r = (r < 0) ? r : output_buffer_indent(&(json->buffer), i + 1);
+			r = (r < 0) ? r : output_buffer_string(&(json->buffer), (char *)(path[i]->data), path[i]->len);
+			r = (r < 0) ? r : output_buffer_put(&(json->buffer), (i == depth - 1) ? ": [" : ": {", 3);
+			ERROR_CHECK_NEG(r, NULL);
+
+			json->path[i] = malloc(path[i]->len);
+			ERROR_CHECK_NULL(json->path[i], "Memory allocation error.");
+
+			memcpy(json->path[i], path[i]->data, path[i]->len);
+			json->path_len[i] = path[i]->len;
+			json->depth = i + 1;
+		}
+
+		r = output_buffer_put(&(json->buffer), "\n", 1);
+		r = (r < 0) ? r : output_buffer_indent(&(json->buffer), depth + 1);
+		r = (r < 0) ? r : output_buffer_string(&(json->buffer), (char *)(list->content), strnlen((char *)(list->content), list->length));
+		ERROR_CHECK_NEG(r, NULL);
+	}
+
+	return 1;
+}
+
+int output_json_end(output_json json)
+{
+	int r, i;
+
+	assert(json);
+
+	// Nothing is printed if every item was filtered out.
+	if (!json->started)
+	{
+		return 1;
+	}
+
+	for (i = json->depth; i > 0; i--)
+	{
+		r = output_buffer_put(&(json->buffer), "\n", 1);
+		r = (r < 0) ? r : output_buffer_indent(&(json->buffer), i);
+		r = (r < 0) ? r : output_buffer_put(&(json->buffer), (i == json->depth) ? "]" : "}", 1);
+		ERROR_CHECK_NEG(r, NULL);
+
+		free(json->path[i - 1]);
+	}
+	json->depth = 0;
+	json->started = 0;
+
+	r = output_buffer_put(&(json->buffer), (json->trace) ? "\n}\n" : "\n]\n", 3);
+	ERROR_CHECK_NEG(r, NULL);
+
+	fflush(stdout);
+
+	r = output_buffer_flush(&(json->buffer));
+	ERROR_CHECK_NEG(r, NULL);
+
+	return 1;
+}
+
+void output_json_free(output_json json)
+{
+	int i;
+
+	if (json == NULL)
+	{
+		return;
+	}
+
+	for (i = 0; i < json->depth; i++)
+	{
+		free(json->path[i]);
+	}
+
+	free(json);
+}
+
+static int output_buffer_put(struct output_buffer *buffer, const char *data, size_t len)
+{
+	int r;
+	size_t n;
+
+	while (len > 0)
+	{
+		if (buffer->len == OUTPUT_BUFFER_SIZE)
+		{
+			r = output_buffer_flush(buffer);
+			ERROR_CHECK_NEG(r, "Could not write output.");
+		}
+
+		n = OUTPUT_BUFFER_SIZE - buffer->len;
+		if (n > len)
+		{
+			n = len;
+		}
+
+		memcpy(buffer->data + buffer->len, data, n);
+		buffer->len += n;
+		data += n;
+		len -= n;
+	}
+
+	return 1;
+}
+
+static int output_buffer_indent(struct output_buffer *buffer, int level)
+{
+	int r;
+
+	while (level-- > 0)
+	{
+		r = output_buffer_put(buffer, "  ", 2);
+		if (r < 0)
+		{
+			return -1;
+		}
+	}
+
+	return 1;
+}
+
+// Quoted and escaped the same way cJSON prints strings.
+static int output_buffer_string(struct output_buffer *buffer, const char *str, size_t len)
+{
+	int r;
+	size_t i, start;
+	char escape[7];
+
+	r = output_buffer_put(buffer, "\"", 1);
+	if (r < 0)
+	{
+		return -1;
+	}
+
+	for (i = 0, start = 0; i < len; i++)
+	{
+		unsigned char c = (unsigned char)str[i];
+
+		if (c >= 32 && c != '"' && c != '\\')
+		{
+			continue;
+		}
+
+		r = output_buffer_put(buffer, str + start, i - start);
+		if (r < 0)
+		{
+			return -1;
+		}
+
+		switch (c)
+		{
+			case '"':  memcpy(escape, "\\\"", 3); break;
+			case '\\': memcpy(escape, "\\\\", 3); break;
+			case '\b': memcpy(escape, "\\b", 3); break;
+			case '\f': memcpy(escape, "\\f", 3); break;
+			case '\n': memcpy(escape, "\\n", 3); break;
+			case '\r': memcpy(escape, "\\r", 3); break;
+			case '\t': memcpy(escape, "\\t", 3); break;
+			default:   sprintf(escape, "\\u%04x", c); break;
+		}
+
+		r = output_buffer_put(buffer, escape, strlen(escape));
+		if (r < 0)
+		{
+			return -1;
+		}
+
+		start = i + 1;
+	}
+
+	r = output_buffer_put(buffer, str + start, len - start);
+	r = (r < 0) ? r : output_buffer_put(buffer, "\"", 1);
+
+	return r;
+}
+
+static int output_buffer_flush(struct output_buffer *buffer)
+{
+	int r;
+	struct iovec iov;
+
+	if (buffer->len == 0)
+	{
+		return 1;
+	}
+
+	iov.iov_base = buffer->data;
+	iov.iov_len = buffer->len;
+
+	r = output_writev(buffer->fd, &iov, 1);
+	ERROR_CHECK_NEG(r, "Could not write output.");
+
+	buffer->len = 0;
+
+	return 1;
+}
+
+static int output_writev(int fd, struct iovec *iov, int iovcnt)
+{
+	ssize_t r;
+
+	while (iovcnt > 0)
+	{
+		r = writev(fd, iov, iovcnt);
+		if (r < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return -1;
+		}
+
+		// Skip over whatever was written and retry the remainder.
+		while (iovcnt > 0 && (size_t)r >= iov->iov_len)
+		{
+			r -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+
+		if (iovcnt > 0)
+		{
+			iov->iov_base = (unsigned char *)iov->iov_base + r;
+			iov->iov_len -= r;
+		}
+	}
+
+	return 1;
 }
 
 void output_free(output_item list)
 {
+	output_arena arena, next;
+
 	if (list == NULL)
 	{
 		return;
 	}
 
-	output_free(list->next);
-	input_free(list->input);
-	free(list->content);
-	free(list);
-}
\ No newline at end of file
+	arena = list->arena;
+
+	while (list != NULL)
+	{
+		input_free(list->input);
+		list = list->next;
+	}
+
+	while (arena != NULL)
+	{
+		next = arena->next;
+		free(arena);
+		arena = next;
+	}
+}
@@ -10,21 +10,34 @@
 
 #include "input.h"
 
+typedef struct output_arena *output_arena;
+typedef struct output_json *output_json;
+
 typedef struct output_item *output_item;
 struct output_item {
 	void *content;
 	size_t length;
 	input_item input;
 	output_item next;
+	output_item tail;       // Only valid on the head of a list
+	size_t count;           // Only valid on the head of a list
+	output_arena arena;     // Only valid on the head of a list
 };
 
-output_item output_new(void *, size_t);
 output_item output_append(output_item, output_item);
 output_item output_append_new(output_item, void *, size_t);
 output_item output_append_new_copy(output_item, void *, size_t);
+output_item output_filter(output_item, int (*)(char *));
 int output_append_input(output_item, input_item, int);
 size_t output_size(output_item);
 size_t output_length(output_item);
+int output_write_list(output_item, int, int (*)(char *));
+int output_write_binary(output_item, int);
+int output_write_json(output_item, int, int, int (*)(char *));
+int output_json_new(output_json *, int, int, int (*)(char *));
+int output_json_write(output_json, output_item);
+int output_json_end(output_json);
+void output_json_free(output_json);
 void output_free(output_item);
 
-#endif
\ No newline at end of file
+#endif
@@ -5,6 +5,7 @@
  * under the terms of the GPL License. See LICENSE for more details.
  */
 
+#include <stdlib.h>
 #include <assert.h>
 #include <gmp.h>
 #ifdef GMP_H_MISSING
@@ -44,8 +45,10 @@ void point_set_generator(Point p)
 
 void point_double(Point result, Point a)
 {
-	static mpz_t tempx, tempy, p, slope;
-	static int init = 0;
+	// Scratch values are kept per thread so that points can be computed
+	// concurrently by worker threads.
+	static __thread mpz_t tempx, tempy, p, slope;
+	static __thread int init = 0;
 	
 	assert(result);
 	assert(a->x && a->y);
@@ -84,8 +87,8 @@ void point_double(Point result, Point a)
 
 void point_add(Point result, Point a, Point b)
 {
-	static mpz_t tempx, tempy, sumx, sumy, p, slope;
-	static int init = 0;
+	static __thread mpz_t tempx, tempy, sumx, sumy, p, slope;
+	static __thread int init = 0;
 	
 	assert(result);
 	assert(a);
@@ -129,6 +132,125 @@ void point_add(Point result, Point a, Point b)
 	mpz_set(result->y, sumy);
 }
 
+/*
+ * Sets results[i] = a[i] + b[i] for n pairs of points, sharing a single
+ * modular inversion between all of them (Montgomery's trick). results may
+ * alias a or b. Returns -1 if a pair has equal x values, which point_add
+ * can not handle either, or if memory can not be allocated.
+ */
+int point_add_batch(Point *results, Point *a, Point *b, size_t n)
+{
+	size_t i;
+	mpz_t *tmp;
+	// Scratch values, including the growing prefix array, are kept per
+	// thread as in point_add.
+	static __thread mpz_t *prefix = NULL;
+	static __thread size_t prefix_len = 0;
+	static __thread mpz_t p, inv, dinv, diff, slope, sumx, sumy;
+	static __thread int init = 0;
+
+	assert(results);
+	assert(a);
+	assert(b);
+
+	if (!init)
+	{
+		mpz_init(p);
+		mpz_init(inv);
+		mpz_init(dinv);
+		mpz_init(diff);
+		mpz_init(slope);
+		mpz_init(sumx);
+		mpz_init(sumy);
+		mpz_set_str(p, BITCOIN_PRIME, 16);
+		init = 1;
+	}
+
+	if (n == 0)
+	{
+		return 1;
+	}
+
+	if (n > prefix_len)
+	{
+		tmp = realloc(prefix, n * sizeof(*prefix));
+		if (tmp == NULL)
+		{
+			return -1;
+		}
+		prefix = tmp;
+
+		for (i = prefix_len; i < n; ++i)
+		{
+			mpz_init(prefix[i]);
+		}
+		prefix_len = n;
+	}
+
+	// prefix[i] = (x2-x1) of pairs 0 through i multiplied together
+	for (i = 0; i < n; ++i)
+	{
+		mpz_sub(diff, b[i]->x, a[i]->x);
+		mpz_mod(diff, diff, p);
+		if (mpz_cmp_ui(diff, 0) == 0)
+		{
+			return -1;
+		}
+
+		if (i == 0)
+		{
+			mpz_set(prefix[i], diff);
+		}
+		else
+		{
+			mpz_mul(prefix[i], prefix[i-1], diff);
+			mpz_mod(prefix[i], prefix[i], p);
+		}
+	}
+
+	mpz_invert(inv, prefix[n-1], p);
+
+	// Walk back, peeling the inverse of one difference off at a time.
+	for (i = n; i-- > 0;)
+	{
+		if (i > 0)
+		{
+			mpz_mul(dinv, inv, prefix[i-1]);
+			mpz_mod(dinv, dinv, p);
+		}
+		else
+		{
+			mpz_set(dinv, inv);
+		}
+
+		mpz_sub(diff, b[i]->x, a[i]->x);
+		mpz_mul(inv, inv, diff);
+		mpz_mod(inv, inv, p);
+
+		// slope = (y2-y1) / (x2-x1)
+		mpz_sub(slope, b[i]->y, a[i]->y);
+		mpz_mul(slope, slope, dinv);
+		mpz_mod(slope, slope, p);
+
+		// xsum = slope^2 - (x1+x2)
+		mpz_mul(sumx, slope, slope);
+		mpz_sub(sumx, sumx, a[i]->x);
+		mpz_sub(sumx, sumx, b[i]->x);
+		mpz_mod(sumx, sumx, p);
+
+		// ysum = slope*(x1-xsum)-y1
+		mpz_sub(sumy, a[i]->x, sumx);
+		mpz_mul(sumy, slope, sumy);
+		mpz_sub(sumy, sumy, a[i]->y);
+		mpz_mod(sumy, sumy, p);
+
+		mpz_set(results[i]->x, sumx);
+		mpz_set(results[i]->y, sumy);
+	}
+
+	return 1;
+}
+
 void point_solve_y(Point point, unsigned char even_odd_flag)
 {
 	mpz_t tempx, tempy, exp, p;
@@ -175,8 +297,8 @@ void point_solve_y(Point point, unsigned char even_odd_flag)
 int point_verify(Point a)
 {
 	int r = 0;
-	static mpz_t tempx, tempy, tempr, p;
-	static int init = 0;
+	static __thread mpz_t tempx, tempy, tempr, p;
+	static __thread int init = 0;
 	
 	assert(a->x && a->y);
 	
@@ -8,6 +8,7 @@
 #ifndef POINT_H
 #define POINT_H 1
 
+#include <stddef.h>
 #include <gmp.h>
 #ifdef GMP_H_MISSING
 #   include "GMP/mini-gmp.h"
@@ -25,6 +26,7 @@ void point_set(Point, Point);
 void point_set_generator(Point);
 void point_double(Point, Point);
 void point_add(Point, Point, Point);
+int  point_add_batch(Point *, Point *, Point *, size_t);
 void point_solve_y(Point, unsigned char);
 int  point_verify(Point);
 void point_clear(Point);
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "pool.h"
+#include "error.h"
+
+struct Pool {
+	int size;
+	pthread_t *threads;
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	int (*job)(void *, size_t);
+	void *arg;
+	size_t count;
+	size_t next;
+	size_t done;
+	int failed;
+	int shutdown;
+};
+
+static void *pool_worker(void *);
+
+int pool_new(Pool *pool, int size)
+{
+	int i, r;
+
+	assert(pool);
+
+	ERROR_CHECK_TRUE((size < 1 || size > POOL_THREADS_MAX), "Invalid number of worker threads.");
+
+	*pool = malloc(sizeof(struct Pool));
+	ERROR_CHECK_NULL(*pool, "Memory allocation error.");
+
+	memset(*pool, 0, sizeof(struct Pool));
+
+	(*pool)->threads = malloc(sizeof(pthread_t) * size);
+	ERROR_CHECK_NULL((*pool)->threads, "Memory allocation error.");
+
+	pthread_mutex_init(&((*pool)->lock), NULL);
+	pthread_cond_init(&((*pool)->work_cond), NULL);
+	pthread_cond_init(&((*pool)->done_cond), NULL);
+
+	for (i = 0; i < size; i++)
+	{
+		r = pthread_create(&((*pool)->threads[i]), NULL, &pool_worker, *pool);
+		ERROR_CHECK_TRUE(r > 0, "Could not create worker thread.");
+
+		(*pool)->size++;
+	}
+
+	return 1;
+}
+
+int pool_run(Pool pool, int (*job)(void *, size_t), void *arg, size_t count)
+{
+	int failed;
+
+	assert(pool);
+	assert(job);
+
+	if (count == 0)
+	{
+		return 1;
+	}
+
+	pthread_mutex_lock(&(pool->lock));
+
+	pool->job = job;
+	pool->arg = arg;
+	pool->next = 0;
+	pool->done = 0;
+	pool->failed = 0;
+	pool->count = count;
+
+	pthread_cond_broadcast(&(pool->work_cond));
+
+	while (pool->done < pool->count)
+	{
+		pthread_cond_wait(&(pool->done_cond), &(pool->lock));
+	}
+
+	failed = pool->failed;
+
+	// Park the workers until the next run.
+	pool->count = 0;
+	pool->next = 0;
+
+	pthread_mutex_unlock(&(pool->lock));
+
+	return (failed) ? -1 : 1;
+}
+
+int pool_size(Pool pool)
+{
+	assert(pool);
+
+	return pool->size;
+}
+
+void pool_free(Pool pool)
+{
+	int i;
+
+	assert(pool);
+
+	pthread_mutex_lock(&(pool->lock));
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&(pool->work_cond));
+	pthread_mutex_unlock(&(pool->lock));
+
+	for (i = 0; i < pool->size; i++)
+	{
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_mutex_destroy(&(pool->lock));
+	pthread_cond_destroy(&(pool->work_cond));
+	pthread_cond_destroy(&(pool->done_cond));
+
+	free(pool->threads);
+	free(pool);
+}
+
+static void *pool_worker(void *arg)
+{
+	int r;
+	size_t i;
+	Pool pool = arg;
+
+	pthread_mutex_lock(&(pool->lock));
+
+	while (1)
+	{
+		while (!pool->shutdown && pool->next >= pool->count)
+		{
+			pthread_cond_wait(&(pool->work_cond), &(pool->lock));
+		}
+
+		if (pool->shutdown)
+		{
+			break;
+		}
+
+		i = pool->next++;
+
+		pthread_mutex_unlock(&(pool->lock));
+
+		r = pool->job(pool->arg, i);
+
+		pthread_mutex_lock(&(pool->lock));
+
+		if (r < 0)
+		{
+			pool->failed = 1;
+		}
+
+		pool->done++;
+		if (pool->done == pool->count)
+		{
+			pthread_cond_signal(&(pool->done_cond));
+		}
+	}
+
+	pthread_mutex_unlock(&(pool->lock));
+
+	return NULL;
+}
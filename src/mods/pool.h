@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#ifndef POOL_H
+#define POOL_H 1
+
+#include <stddef.h>
+
+#define POOL_THREADS_MAX    256
+
+typedef struct Pool *Pool;
+
+int pool_new(Pool *, int);
+int pool_run(Pool, int (*)(void *, size_t), void *, size_t);
+int pool_size(Pool);
+void pool_free(Pool);
+
+#endif
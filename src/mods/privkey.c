@@ -24,16 +24,16 @@
 #include "crypto.h"
 #include "error.h"
 
-#define MAINNET_PREFIX      0x80
-#define TESTNET_PREFIX      0xEF
 
 #define PRIVKEY_COMPRESSED_FLAG    0x01
 #define PRIVKEY_UNCOMPRESSED_FLAG  0x00
 
-struct PrivKey
-{
-	unsigned char data[PRIVKEY_LENGTH];
-	int cflag;
+// Order of the secp256k1 group
+static const unsigned char privkey_curve_order[PRIVKEY_LENGTH] = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFE,
+	0xBA, 0xAE, 0xDC, 0xE6, 0xAF, 0x48, 0xA0, 0x3B,
+	0xBF, 0xD2, 0x5E, 0x8C, 0xD0, 0x36, 0x41, 0x41
 };
 
 int privkey_new(PrivKey key)
@@ -42,12 +42,17 @@ int privkey_new(PrivKey key)
 
 	assert(key);
 
-	r = random_get(key->data, PRIVKEY_LENGTH);
-	if (r < 0)
+	// Draw again until the key is in the valid range [1, n-1].
+	do
 	{
-		error_log("Could not get random data for new private key.");
-		return -1;
+		r = random_get(key->data, PRIVKEY_LENGTH);
+		if (r < 0)
+		{
+			error_log("Could not get random data for new private key.");
+			return -1;
+		}
 	}
+	while (privkey_is_zero(key) || memcmp(key->data, privkey_curve_order, PRIVKEY_LENGTH) >= 0);
 	
 	key->cflag = PRIVKEY_COMPRESSED_FLAG;
 	
@@ -136,25 +141,18 @@ int privkey_to_dec(char *str, PrivKey key)
 	return 1;
 }
 
-int privkey_to_wif(char *str, PrivKey key)
+int privkey_to_wif(char *str, PrivKey key, Network network)
 {
 	int r, len;
 	unsigned char p[PRIVKEY_LENGTH + 2];
-	char *base58check;
 
 	assert(str);
 	assert(key);
+	assert(network);
 
 	len = PRIVKEY_LENGTH + 1;
 
-	if (network_is_main())
-	{
-		p[0] = MAINNET_PREFIX;
-	}
-	else if (network_is_test())
-	{
-		p[0] = TESTNET_PREFIX;
-	}
+	p[0] = network->wif_prefix;
 	memcpy(p+1, key->data, PRIVKEY_LENGTH);
 	if (privkey_is_compressed(key))
 	{
@@ -162,45 +160,29 @@ int privkey_to_wif(char *str, PrivKey key)
 		len += 1;
 	}
 
-	// Assume the base58 string will never be longer
-	// than twice the input string
-	base58check = malloc(len * 2);
-	if (base58check == NULL)
-	{
-		error_log("Memory allocation error.");
-		return -1;
-	}
-	r = base58check_encode(base58check, p, len);
+	r = base58check_encode(str, p, len);
 	if (r < 0)
 	{
 		error_log("Could not encode private key to WIF format.");
 		return -1;
 	}
-
-	strcpy(str, base58check);
-
-	free(base58check);
 	
 	return 1;
 }
 
-int privkey_from_wif(PrivKey key, char *wif)
+/*
+ * The network is taken from the WIF prefix and, when network is not NULL,
+ * returned to the caller.
+ */
+int privkey_from_wif(PrivKey key, char *wif, Network *network)
 {
-	unsigned char *p;
+	unsigned char p[BASE58_DATA_MAX];
 	int l;
+	Network wif_network;
 
 	assert(key);
 	assert(wif);
 
-	// Assume that the length of the decoded data will always
-	// be less than the encoded data
-	p = malloc(strlen(wif) * 2);
-	if (p == NULL)
-	{
-		error_log("Memory allocation error.");
-		return -1;
-	}
-
 	l = base58check_decode(p, wif, BASE58CHECK_TYPE_NA);
 	if (l < 0)
 	{
@@ -214,18 +196,16 @@ int privkey_from_wif(PrivKey key, char *wif)
 		return -1;
 	}
 
-	switch (p[0])
+	wif_network = network_from_wif_prefix(p[0]);
+	if (wif_network == NULL)
 	{
-		case MAINNET_PREFIX:
-			network_set_main();
-			break;
-		case TESTNET_PREFIX:
-			network_set_test();
-			break;
-		default:
-			error_log("Input contains invalid network prefix.");
-			return -1;
-			break;
+		error_log("Input contains invalid network prefix.");
+		return -1;
+	}
+
+	if (network)
+	{
+		*network = wif_network;
 	}
 	
 	if (l == PRIVKEY_LENGTH + 2)
@@ -246,8 +226,6 @@ int privkey_from_wif(PrivKey key, char *wif)
 	}
 
 	memcpy(key->data, p+1, PRIVKEY_LENGTH);
-
-	free(p);
 	
 	return 1;
 }
@@ -525,7 +503,7 @@ int privkey_from_guess(PrivKey key, unsigned char *data, size_t data_len)
 		error_clear();
 
 		// WIF
-		r = privkey_from_wif(key, data_str);
+		r = privkey_from_wif(key, data_str, NULL);
 		if (r > 0)
 		{
 			return PRIVKEY_GUESS_WIF;
@@ -8,6 +8,8 @@
 #ifndef PRIVKEY_H
 #define PRIVKEY_H 1
 
+#include "network.h"
+
 #define PRIVKEY_LENGTH         32
 #define PRIVKEY_WIF_LENGTH_MIN 51
 #define PRIVKEY_WIF_LENGTH_MAX 52
@@ -18,16 +20,22 @@
 #define PRIVKEY_GUESS_RAW      5
 #define PRIVKEY_GUESS_BLOB     6
 
+// Defined here so callers can keep keys on the stack.
 typedef struct PrivKey *PrivKey;
+struct PrivKey
+{
+	unsigned char data[PRIVKEY_LENGTH];
+	int cflag;
+};
 
 int privkey_new(PrivKey);
 int privkey_compress(PrivKey);
 int privkey_uncompress(PrivKey);
 int privkey_to_hex(char *, PrivKey, int);
 int privkey_to_raw(unsigned char *, PrivKey, int);
-int privkey_to_wif(char *, PrivKey);
+int privkey_to_wif(char *, PrivKey, Network);
 int privkey_to_dec(char *, PrivKey);
-int privkey_from_wif(PrivKey, char *);
+int privkey_from_wif(PrivKey, char *, Network *);
 int privkey_from_hex(PrivKey, char *);
 int privkey_from_dec(PrivKey, char *);
 int privkey_from_sbd(PrivKey, char *);
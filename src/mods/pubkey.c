@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <assert.h>
+#include <pthread.h>
 #include <gmp.h>
 #ifdef GMP_H_MISSING
 #   include "GMP/mini-gmp.h"
@@ -28,19 +29,45 @@
 #define PUBKEY_UNCOMPRESSED_FLAG      0x04
 #define PUBKEY_POINTS                 (PRIVKEY_LENGTH * 8)
 
-struct PubKey
-{
-	unsigned char data[PUBKEY_UNCOMPRESSED_LENGTH + 1];
+// Order of the secp256k1 group
+static const unsigned char pubkey_curve_order[PRIVKEY_LENGTH] = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFE,
+	0xBA, 0xAE, 0xDC, 0xE6, 0xAF, 0x48, 0xA0, 0x3B,
+	0xBF, 0xD2, 0x5E, 0x8C, 0xD0, 0x36, 0x41, 0x41
 };
 
+static struct Point generator_points[PUBKEY_POINTS];
+static pthread_once_t generator_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Doublings of the generator point, G * 2^i, are the same for every key.
+ * They are computed once and only read afterwards, so all threads share
+ * them.
+ */
+static void pubkey_init_points(void)
+{
+	size_t i;
+
+	for (i = 0; i < PUBKEY_POINTS; ++i)
+	{
+		point_init(&generator_points[i]);
+	}
+
+	point_set_generator(&generator_points[0]);
+	for (i = 1; i < PUBKEY_POINTS; ++i)
+	{
+		point_double(&generator_points[i], &generator_points[i-1]);
+	}
+}
+
 int pubkey_get(PubKey pubkey, PrivKey privkey)
 {
-	int r;
 	size_t i, l;
-	char privkey_hex[((PRIVKEY_LENGTH + 1) * 2) + 1];
-	mpz_t bignum;
-	Point point;
-	Point points[PUBKEY_POINTS];
+	// Scratch values are kept per thread, as in point.c.
+	static __thread mpz_t bignum;
+	static __thread struct Point point;
+	static __thread int init = 0;
 	
 	assert(privkey);
 	assert(pubkey);
@@ -53,74 +80,45 @@ int pubkey_get(PubKey pubkey, PrivKey privkey)
 		return -1;
 	}
 
-	mpz_init(bignum);
+	pthread_once(&generator_once, pubkey_init_points);
 
-	// Load private key from hex string.
-	r = privkey_to_hex(privkey_hex, privkey, 0);
-	if (r < 0)
-	{
-		error_log("Could not convert private key to hex string.");
-		return -1;
-	}
-	privkey_hex[PRIVKEY_LENGTH * 2] = '\0';
-	mpz_set_str(bignum, privkey_hex, 16);
-	
-	// Initalize the points
-	point = malloc(sizeof(*point));
-	if (point == NULL)
+	if (!init)
 	{
-		error_log("Memory allocation error.");
-		return -1;
-	}
-	point_init(point);
-	for (i = 0; i < PUBKEY_POINTS; ++i)
-	{
-		points[i] = malloc(sizeof(*point));
-		if (points[i] == NULL)
-		{
-			error_log("Memory allocation error.");
-			return -1;
-		}
-		point_init(points[i]);
+		mpz_init(bignum);
+		point_init(&point);
+		init = 1;
 	}
 
-	// Calculating public key
-	point_set_generator(points[0]);
-	for (i = 1; i < PUBKEY_POINTS; ++i)
-	{
-		point_double(points[i], points[i-1]);
-		if (!point_verify(points[i]))
-		{
-			error_log("Unexpected point value while calculating public key.");
-			return -1;
-		}
-	}
+	mpz_import(bignum, PRIVKEY_LENGTH, 1, 1, 1, 0, privkey->data);
+	mpz_set_ui(point.x, 0);
+	mpz_set_ui(point.y, 0);
 
 	// Add all points corresponding to 1 bits
 	for (i = 0; i < PUBKEY_POINTS; ++i)
 	{
 		if (mpz_tstbit(bignum, i) == 1)
 		{
-			if (mpz_cmp_ui(point->x, 0) == 0 && mpz_cmp_ui(point->y, 0) == 0)
+			if (mpz_cmp_ui(point.x, 0) == 0 && mpz_cmp_ui(point.y, 0) == 0)
 			{
-				point_set(point, points[i]);
+				point_set(&point, &generator_points[i]);
 			}
 			else
 			{
-				point_add(point, point, points[i]);
-			}
-			if (!point_verify(points[i]))
-			{
-				error_log("Unexpected point value while calculating public key.");
-				return -1;
+				point_add(&point, &point, &generator_points[i]);
 			}
 		}
 	}
+
+	if (!point_verify(&point))
+	{
+		error_log("Unexpected point value while calculating public key.");
+		return -1;
+	}
 	
 	// Setting compression flag
 	if (privkey_is_compressed(privkey))
 	{
-		if (mpz_even_p(point->y))
+		if (mpz_even_p(point.y))
 		{
 			pubkey->data[0] = PUBKEY_COMPRESSED_FLAG_EVEN;
 		}
@@ -136,8 +134,8 @@ int pubkey_get(PubKey pubkey, PrivKey privkey)
 	
 	// Exporting x,y coordinates as byte string, making sure to leave leading
 	// zeros if either exports as less than 32 bytes.
-	l = (mpz_sizeinbase(point->x, 2) + 7) / 8;
-	mpz_export(pubkey->data + 1 + (32 - l), &i, 1, 1, 1, 0, point->x);
+	l = (mpz_sizeinbase(point.x, 2) + 7) / 8;
+	mpz_export(pubkey->data + 1 + (32 - l), &i, 1, 1, 1, 0, point.x);
 	if (l != i)
 	{
 		error_log("Length of public key x-value export (%zu) does not match expected length (%zu).", i, l);
@@ -145,8 +143,8 @@ int pubkey_get(PubKey pubkey, PrivKey privkey)
 	}
 	if (!privkey_is_compressed(privkey))
 	{
-		l = (mpz_sizeinbase(point->y, 2) + 7) / 8;
-		mpz_export(pubkey->data + 33 + (32 - l), &i, 1, 1, 1, 0, point->y);
+		l = (mpz_sizeinbase(point.y, 2) + 7) / 8;
+		mpz_export(pubkey->data + 33 + (32 - l), &i, 1, 1, 1, 0, point.y);
 		if (l != i)
 		{
 			error_log("Length of public key y-value export (%zu) does not match expected length (%zu).", i, l);
@@ -154,29 +152,178 @@ int pubkey_get(PubKey pubkey, PrivKey privkey)
 		}
 	}
 
-	// Clear all mpz data
-	mpz_clear(bignum);
-	point_clear(point);
-	for (i = 0; i < PUBKEY_POINTS; ++i)
+	return 1;
+}
+
+/*
+ * Writes the 32 byte x-only output keys Q = P + hash_TapTweak(P)G used by
+ * key-path-only P2TR outputs (BIP86), where P is each key lifted to even
+ * y, for count keys into count * 32 bytes of output.
+ *
+ * The tweak multiplications of all keys walk the generator doublings
+ * together, so each doubling costs one field inversion for the whole
+ * batch instead of one per key.
+ */
+int pubkey_get_taproot_batch(unsigned char *output, PubKey keys, size_t count)
+{
+	int r = -1;
+	size_t i, k, n, l, e;
+	size_t points_len = 0;
+	unsigned char *xs = NULL;
+	unsigned char *tweaks = NULL;
+	int *started = NULL;
+	struct PrivKey tweak;
+	struct Point *acc = NULL;
+	struct Point *lifted = NULL;
+	Point *a = NULL;
+	Point *b = NULL;
+
+	assert(output);
+	assert(keys);
+
+	if (count == 0)
+	{
+		return 1;
+	}
+
+	pthread_once(&generator_once, pubkey_init_points);
+
+	xs = malloc(count * PUBKEY_COMPRESSED_LENGTH);
+	tweaks = malloc(count * PRIVKEY_LENGTH);
+	started = calloc(count, sizeof(*started));
+	acc = malloc(count * sizeof(*acc));
+	lifted = malloc(count * sizeof(*lifted));
+	a = malloc(count * sizeof(*a));
+	b = malloc(count * sizeof(*b));
+	if (!xs || !tweaks || !started || !acc || !lifted || !a || !b)
+	{
+		error_log("Memory allocation error.");
+		goto cleanup;
+	}
+
+	for (k = 0; k < count; ++k)
 	{
-		point_clear(points[i]);
+		memcpy(xs + (k * PUBKEY_COMPRESSED_LENGTH), keys[k].data + 1, PUBKEY_COMPRESSED_LENGTH);
 	}
 
-	// Free all points
-	free(point);
+	r = crypto_get_tagged_hash_batch(tweaks, "TapTweak", xs, PUBKEY_COMPRESSED_LENGTH, count);
+	if (r < 0)
+	{
+		error_log("Could not calculate taproot tweak.");
+		goto cleanup;
+	}
+	r = -1;
+
+	for (k = 0; k < count; ++k)
+	{
+		memcpy(tweak.data, tweaks + (k * PRIVKEY_LENGTH), PRIVKEY_LENGTH);
+		if (privkey_is_zero(&tweak) || memcmp(tweak.data, pubkey_curve_order, PRIVKEY_LENGTH) >= 0)
+		{
+			error_log("Taproot tweak is out of range.");
+			goto cleanup;
+		}
+	}
+
+	for (k = 0; k < count; ++k)
+	{
+		point_init(&acc[k]);
+		point_init(&lifted[k]);
+	}
+	points_len = count;
+
+	// acc = tweak * G, adding G * 2^i for each bit i set in the tweak.
 	for (i = 0; i < PUBKEY_POINTS; ++i)
 	{
-		free(points[i]);
+		n = 0;
+		for (k = 0; k < count; ++k)
+		{
+			// Tweaks are big-endian.
+			e = tweaks[(k * PRIVKEY_LENGTH) + PRIVKEY_LENGTH - 1 - (i / 8)];
+			if (!((e >> (i % 8)) & 1))
+			{
+				continue;
+			}
+
+			if (!started[k])
+			{
+				point_set(&acc[k], &generator_points[i]);
+				started[k] = 1;
+			}
+			else
+			{
+				a[n] = &acc[k];
+				b[n] = &generator_points[i];
+				n++;
+			}
+		}
+
+		if (point_add_batch(a, a, b, n) < 0)
+		{
+			error_log("Could not add points while calculating taproot tweak.");
+			goto cleanup;
+		}
 	}
 
-	return 1;
+	for (k = 0; k < count; ++k)
+	{
+		mpz_import(lifted[k].x, PUBKEY_COMPRESSED_LENGTH, 1, 1, 1, 0, keys[k].data + 1);
+		point_solve_y(&lifted[k], PUBKEY_COMPRESSED_FLAG_EVEN);
+
+		a[k] = &lifted[k];
+		b[k] = &acc[k];
+	}
+
+	if (point_add_batch(a, a, b, count) < 0)
+	{
+		error_log("Could not add taproot tweak point to the internal key.");
+		goto cleanup;
+	}
+
+	memset(output, 0, count * PUBKEY_COMPRESSED_LENGTH);
+
+	for (k = 0; k < count; ++k)
+	{
+		if (!point_verify(&lifted[k]))
+		{
+			error_log("Unexpected point value while calculating taproot output key.");
+			goto cleanup;
+		}
+
+		l = (mpz_sizeinbase(lifted[k].x, 2) + 7) / 8;
+		mpz_export(output + (k * PUBKEY_COMPRESSED_LENGTH) + (32 - l), &e, 1, 1, 1, 0, lifted[k].x);
+		if (l != e)
+		{
+			error_log("Length of taproot output key export (%zu) does not match expected length (%zu).", e, l);
+			goto cleanup;
+		}
+	}
+
+	r = 1;
+
+	cleanup:
+
+	for (k = 0; k < points_len; ++k)
+	{
+		point_clear(&acc[k]);
+		point_clear(&lifted[k]);
+	}
+
+	free(xs);
+	free(tweaks);
+	free(started);
+	free(acc);
+	free(lifted);
+	free(a);
+	free(b);
+
+	return r;
 }
 
 int pubkey_from_hex(PubKey key, char *input)
 {
 	int r;
 	size_t input_len;
-	unsigned char *raw_input;
+	unsigned char raw_input[PUBKEY_UNCOMPRESSED_LENGTH + 1];
 	
 	assert(input);
 	assert(key);
@@ -189,10 +336,9 @@ int pubkey_from_hex(PubKey key, char *input)
 		return -1;
 	}
 
-	raw_input = malloc(input_len / 2);
-	if (raw_input == NULL)
+	if (input_len / 2 > PUBKEY_UNCOMPRESSED_LENGTH + 1)
 	{
-		error_log("Memory allocation error.");
+		error_log("Input is too long to be a public key.");
 		return -1;
 	}
 
@@ -210,8 +356,6 @@ int pubkey_from_hex(PubKey key, char *input)
 		return -1;
 	}
 
-	free(raw_input);
-
 	return 1;
 }
 
@@ -246,12 +390,16 @@ int pubkey_from_raw(PubKey key, unsigned char *input, size_t input_len)
 	return 1;
 }
 
-int pubkey_from_guess(PubKey key, unsigned char *input, size_t input_len)
+/*
+ * When the input is a WIF private key and network is not NULL, the WIF
+ * network is returned to the caller.
+ */
+int pubkey_from_guess(PubKey key, unsigned char *input, size_t input_len, Network *network)
 {
 	int r;
 	size_t i;
 	char input_str[BUFSIZ];
-	PrivKey privkey;
+	struct PrivKey privkey;
 
 	assert(key);
 	assert(input);
@@ -273,21 +421,16 @@ int pubkey_from_guess(PubKey key, unsigned char *input, size_t input_len)
 
 	if (*input_str)
 	{
-		privkey = malloc(privkey_sizeof());
-		ERROR_CHECK_NULL(privkey, "Memory allocation error.");
-
-		r = privkey_from_wif(privkey, input_str);
+		r = privkey_from_wif(&privkey, input_str, network);
 		if (r > 0)
 		{
-			r = pubkey_get(key, privkey);
+			r = pubkey_get(key, &privkey);
 			if (r > 0)
 			{
-				free(privkey);
 				return 1;
 			}
 		}
 
-		free(privkey);
 		error_clear();
 
 		r = pubkey_from_hex(key, input_str);
@@ -336,7 +479,7 @@ int pubkey_compress(PubKey key)
 int pubkey_uncompress(PubKey key)
 {
 	size_t i, l;
-	Point point;
+	struct Point point;
 
 	if (key->data[0] == PUBKEY_UNCOMPRESSED_FLAG)
 	{
@@ -349,19 +492,13 @@ int pubkey_uncompress(PubKey key)
 		return -1;
 	}
 
-	point = malloc(sizeof(*point));
-	if (point == NULL)
-	{
-		error_log("Memory allocation error.");
-		return -1;
-	}
-	point_init(point);
+	point_init(&point);
 
-	mpz_import(point->x, PUBKEY_COMPRESSED_LENGTH, 1, 1, 1, 0, key->data + 1);
+	mpz_import(point.x, PUBKEY_COMPRESSED_LENGTH, 1, 1, 1, 0, key->data + 1);
 
-	point_solve_y(point, key->data[0]);
+	point_solve_y(&point, key->data[0]);
 
-	if (!point_verify(point))
+	if (!point_verify(&point))
 	{
 		error_log("Invalid point values.");
 		return -1;
@@ -369,8 +506,8 @@ int pubkey_uncompress(PubKey key)
 
 	memset(key->data + 33, 0, 32);
 
-	l = (mpz_sizeinbase(point->y, 2) + 7) / 8;
-	mpz_export(key->data + 33 + (32 - l), &i, 1, 1, 1, 0, point->y);
+	l = (mpz_sizeinbase(point.y, 2) + 7) / 8;
+	mpz_export(key->data + 33 + (32 - l), &i, 1, 1, 1, 0, point.y);
 	if (l != i)
 	{
 		error_log("Length of public key y-value export (%zu) does not match expected length (%zu).", i, l);
@@ -379,8 +516,7 @@ int pubkey_uncompress(PubKey key)
 
 	key->data[0] = PUBKEY_UNCOMPRESSED_FLAG;
 
-	point_clear(point);
-	free(point);
+	point_clear(&point);
 
 	return 1;
 }
@@ -13,12 +13,18 @@
 #define PUBKEY_UNCOMPRESSED_LENGTH    64
 #define PUBKEY_COMPRESSED_LENGTH      32
 
+// Defined here so callers can keep keys on the stack.
 typedef struct PubKey *PubKey;
+struct PubKey
+{
+	unsigned char data[PUBKEY_UNCOMPRESSED_LENGTH + 1];
+};
 
 int pubkey_get(PubKey, PrivKey);
+int pubkey_get_taproot_batch(unsigned char *, PubKey, size_t);
 int pubkey_from_hex(PubKey, char *);
 int pubkey_from_raw(PubKey, unsigned char *, size_t);
-int pubkey_from_guess(PubKey, unsigned char *, size_t);
+int pubkey_from_guess(PubKey, unsigned char *, size_t, Network *);
 int pubkey_compress(PubKey);
 int pubkey_uncompress(PubKey);
 int pubkey_is_compressed(PubKey);
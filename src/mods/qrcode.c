@@ -5,9 +5,12 @@
  * under the terms of the GPL License. See LICENSE for more details.
  */
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <assert.h>
+#include "qrcode.h"
 #include "error.h"
 #include "QRCodeGen/qrcodegen.h"
 
@@ -27,77 +30,192 @@
 #define BLOCK_UR_LL_LR  "\xe2\x96\x84\xe2\x96\x88"
 #define BLOCK_FULL      "\xe2\x96\x88\xe2\x96\x88"
 #define BLOCK_EMPTY     "  "
+#define BLOCK_MAX_LEN   6
 
-int qrcode_from_str(char *output, char *input)
-{
-	int x, y;
-	int size;
-	int border = 0;
-	bool ok;
-	enum qrcodegen_Ecc errCorLvl = qrcodegen_Ecc_LOW;
+#define QRCODE_BORDER       4       // Quiet zone for SVG and PBM images
+#define QRCODE_PBM_SCALE    8       // Pixels per module in PBM images
+#define QRCODE_SVG_HEADER   "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\" viewBox=\"0 0 %d %d\" stroke=\"none\">\n<rect width=\"100%%\" height=\"100%%\" fill=\"#FFFFFF\"/>\n<path fill=\"#000000\" d=\""
+#define QRCODE_SVG_FOOTER   "\"/>\n</svg>\n"
+#define QRCODE_SVG_RUN_MAX  32      // Longest "M%d,%dh%dv1h-%dz" path segment
 
-	int ul, ur, ll, lr;
-	char *block_string = NULL;
+// Indexed by the four modules of a 2x2 cell: ul, ur, ll, lr from the
+// high bit down.
+static const char *blocks[16] = {
+	BLOCK_EMPTY, BLOCK_LR, BLOCK_LL, BLOCK_LL_LR,
+	BLOCK_UR, BLOCK_UR_LR, BLOCK_UR_LL, BLOCK_UR_LL_LR,
+	BLOCK_UL, BLOCK_UL_LR, BLOCK_UL_LL, BLOCK_UL_LL_LR,
+	BLOCK_UL_UR, BLOCK_UL_UR_LR, BLOCK_UL_UR_LL, BLOCK_FULL
+};
 
-	assert(input);
-	assert(output);
+static size_t qrcode_render_text(char *, uint8_t *, int);
+static size_t qrcode_render_svg(char *, uint8_t *, int);
+static size_t qrcode_render_pbm(char *, uint8_t *, int);
 
+/*
+ * Renders input as a QR code in the given format. The result is written to
+ * a single buffer sized up front from the symbol size, so rendering is
+ * linear in the number of modules. The buffer is null terminated (PBM
+ * images are binary, so use the returned length) and must be freed by the
+ * caller.
+ */
+int qrcode_render(char **output, size_t *output_len, char *input, int format)
+{
+	int size, cells;
+	size_t buffer_size;
+	bool ok;
+	char *buffer;
 	uint8_t qrcode[qrcodegen_BUFFER_LEN_MAX];
 	uint8_t tempBuffer[qrcodegen_BUFFER_LEN_MAX];
 
-	ok = qrcodegen_encodeText(input, tempBuffer, qrcode, errCorLvl, qrcodegen_VERSION_MIN, qrcodegen_VERSION_MAX, qrcodegen_Mask_AUTO, true);
+	assert(output);
+	assert(output_len);
+	assert(input);
+
+	ok = qrcodegen_encodeText(input, tempBuffer, qrcode, qrcodegen_Ecc_LOW, qrcodegen_VERSION_MIN, qrcodegen_VERSION_MAX, qrcodegen_Mask_AUTO, true);
 	ERROR_CHECK_FALSE(ok, "Could not encode QR code.");
 
 	size = qrcodegen_getSize(qrcode);
-	for (y = -border; y < size + border; y += 2)
+	cells = (size + 1) / 2;
+
+	switch (format)
 	{
-		for (x = -border; x < size + border; x += 2)
+		case QRCODE_FORMAT_TEXT:
+			buffer_size = (size_t)cells * (cells * BLOCK_MAX_LEN + 1);
+			break;
+		case QRCODE_FORMAT_SVG:
+			buffer_size = sizeof(QRCODE_SVG_HEADER) + sizeof(QRCODE_SVG_FOOTER) + 32;
+			buffer_size += (size_t)size * cells * QRCODE_SVG_RUN_MAX;
+			break;
+		case QRCODE_FORMAT_PBM:
+			buffer_size = 32;
+			buffer_size += (size_t)((size + QRCODE_BORDER * 2) * QRCODE_PBM_SCALE + 7) / 8 * (size + QRCODE_BORDER * 2) * QRCODE_PBM_SCALE;
+			break;
+		default:
+			error_log("Unknown QR code format.");
+			return -1;
+	}
+
+	buffer = malloc(buffer_size + 1);
+	ERROR_CHECK_NULL(buffer, "Memory allocation error.");
+
+	switch (format)
+	{
+		case QRCODE_FORMAT_TEXT:
+			*output_len = qrcode_render_text(buffer, qrcode, size);
+			break;
+		case QRCODE_FORMAT_SVG:
+			*output_len = qrcode_render_svg(buffer, qrcode, size);
+			break;
+		case QRCODE_FORMAT_PBM:
+			*output_len = qrcode_render_pbm(buffer, qrcode, size);
+			break;
+	}
+
+	assert(*output_len <= buffer_size);
+	buffer[*output_len] = '\0';
+
+	*output = buffer;
+
+	return 1;
+}
+
+static size_t qrcode_render_text(char *output, uint8_t *qrcode, int size)
+{
+	int x, y, i;
+	size_t len;
+	const char *block;
+	char *p = output;
+
+	for (y = 0; y < size; y += 2)
+	{
+		for (x = 0; x < size; x += 2)
 		{
-			ul = qrcodegen_getModule(qrcode, x, y);
-			ur = qrcodegen_getModule(qrcode, x+1, y);
-			ll = qrcodegen_getModule(qrcode, x, y+1);
-			lr = qrcodegen_getModule(qrcode, x+1, y+1);
-
-			if (ul && !ur && !ll && !lr)
-				block_string = BLOCK_UL;
-			else if (!ul && ur && !ll && !lr)
-				block_string = BLOCK_UR;
-			else if (!ul && !ur && ll && !lr)
-				block_string = BLOCK_LL;
-			else if (!ul && !ur && !ll && lr)
-				block_string = BLOCK_LR;
-			else if (ul && ur && !ll && !lr)
-				block_string = BLOCK_UL_UR;
-			else if (!ul && !ur && ll && lr)
-				block_string = BLOCK_LL_LR;
-			else if (ul && !ur && ll && !lr)
-				block_string = BLOCK_UL_LL;
-			else if (!ul && ur && !ll && lr)
-				block_string = BLOCK_UR_LR;
-			else if (ul && !ur && !ll && lr)
-				block_string = BLOCK_UL_LR;
-			else if (!ul && ur && ll && !lr)
-				block_string = BLOCK_UR_LL;
-			else if (ul && ur && ll && !lr)
-				block_string = BLOCK_UL_UR_LL;
-			else if (ul && ur && !ll && lr)
-				block_string = BLOCK_UL_UR_LR;
-			else if (ul && !ur && ll && lr)
-				block_string = BLOCK_UL_LL_LR;
-			else if (!ul && ur && ll && lr)
-				block_string = BLOCK_UR_LL_LR;
-			else if (ul && ur && ll && lr)
-				block_string = BLOCK_FULL;
-			else
-				block_string = BLOCK_EMPTY;
-
-			strcat(output, block_string);
-
-			// Leaving here in case I implement an option to print a bigger size
-			//strcat(output, (qrcodegen_getModule(qrcode, x, y) ? "\xe2\x96\x88\xe2\x96\x88" : " "));
+			i = qrcodegen_getModule(qrcode, x, y) << 3;
+			i |= qrcodegen_getModule(qrcode, x+1, y) << 2;
+			i |= qrcodegen_getModule(qrcode, x, y+1) << 1;
+			i |= qrcodegen_getModule(qrcode, x+1, y+1);
+
+			block = blocks[i];
+			len = strlen(block);
+			memcpy(p, block, len);
+			p += len;
 		}
-		strcat(output, "\n");
+		*p++ = '\n';
 	}
 
-	return 1;
-}
\ No newline at end of file
+	return p - output;
+}
+
+static size_t qrcode_render_svg(char *output, uint8_t *qrcode, int size)
+{
+	int x, y, run;
+	int dim = size + QRCODE_BORDER * 2;
+	char *p = output;
+
+	p += sprintf(p, QRCODE_SVG_HEADER, dim, dim);
+
+	// One path segment per horizontal run of dark modules.
+	for (y = 0; y < size; y++)
+	{
+		for (x = 0; x < size; x++)
+		{
+			if (!qrcodegen_getModule(qrcode, x, y))
+			{
+				continue;
+			}
+
+			for (run = 1; x + run < size && qrcodegen_getModule(qrcode, x + run, y); run++)
+				;
+
+			p += sprintf(p, "M%d,%dh%dv1h-%dz", x + QRCODE_BORDER, y + QRCODE_BORDER, run, run);
+
+			x += run;
+		}
+	}
+
+	memcpy(p, QRCODE_SVG_FOOTER, sizeof(QRCODE_SVG_FOOTER) - 1);
+	p += sizeof(QRCODE_SVG_FOOTER) - 1;
+
+	return p - output;
+}
+
+static size_t qrcode_render_pbm(char *output, uint8_t *qrcode, int size)
+{
+	int x, y, px, s;
+	int dim = (size + QRCODE_BORDER * 2) * QRCODE_PBM_SCALE;
+	int row_len = (dim + 7) / 8;
+	char *p = output;
+	unsigned char *row;
+
+	p += sprintf(p, "P4\n%d %d\n", dim, dim);
+
+	// Each module row is packed once and repeated for the scale.
+	for (y = -QRCODE_BORDER; y < size + QRCODE_BORDER; y++)
+	{
+		row = (unsigned char *)p;
+		memset(row, 0, row_len);
+
+		for (x = 0; x < size; x++)
+		{
+			if (!qrcodegen_getModule(qrcode, x, y))
+			{
+				continue;
+			}
+
+			px = (x + QRCODE_BORDER) * QRCODE_PBM_SCALE;
+			for (s = 0; s < QRCODE_PBM_SCALE; s++, px++)
+			{
+				row[px / 8] |= 0x80 >> (px % 8);
+			}
+		}
+		p += row_len;
+
+		for (s = 1; s < QRCODE_PBM_SCALE; s++)
+		{
+			memcpy(p, row, row_len);
+			p += row_len;
+		}
+	}
+
+	return p - output;
+}
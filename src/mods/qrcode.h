@@ -8,6 +8,12 @@
 #ifndef QRCODE_H
 #define QRCODE_H 1
 
-int qrcode_from_str(char *, char *);
+#include <stddef.h>
+
+#define QRCODE_FORMAT_TEXT   0
+#define QRCODE_FORMAT_SVG    1
+#define QRCODE_FORMAT_PBM    2
+
+int qrcode_render(char **, size_t *, char *, int);
 
 #endif
\ No newline at end of file
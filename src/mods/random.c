@@ -6,41 +6,250 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <assert.h>
+#include <sys/random.h>
+#include "random.h"
 #include "error.h"
 
-#define RANDOM_SOURCE "/dev/urandom"
+#define RANDOM_SOURCE          "/dev/urandom"
+#define RANDOM_KEY_LENGTH      32
+#define RANDOM_BLOCK_LENGTH    64
+#define RANDOM_BLOCKS          16
+#define RANDOM_BUFFER_LENGTH   (RANDOM_BLOCK_LENGTH * RANDOM_BLOCKS)
+#define RANDOM_RESEED_BYTES    (1024 * 1024)
+
+#define ROTL32(v, n)           (((v) << (n)) | ((v) >> (32 - (n))))
+#define QUARTERROUND(x, a, b, c, d) \
+	x[a] += x[b]; x[d] ^= x[a]; x[d] = ROTL32(x[d], 16); \
+	x[c] += x[d]; x[b] ^= x[c]; x[b] = ROTL32(x[b], 12); \
+	x[a] += x[b]; x[d] ^= x[a]; x[d] = ROTL32(x[d], 8);  \
+	x[c] += x[d]; x[b] ^= x[c]; x[b] = ROTL32(x[b], 7);
+
+/*
+ * Each thread runs its own ChaCha20 key stream, seeded from the kernel.
+ * The first bytes of every refill become the next key and are wiped, so
+ * bytes already handed out can not be recovered from the state. A forked
+ * child, or a thread that has produced RANDOM_RESEED_BYTES, seeds again
+ * before producing more.
+ */
+struct random_state {
+	uint32_t key[RANDOM_KEY_LENGTH / 4];
+	unsigned char buffer[RANDOM_BUFFER_LENGTH];
+	size_t pos;
+	size_t count;
+	unsigned long generation;
+	int seeded;
+};
+
+static __thread struct random_state state;
+static unsigned long fork_generation = 0;
+static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+
+static void random_chacha20_block(unsigned char *, uint32_t *, uint32_t);
+static void random_refill(void);
+static int random_seed(void);
+static int random_get_entropy(unsigned char *, size_t);
+static void random_atfork_child(void);
+static void random_atfork_register(void);
 
 int random_get(unsigned char *output, size_t bytes)
 {
-	size_t i;
-	int c;
-	FILE *source;
+	int r;
+	size_t len;
 
 	assert(output);
 	assert(bytes);
 
-	source = fopen(RANDOM_SOURCE, "r");
-	if (source == NULL)
+	pthread_once(&atfork_once, random_atfork_register);
+
+	if (!state.seeded || state.count >= RANDOM_RESEED_BYTES || state.generation != __atomic_load_n(&fork_generation, __ATOMIC_ACQUIRE))
+	{
+		r = random_seed();
+		ERROR_CHECK_NEG(r, "Could not seed random number generator.");
+	}
+
+	state.count += bytes;
+
+	while (bytes > 0)
+	{
+		if (state.pos == RANDOM_BUFFER_LENGTH)
+		{
+			random_refill();
+		}
+
+		len = RANDOM_BUFFER_LENGTH - state.pos;
+		if (len > bytes)
+		{
+			len = bytes;
+		}
+
+		memcpy(output, state.buffer + state.pos, len);
+		memset(state.buffer + state.pos, 0, len);
+
+		state.pos += len;
+		output += len;
+		bytes -= len;
+	}
+
+	return 1;
+}
+
+static void random_chacha20_block(unsigned char *output, uint32_t *key, uint32_t counter)
+{
+	int i;
+	uint32_t input[16], x[16];
+
+	// "expand 32-byte k"
+	input[0] = 0x61707865;
+	input[1] = 0x3320646e;
+	input[2] = 0x79622d32;
+	input[3] = 0x6b206574;
+	for (i = 0; i < 8; ++i)
+	{
+		input[4 + i] = key[i];
+	}
+	input[12] = counter;
+	input[13] = 0;
+	input[14] = 0;
+	input[15] = 0;
+
+	memcpy(x, input, sizeof(x));
+
+	for (i = 0; i < 10; ++i)
+	{
+		QUARTERROUND(x, 0, 4,  8, 12)
+		QUARTERROUND(x, 1, 5,  9, 13)
+		QUARTERROUND(x, 2, 6, 10, 14)
+		QUARTERROUND(x, 3, 7, 11, 15)
+		QUARTERROUND(x, 0, 5, 10, 15)
+		QUARTERROUND(x, 1, 6, 11, 12)
+		QUARTERROUND(x, 2, 7,  8, 13)
+		QUARTERROUND(x, 3, 4,  9, 14)
+	}
+
+	for (i = 0; i < 16; ++i)
+	{
+		x[i] += input[i];
+		output[i * 4 + 0] = x[i] & 0xFF;
+		output[i * 4 + 1] = (x[i] >> 8) & 0xFF;
+		output[i * 4 + 2] = (x[i] >> 16) & 0xFF;
+		output[i * 4 + 3] = (x[i] >> 24) & 0xFF;
+	}
+
+	memset(x, 0, sizeof(x));
+	memset(input, 0, sizeof(input));
+}
+
+static void random_refill(void)
+{
+	int i;
+
+	for (i = 0; i < RANDOM_BLOCKS; ++i)
+	{
+		random_chacha20_block(state.buffer + (i * RANDOM_BLOCK_LENGTH), state.key, i);
+	}
+
+	// Fast key erasure
+	memcpy(state.key, state.buffer, RANDOM_KEY_LENGTH);
+	memset(state.buffer, 0, RANDOM_KEY_LENGTH);
+
+	state.pos = RANDOM_KEY_LENGTH;
+}
+
+static int random_seed(void)
+{
+	int r;
+
+	// Read the generation before seeding, so a fork during the read is
+	// caught on the next call.
+	state.generation = __atomic_load_n(&fork_generation, __ATOMIC_ACQUIRE);
+
+	r = random_get_entropy((unsigned char *)state.key, RANDOM_KEY_LENGTH);
+	ERROR_CHECK_NEG(r, NULL);
+
+	random_refill();
+
+	state.count = 0;
+	state.seeded = 1;
+
+	return 1;
+}
+
+static int random_get_entropy(unsigned char *output, size_t bytes)
+{
+	int fd;
+	ssize_t r;
+
+	while (bytes > 0)
+	{
+		r = getrandom(output, bytes, 0);
+		if (r < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			if (errno == ENOSYS)
+			{
+				break;
+			}
+
+			error_log("Could not get random data from kernel. Errno %i.", errno);
+			return -1;
+		}
+
+		output += r;
+		bytes -= r;
+	}
+
+	if (bytes == 0)
+	{
+		return 1;
+	}
+
+	// Kernels without getrandom()
+	fd = open(RANDOM_SOURCE, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
 	{
 		error_log("Unable to open source file %s. Errno %i.", RANDOM_SOURCE, errno);
 		return -1;
 	}
 
-	for (i = 0; i < bytes; ++i)
+	while (bytes > 0)
 	{
-		c = fgetc(source);
-		if (c == EOF)
+		r = read(fd, output, bytes);
+		if (r < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (r <= 0)
 		{
-			error_log("Could not read character from source file %s.", RANDOM_SOURCE);
+			close(fd);
+			error_log("Could not read from source file %s.", RANDOM_SOURCE);
 			return -1;
 		}
 
-		output[i] = c;
+		output += r;
+		bytes -= r;
 	}
 
-	fclose(source);
+	close(fd);
 
 	return 1;
 }
+
+static void random_atfork_child(void)
+{
+	__atomic_add_fetch(&fork_generation, 1, __ATOMIC_RELEASE);
+}
+
+static void random_atfork_register(void)
+{
+	pthread_atfork(NULL, NULL, &random_atfork_child);
+}
@@ -298,11 +298,11 @@ char *script_from_raw(unsigned char *raw, size_t l)
 	return r;
 }
 
-int script_get_output_address(char *address, unsigned char *script, uint64_t size, uint32_t tx_version)
+int script_get_output_address(char *address, unsigned char *script, uint64_t size, uint32_t tx_version, Network network)
 {
 	int r;
 	unsigned char last_op;
-	PubKey pubkey = NULL;
+	struct PubKey pubkey;
 	int uc_pubkey_len = PUBKEY_UNCOMPRESSED_LENGTH + 1;
 	int c_pubkey_len = PUBKEY_COMPRESSED_LENGTH + 1;
 	unsigned char tmp[BUFSIZ];
@@ -323,19 +323,19 @@ int script_get_output_address(char *address, unsigned char *script, uint64_t siz
 	// witness_v0_keyhash, 20 byte
 	if (*script == 0x00 && *(script + 1) == 0x14 && (int)size == (1 + 1 + *(script + 1)))
 	{
-		r = address_p2wpkh_from_raw(address, script + 2, 0x14, 0);
+		r = address_p2wpkh_from_raw(address, script + 2, 0x14, 0, network);
 		ERROR_CHECK_NEG(r, "Could not generate address from value data.");
 	}
 	// witness_v0_keyhash, 32 byte
 	else if (*script == 0x00 && *(script + 1) == 0x20 && (int)size == (1 + 1 + *(script + 1)))
 	{
-		r = address_p2wpkh_from_raw(address, script + 2, 0x20, 0);
+		r = address_p2wpkh_from_raw(address, script + 2, 0x20, 0, network);
 		ERROR_CHECK_NEG(r, "Could not generate address from value data.");
 	}
 	// witness_v1_taproot, 32 byte
 	else if (*script == 0x51 && *(script + 1) == 0x20 && (int)size == (1 + 1 + *(script + 1)))
 	{
-		r = address_p2wpkh_from_raw(address, script + 2, 0x20, 1);
+		r = address_p2wpkh_from_raw(address, script + 2, 0x20, 1, network);
 		ERROR_CHECK_NEG(r, "Could not generate address from value data.");
 	}
 	// OP_CHECKSIG
@@ -344,7 +344,7 @@ int script_get_output_address(char *address, unsigned char *script, uint64_t siz
 		// Hash160
 		if (*script == 0x76 && *(script + 1) == 0xa9 && *(script + 2) == 0x14)
 		{
-			r = address_from_rmd160(address, script + 3);
+			r = address_from_rmd160(address, script + 3, network);
 			ERROR_CHECK_NEG(r, "Could not generate address from value data.");
 		}
 		// Hash160 - all zeros - burner address?
@@ -352,7 +352,7 @@ int script_get_output_address(char *address, unsigned char *script, uint64_t siz
 		{
 			memset(tmp, 0, BUFSIZ);
 
-			r = address_from_rmd160(address, tmp);
+			r = address_from_rmd160(address, tmp, network);
 			ERROR_CHECK_NEG(r, "Could not generate address from value data.");
 		}
 		// Uncompressed Public Key
@@ -363,15 +363,11 @@ int script_get_output_address(char *address, unsigned char *script, uint64_t siz
 			// Make sure the compression flag is correct
 			if (*script == 0x04)
 			{
-				pubkey = malloc(pubkey_sizeof());
-
-				r = pubkey_from_raw(pubkey, script, uc_pubkey_len);
+				r = pubkey_from_raw(&pubkey, script, uc_pubkey_len);
 				ERROR_CHECK_NEG(r, "Can not get pubkey object from output script.");
 
-				r = address_get_p2pkh(address, pubkey);
+				r = address_get_p2pkh(address, &pubkey, network);
 				ERROR_CHECK_NEG(r, "Can not get address from pubkey.");
-
-				free(pubkey);
 			}
 		}
 		// Compressed Public Key
@@ -382,15 +378,11 @@ int script_get_output_address(char *address, unsigned char *script, uint64_t siz
 			// Make sure the compression flag is correct
 			if (*script == 0x02 || *script == 0x03)
 			{
-				pubkey = malloc(pubkey_sizeof());
-
-				r = pubkey_from_raw(pubkey, script, c_pubkey_len);
+				r = pubkey_from_raw(&pubkey, script, c_pubkey_len);
 				ERROR_CHECK_NEG(r, "Can not get pubkey object from output script.");
 
-				r = address_get_p2pkh(address, pubkey);
+				r = address_get_p2pkh(address, &pubkey, network);
 				ERROR_CHECK_NEG(r, "Can not get address from pubkey.");
-
-				free(pubkey);
 			}
 		}
 	}
@@ -400,7 +392,7 @@ int script_get_output_address(char *address, unsigned char *script, uint64_t siz
 		// P2SH - OP_HASH160
 		if (*script == 0xa9 && *(script + 1) == 0x14 && size == 0x14 + 3)
 		{
-			r = address_from_p2sh_script(address, script + 2);
+			r = address_from_p2sh_script(address, script + 2, network);
 			ERROR_CHECK_NEG(r, "Could not generate address.");
 		}
 	}
@@ -413,3 +405,57 @@ int script_get_output_address(char *address, unsigned char *script, uint64_t siz
 
 	return 1;
 }
+
+int script_get_output_type(unsigned char *script, uint64_t size)
+{
+	if (size < 2)
+	{
+		return SCRIPT_TYPE_UNKNOWN;
+	}
+
+	// OP_0 <20 bytes>
+	if (script[0] == 0x00 && script[1] == 0x14 && size == 22)
+	{
+		return SCRIPT_TYPE_P2WPKH;
+	}
+
+	// OP_0 <32 bytes>
+	if (script[0] == 0x00 && script[1] == 0x20 && size == 34)
+	{
+		return SCRIPT_TYPE_P2WSH;
+	}
+
+	// OP_1 <32 bytes>
+	if (script[0] == 0x51 && script[1] == 0x20 && size == 34)
+	{
+		return SCRIPT_TYPE_P2TR;
+	}
+
+	// OP_DUP OP_HASH160 <20 bytes> OP_EQUALVERIFY OP_CHECKSIG
+	if (size == 25 && script[0] == 0x76 && script[1] == 0xa9 && script[2] == 0x14 && script[23] == 0x88 && script[24] == 0xac)
+	{
+		return SCRIPT_TYPE_P2PKH;
+	}
+
+	// OP_HASH160 <20 bytes> OP_EQUAL
+	if (size == 23 && script[0] == 0xa9 && script[1] == 0x14 && script[22] == 0x87)
+	{
+		return SCRIPT_TYPE_P2SH;
+	}
+
+	// <pubkey> OP_CHECKSIG
+	if (script[size - 1] == 0xac)
+	{
+		if (size == PUBKEY_UNCOMPRESSED_LENGTH + 3 && script[0] == PUBKEY_UNCOMPRESSED_LENGTH + 1 && script[1] == 0x04)
+		{
+			return SCRIPT_TYPE_P2PK;
+		}
+
+		if (size == PUBKEY_COMPRESSED_LENGTH + 3 && script[0] == PUBKEY_COMPRESSED_LENGTH + 1 && (script[1] == 0x02 || script[1] == 0x03))
+		{
+			return SCRIPT_TYPE_P2PK;
+		}
+	}
+
+	return SCRIPT_TYPE_UNKNOWN;
+}
@@ -9,9 +9,19 @@
 #define SCRIPT_H 1
 
 #include <stdint.h>
+#include "network.h"
+
+#define SCRIPT_TYPE_UNKNOWN    0
+#define SCRIPT_TYPE_P2PK       1
+#define SCRIPT_TYPE_P2PKH      2
+#define SCRIPT_TYPE_P2SH       3
+#define SCRIPT_TYPE_P2WPKH     4
+#define SCRIPT_TYPE_P2WSH      5
+#define SCRIPT_TYPE_P2TR       6
 
 const char *script_get_word(uint8_t);
 char *script_from_raw(unsigned char *, size_t);
-int script_get_output_address(char *, unsigned char*, uint64_t, uint32_t);
+int script_get_output_address(char *, unsigned char*, uint64_t, uint32_t, Network);
+int script_get_output_type(unsigned char *, uint64_t);
 
 #endif
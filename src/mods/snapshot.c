@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+#include "error.h"
+#include "serialize.h"
+
+#define SNAPSHOT_MAGIC              "utxo\xff"
+#define SNAPSHOT_MAGIC_LENGTH       5
+#define SNAPSHOT_VERSION            2
+#define SNAPSHOT_NETWORK_MAIN       "\xf9\xbe\xb4\xd9"
+#define SNAPSHOT_NETWORK_LENGTH     4
+#define SNAPSHOT_BLOCK_HASH_LENGTH  32
+#define SNAPSHOT_HEADER_MAX         64
+#define SNAPSHOT_BUFFER_SIZE        (4 * 1024 * 1024)
+
+// More than any one coin record. Scripts over 10,000 bytes are
+// unspendable and never enter the UTXO set, and utxovalue_decode()
+// rejects them.
+#define SNAPSHOT_RECORD_MAX         (64 * 1024)
+
+/*
+ * Reads a UTXO set written by Bitcoin Core's dumptxoutset RPC. The file
+ * starts with the base block hash and the coin count, behind a magic and
+ * version since Core 28. Older files then list every coin with its full
+ * outpoint. Newer ones group coins by txid and give only the output
+ * index for each. The coins themselves are serialized exactly as in the
+ * chainstate database, less the obfuscation, so utxovalue_decode()
+ * decodes them.
+ *
+ * Records are decoded from a window that always has SNAPSHOT_RECORD_MAX
+ * readable bytes past the current one, either real data or zero padding
+ * at the end of the file, so the outpoint decoders never run off the end.
+ * Coin values are only decoded from the real data.
+ */
+static int fd = -1;
+static unsigned char *map = NULL;
+static size_t map_len = 0;
+static unsigned char *buffer = NULL;
+static unsigned char *data = NULL;
+static size_t data_len = 0;
+static size_t pos = 0;
+static int eof = 0;
+static int legacy = 0;
+static uint64_t coin_count = 0;
+static uint64_t coins_read = 0;
+static unsigned char txid[UTXOKEY_TX_HASH_LENGTH];
+static uint64_t txid_coins = 0;
+
+static int snapshot_fill(void);
+
+int snapshot_open(char *path, bool use_mmap)
+{
+	int r;
+	uint16_t version;
+	struct stat st;
+
+	assert(path);
+	assert(fd < 0);
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		error_log("Could not open snapshot file %s. Errno %i.", path, errno);
+		return -1;
+	}
+
+	buffer = calloc(1, SNAPSHOT_BUFFER_SIZE + SNAPSHOT_RECORD_MAX);
+	ERROR_CHECK_NULL(buffer, "Memory allocation error.");
+
+	if (use_mmap)
+	{
+		r = fstat(fd, &st);
+		ERROR_CHECK_NEG(r, "Could not get snapshot file size.");
+
+		if (st.st_size > 0)
+		{
+			map_len = (size_t)st.st_size;
+			map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+			ERROR_CHECK_TRUE(map == MAP_FAILED, "Could not map snapshot file.");
+
+			madvise(map, map_len, MADV_SEQUENTIAL);
+
+			data = map;
+			data_len = map_len;
+			eof = 1;
+		}
+	}
+
+	if (data == NULL)
+	{
+		data = buffer;
+		data_len = 0;
+	}
+
+	r = snapshot_fill();
+	ERROR_CHECK_NEG(r, NULL);
+
+	ERROR_CHECK_TRUE(data_len < SNAPSHOT_BLOCK_HASH_LENGTH + sizeof(uint64_t), "Snapshot file is too short.");
+
+	if (memcmp(data, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LENGTH) == 0)
+	{
+		pos = SNAPSHOT_MAGIC_LENGTH;
+
+		deserialize_uint16(&version, data + pos, SERIALIZE_ENDIAN_LIT);
+		pos += sizeof(uint16_t);
+		if (version != SNAPSHOT_VERSION)
+		{
+			error_log("Unsupported snapshot version %u.", version);
+			return -1;
+		}
+
+		ERROR_CHECK_TRUE(memcmp(data + pos, SNAPSHOT_NETWORK_MAIN, SNAPSHOT_NETWORK_LENGTH) != 0, "Snapshot is not from the main network.");
+		pos += SNAPSHOT_NETWORK_LENGTH;
+	}
+	else
+	{
+		legacy = 1;
+	}
+
+	pos += SNAPSHOT_BLOCK_HASH_LENGTH;
+
+	deserialize_uint64(&coin_count, data + pos, SERIALIZE_ENDIAN_LIT);
+	pos += sizeof(uint64_t);
+
+	ERROR_CHECK_TRUE(pos > data_len, "Snapshot file is too short.");
+
+	return 1;
+}
+
+// Returns zero after the last coin. Decodes into the script buffer value
+// already has, as described for utxovalue_decode().
+int snapshot_get_next(UTXOKey key, UTXOValue value)
+{
+	int r;
+	uint32_t vout32;
+	uint64_t vout;
+
+	assert(fd >= 0);
+	assert(key);
+	assert(value);
+
+	if (coins_read == coin_count)
+	{
+		return 0;
+	}
+
+	r = snapshot_fill();
+	ERROR_CHECK_NEG(r, NULL);
+
+	if (legacy)
+	{
+		memcpy(txid, data + pos, UTXOKEY_TX_HASH_LENGTH);
+		pos += UTXOKEY_TX_HASH_LENGTH;
+
+		deserialize_uint32(&vout32, data + pos, SERIALIZE_ENDIAN_LIT);
+		pos += sizeof(uint32_t);
+
+		vout = vout32;
+	}
+	else
+	{
+		if (txid_coins == 0)
+		{
+			memcpy(txid, data + pos, UTXOKEY_TX_HASH_LENGTH);
+			pos += UTXOKEY_TX_HASH_LENGTH;
+
+			pos = deserialize_compuint(&txid_coins, data + pos, SERIALIZE_ENDIAN_LIT) - data;
+			ERROR_CHECK_TRUE(txid_coins == 0, "Snapshot has a transaction without coins.");
+		}
+
+		pos = deserialize_compuint(&vout, data + pos, SERIALIZE_ENDIAN_LIT) - data;
+
+		txid_coins--;
+	}
+
+	// Only real data counts, not the zero padding
+	ERROR_CHECK_TRUE(pos > data_len, "Snapshot file is truncated.");
+
+	r = utxovalue_decode(value, data + pos, data_len - pos);
+	ERROR_CHECK_NEG(r, "Could not deserialize coin. Snapshot file may be truncated or corrupt.");
+
+	pos += r;
+
+	// Same layout as a chainstate key, so txoa entries match.
+	key->type = 'C';
+	deserialize_uchar(key->tx_hash, txid, UTXOKEY_TX_HASH_LENGTH, SERIALIZE_ENDIAN_LIT);
+	key->vout = vout;
+
+	coins_read++;
+
+	return 1;
+}
+
+uint64_t snapshot_get_coin_count(void)
+{
+	return coin_count;
+}
+
+void snapshot_close(void)
+{
+	assert(fd >= 0);
+
+	if (map)
+	{
+		munmap(map, map_len);
+	}
+
+	close(fd);
+	free(buffer);
+
+	fd = -1;
+	map = NULL;
+	map_len = 0;
+	buffer = NULL;
+	data = NULL;
+	data_len = 0;
+	pos = 0;
+	eof = 0;
+	legacy = 0;
+	coin_count = 0;
+	coins_read = 0;
+	txid_coins = 0;
+}
+
+static int snapshot_fill(void)
+{
+	ssize_t r;
+	size_t remaining;
+
+	if (pos + SNAPSHOT_RECORD_MAX <= data_len)
+	{
+		return 1;
+	}
+
+	remaining = data_len - pos;
+
+	// Near the end of the mapping. Finish from the zero padded buffer.
+	if (data == map)
+	{
+		memcpy(buffer, map + pos, remaining);
+		memset(buffer + remaining, 0, SNAPSHOT_RECORD_MAX);
+
+		data = buffer;
+		data_len = remaining;
+		pos = 0;
+
+		return 1;
+	}
+
+	if (eof)
+	{
+		return 1;
+	}
+
+	memmove(buffer, buffer + pos, remaining);
+	data_len = remaining;
+	pos = 0;
+
+	while (data_len < SNAPSHOT_BUFFER_SIZE)
+	{
+		r = read(fd, buffer + data_len, SNAPSHOT_BUFFER_SIZE - data_len);
+		if (r < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (r < 0)
+		{
+			error_log("Could not read snapshot file. Errno %i.", errno);
+			return -1;
+		}
+		if (r == 0)
+		{
+			eof = 1;
+			break;
+		}
+
+		data_len += r;
+	}
+
+	memset(buffer + data_len, 0, SNAPSHOT_BUFFER_SIZE + SNAPSHOT_RECORD_MAX - data_len);
+
+	return 1;
+}
\ No newline at end of file
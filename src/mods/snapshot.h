@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2023 Brian Barto
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GPL License. See LICENSE for more details.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H 1
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "utxokey.h"
+#include "utxovalue.h"
+
+int snapshot_open(char *, bool);
+int snapshot_get_next(UTXOKey, UTXOValue);
+uint64_t snapshot_get_coin_count(void);
+void snapshot_close(void);
+
+#endif
\ No newline at end of file
@@ -17,16 +17,43 @@
 #include "database.h"
 #include "serialize.h"
 #include "transaction.h"
+#include "cache.h"
 
 #define TXAO_LAST_BLOCK_KEY     "__last_block"
+#define TXOA_RECORD_COUNT_KEY   "__record_count"
+#define TXOA_CHECKPOINT_KEY     "__import_checkpoint"
 #define TXOA_KEY_LEN            TRANSACTION_ID_LEN + sizeof(uint32_t)
 #define TXOA_DEFAULT_PATH       ".btk/balance/txoa"
 
 static DBRef dbref = NULL;
 
+/*
+ * The number of outputs is stored in the database and kept current by the
+ * batch functions, which write the change along with the batch. Each
+ * output is put once and deleted once, when spent. A database created
+ * before there was a counter has none, and is counted by iterating.
+ */
+static int record_count_known = 0;
+static uint64_t record_count = 0;
+static int64_t record_count_change = 0;
+
+/*
+ * Batch changes wait in a write-back cache until txoa_batch_write(), so
+ * that txoa_get() finds outputs created earlier in the same batch. An
+ * output spent before then was never written, and is simply dropped.
+ * After txoa_cache_open(), written outputs stay cached until a write
+ * finds the cache over its limit, so spending them reads nothing.
+ */
+static Cache cache = NULL;
+static size_t cache_limit = 0;
+
+static int txoa_cache_write(const unsigned char *, size_t, const unsigned char *, size_t, void *);
+
 int txoa_open(char *path, bool create)
 {
 	int r;
+	unsigned char *value = NULL;
+	size_t value_len = 0;
 	
 	if (path == NULL)
 	{
@@ -50,6 +77,24 @@ int txoa_open(char *path, bool create)
 		return -1;
 	}
 
+	record_count = 0;
+	record_count_change = 0;
+	record_count_known = create;
+
+	if (!create)
+	{
+		r = database_get(&value, &value_len, dbref, (unsigned char *)TXOA_RECORD_COUNT_KEY, strlen(TXOA_RECORD_COUNT_KEY));
+		ERROR_CHECK_NEG(r, "Could not get record count from txoa database.");
+
+		if (value && value_len == sizeof(uint64_t))
+		{
+			deserialize_uint64(&record_count, value, SERIALIZE_ENDIAN_LIT);
+			record_count_known = 1;
+		}
+
+		free(value);
+	}
+
 	return 1;
 }
 
@@ -57,18 +102,44 @@ void txoa_close(void)
 {
 	assert (dbref);
 
+	if (cache)
+	{
+		cache_free(cache);
+		cache = NULL;
+	}
+	cache_limit = 0;
+
 	database_close(dbref);
 	free(dbref);
 
 	dbref = NULL;
 }
 
+// Caches outputs for updates, up to about limit bytes of them.
+int txoa_cache_open(size_t limit)
+{
+	int r;
+
+	assert(dbref);
+
+	if (!cache)
+	{
+		r = cache_new(&cache);
+		ERROR_CHECK_NEG(r, NULL);
+	}
+
+	cache_limit = limit;
+
+	return 1;
+}
+
 int txoa_get(char *address, uint64_t *amount, unsigned char *tx_hash, uint32_t index)
 {
 	int r;
 	size_t len;
 	unsigned char key[TXOA_KEY_LEN];
 	unsigned char *tmp;
+	const unsigned char *cached;
 
 	assert(address);
 	assert(tx_hash);
@@ -76,6 +147,17 @@ int txoa_get(char *address, uint64_t *amount, unsigned char *tx_hash, uint32_t i
 	serialize_uchar(key, tx_hash, TRANSACTION_ID_LEN);
 	serialize_uint32(key + TRANSACTION_ID_LEN, index, SERIALIZE_ENDIAN_LIT);
 
+	if (cache && cache_get(&cached, &len, cache, key, TXOA_KEY_LEN) > 0)
+	{
+		if (cached && len > sizeof(uint64_t))
+		{
+			memcpy(address, cached, len - sizeof(uint64_t));
+			deserialize_uint64(amount, (unsigned char *)cached + (len - sizeof(uint64_t)), SERIALIZE_ENDIAN_LIT);
+		}
+
+		return 1;
+	}
+
 	r = database_get(&tmp, &len, dbref, key, TXOA_KEY_LEN);
 	ERROR_CHECK_NEG(r, "Could not get address from txoa database.");
 
@@ -139,6 +221,33 @@ int txoa_set_last_block(int block_num)
 	return 1;
 }
 
+// Like txoa_set_last_block(), written with the next batch.
+int txoa_batch_set_last_block(int block_num)
+{
+	int r;
+	unsigned char value[sizeof(uint32_t)];
+
+	assert(dbref);
+
+	serialize_uint32(value, (uint32_t)block_num, SERIALIZE_ENDIAN_LIT);
+
+	r = database_batch_put(dbref, (unsigned char *)TXAO_LAST_BLOCK_KEY, strlen(TXAO_LAST_BLOCK_KEY), value, sizeof(uint32_t));
+	ERROR_CHECK_NEG(r, "Could not add entry to txoa database.");
+
+	return 1;
+}
+
+// Memory held by batch changes not yet written.
+size_t txoa_batch_memory(void)
+{
+	if (!cache)
+	{
+		return 0;
+	}
+
+	return cache_dirty_memory(cache);
+}
+
 int txoa_get_last_block(int *block_num)
 {
 	int r;
@@ -172,6 +281,38 @@ int txoa_batch_put(unsigned char *tx_hash, uint32_t index, char *address, uint64
 	assert(tx_hash);
 	assert(address);
 
+	serialize_uchar(key, tx_hash, TRANSACTION_ID_LEN);
+	serialize_uint32(key + TRANSACTION_ID_LEN, index, SERIALIZE_ENDIAN_LIT);
+
+	memcpy(value, address, strlen(address));
+	serialize_uint64(value + strlen(address), amount, SERIALIZE_ENDIAN_LIT);
+
+	if (!cache)
+	{
+		r = cache_new(&cache);
+		ERROR_CHECK_NEG(r, NULL);
+	}
+
+	// A new output, so not in the database yet
+	r = cache_put(cache, key, TXOA_KEY_LEN, value, strlen(address) + sizeof(uint64_t), CACHE_DIRTY | CACHE_FRESH);
+	ERROR_CHECK_NEG(r, "Could not add entry to txoa database.");
+
+	record_count_change++;
+
+	return 1;
+}
+
+// Like txoa_batch_put(), for an import that never reads the outputs back
+// while writing them, so they go straight to the database batch.
+int txoa_load_put(unsigned char *tx_hash, uint32_t index, char *address, uint64_t amount)
+{
+	int r;
+	unsigned char key[TXOA_KEY_LEN];
+	unsigned char value[BUFSIZ];
+
+	assert(tx_hash);
+	assert(address);
+
 	memset(key, 0, TXOA_KEY_LEN);
 	memset(value, 0, BUFSIZ);
 
@@ -184,6 +325,8 @@ int txoa_batch_put(unsigned char *tx_hash, uint32_t index, char *address, uint64
 	r = database_batch_put(dbref, key, TXOA_KEY_LEN, value, strlen(address) + sizeof(uint64_t));
 	ERROR_CHECK_NEG(r, "Could not add entry to txoa database.");
 
+	record_count_change++;
+
 	return 1;
 }
 
@@ -197,21 +340,52 @@ int txoa_batch_delete(unsigned char *tx_hash, uint32_t index)
 	serialize_uchar(key, tx_hash, TRANSACTION_ID_LEN);
 	serialize_uint32(key + TRANSACTION_ID_LEN, index, SERIALIZE_ENDIAN_LIT);
 
-	r = database_batch_delete(dbref, key, TXOA_KEY_LEN);
+	if (!cache)
+	{
+		r = cache_new(&cache);
+		ERROR_CHECK_NEG(r, NULL);
+	}
+
+	r = cache_put(cache, key, TXOA_KEY_LEN, NULL, 0, CACHE_DIRTY);
 	ERROR_CHECK_NEG(r, "Could not delete txao entry after spending.");
 
+	record_count_change--;
+
 	return 1;
 }
 
 int txoa_batch_write(void)
 {
 	int r;
+	unsigned char value[sizeof(uint64_t)];
 
 	assert(dbref);
 
+	if (cache)
+	{
+		r = cache_flush(cache, &txoa_cache_write, NULL);
+		ERROR_CHECK_NEG(r, NULL);
+	}
+
+	if (record_count_known && record_count_change != 0)
+	{
+		record_count += record_count_change;
+
+		serialize_uint64(value, record_count, SERIALIZE_ENDIAN_LIT);
+
+		r = database_batch_put(dbref, (unsigned char *)TXOA_RECORD_COUNT_KEY, strlen(TXOA_RECORD_COUNT_KEY), value, sizeof(uint64_t));
+		ERROR_CHECK_NEG(r, "Could not put record count in txoa database.");
+	}
+	record_count_change = 0;
+
 	r = database_batch_write(dbref);
 	ERROR_CHECK_NEG(r, "Could not execute batch write.");
 
+	if (cache && cache_memory(cache) > cache_limit)
+	{
+		cache_clear(cache);
+	}
+
 	return 1;
 }
 
@@ -219,22 +393,148 @@ int txoa_get_record_count(size_t *count)
 {
 	int r;
 	size_t c = 0;
+	DBCursor cursor;
+	size_t key_len, value_len;
+	const unsigned char *key, *value;
 
 	assert(count);
 	assert(dbref);
 
-	database_iter_reset(dbref);
+	if (record_count_known)
+	{
+		*count = record_count + record_count_change;
+		return 1;
+	}
 
-	r = database_iter_seek_start(dbref);
-	ERROR_CHECK_NEG(r, "Unable to seek to first record in txoa database.");
+	r = database_cursor_new(&cursor, dbref, NULL, 0, NULL, 0);
+	ERROR_CHECK_NEG(r, "Could not create txoa cursor.");
 
-	while ((r = database_iter_next(dbref)) > 0)
+	while ((r = database_cursor_get(&key, &key_len, &value, &value_len, cursor)) > 0)
 	{
-		c++;
+		// Other keys are named, and never this long
+		if (key_len == TXOA_KEY_LEN)
+		{
+			c++;
+		}
+
+		database_cursor_next(cursor);
 	}
-	ERROR_CHECK_NEG(r, "Could not iterate.");
+
+	database_cursor_free(cursor);
+
+	ERROR_CHECK_NEG(r, "Could not read txoa database.");
 
 	*count = c;
 
+	return 1;
+}
+
+/*
+ * An import stores how far it got along with each batch of outputs, so
+ * the outputs in the database are always exactly those the checkpoint
+ * covers. The content is up to the importer.
+ */
+int txoa_batch_put_checkpoint(unsigned char *checkpoint, size_t len)
+{
+	int r;
+
+	assert(checkpoint);
+	assert(dbref);
+
+	r = database_batch_put(dbref, (unsigned char *)TXOA_CHECKPOINT_KEY, strlen(TXOA_CHECKPOINT_KEY), checkpoint, len);
+	ERROR_CHECK_NEG(r, "Could not put checkpoint in txoa database.");
+
+	return 1;
+}
+
+int txoa_batch_delete_checkpoint(void)
+{
+	int r;
+
+	assert(dbref);
+
+	r = database_batch_delete(dbref, (unsigned char *)TXOA_CHECKPOINT_KEY, strlen(TXOA_CHECKPOINT_KEY));
+	ERROR_CHECK_NEG(r, "Could not delete checkpoint from txoa database.");
+
+	return 1;
+}
+
+// Sets checkpoint to NULL when there is none. Otherwise the caller frees it.
+int txoa_get_checkpoint(unsigned char **checkpoint, size_t *len)
+{
+	int r;
+
+	assert(checkpoint);
+	assert(len);
+	assert(dbref);
+
+	*checkpoint = NULL;
+
+	r = database_get(checkpoint, len, dbref, (unsigned char *)TXOA_CHECKPOINT_KEY, strlen(TXOA_CHECKPOINT_KEY));
+	ERROR_CHECK_NEG(r, "Could not get checkpoint from txoa database.");
+
+	return 1;
+}
+
+// Calls fn with the address and amount of every output in the database.
+int txoa_scan(int (*fn)(char *, uint64_t, void *), void *arg)
+{
+	int r;
+	DBCursor cursor;
+	uint64_t amount;
+	size_t key_len, value_len;
+	const unsigned char *key, *value;
+	char address[BUFSIZ];
+
+	assert(fn);
+	assert(dbref);
+
+	r = database_cursor_new(&cursor, dbref, NULL, 0, NULL, 0);
+	ERROR_CHECK_NEG(r, "Could not create txoa cursor.");
+
+	while ((r = database_cursor_get(&key, &key_len, &value, &value_len, cursor)) > 0)
+	{
+		// Other keys are named, and never this long
+		if (key_len == TXOA_KEY_LEN && value_len > sizeof(uint64_t) && value_len - sizeof(uint64_t) < BUFSIZ)
+		{
+			memcpy(address, value, value_len - sizeof(uint64_t));
+			address[value_len - sizeof(uint64_t)] = '\0';
+
+			deserialize_uint64(&amount, (unsigned char *)value + (value_len - sizeof(uint64_t)), SERIALIZE_ENDIAN_LIT);
+
+			r = fn(address, amount, arg);
+			if (r < 0)
+			{
+				break;
+			}
+		}
+
+		database_cursor_next(cursor);
+	}
+
+	database_cursor_free(cursor);
+
+	ERROR_CHECK_NEG(r, "Could not read txoa database.");
+
+	return 1;
+}
+
+static int txoa_cache_write(const unsigned char *key, size_t key_len, const unsigned char *value, size_t value_len, void *arg)
+{
+	int r;
+
+	(void)arg;
+
+	if (value)
+	{
+		r = database_batch_put(dbref, (unsigned char *)key, key_len, (unsigned char *)value, value_len);
+		ERROR_CHECK_NEG(r, "Could not add entry to txoa database.");
+	}
+	else
+	{
+		r = database_batch_delete(dbref, (unsigned char *)key, key_len);
+		ERROR_CHECK_NEG(r, "Could not delete txao entry after spending.");
+	}
+
 	return 1;
 }
\ No newline at end of file
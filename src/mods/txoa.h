@@ -8,11 +8,13 @@
 #ifndef TXOA_H
 #define TXOA_H 1
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
 int txoa_open(char *, bool);
 void txoa_close(void);
+int txoa_cache_open(size_t);
 int txoa_get(char *, uint64_t *, unsigned char *, uint32_t);
 int txoa_put(unsigned char *, uint32_t, char *);
 int txoa_delete(unsigned char *, uint32_t);
@@ -23,5 +25,13 @@ int txoa_get_record_count(size_t *);
 int txoa_batch_put(unsigned char *, uint32_t, char *, uint64_t);
 int txoa_batch_delete(unsigned char *, uint32_t);
 int txoa_batch_write(void);
+int txoa_batch_set_last_block(int);
+size_t txoa_batch_memory(void);
+int txoa_load_put(unsigned char *, uint32_t, char *, uint64_t);
+
+int txoa_batch_put_checkpoint(unsigned char *, size_t);
+int txoa_batch_delete_checkpoint(void);
+int txoa_get_checkpoint(unsigned char **, size_t *);
+int txoa_scan(int (*)(char *, uint64_t, void *), void *);
 
 #endif
\ No newline at end of file
@@ -6,6 +6,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <assert.h>
 #include "utxovalue.h"
@@ -16,18 +17,43 @@
 #define UTXOVALUE_HASH160_PUBKEY_SIZE     20
 #define UTXOVALUE_COMPRESSED_PUBKEY_SIZE  33
 
-int utxovalue_from_raw(UTXOValue value, unsigned char *input)
+// Covers every standard script, so a reused buffer rarely grows.
+#define UTXOVALUE_SCRIPT_MIN_SIZE         64
+
+// Consensus MAX_SCRIPT_SIZE. Longer scripts are unspendable and never
+// enter the UTXO set.
+#define UTXOVALUE_SCRIPT_MAX_SIZE         10000
+
+static const unsigned char *utxovalue_varint(uint64_t *, const unsigned char *, const unsigned char *);
+
+/*
+ * Decodes into the script buffer the value already has, growing it when
+ * needed, so one value can be reused for a whole scan. Start with script
+ * NULL and script_size zero, and free script once when done. The input
+ * is left unchanged. Returns the bytes decoded, or -1 if the value does not
+ * fit in input_len bytes or its script is too long to be a coin.
+ */
+int utxovalue_decode(UTXOValue value, const unsigned char *input, size_t input_len)
 {
-	unsigned char *head;
+	size_t skip = 0;
+	unsigned char first = 0;
+	const unsigned char *head, *end;
 
 	assert(value);
 	assert(input);
 
 	head = input;
+	end = input + input_len;
+
+	input = utxovalue_varint(&(value->height), input, end);
+	ERROR_CHECK_NULL(input, "Coin value is truncated.");
+
+	input = utxovalue_varint(&(value->amount), input, end);
+	ERROR_CHECK_NULL(input, "Coin value is truncated.");
+
+	input = utxovalue_varint(&(value->n_size), input, end);
+	ERROR_CHECK_NULL(input, "Coin value is truncated.");
 
-	input = deserialize_varint(&(value->height), input);
-	input = deserialize_varint(&(value->amount), input);
-	input = deserialize_varint(&(value->n_size), input);
 	if (value->n_size == 0 || value->n_size == 1)
 	{
 		value->script_len = UTXOVALUE_HASH160_PUBKEY_SIZE;
@@ -42,20 +68,36 @@ int utxovalue_from_raw(UTXOValue value, unsigned char *input)
 	else if (value->n_size == 4 || value->n_size == 5)
 	{
 		// nsize byte (-2) is is part of the script
-		input--;
-		*input -= 2;
+		first = value->n_size - 2;
+		skip = 1;
 
 		value->script_len = UTXOVALUE_COMPRESSED_PUBKEY_SIZE;
 	}
 	else
 	{
+		ERROR_CHECK_TRUE(value->n_size - 6 > UTXOVALUE_SCRIPT_MAX_SIZE, "Coin script is too long.");
+
 		value->script_len = value->n_size - 6;
 	}
 
-	value->script = malloc(value->script_len);
-	ERROR_CHECK_NULL(value->script, "Memory allocation error.");
+	ERROR_CHECK_TRUE(value->script_len - skip > (size_t)(end - input), "Coin value is truncated.");
 
-	input = deserialize_uchar(value->script, input, value->script_len, SERIALIZE_ENDIAN_BIG);
+	if (value->script_len > value->script_size || value->script == NULL)
+	{
+		free(value->script);
+
+		value->script_size = value->script_len > UTXOVALUE_SCRIPT_MIN_SIZE ? value->script_len : UTXOVALUE_SCRIPT_MIN_SIZE;
+		value->script = malloc(value->script_size);
+		ERROR_CHECK_NULL(value->script, "Memory allocation error.");
+	}
+
+	if (skip)
+	{
+		value->script[0] = first;
+	}
+
+	memcpy(value->script + skip, input, value->script_len - skip);
+	input += value->script_len - skip;
 
 	// pop off the coinbase flag from height.
 	value->height = value->height >> 1;
@@ -75,4 +117,26 @@ void utxovalue_free(UTXOValue value)
 		free(value->script);
 	}
 	free(value);
+}
+
+// Like deserialize_varint(), but stops at end. Returns NULL if the varint
+// runs past it or is too long for 64 bits.
+static const unsigned char *utxovalue_varint(uint64_t *dest, const unsigned char *src, const unsigned char *end)
+{
+	int i;
+
+	*dest = 0;
+
+	for (i = 0; src < end && i < 10; i++, src++)
+	{
+		*dest = (*dest << 7) | (uint64_t)(*src & 0x7F);
+		if (*src < 0x80)
+		{
+			return src + 1;
+		}
+
+		*dest += 1;
+	}
+
+	return NULL;
 }
\ No newline at end of file
@@ -8,6 +8,7 @@
 #ifndef UTXOVALUE_H
 #define UTXOVALUE_H 1
 
+#include <stddef.h>
 #include <stdint.h>
 
 typedef struct UTXOValue *UTXOValue;
@@ -18,9 +19,10 @@ struct UTXOValue
 	uint64_t       n_size;
 	size_t         script_len;
 	unsigned char *script;
+	size_t         script_size;
 };
 
-int utxovalue_from_raw(UTXOValue, unsigned char *);
+int utxovalue_decode(UTXOValue, const unsigned char *, size_t);
 void utxovalue_free(UTXOValue);
 
 #endif
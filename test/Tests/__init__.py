@@ -4,4 +4,7 @@ from .address import Address
 from .balance import Balance
 from .node import Node
 from .config import Config
-from .version import Version
\ No newline at end of file
+from .version import Version
+from .chain import Chain
+from .serve import Serve
+from .lib import Lib
\ No newline at end of file
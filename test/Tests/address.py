@@ -18,8 +18,8 @@ inputs = [
         "p2pkh_test_u": "mr1YQWcgqnhrCu4tXNr4PdMaPR6zMqm786",
         "bech32": "bc1qaj8dzeef28e9qrwa386krprp56fps44gspvvy7",
         "bech32_test": "tb1qaj8dzeef28e9qrwa386krprp56fps44g68hlld",
-        "bech32m": "bc1paj8dzeef28e9qrwa386krprp56fps44gwrttvh",
-        "bech32m_test": "tb1paj8dzeef28e9qrwa386krprp56fps44gy9schy",
+        "bech32m": "bc1p73gxns0ld3k5jfw4cqn3gvf55e74h37t2xjh6whcehs56l43hdksknhy9a",
+        "bech32m_test": "tb1p73gxns0ld3k5jfw4cqn3gvf55e74h37t2xjh6whcehs56l43hdkspmptlj",
     },
     {
         "wif": "KyqWNV7VzbrzsyhuDQAzo2qPv3YuiJk5Rp9QwRS2m3ThdMudb5fs",
@@ -35,8 +35,8 @@ inputs = [
         "p2pkh_test_u": "mueuGYRd7tcNYQjjzh3rwY9eCM13VG6Hsk",
         "bech32": "bc1q2vt4nxs9a62ldd2gp8jf6telc7ulyu67r2xanu",
         "bech32_test": "tb1q2vt4nxs9a62ldd2gp8jf6telc7ulyu67fvawg0",
-        "bech32m": "bc1p2vt4nxs9a62ldd2gp8jf6telc7ulyu67agp6m4",
-        "bech32m_test": "tb1p2vt4nxs9a62ldd2gp8jf6telc7ulyu67hw6fqx",
+        "bech32m": "bc1pac99zztrqggyran0zfj8y0ytpaqt5wvhq5rpn3gstajmn5vc5p3s3frhgy",
+        "bech32m_test": "tb1pac99zztrqggyran0zfj8y0ytpaqt5wvhq5rpn3gstajmn5vc5p3sxp4cjt",
     },
     {
         "wif": "KxKDsiQBjoyq84AnzKf82Xk5GSPzeHbJB489AZcDnQzGfr3mNfUn",
@@ -52,8 +52,8 @@ inputs = [
         "p2pkh_test_u": "mqWjKhyKE4wFmA4E73uRaSFzpmV9aLW6JA",
         "bech32": "bc1q45g8mauwsehetrvzc9dsknxe0250nknqg6de08",
         "bech32_test": "tb1q45g8mauwsehetrvzc9dsknxe0250nknqzuk255",
-        "bech32m": "bc1p45g8mauwsehetrvzc9dsknxe0250nknqkc278w",
-        "bech32m_test": "tb1p45g8mauwsehetrvzc9dsknxe0250nknqu73dua",
+        "bech32m": "bc1pngl0mc9aq3jk5kfta09z050jcz9alwdqhx7y86l83rjaltaegypsfl6ylj",
+        "bech32m_test": "tb1pngl0mc9aq3jk5kfta09z050jcz9alwdqhx7y86l83rjaltaegyps7hvt9a",
     },
     {
         "wif": "Kz2PvtUtw52z7yLxpXUNftHU6mzBg1VTd5cAGSX7xyVmy1xWRuyK",
@@ -69,8 +69,8 @@ inputs = [
         "p2pkh_test_u": "mp9keAUcPsXiw25f6gXAqTVWT9CpedJesA",
         "bech32": "bc1qvwd69k9xa746xt60t22600eq7vzzlrrrecakch",
         "bech32_test": "tb1qvwd69k9xa746xt60t22600eq7vzzlrrrn7x9ry",
-        "bech32m": "bc1pvwd69k9xa746xt60t22600eq7vzzlrrr8663s7",
-        "bech32m_test": "tb1pvwd69k9xa746xt60t22600eq7vzzlrrrdupztd",
+        "bech32m": "bc1p0s3v0yyd9m3r9u0x7lf3mr7h4fnrlzrfxxx8hd3em5ez7v5lertspe5c68",
+        "bech32m_test": "tb1p0s3v0yyd9m3r9u0x7lf3mr7h4fnrlzrfxxx8hd3em5ez7v5lertsk3zhqg",
     },
     {
         "wif": "L2VtEHPMEp9nLLpwWHRHX19xi1N1inMna231WqL1noXLdpvNSVeo",
@@ -86,8 +86,8 @@ inputs = [
         "p2pkh_test_u": "miFVqgzdp1TkVucQ1S3T8bFs7XSb4vQBba",
         "bech32": "bc1ql9tyhtv8p60tq6m29whfge9a7vw2xwnlqdj8fw",
         "bech32_test": "tb1ql9tyhtv8p60tq6m29whfge9a7vw2xwnl2tf5ja",
-        "bech32m": "bc1pl9tyhtv8p60tq6m29whfge9a7vw2xwnl704qp8",
-        "bech32m_test": "tb1pl9tyhtv8p60tq6m29whfge9a7vw2xwnl5fwn65",
+        "bech32m": "bc1p05s77nusz7hdk3zwt0rapp75y39xa484pnln0w8urx4sz5cnxzuqcclluz",
+        "bech32m_test": "tb1p05s77nusz7hdk3zwt0rapp75y39xa484pnln0w8urx4sz5cnxzuq0sfsxd",
     },
     {
         "wif": "L4EZ2ismHBC8KtCDbdQwsNiYRNkHiPpRaDtDzv3hodDWsDpPfLpV",
@@ -103,8 +103,8 @@ inputs = [
         "p2pkh_test_u": "moJPG57v3jef7fGkWYmYHSHv5eZAbE5Kwx",
         "bech32": "bc1qk5wfcvfs8rsfj3qch04l75l7t9atp3arjryyx6",
         "bech32_test": "tb1qk5wfcvfs8rsfj3qch04l75l7t9atp3arc9lhaf",
-        "bech32m": "bc1pk5wfcvfs8rsfj3qch04l75l7t9atp3arvprrwn",
-        "bech32m_test": "tb1pk5wfcvfs8rsfj3qch04l75l7t9atp3arx8cs4q",
+        "bech32m": "bc1pyn226wfzl78kmps8jh7pv7malm385sukfmdn4uym6zusr0jvwhpqmna04z",
+        "bech32m_test": "tb1pyn226wfzl78kmps8jh7pv7malm385sukfmdn4uym6zusr0jvwhpqvmtq0d",
     },
     {
         "wif": "L1Kc4zFKB5bqghB2SoufWA18ct9BNqMAE1XqBbfzs9dKz7Gxi5JX",
@@ -120,8 +120,8 @@ inputs = [
         "p2pkh_test_u": "mqvEj8TKjDqHs7n7ztc388VKPHeCQDGaBu",
         "bech32": "bc1q4ymve7dnxnqahayq3pr9hum0ujtnf7geq8syus",
         "bech32_test": "tb1q4ymve7dnxnqahayq3pr9hum0ujtnf7ge2pth8r",
-        "bech32m": "bc1p4ymve7dnxnqahayq3pr9hum0ujtnf7ge79hr5e",
-        "bech32m_test": "tb1p4ymve7dnxnqahayq3pr9hum0ujtnf7ge5rvs02",
+        "bech32m": "bc1p634ahm64vy68dchpwedzk8xay6d59yj5zf3jqwd0nap978fj89pst6zgcg",
+        "bech32m_test": "tb1p634ahm64vy68dchpwedzk8xay6d59yj5zf3jqwd0nap978fj89psuj58z8",
     },
     {
         "wif": "L2u8RxPt7EnzMLgnK5UrXVyUh8JnCVLuGJeVN83uGxCSBHKfqEaP",
@@ -137,8 +137,8 @@ inputs = [
         "p2pkh_test_u": "mwoY4wjdbbdWQg2K1A7tKx4VjxonVQXJj5",
         "bech32": "bc1quzdzp3lu5cs72vrl82hpc4kpttg43uy8llj6gt",
         "bech32_test": "tb1quzdzp3lu5cs72vrl82hpc4kpttg43uy84effnc",
-        "bech32m": "bc1puzdzp3lu5cs72vrl82hpc4kpttg43uy8pa4aqz",
-        "bech32m_test": "tb1puzdzp3lu5cs72vrl82hpc4kpttg43uy8tmwwm3",
+        "bech32m": "bc1ptcgz0el484kjacag9rp59xz56rtjrlnyuz4xrpv9vtrald9xhwhqqs0qt0",
+        "bech32m_test": "tb1ptcgz0el484kjacag9rp59xz56rtjrlnyuz4xrpv9vtrald9xhwhqhce03q",
     },
     {
         "wif": "L4ZkzcBhWuEhkJQ5xcfiBzZ6einm27bKFtiC5aBjvHTQMmkbxcse",
@@ -154,8 +154,8 @@ inputs = [
         "p2pkh_test_u": "mg9522zU79jiyddphumJ2B3nXED2U2fbbW",
         "bech32": "bc1qxun5fxgesuczgzvvyermjgd6z0y29mgr8ltggn",
         "bech32_test": "tb1qxun5fxgesuczgzvvyermjgd6z0y29mgrdesmnq",
-        "bech32m": "bc1pxun5fxgesuczgzvvyermjgd6z0y29mgreav0q6",
-        "bech32m_test": "tb1pxun5fxgesuczgzvvyermjgd6z0y29mgrnmhumf",
+        "bech32m": "bc1p3c0jg0mvx4s57r9c4r42h58mht40nx4fgaemnm7p5u08vuyffcsszyvlrx",
+        "bech32m_test": "tb1p3c0jg0mvx4s57r9c4r42h58mht40nx4fgaemnm7p5u08vuyffcss4v6sef",
     },
     {
         "wif": "KzZpAtMLUCMXdsGUa9ZXXGN655H7fa9ddrPv5AfiBuNqN7yY8K2g",
@@ -171,8 +171,8 @@ inputs = [
         "p2pkh_test_u": "msoJDyzTcof6Tg88D1WjMU3o6Bbb1F2zD3",
         "bech32": "bc1qfehccrcdk2zmgpxx8xew54skpgqj36v3a89pse",
         "bech32_test": "tb1qfehccrcdk2zmgpxx8xew54skpgqj36v3hp7jt2",
-        "bech32m": "bc1pfehccrcdk2zmgpxx8xew54skpgqj36v3r9zxcs",
-        "bech32m_test": "tb1pfehccrcdk2zmgpxx8xew54skpgqj36v3fre4rr",
+        "bech32m": "bc1ptrphsk40cx8ekqtkyw5rnu3yeu64adufzkzn7cgmtgghfst94ccq5v6w02",
+        "bech32m_test": "tb1ptrphsk40cx8ekqtkyw5rnu3yeu64adufzkzn7cgmtgghfst94ccqryvp49",
     },
 ]
 
@@ -278,6 +278,27 @@ class Address(unittest.TestCase):
     def test_0135(self):
         self.io_test(opts=["-w", "--bech32m"], input="wif", output="bech32m")
 
+    def test_0136(self):
+
+        for input in inputs:
+            if "bech32m" not in input:
+                continue
+
+            self.btk.reset()
+            self.btk.arg("-w")
+            self.btk.arg("--legacy")
+            self.btk.arg("--bech32")
+            self.btk.arg("--bech32m")
+            self.btk.arg(input["wif"])
+
+            out = self.btk.run()
+
+            self.assertTrue(out.returncode == 0)
+
+            out_json = json.loads(out.stdout)
+
+            self.assertTrue(out_json == [input["bech32"], input["bech32m"], input["p2pkh"]])
+
     ####################
     ## WIF Uncompressed
     ####################
@@ -405,6 +426,98 @@ class Address(unittest.TestCase):
         self.assertTrue(out.returncode == 0)
         self.assertFalse(out.stdout)
 
+    def test_0371(self):
+
+        ## Literal patterns, anchored or not, match without case
+        patterns = {
+            "^1nzozs": ["p2pkh"],
+            "^bc1Q": ["bech32"],
+            "gmgkj1$": ["p2pkh"],
+            "^1NZoZSUY4Lfg5yVn5FPHo4NHEUKcGmGkj1$": ["p2pkh"],
+            "HEUKc": ["p2pkh"],
+            "^1NZo.S": ["p2pkh"],
+            "^bc1q\\.": [],
+            "^gmgkj1": [],
+        }
+
+        for pattern, expected in patterns.items():
+            self.btk.reset()
+            self.btk.arg("-w")
+            self.btk.arg("-L")
+            self.btk.arg("--bech32")
+            self.btk.arg("--legacy")
+            self.btk.arg(f"--grep='{pattern}'")
+            self.btk.arg(inputs[0]["wif"])
+
+            out = self.btk.run()
+
+            self.assertTrue(out.returncode == 0)
+            self.assertTrue(out.stdout.split() == [inputs[0][key] for key in expected])
+
+    ####################
+    ## Trace
+    ####################
+
+    def test_0375(self):
+
+        input = inputs[0]["wif"]
+
+        self.btk.reset()
+        self.btk.set_input(f"{{\n\"parent\": [\n\"{input}\"\n]\n}}")
+        self.btk.arg("-w")
+        self.btk.arg("--legacy")
+        self.btk.arg("--bech32")
+        self.btk.arg("--trace")
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode == 0)
+        self.assertTrue(out.stdout)
+
+        # Both outputs of the same input must share one nested key.
+        out_json = json.loads(out.stdout, object_pairs_hook=lambda pairs: pairs)
+
+        self.assertTrue(len(out_json) == 1)
+        self.assertTrue(out_json[0][0] == "parent")
+        self.assertTrue(len(out_json[0][1]) == 1)
+        self.assertTrue(out_json[0][1][0][0] == input)
+        self.assertTrue(sorted(out_json[0][1][0][1]) == sorted([inputs[0]["p2pkh"], inputs[0]["bech32"]]))
+
+    ####################
+    ## Frames
+    ####################
+
+    def test_0376(self):
+
+        input = inputs[0]["wif"]
+
+        self.btk.reset("pubkey")
+        self.btk.set_input(input.encode())
+        self.btk.arg("-w")
+        self.btk.arg("--out-format=frames")
+        self.btk.set_text(False)
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode == 0)
+        self.assertTrue(out.stdout.startswith(b"\xf0BTK\x02\x00\x21"))
+
+        # Frames input is detected without --in-format.
+        self.btk.reset("address")
+        self.btk.set_input(out.stdout)
+        self.btk.arg("--legacy")
+        self.btk.arg("--bech32")
+        self.btk.set_text(False)
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode == 0)
+        self.assertTrue(out.stdout)
+
+        out_json = json.loads(out.stdout)
+
+        self.assertTrue(sorted(out_json) == sorted([inputs[0]["p2pkh"], inputs[0]["bech32"]]))
+
     ###############
     ## Match Tests
     ###############
@@ -1,7 +1,16 @@
+import os
+import re
+import struct
+import random
 import pathlib
 import json
+import tempfile
+import subprocess
 import unittest
 from .btk import BTK
+from . import snapshot
+from . import ldb
+from . import bitcoind
 
 inputs = [
     {
@@ -22,6 +31,57 @@ inputs = [
     }
 ]
 
+snapshot_coins = [
+    snapshot.p2pkh(bytes(range(32)), 0, 5000000000, bytes.fromhex("751e76e8199196d454941c45d1b3a323f1433bd6")),
+    snapshot.p2wpkh(bytes(range(32)), 3, 123450000, bytes.fromhex("91b24bf9f5288532960ac687abb035127b1d28a5")),
+    snapshot.p2pkh(bytes(range(1, 33)), 1, 2500000000, bytes.fromhex("751e76e8199196d454941c45d1b3a323f1433bd6")),
+    snapshot.p2sh(bytes(range(1, 33)), 2, 1, bytes.fromhex("bcfeb728b584253d5f3f70bcb780e9ef218a68f4")),
+    snapshot.p2wpkh(bytes(range(2, 34)), 0, 2100000000000000, bytes.fromhex("0000000000000000000000000000000000000001")),
+]
+
+def chainstate_history(seed=1, count=3000, changes=1200):
+    # Coins written to a chainstate, then some of them spent and new ones
+    # added. Returns the history and the coins left at the end.
+    rng = random.Random(seed)
+    hashes = [bytes(rng.getrandbits(8) for _ in range(20)) for _ in range(40)]
+    obfuscate_key = bytes(rng.getrandbits(8) for _ in range(8))
+
+    def new_coin():
+        txid = bytes(rng.getrandbits(8) for _ in range(32))
+        make = rng.choice([snapshot.p2pkh, snapshot.p2sh, snapshot.p2wpkh])
+        return make(txid, rng.randrange(4), rng.randrange(1, 10 ** 10), rng.choice(hashes))
+
+    def put(coin):
+        key = b"C" + coin.txid + snapshot.varint(coin.vout)
+        value = coin.encode()
+        value = bytes(b ^ obfuscate_key[i % 8] for i, b in enumerate(value))
+        coins[key] = coin
+        history.append((key, value))
+
+    coins = {}
+    history = [(b"\x0e\x00obfuscate_key", b"\x08" + obfuscate_key), (b"B" + bytes(32), bytes(32))]
+
+    for _ in range(count):
+        put(new_coin())
+
+    for _ in range(changes):
+        if rng.random() < 0.6:
+            key = rng.choice(sorted(coins))
+            del coins[key]
+            history.append((key, None))
+        else:
+            put(new_coin())
+
+    return history, coins
+
+def chainstate_put(history, coins, coin, value=None):
+    # Adds a coin to a chainstate history, stored as value when given.
+    obfuscate_key = history[0][1][1:]
+    key = b"C" + coin.txid + snapshot.varint(coin.vout)
+    value = value if value is not None else coin.encode()
+    history.append((key, bytes(b ^ obfuscate_key[i % 8] for i, b in enumerate(value))))
+    coins[key] = coin
+
 class Balance(unittest.TestCase):
 
     def run_test(self):
@@ -140,4 +200,510 @@ class Balance(unittest.TestCase):
             self.btk.arg(f"--grep=nomatch")
             out = self.btk.run()
             self.assertTrue(out.returncode == 0)
-            self.assertFalse(out.stdout)
\ No newline at end of file
+            self.assertFalse(out.stdout)
+
+    ########################
+    ## Create From Snapshot
+    ########################
+
+    def snapshot_create(self, dir, data, opts=[]):
+        path = os.path.join(dir, "utxo.dat")
+        with open(path, "wb") as f:
+            f.write(data)
+
+        self.btk.reset()
+        self.btk.arg(f"--create-from-snapshot={path}")
+        self.btk.arg(f"--balance-path={os.path.join(dir, 'balance')}")
+        for opt in opts:
+            self.btk.arg(opt)
+
+        return self.btk.run()
+
+    def snapshot_test(self, legacy, opts=[]):
+        balances = {}
+        for coin in snapshot_coins:
+            balances[coin.address] = balances.get(coin.address, 0) + coin.amount
+
+        with tempfile.TemporaryDirectory() as dir:
+            out = self.snapshot_create(dir, snapshot.encode(snapshot_coins, legacy=legacy), opts)
+
+            self.assertTrue(out.returncode == 0)
+
+            # Outputs to the same address add up.
+            self.assertTrue(len(balances) == len(snapshot_coins) - 1)
+
+            for address, amount in balances.items():
+                self.btk.reset()
+                self.btk.arg(f"--balance-path={os.path.join(dir, 'balance')}")
+                self.btk.arg("-L")
+                self.btk.arg(address)
+
+                out = self.btk.run()
+
+                self.assertTrue(out.returncode == 0)
+                self.assertTrue(out.stdout.strip() == str(amount))
+
+    def test_0200(self):
+        self.snapshot_test(legacy=False)
+
+    def test_0210(self):
+        self.snapshot_test(legacy=True)
+
+    def test_0220(self):
+        self.snapshot_test(legacy=False, opts=["--mmap"])
+
+    def test_0230(self):
+        self.snapshot_test(legacy=True, opts=["--mmap"])
+
+    def test_0240(self):
+        with tempfile.TemporaryDirectory() as dir:
+            out = self.snapshot_create(dir, snapshot.encode(snapshot_coins, network=snapshot.NETWORK_TEST))
+
+            self.assertTrue(out.returncode == 1)
+            self.assertTrue("main network" in out.stderr)
+
+    def test_0250(self):
+        for legacy in [False, True]:
+            data = snapshot.encode(snapshot_coins, legacy=legacy)
+
+            # Cut inside the last coin, and inside the header.
+            for length in [len(data) - 10, 20]:
+                for opts in [[], ["--mmap"]]:
+                    with tempfile.TemporaryDirectory() as dir:
+                        out = self.snapshot_create(dir, data[:length], opts)
+
+                        self.assertTrue(out.returncode == 1)
+
+    def test_0260(self):
+        # A script length far beyond the end of the file must be rejected
+        # before any of it is read.
+        hostile = snapshot.Coin(bytes(32), 0, 1, snapshot.varint(5000000 + 6) + bytes(10))
+
+        for legacy in [False, True]:
+            for opts in [[], ["--mmap"]]:
+                with tempfile.TemporaryDirectory() as dir:
+                    out = self.snapshot_create(dir, snapshot.encode(snapshot_coins + [hostile], legacy=legacy), opts)
+
+                    self.assertTrue(out.returncode == 1)
+                    self.assertTrue("too long" in out.stderr)
+
+    ##################
+    ## Direct Read
+    ##################
+
+    def balance_check(self, balance_path, coins, extra_addresses=[]):
+        balances = {address: 0 for address in extra_addresses}
+        for coin in coins:
+            balances[coin.address] = balances.get(coin.address, 0) + coin.amount
+
+        self.assertTrue(self.balance_read(balance_path, sorted(balances)) == balances)
+
+    def count_check(self, out, coins):
+        # The stored counts, printed when a run finishes.
+        coins = [coin for coin in coins if coin.amount > 0]
+
+        self.assertTrue(f"Addresses: {len(set(coin.address for coin in coins))}\n" in out.stdout)
+        self.assertTrue(f"Unspent outputs: {len(coins)}\n" in out.stdout)
+
+    def balance_read(self, balance_path, addresses):
+        self.btk.reset()
+        self.btk.set_input("\n".join(addresses))
+        self.btk.arg(f"--balance-path={balance_path}")
+        self.btk.arg("-l")
+        self.btk.arg("-L")
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode == 0)
+
+        return dict(zip(addresses, (int(balance) for balance in out.stdout.split())))
+
+    def direct_read_test(self, opts):
+        history, coins = chainstate_history()
+
+        with tempfile.TemporaryDirectory() as dir:
+            chainstate_path = os.path.join(dir, "chainstate")
+            balance_path = os.path.join(dir, "balance")
+
+            live = ldb.write(chainstate_path, history)
+
+            # The files hold the coins the history leaves.
+            self.assertTrue(sorted(k for k in live if k[:1] == b"C") == sorted(coins))
+
+            self.btk.reset()
+            self.btk.arg("--create-from-chainstate")
+            self.btk.arg("--direct-read")
+            self.btk.arg(f"--chainstate-path={chainstate_path}")
+            self.btk.arg(f"--balance-path={balance_path}")
+            for opt in opts:
+                self.btk.arg(opt)
+
+            out = self.btk.run()
+
+            self.assertTrue(out.returncode == 0)
+
+            # Spent coins leave addresses that must read zero.
+            spent = [snapshot.p2pkh(b"", 0, 0, bytes(20)).address]
+            self.balance_check(balance_path, coins.values(), spent)
+            self.count_check(out, coins.values())
+
+            return len(coins), out
+
+    def test_0300(self):
+        self.direct_read_test([])
+
+    def test_0310(self):
+        self.direct_read_test(["--jobs=4"])
+
+    def test_0320(self):
+        self.direct_read_test(["--jobs=16"])
+
+    def test_0330(self):
+        history, coins = chainstate_history(count=200, changes=0)
+
+        with tempfile.TemporaryDirectory() as dir:
+            chainstate_path = os.path.join(dir, "chainstate")
+
+            ldb.write(chainstate_path, history)
+
+            # Corrupt one byte of a table, inside its first data block.
+            table = sorted(f for f in os.listdir(chainstate_path) if f.endswith(".ldb"))[0]
+            with open(os.path.join(chainstate_path, table), "r+b") as f:
+                f.seek(4)
+                byte = f.read(1)
+                f.seek(4)
+                f.write(bytes([byte[0] ^ 0xff]))
+
+            self.btk.reset()
+            self.btk.arg("--create-from-chainstate")
+            self.btk.arg("--direct-read")
+            self.btk.arg(f"--chainstate-path={chainstate_path}")
+            self.btk.arg(f"--balance-path={os.path.join(dir, 'balance')}")
+
+            out = self.btk.run()
+
+            self.assertTrue(out.returncode == 1)
+            self.assertTrue("checksum" in out.stderr)
+
+    def test_0340(self):
+        # Direct read only applies to a chainstate import.
+        with tempfile.TemporaryDirectory() as dir:
+            self.btk.reset()
+            self.btk.arg("--direct-read")
+            self.btk.arg(f"--balance-path={os.path.join(dir, 'balance')}")
+            self.btk.arg("1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH")
+
+            out = self.btk.run()
+
+            self.assertTrue(out.returncode == 1)
+
+    def log_damage_test(self, damage):
+        history, coins = chainstate_history(count=200, changes=0)
+
+        with tempfile.TemporaryDirectory() as dir:
+            chainstate_path = os.path.join(dir, "chainstate")
+
+            ldb.write(chainstate_path, history)
+
+            log = os.path.join(chainstate_path, max(f for f in os.listdir(chainstate_path) if f.endswith(".log")))
+            with open(log, "r+b") as f:
+                damage(f)
+
+            self.btk.reset()
+            self.btk.arg("--create-from-chainstate")
+            self.btk.arg("--direct-read")
+            self.btk.arg(f"--chainstate-path={chainstate_path}")
+            self.btk.arg(f"--balance-path={os.path.join(dir, 'balance')}")
+
+            return self.btk.run()
+
+    def test_0350(self):
+        # The first record claims more than the rest of its log block.
+        def damage(f):
+            f.seek(4)
+            f.write(struct.pack("<H", ldb.LOG_BLOCK_SIZE))
+
+        out = self.log_damage_test(damage)
+
+        self.assertTrue(out.returncode == 1)
+        self.assertTrue("block boundary" in out.stderr)
+
+    def test_0360(self):
+        # A record cut short at the end of the log is what a crash leaves.
+        def damage(f):
+            f.truncate(os.fstat(f.fileno()).st_size - 3)
+
+        out = self.log_damage_test(damage)
+
+        self.assertTrue(out.returncode == 0)
+
+    ###########
+    ## Resume
+    ###########
+
+    def test_0400(self):
+        history, coins = chainstate_history(count=20000, changes=0)
+
+        # The last coin can not be decoded, so the first import stops
+        # after some batches are written. It is fixed before resuming.
+        last = snapshot.p2pkh(b"\xff" * 32, 0, 7, bytes(20))
+        broken = list(history)
+        chainstate_put(broken, {}, last, snapshot.varint(2) + snapshot.varint(7) + snapshot.varint(5000000 + 6) + bytes(10))
+        chainstate_put(history, coins, last)
+
+        with tempfile.TemporaryDirectory() as dir:
+            chainstate_path = os.path.join(dir, "chainstate")
+            balance_path = os.path.join(dir, "balance")
+
+            ldb.write(chainstate_path, broken)
+
+            self.btk.reset()
+            self.btk.arg("--create-from-chainstate")
+            self.btk.arg("--direct-read")
+            self.btk.arg(f"--chainstate-path={chainstate_path}")
+            self.btk.arg(f"--balance-path={balance_path}")
+            self.btk.arg("--jobs=4")
+
+            out = self.btk.run()
+
+            self.assertTrue(out.returncode == 1)
+
+            os.rename(chainstate_path, chainstate_path + ".broken")
+            ldb.write(chainstate_path, history)
+
+            # The resumed import keeps the four ranges it started with.
+            self.btk.reset()
+            self.btk.arg("--create-from-chainstate")
+            self.btk.arg("--direct-read")
+            self.btk.arg("--resume")
+            self.btk.arg(f"--chainstate-path={chainstate_path}")
+            self.btk.arg(f"--balance-path={balance_path}")
+
+            out = self.btk.run()
+
+            self.assertTrue(out.returncode == 0)
+            self.assertTrue("Reading imported outputs" in out.stdout)
+
+            self.balance_check(balance_path, coins.values())
+
+    def test_0410(self):
+        # Nothing to resume once an import has finished.
+        history, coins = chainstate_history(count=100, changes=0)
+
+        with tempfile.TemporaryDirectory() as dir:
+            chainstate_path = os.path.join(dir, "chainstate")
+            balance_path = os.path.join(dir, "balance")
+
+            ldb.write(chainstate_path, history)
+
+            for opts in [[], ["--resume"]]:
+                self.btk.reset()
+                self.btk.arg("--create-from-chainstate")
+                self.btk.arg("--direct-read")
+                self.btk.arg(f"--chainstate-path={chainstate_path}")
+                self.btk.arg(f"--balance-path={balance_path}")
+                for opt in opts:
+                    self.btk.arg(opt)
+
+                out = self.btk.run()
+
+            self.assertTrue(out.returncode == 1)
+            self.assertTrue("No import checkpoint" in out.stderr)
+
+            self.balance_check(balance_path, coins.values())
+
+    ###########
+    ## Count
+    ###########
+
+    def count_test(self, opts):
+        count, out = self.direct_read_test(opts)
+        progress = [(int(n), int(total)) for n, total in re.findall(r"\[(\d+)/(\d+)\]", out.stdout)]
+
+        self.assertTrue(len(progress) > 0)
+        self.assertTrue(progress[-1][0] == count)
+
+        return count, progress
+
+    def test_0500(self):
+        # The total is known before the first record is written.
+        for jobs in ["--jobs=1", "--jobs=4"]:
+            count, progress = self.count_test(["--count=exact", jobs])
+            self.assertTrue(all(total == count for n, total in progress))
+
+    def test_0510(self):
+        # An estimate only grows to cover the records actually read.
+        count, progress = self.count_test(["--count=estimate"])
+        self.assertTrue(all(total >= n for n, total in progress))
+
+    def test_0520(self):
+        self.btk.reset()
+        self.btk.arg("--create-from-chainstate")
+        self.btk.arg("--count=all")
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode == 1)
+        self.assertTrue("exact or estimate" in out.stderr)
+
+    ##################
+    ## Commit Blocks
+    ##################
+
+    def update_stop(self, balance_path, node, block, opts):
+        # Creates the database from the node until the given block is
+        # processed, then kills the run while it waits for the next one.
+        node.hold = block + 1
+        node.release.clear()
+
+        process = subprocess.Popen(["bin/btk", "balance", "--create", f"--balance-path={balance_path}"] + node.opts() + opts, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, text=True)
+
+        out = ""
+        while f"[Block {block}/" not in out:
+            c = process.stdout.read(1)
+            if not c:
+                break
+            out += c
+
+        process.kill()
+        process.wait()
+        process.stdout.close()
+
+        node.hold = None
+        node.release.set()
+
+        self.assertTrue(f"[Block {block}/" in out)
+
+    def update_finish(self, balance_path, node):
+        # An update carries on from the last block written.
+        self.btk.reset()
+        self.btk.arg("--update")
+        self.btk.arg(f"--balance-path={balance_path}")
+        for opt in node.opts():
+            self.btk.arg(opt)
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode == 0)
+
+        self.balance_check(balance_path, node.chain.coins[-1], node.chain.addresses)
+        self.count_check(out, node.chain.coins[-1])
+
+    def test_0600(self):
+        chain = bitcoind.Chain(30)
+
+        with bitcoind.Node(chain) as node:
+            for commit_blocks in [1, 7, 100]:
+                with tempfile.TemporaryDirectory() as dir:
+                    balance_path = os.path.join(dir, "balance")
+
+                    self.update_stop(balance_path, node, 20, [f"--commit-blocks={commit_blocks}"])
+
+                    # Only whole groups of blocks were written.
+                    written = 20 // commit_blocks * commit_blocks
+                    self.balance_check(balance_path, chain.coins[written], chain.addresses)
+
+                    if written > 0:
+                        self.update_finish(balance_path, node)
+
+    def test_0610(self):
+        # A create runs to the last block in one go.
+        chain = bitcoind.Chain(12)
+
+        with bitcoind.Node(chain) as node:
+            with tempfile.TemporaryDirectory() as dir:
+                balance_path = os.path.join(dir, "balance")
+
+                self.btk.reset()
+                self.btk.arg("--create")
+                self.btk.arg(f"--balance-path={balance_path}")
+                self.btk.arg("--commit-blocks=5")
+                for opt in node.opts():
+                    self.btk.arg(opt)
+
+                out = self.btk.run()
+
+                self.assertTrue(out.returncode == 0)
+
+                self.balance_check(balance_path, chain.coins[-1], chain.addresses)
+
+    def test_0620(self):
+        for value in ["0", "-3", "ten"]:
+            self.btk.reset()
+            self.btk.arg("--create")
+            self.btk.arg(f"--commit-blocks={value}")
+
+            out = self.btk.run()
+
+            self.assertTrue(out.returncode == 1)
+            self.assertTrue("--commit-blocks" in out.stderr)
+
+    ############
+    ## DB Cache
+    ############
+
+    def test_0700(self):
+        # Groups are larger than the run gets through, so only the memory
+        # limit makes it write before the held block.
+        chain = bitcoind.Chain(30, outputs=500)
+
+        states = []
+        for coins in chain.coins:
+            balances = {address: 0 for address in chain.addresses}
+            for coin in coins:
+                balances[coin.address] += coin.amount
+            states.append(balances)
+
+        with bitcoind.Node(chain) as node:
+            for opts in [[], ["--dbcache=1"]]:
+                with tempfile.TemporaryDirectory() as dir:
+                    balance_path = os.path.join(dir, "balance")
+
+                    self.update_stop(balance_path, node, 20, ["--commit-blocks=1000"] + opts)
+
+                    balances = self.balance_read(balance_path, chain.addresses)
+                    self.assertTrue(balances in states)
+
+                    written = states.index(balances)
+
+                    if opts:
+                        self.assertTrue(written > 0)
+                        self.update_finish(balance_path, node)
+                    else:
+                        self.assertTrue(written == 0)
+
+    def test_0720(self):
+        # At one megabyte the sums spill every 30000 or so addresses, so
+        # an import merges them from several runs. Most addresses are in
+        # more than one run, and must add up as they do in memory.
+        rng = random.Random(7)
+        hashes = [rng.randbytes(20) for _ in range(40000)]
+        coins = [snapshot.p2pkh(rng.randbytes(32), 0, rng.randrange(1, 10 ** 8), rng.choice(hashes)) for _ in range(80000)]
+        data = snapshot.encode(coins)
+        addresses = sorted(set(coin.address for coin in coins))
+
+        with tempfile.TemporaryDirectory() as dir:
+            balances = []
+            for opts in [[], ["--dbcache=1"]]:
+                path = os.path.join(dir, str(len(balances)))
+                os.makedirs(path)
+
+                out = self.snapshot_create(path, data, opts)
+
+                self.assertTrue(out.returncode == 0)
+                self.count_check(out, coins)
+
+                balances.append(self.balance_read(os.path.join(path, "balance"), addresses))
+
+            self.assertTrue(balances[1] == balances[0])
+
+    def test_0710(self):
+        for value in ["0", "-3", "ten"]:
+            self.btk.reset()
+            self.btk.arg("--create")
+            self.btk.arg(f"--dbcache={value}")
+
+            out = self.btk.run()
+
+            self.assertTrue(out.returncode == 1)
+            self.assertTrue("--dbcache" in out.stderr)
\ No newline at end of file
@@ -0,0 +1,140 @@
+import json
+import random
+import struct
+import hashlib
+import threading
+import http.server
+from . import snapshot
+
+# A stand-in for a bitcoin core node, for the --create and --update tests.
+# It answers the json-rpc calls the balance command makes, getblockcount,
+# getblockhash and getblock, with a synthetic chain of pay to public key
+# hash transactions. A block can be held back, so a run can be stopped
+# part way at a known block.
+
+AUTH = "dXNlcjpwYXNz"
+
+
+def sha256d(data):
+    return hashlib.sha256(hashlib.sha256(data).digest()).digest()
+
+
+class Chain:
+
+    def __init__(self, blocks, seed=1, outputs=4):
+        # Each block has a coinbase and a few transactions that spend
+        # earlier outputs, outputs being how many each one creates.
+        rng = random.Random(seed)
+        hashes = [bytes(rng.getrandbits(8) for _ in range(20)) for _ in range(40)]
+
+        self.addresses = sorted(snapshot.base58check(b"\x00" + h) for h in hashes)
+        self.blocks = [None]
+        self.hashes = [bytes(32)]
+        self.coins = [[]]
+
+        unspent = []
+
+        for height in range(1, blocks + 1):
+            txs = []
+
+            # Coinbase scripts hold the height, so no two are the same.
+            outs = [(rng.randrange(1, 10 ** 9), rng.choice(hashes)) for _ in range(outputs)]
+            txs.append(transaction([(bytes(32), 0xffffffff, struct.pack("<I", height))], outs))
+
+            for _ in range(min(3, len(unspent))):
+                spent = [unspent.pop(rng.randrange(len(unspent))) for _ in range(min(2, len(unspent)))]
+                total = sum(coin.amount for coin in spent)
+                outs = [(total // outputs, rng.choice(hashes)) for _ in range(outputs)]
+                txs.append(transaction([(bytes(reversed(coin.txid)), coin.vout, b"") for coin in spent], outs))
+
+            for tx, outs in txs:
+                txid = bytes(reversed(sha256d(tx)))
+                unspent += [snapshot.p2pkh(txid, vout, amount, h) for vout, (amount, h) in enumerate(outs)]
+
+            header = struct.pack("<I", 1) + self.hashes[-1] + bytes(32) + struct.pack("<III", height, 0x1d00ffff, 0)
+            self.blocks.append(header + snapshot.compact_size(len(txs)) + b"".join(tx for tx, outs in txs))
+            self.hashes.append(sha256d(header))
+            self.coins.append(list(unspent))
+
+    def block_hash(self, height):
+        return bytes(reversed(self.hashes[height])).hex()
+
+
+def transaction(inputs, outputs):
+    tx = struct.pack("<I", 1) + snapshot.compact_size(len(inputs))
+    for prev, index, script in inputs:
+        tx += prev + struct.pack("<I", index) + snapshot.compact_size(len(script)) + script + struct.pack("<I", 0xffffffff)
+    tx += snapshot.compact_size(len(outputs))
+    for amount, h in outputs:
+        script = b"\x76\xa9\x14" + h + b"\x88\xac"
+        tx += struct.pack("<Q", amount) + snapshot.compact_size(len(script)) + script
+    tx += struct.pack("<I", 0)
+    return tx, outputs
+
+
+class Node:
+
+    def __init__(self, chain):
+        self.chain = chain
+        self.hold = None
+        self.release = threading.Event()
+
+        node = self
+
+        class Handler(http.server.BaseHTTPRequestHandler):
+
+            def do_POST(self):
+                if self.headers.get("Authorization") != "Basic " + AUTH:
+                    self.send_error(401)
+                    return
+
+                request = json.loads(self.rfile.read(int(self.headers["Content-length"])))
+                result = node.call(request["method"], request["params"])
+
+                body = json.dumps({"result": result, "error": None, "id": request["id"]}).encode()
+
+                # A held reply goes to a run that was stopped meanwhile.
+                try:
+                    self.send_response(200)
+                    self.send_header("Content-Type", "application/json")
+                    self.send_header("Content-Length", str(len(body)))
+                    self.end_headers()
+                    self.wfile.write(body)
+                except (BrokenPipeError, ConnectionResetError):
+                    pass
+
+            def log_message(self, format, *args):
+                pass
+
+        self.server = http.server.ThreadingHTTPServer(("127.0.0.1", 0), Handler)
+        self.port = self.server.server_address[1]
+        self.thread = threading.Thread(target=self.server.serve_forever)
+        self.thread.start()
+
+    def call(self, method, params):
+        if method == "getblockcount":
+            return len(self.chain.blocks) - 1
+        if method == "getblockhash":
+            # A held block is not answered until it is let go.
+            if params[0] == self.hold:
+                self.release.wait()
+            return self.chain.block_hash(params[0])
+        if method == "getblock":
+            height = [self.chain.block_hash(i) for i in range(len(self.chain.blocks))].index(params[0])
+            return self.chain.blocks[height].hex()
+        return None
+
+    def opts(self):
+        return ["--hostname=127.0.0.1", f"--port={self.port}", f"--rpc-auth={AUTH}"]
+
+    def close(self):
+        self.release.set()
+        self.server.shutdown()
+        self.server.server_close()
+        self.thread.join()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
\ No newline at end of file
@@ -0,0 +1,182 @@
+import json
+import unittest
+from .btk import BTK
+
+inputs = [
+    {
+        "wif": "KwZyzjLqrxTdMBUXV1pNsF53jmatRNSZn7t5x8sx735rzAbz4Cpa",
+        "hex": "03aeed4c495e665e8f81d503edb3972f9605d467e39bdf4e807846ef2b8faf7de6",
+        "p2pkh": "1NZoZSUY4Lfg5yVn5FPHo4NHEUKcGmGkj1",
+        "p2pkh_u": "1BVb7TXi2mGbRnbGoosgZi9FXRWHTFzub3",
+        "bech32": "bc1qaj8dzeef28e9qrwa386krprp56fps44gspvvy7",
+    },
+    {
+        "wif": "KyqWNV7VzbrzsyhuDQAzo2qPv3YuiJk5Rp9QwRS2m3ThdMudb5fs",
+        "hex": "03c4bccbc63026e871efdeec3a1a398da8e14a218c5a4b79be06ad74a681baa528",
+        "p2pkh": "18aM4Jurg1Ecbds4u1woSzgmbdCExTK26e",
+        "p2pkh_u": "1F8wyVLeJsB7mJG8H85V7cwKLMQLYVDptg",
+        "bech32": "bc1q2vt4nxs9a62ldd2gp8jf6telc7ulyu67r2xanu",
+    },
+]
+
+
+class Chain(unittest.TestCase):
+
+    def run_test(self):
+        suite = unittest.defaultTestLoader.loadTestsFromTestCase(Chain)
+        unittest.TextTestRunner().run(suite)
+
+    def setUp(self):
+        self.btk = BTK("chain")
+
+    ###############
+    ## Stages
+    ###############
+
+    def test_0010(self):
+
+        for input in inputs:
+            self.btk.reset()
+            self.btk.arg("privkey,pubkey")
+            self.btk.arg(input["wif"])
+
+            out = self.btk.run()
+
+            self.assertTrue(out.returncode == 0)
+            self.assertTrue(out.stdout)
+
+            out_json = json.loads(out.stdout)
+
+            self.assertTrue(out_json[0] == input["hex"])
+
+    def test_0020(self):
+
+        for input in inputs:
+            self.btk.reset()
+            self.btk.arg("privkey,pubkey,address")
+            self.btk.arg(input["wif"])
+
+            out = self.btk.run()
+
+            self.assertTrue(out.returncode == 0)
+            self.assertTrue(out.stdout)
+
+            out_json = json.loads(out.stdout)
+
+            self.assertTrue(out_json[0] == input["p2pkh"])
+
+    def test_0030(self):
+
+        input = "\n".join(i["wif"] for i in inputs)
+
+        self.btk.reset()
+        self.btk.set_input(input)
+        self.btk.arg("privkey,address")
+        self.btk.arg("--in-format=list")
+        self.btk.arg("--out-format=list")
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode == 0)
+        self.assertTrue(out.stdout.split() == [i["p2pkh"] for i in inputs])
+
+    ###############
+    ## Stage Options
+    ###############
+
+    def test_0040(self):
+
+        input = inputs[0]
+
+        self.btk.reset()
+        self.btk.arg("\"privkey,pubkey --compressed=false,address\"")
+        self.btk.arg(input["wif"])
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode == 0)
+
+        out_json = json.loads(out.stdout)
+
+        self.assertTrue(out_json[0] == input["p2pkh_u"])
+
+    def test_0050(self):
+
+        input = inputs[0]
+
+        self.btk.reset()
+        self.btk.arg("\"privkey,address --bech32 --legacy\"")
+        self.btk.arg(input["wif"])
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode == 0)
+
+        out_json = json.loads(out.stdout)
+
+        self.assertTrue(sorted(out_json) == sorted([input["p2pkh"], input["bech32"]]))
+
+    ###############
+    ## Errors
+    ###############
+
+    def test_0060(self):
+
+        self.btk.reset()
+        self.btk.arg("privkey,privkey")
+        self.btk.arg(inputs[0]["wif"])
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode != 0)
+
+    def test_0070(self):
+
+        self.btk.reset()
+        self.btk.arg("\"privkey,pubkey --out-format=list\"")
+        self.btk.arg(inputs[0]["wif"])
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode != 0)
+
+    def test_0080(self):
+
+        self.btk.reset()
+        self.btk.arg("privkey,node")
+        self.btk.arg(inputs[0]["wif"])
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode != 0)
+
+    def test_0090(self):
+
+        self.btk.reset()
+        self.btk.arg("\"privkey --create,address --legacy\"")
+        self.btk.arg("--count=100")
+        self.btk.arg("-L")
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode == 0)
+
+        out_list = out.stdout.split()
+
+        self.assertTrue(len(out_list) == 100)
+        self.assertTrue(len(set(out_list)) == 100)
+        self.assertTrue(all(a.startswith("1") for a in out_list))
+
+    def test_0100(self):
+        # Commas inside stage options do not split the stage list.
+        self.btk.reset()
+        self.btk.arg("\"privkey --rehash=1,2,pubkey\"")
+        self.btk.arg("KwDiBf89QgGbjEhKnhXJuH7LrciVrZi3qYjgd9M7rFU73sVHnoWn")
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode == 0)
+
+        out_json = json.loads(out.stdout)
+
+        self.assertTrue(out_json == ["0394d6deea102c33307a5ae7e41515198f6fc19d3b11abeca5bff56f1011ed2d8e", "02433ec8677e4f0f0b651810e1573013539c39860011f7e7e1f4ed01bba43ba5b7"])
\ No newline at end of file
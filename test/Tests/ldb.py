@@ -0,0 +1,239 @@
+import os
+import random
+import struct
+
+# Writes a LevelDB database straight to its files, for the --direct-read
+# tests. A history of puts and deletes is spread over the places LevelDB
+# keeps data: older writes in sorted level 1 and 2 tables, newer ones in
+# overlapping level 0 tables, and the newest in the write-ahead log, where
+# one large batch is fragmented across log blocks. A table the manifest
+# has deleted and a log older than the current one are left on disk, as
+# LevelDB may leave them, and must be ignored. Tables are uncompressed, as
+# Bitcoin Core writes them.
+
+TYPE_DELETION = 0
+TYPE_VALUE = 1
+
+LOG_BLOCK_SIZE = 32768
+LOG_FULL = 1
+LOG_FIRST = 2
+LOG_MIDDLE = 3
+LOG_LAST = 4
+
+TABLE_MAGIC = 0xdb4775248b80fb57
+
+CRC32C_TABLE = []
+for i in range(256):
+    c = i
+    for _ in range(8):
+        c = (c >> 1) ^ 0x82f63b78 if c & 1 else c >> 1
+    CRC32C_TABLE.append(c)
+
+
+def write(path, history, seed=1):
+    # history is a list of (key, value) in write order, with None as the
+    # value of a delete. Returns the keys that are live at the end, with
+    # their values.
+    rng = random.Random(seed)
+    os.makedirs(path)
+
+    entries = [(key, seq + 1, TYPE_VALUE if value is not None else TYPE_DELETION, value or b"") for seq, (key, value) in enumerate(history)]
+
+    n = len(entries)
+    cuts = [int(n * x) for x in (0.3, 0.45, 0.55)]
+
+    files = []
+    number = [10]
+
+    def table_file(level, items):
+        number[0] += 1
+        size = write_table(os.path.join(path, "%06d.ldb" % number[0]), items, rng)
+        files.append((level, number[0], size, internal_key(*items[0][:3]), internal_key(*items[-1][:3])))
+
+    # Deeper levels hold older writes. Files of one level do not overlap.
+    for level, part, count in ((2, entries[:cuts[0]], 7), (1, entries[cuts[0]:cuts[1]], 4)):
+        items = sort_entries(part)
+        per = max(1, len(items) // count)
+        i = 0
+        while i < len(items):
+            j = min(len(items), i + per)
+            while j < len(items) and items[j][0] == items[j - 1][0]:
+                j += 1
+            table_file(level, items[i:j])
+            i = j
+
+    # Level 0 files each cover the whole key space.
+    middle = (cuts[1] + cuts[2]) // 2
+    table_file(0, sort_entries(entries[cuts[1]:middle]))
+    table_file(0, sort_entries(entries[middle:cuts[2]]))
+
+    # A table that was compacted away, with stale data.
+    number[0] += 1
+    dead = number[0]
+    dead_items = sort_entries([(key, seq, TYPE_VALUE, b"stale") for key, seq, t, value in entries[:10]])
+    write_table(os.path.join(path, "%06d.ldb" % dead), dead_items, rng)
+
+    log_number = number[0] + 1
+    manifest_number = number[0] + 2
+
+    manifest = Log(os.path.join(path, "MANIFEST-%06d" % manifest_number))
+    manifest.add(varint(1) + length_prefixed(b"leveldb.BytewiseComparator"))
+    manifest.add(varint(7) + varint(1) + varint(dead) + varint(1) + length_prefixed(internal_key(*dead_items[0][:3])) + length_prefixed(internal_key(*dead_items[-1][:3])))
+    edit = b""
+    for level, file_number, size, smallest, largest in files:
+        edit += varint(7) + varint(level) + varint(file_number) + varint(size) + length_prefixed(smallest) + length_prefixed(largest)
+    edit += varint(2) + varint(log_number) + varint(3) + varint(manifest_number + 1) + varint(4) + varint(n) + varint(6) + varint(1) + varint(dead)
+    manifest.add(edit)
+    manifest.close()
+
+    with open(os.path.join(path, "CURRENT"), "w") as f:
+        f.write("MANIFEST-%06d\n" % manifest_number)
+
+    # A log from before the last compaction, already in the tables.
+    log = Log(os.path.join(path, "000005.log"))
+    log.add(write_batch([(entries[0][0], 1, TYPE_VALUE, b"stale")]))
+    log.close()
+
+    # The live log, ending in a batch that spans more than two log blocks.
+    log = Log(os.path.join(path, "%06d.log" % log_number))
+    rest = entries[cuts[2]:]
+    tail = len(rest)
+    while tail > 0 and sum(len(e[0]) + len(e[3]) + 3 for e in rest[tail:]) < 2 * LOG_BLOCK_SIZE:
+        tail -= 1
+    i = 0
+    while i < tail:
+        batch = rest[i:min(tail, i + rng.choice([1, 5, 200]))]
+        log.add(write_batch(batch))
+        i += len(batch)
+    if tail < len(rest):
+        log.add(write_batch(rest[tail:]))
+    log.close()
+
+    live = {}
+    for key, value in history:
+        if value is None:
+            live.pop(key, None)
+        else:
+            live[key] = value
+
+    return live
+
+
+def sort_entries(entries):
+    # Internal key order: user key ascending, then newest first.
+    return sorted(entries, key=lambda e: (e[0], -e[1]))
+
+
+def internal_key(key, seq, t):
+    return key + struct.pack("<Q", (seq << 8) | t)
+
+
+def write_batch(entries):
+    record = struct.pack("<QI", entries[0][1], len(entries))
+    for key, seq, t, value in entries:
+        record += bytes([t]) + length_prefixed(key)
+        if t == TYPE_VALUE:
+            record += length_prefixed(value)
+    return record
+
+
+def write_table(path, items, rng):
+    data = bytearray()
+    index = []
+
+    entries_per_block = rng.choice([1, 3, 50, 400])
+    for i in range(0, len(items), entries_per_block):
+        chunk = items[i:i + entries_per_block]
+        handle = write_block(data, [(internal_key(*item[:3]), item[3]) for item in chunk], 16)
+        index.append((internal_key(*chunk[-1][:3]), handle))
+
+    meta_handle = write_block(data, [], 16)
+    index_handle = write_block(data, index, 1)
+
+    footer = meta_handle + index_handle
+    footer += bytes(40 - len(footer)) + struct.pack("<Q", TABLE_MAGIC)
+    data += footer
+
+    with open(path, "wb") as f:
+        f.write(data)
+
+    return len(data)
+
+
+def write_block(data, entries, restart_interval):
+    # Appends a block with its trailer and returns its handle.
+    block = bytearray()
+    restarts = []
+    last = b""
+    for i, (key, value) in enumerate(entries):
+        shared = 0
+        if i % restart_interval == 0:
+            restarts.append(len(block))
+        else:
+            while shared < min(len(key), len(last)) and key[shared] == last[shared]:
+                shared += 1
+        block += varint(shared) + varint(len(key) - shared) + varint(len(value)) + key[shared:] + value
+        last = key
+    for restart in restarts:
+        block += struct.pack("<I", restart)
+    block += struct.pack("<I", len(restarts))
+
+    offset = len(data)
+    data += block + b"\x00" + struct.pack("<I", mask_crc(crc32c(bytes(block) + b"\x00")))
+
+    return varint(offset) + varint(len(block))
+
+
+class Log:
+
+    def __init__(self, path):
+        self.file = open(path, "wb")
+        self.position = 0
+
+    def add(self, record):
+        first = True
+        while True:
+            left = LOG_BLOCK_SIZE - self.position % LOG_BLOCK_SIZE
+            if left < 7:
+                self.file.write(bytes(left))
+                self.position += left
+                continue
+
+            fragment, record = record[:left - 7], record[left - 7:]
+            if first:
+                t = LOG_FULL if not record else LOG_FIRST
+            else:
+                t = LOG_LAST if not record else LOG_MIDDLE
+
+            self.file.write(struct.pack("<IHB", mask_crc(crc32c(fragment, crc32c(bytes([t])))), len(fragment), t) + fragment)
+            self.position += 7 + len(fragment)
+            first = False
+
+            if not record:
+                break
+
+    def close(self):
+        self.file.close()
+
+
+def crc32c(data, crc=0):
+    crc ^= 0xffffffff
+    for b in data:
+        crc = CRC32C_TABLE[(crc ^ b) & 0xff] ^ (crc >> 8)
+    return crc ^ 0xffffffff
+
+
+def mask_crc(crc):
+    return ((((crc >> 15) | (crc << 17)) & 0xffffffff) + 0xa282ead8) & 0xffffffff
+
+
+def varint(n):
+    out = b""
+    while n >= 0x80:
+        out += bytes([n & 0x7f | 0x80])
+        n >>= 7
+    return out + bytes([n])
+
+
+def length_prefixed(data):
+    return varint(len(data)) + data
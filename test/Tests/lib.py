@@ -0,0 +1,160 @@
+import ctypes
+import hashlib
+import subprocess
+import unittest
+
+inputs = [
+    {
+        "wif": "KwZyzjLqrxTdMBUXV1pNsF53jmatRNSZn7t5x8sx735rzAbz4Cpa",
+        "wif_u": "5HtsyacJsHeJJG4X1ukMpBSPNUKZ3MGJrC5Ko2LFJEAFxC1Quux",
+        "wif_test": "cMvyTeLhJ29tWcwnsRdWEZa7MztJ5pYFrA2Z4ZLTc9jsEuiM9R3d",
+        "hex": "03aeed4c495e665e8f81d503edb3972f9605d467e39bdf4e807846ef2b8faf7de6",
+        "hex_u": "04aeed4c495e665e8f81d503edb3972f9605d467e39bdf4e807846ef2b8faf7de61b8daa3aa7f4e706d48b902556560376760cd1a65b657e5bc2f5f278b6d62321",
+        "p2pkh": "1NZoZSUY4Lfg5yVn5FPHo4NHEUKcGmGkj1",
+        "p2pkh_u": "1BVb7TXi2mGbRnbGoosgZi9FXRWHTFzub3",
+        "p2pkh_test": "n35krVZWsN6vs5yPnpMfcyac6TvK9kcyLW",
+        "bech32": "bc1qaj8dzeef28e9qrwa386krprp56fps44gspvvy7",
+        "bech32_test": "tb1qaj8dzeef28e9qrwa386krprp56fps44g68hlld",
+        "bech32m": "bc1p73gxns0ld3k5jfw4cqn3gvf55e74h37t2xjh6whcehs56l43hdksknhy9a",
+    },
+]
+
+NETWORK_MAIN = 0
+NETWORK_TEST = 1
+
+SCRIPT_UNKNOWN = 0
+SCRIPT_P2PKH = 2
+SCRIPT_P2WPKH = 4
+
+
+class Lib(unittest.TestCase):
+
+    def run_test(self):
+        suite = unittest.defaultTestLoader.loadTestsFromTestCase(Lib)
+        unittest.TextTestRunner().run(suite)
+
+    @classmethod
+    def setUpClass(cls):
+        cls.lib = ctypes.CDLL("bin/libbtk.so")
+        cls.lib.libbtk_error.restype = ctypes.c_char_p
+
+    def privkey(self, wif):
+        privkey = ctypes.create_string_buffer(32)
+        compressed = ctypes.c_int()
+        network = ctypes.c_int()
+        r = self.lib.libbtk_privkey_from_wif(privkey, ctypes.byref(compressed), ctypes.byref(network), wif.encode())
+        self.assertEqual(r, 1)
+        return privkey.raw, compressed.value, network.value
+
+    def pubkey(self, privkey, compressed):
+        pubkey = ctypes.create_string_buffer(65)
+        r = self.lib.libbtk_pubkey_get(pubkey, ctypes.c_size_t(65), privkey, compressed)
+        self.assertGreater(r, 0)
+        return pubkey.raw[:r]
+
+    def address(self, func, pubkey, network):
+        address = ctypes.create_string_buffer(91)
+        r = func(address, ctypes.c_size_t(91), pubkey, ctypes.c_size_t(len(pubkey)), network)
+        self.assertEqual(r, 1)
+        return address.value.decode()
+
+    def test_0001(self):
+        """libbtk_api_version"""
+        self.assertEqual(self.lib.libbtk_api_version(), 1)
+
+    def test_0002(self):
+        """wif -> pubkey -> p2pkh, bech32"""
+        for input in inputs:
+            privkey, compressed, network = self.privkey(input["wif"])
+            self.assertEqual(compressed, 1)
+            self.assertEqual(network, NETWORK_MAIN)
+            pubkey = self.pubkey(privkey, compressed)
+            self.assertEqual(pubkey.hex(), input["hex"])
+            self.assertEqual(self.address(self.lib.libbtk_address_p2pkh, pubkey, NETWORK_MAIN), input["p2pkh"])
+            self.assertEqual(self.address(self.lib.libbtk_address_p2pkh, pubkey, NETWORK_TEST), input["p2pkh_test"])
+            self.assertEqual(self.address(self.lib.libbtk_address_p2wpkh, pubkey, NETWORK_MAIN), input["bech32"])
+            self.assertEqual(self.address(self.lib.libbtk_address_p2wpkh, pubkey, NETWORK_TEST), input["bech32_test"])
+            self.assertEqual(self.address(self.lib.libbtk_address_p2tr, pubkey, NETWORK_MAIN), input["bech32m"])
+
+    def test_0003(self):
+        """uncompressed and testnet wif"""
+        for input in inputs:
+            privkey, compressed, network = self.privkey(input["wif_u"])
+            self.assertEqual(compressed, 0)
+            pubkey = self.pubkey(privkey, compressed)
+            self.assertEqual(pubkey.hex(), input["hex_u"])
+            self.assertEqual(self.address(self.lib.libbtk_address_p2pkh, pubkey, NETWORK_MAIN), input["p2pkh_u"])
+
+            privkey_test, compressed, network = self.privkey(input["wif_test"])
+            self.assertEqual(network, NETWORK_TEST)
+            self.assertEqual(privkey_test, privkey)
+
+            wif = ctypes.create_string_buffer(53)
+            r = self.lib.libbtk_privkey_to_wif(wif, ctypes.c_size_t(53), privkey, 1, NETWORK_MAIN)
+            self.assertEqual(r, 1)
+            self.assertEqual(wif.value.decode(), input["wif"])
+
+    def test_0004(self):
+        """script type and address"""
+        for input in inputs:
+            pubkey = bytes.fromhex(input["hex"])
+            p2pkh = self.address(self.lib.libbtk_address_p2pkh, pubkey, NETWORK_MAIN)
+            hash160 = bytes.fromhex(self.hash160(pubkey))
+            script = bytes([0x76, 0xa9, 0x14]) + hash160 + bytes([0x88, 0xac])
+            self.assertEqual(self.lib.libbtk_script_type(script, ctypes.c_size_t(len(script))), SCRIPT_P2PKH)
+            address = ctypes.create_string_buffer(91)
+            r = self.lib.libbtk_script_address(address, ctypes.c_size_t(91), script, ctypes.c_size_t(len(script)), NETWORK_MAIN)
+            self.assertEqual(r, 1)
+            self.assertEqual(address.value.decode(), p2pkh)
+
+            script = bytes([0x00, 0x14]) + hash160
+            self.assertEqual(self.lib.libbtk_script_type(script, ctypes.c_size_t(len(script))), SCRIPT_P2WPKH)
+            script = bytes([0x6a, 0x01, 0x00])
+            self.assertEqual(self.lib.libbtk_script_type(script, ctypes.c_size_t(len(script))), SCRIPT_UNKNOWN)
+
+    def test_0005(self):
+        """errors"""
+        wif = ctypes.create_string_buffer(53)
+        r = self.lib.libbtk_privkey_from_wif(wif, None, None, b"notawif")
+        self.assertEqual(r, -1)
+        self.assertTrue(self.lib.libbtk_error())
+
+        address = ctypes.create_string_buffer(8)
+        pubkey = bytes.fromhex(inputs[0]["hex"])
+        r = self.lib.libbtk_address_p2pkh(address, ctypes.c_size_t(8), pubkey, ctypes.c_size_t(len(pubkey)), NETWORK_MAIN)
+        self.assertEqual(r, -1)
+        self.assertIn(b"too small", self.lib.libbtk_error())
+
+    def test_0006(self):
+        """p2tr batch matches single calls, including the BIP86 test vector"""
+        pubkeys = [bytes.fromhex(input["hex"]) for input in inputs]
+        pubkeys.append(bytes.fromhex("03cc8a4bc64d897bddc5fbc2f670f7a8ba0b386779106cf1223c6fc5d7cd6fc115"))
+        for i in range(1, 50):
+            privkey = hashlib.sha256(bytes([i])).digest()
+            pubkeys.append(self.pubkey(privkey, 1))
+
+        single = [self.address(self.lib.libbtk_address_p2tr, pubkey, NETWORK_MAIN) for pubkey in pubkeys]
+        self.assertEqual(single[0], inputs[0]["bech32m"])
+        self.assertEqual(single[1], "bc1p5cyxnuxmeuwuvkwfem96lqzszd02n6xdcjrs20cac6yqjjwudpxqkedrcr")
+
+        addresses = ctypes.create_string_buffer(91 * len(pubkeys))
+        r = self.lib.libbtk_address_p2tr_batch(addresses, ctypes.c_size_t(91), b"".join(pubkeys), ctypes.c_size_t(33), ctypes.c_size_t(len(pubkeys)), NETWORK_MAIN)
+        self.assertEqual(r, 1)
+
+        batch = [addresses.raw[i * 91:(i + 1) * 91].split(b"\0")[0].decode() for i in range(len(pubkeys))]
+        self.assertEqual(batch, single)
+
+    def test_0007(self):
+        """only the api is exported, with a versioned shared library"""
+        for opts in [["bin/libbtk.a"], ["-D", "bin/libbtk.so"]]:
+            out = subprocess.run(["nm", "-g", "--defined-only"] + opts, capture_output=True, text=True)
+            self.assertEqual(out.returncode, 0)
+            symbols = [line.split()[-1] for line in out.stdout.splitlines() if len(line.split()) == 3]
+            self.assertTrue(symbols)
+            self.assertEqual([symbol for symbol in symbols if not symbol.startswith("libbtk_")], [])
+
+        out = subprocess.run(["readelf", "-d", "bin/libbtk.so"], capture_output=True, text=True)
+        self.assertIn("[libbtk.so.1]", out.stdout)
+
+    def hash160(self, pubkey):
+        return hashlib.new("ripemd160", hashlib.sha256(pubkey).digest()).hexdigest()
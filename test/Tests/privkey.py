@@ -1,5 +1,7 @@
+import os
 import sys
 import json
+import tempfile
 import unittest
 from .btk import BTK
 
@@ -128,6 +130,43 @@ class Privkey(unittest.TestCase):
     def test_0010(self):
         self.io_test(opts=["--create"], input=None, output=None)
 
+    def test_0015(self):
+
+        self.btk.reset()
+        self.btk.arg("--create")
+        self.btk.arg("--count=1000")
+        self.btk.arg("--jobs=4")
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode == 0)
+        self.assertTrue(out.stdout)
+
+        out_json = json.loads(out.stdout)
+
+        self.assertTrue(len(out_json) == 1000)
+        self.assertTrue(len(set(out_json)) == 1000)
+
+        ## Created keys must be valid input
+        self.btk.reset()
+        self.btk.set_input("\n".join(out_json))
+        self.btk.arg("-l")
+        self.btk.arg("-L")
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode == 0)
+        self.assertTrue(out.stdout.split() == out_json)
+
+        ## Count needs a command without input
+        self.btk.reset()
+        self.btk.arg("--count=10")
+        self.btk.arg(inputs[0]["wif"])
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode != 0)
+
     ################
     ## Output Format
     ################
@@ -144,6 +183,95 @@ class Privkey(unittest.TestCase):
     def test_0050(self):
         self.io_test(opts=["--create", "--out-format=list"], input=None, output=None, output_json=False)
 
+    def test_0051(self):
+        self.btk.reset()
+        self.btk.set_input(inputs[0]["wif"])
+        self.btk.arg("-w")
+        self.btk.arg("-l")
+        self.btk.arg("-Q")
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode == 0)
+
+        # Version 3 symbol, 29 modules, two module rows per text line.
+        lines = out.stdout.strip("\n").split("\n")
+        self.assertTrue(len(lines) == 15)
+        self.assertTrue(lines[0].startswith("\u2588\u2580\u2580\u2580\u2580\u2580\u2588"))
+
+    def test_0052(self):
+
+        wif_list = [input_group["wif"] for input_group in inputs if "wif" in input_group]
+
+        with tempfile.TemporaryDirectory() as dir:
+            self.btk.reset()
+            self.btk.set_input("\n".join(wif_list))
+            self.btk.arg("-w")
+            self.btk.arg("-l")
+            self.btk.arg("--out-format=svg")
+            self.btk.arg(f"--out-dir={dir}")
+            self.btk.arg("--jobs=4")
+
+            out = self.btk.run()
+
+            self.assertTrue(out.returncode == 0)
+            # Files are numbered in output order and never named after a key.
+            paths = [os.path.join(dir, "%06d.svg" % (i + 1)) for i in range(len(wif_list))]
+            self.assertTrue(out.stdout.split() == paths)
+            self.assertTrue(sorted(os.listdir(dir)) == sorted(os.path.basename(path) for path in paths))
+
+            for path in paths:
+                with open(path) as f:
+                    svg = f.read()
+                self.assertTrue(svg.startswith("<?xml"))
+                self.assertTrue("viewBox=\"0 0 37 37\"" in svg)
+
+    def test_0053(self):
+
+        with tempfile.TemporaryDirectory() as dir:
+            self.btk.reset()
+            self.btk.set_input(inputs[0]["wif"])
+            self.btk.arg("-w")
+            self.btk.arg("-l")
+            self.btk.arg("--out-format=pbm")
+            self.btk.arg(f"--out-dir={dir}")
+
+            out = self.btk.run()
+
+            self.assertTrue(out.returncode == 0)
+
+            with open(os.path.join(dir, "000001.pbm"), "rb") as f:
+                pbm = f.read()
+
+            # 29 modules plus a 4 module border, 8 pixels each.
+            self.assertTrue(pbm.startswith(b"P4\n296 296\n"))
+            self.assertTrue(len(pbm) == len(b"P4\n296 296\n") + 37 * 296)
+
+            # An existing file, or a link planted in its place, is left alone.
+            os.remove(os.path.join(dir, "000001.pbm"))
+            os.symlink(os.path.join(dir, "target"), os.path.join(dir, "000001.pbm"))
+
+            self.btk.reset()
+            self.btk.set_input(inputs[0]["wif"])
+            self.btk.arg("-w")
+            self.btk.arg("-l")
+            self.btk.arg("--out-format=pbm")
+            self.btk.arg(f"--out-dir={dir}")
+
+            out = self.btk.run()
+
+            self.assertTrue(out.returncode != 0)
+            self.assertFalse(os.path.exists(os.path.join(dir, "target")))
+
+    def test_0054(self):
+        self.btk.reset()
+        self.btk.arg("--create")
+        self.btk.arg("--out-dir=/tmp")
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode != 0)
+
     ################
     ## Input Format
     ################
@@ -707,6 +835,54 @@ class Privkey(unittest.TestCase):
         self.assertTrue(out.returncode == 0)
         self.assertFalse(out.stdout)
 
+    ####################
+    ## Jobs
+    ####################
+
+    def test_1705(self):
+
+        wif_list = [input_group["wif"] for input_group in inputs if "wif" in input_group]
+        wif_u_list = [input_group["wif_u"] for input_group in inputs if "wif" in input_group]
+
+        self.btk.reset()
+        self.btk.set_input("\n".join(wif_list * 50))
+        self.btk.arg("-w")
+        self.btk.arg("-l")
+        self.btk.arg("-W")
+        self.btk.arg("-U")
+        self.btk.arg("-L")
+        self.btk.arg("--jobs=4")
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode == 0)
+        self.assertTrue(out.stdout)
+
+        self.assertTrue(out.stdout.split() == wif_u_list * 50)
+
+    ####################
+    ## Large JSON Input
+    ####################
+
+    def test_1706(self):
+
+        wif_list = [input_group["wif"] for input_group in inputs if "wif" in input_group]
+        wif_u_list = [input_group["wif_u"] for input_group in inputs if "wif" in input_group]
+
+        self.btk.reset()
+        self.btk.set_input(json.dumps({"keys": wif_list * 500}))
+        self.btk.arg("-w")
+        self.btk.arg("-W")
+        self.btk.arg("-U")
+        self.btk.arg("-L")
+
+        out = self.btk.run()
+
+        self.assertTrue(out.returncode == 0)
+        self.assertTrue(out.stdout)
+
+        self.assertTrue(out.stdout.split() == wif_u_list * 500)
+
     ###############
     ## Match Tests
     ###############
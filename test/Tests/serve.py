@@ -0,0 +1,148 @@
+import os
+import json
+import time
+import socket
+import resource
+import tempfile
+import subprocess
+import unittest
+
+
+class Serve(unittest.TestCase):
+
+    def run_test(self):
+        suite = unittest.defaultTestLoader.loadTestsFromTestCase(Serve)
+        unittest.TextTestRunner().run(suite)
+
+    def setUp(self):
+        self.dir = tempfile.TemporaryDirectory()
+        self.path = os.path.join(self.dir.name, "btk.sock")
+        self.server = subprocess.Popen(["bin/btk", "serve", f"--socket={self.path}"], stderr=subprocess.DEVNULL)
+
+        for i in range(100):
+            if os.path.exists(self.path):
+                break
+            time.sleep(0.01)
+
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(self.path)
+        self.file = self.sock.makefile("r")
+
+    def tearDown(self):
+        self.file.close()
+        self.sock.close()
+        self.server.terminate()
+        self.server.wait()
+        self.dir.cleanup()
+
+    def request(self, id, method, params=None):
+        request = {"jsonrpc": "2.0", "id": id, "method": method}
+        if params is not None:
+            request["params"] = params
+        return json.dumps(request) + "\n"
+
+    def send(self, *requests):
+        self.sock.sendall("".join(requests).encode())
+        return [json.loads(self.file.readline()) for r in requests]
+
+    ###############
+    ## Commands
+    ###############
+
+    def test_0010(self):
+        out = self.send(self.request(1, "privkey", ["-X", "1"]))
+
+        self.assertTrue(out[0]["id"] == 1)
+        self.assertTrue(out[0]["result"] == ["0000000000000000000000000000000000000000000000000000000000000001"])
+
+    def test_0020(self):
+        out = self.send(self.request(1, "address", ["--legacy", "--bech32", "KwZyzjLqrxTdMBUXV1pNsF53jmatRNSZn7t5x8sx735rzAbz4Cpa"]))
+
+        self.assertTrue(sorted(out[0]["result"]) == sorted(["1NZoZSUY4Lfg5yVn5FPHo4NHEUKcGmGkj1", "bc1qaj8dzeef28e9qrwa386krprp56fps44gspvvy7"]))
+
+    def test_0030(self):
+        out = self.send(self.request(1, "version"))
+
+        self.assertTrue(out[0]["result"][0].startswith("Bitcoin Toolkit Version"))
+
+    ###############
+    ## Pipelining
+    ###############
+
+    def test_0040(self):
+        # Options of one request must not carry over to the next.
+        out = self.send(
+            self.request(1, "privkey", ["-X", "1"]),
+            self.request(2, "privkey", ["1"]),
+            self.request(3, "pubkey", ["-U", "KwDiBf89QgGbjEhKnhXJuH7LrciVrZi3qYjgd9M7rFU73sVHnoWn"]),
+            self.request(4, "pubkey", ["KwDiBf89QgGbjEhKnhXJuH7LrciVrZi3qYjgd9M7rFU73sVHnoWn"]),
+        )
+
+        self.assertTrue([o["id"] for o in out] == [1, 2, 3, 4])
+        self.assertTrue(out[1]["result"] == ["KwDiBf89QgGbjEhKnhXJuH7LrciVrZi3qYjgd9M7rFU73sVHnoWn"])
+        self.assertTrue(out[2]["result"][0].startswith("04"))
+        self.assertTrue(out[3]["result"] == ["0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798"])
+
+    ###############
+    ## Errors
+    ###############
+
+    def test_0050(self):
+        out = self.send("not json\n", self.request(1, "node"), self.request(2, "privkey", ["-L", "1"]))
+
+        self.assertTrue(out[0]["error"]["code"] == -32700)
+        self.assertTrue(out[1]["error"]["code"] == -32601)
+        self.assertTrue(out[2]["error"]["code"] == -32000)
+
+    ###############
+    ## Shutdown
+    ###############
+
+    def test_0060(self):
+        # SIGTERM ends the server cleanly and removes its socket.
+        self.server.terminate()
+
+        self.assertTrue(self.server.wait(timeout=5) == 0)
+        self.assertFalse(os.path.exists(self.path))
+
+    ###############
+    ## Limits
+    ###############
+
+    def test_0070(self):
+        # With few descriptors, connections past the limit wait in the
+        # backlog instead of ending the server, and are served once
+        # others close.
+        path = os.path.join(self.dir.name, "limited.sock")
+        limit = lambda: resource.setrlimit(resource.RLIMIT_NOFILE, (24, 24))
+        server = subprocess.Popen(["bin/btk", "serve", f"--socket={path}"], stderr=subprocess.DEVNULL, preexec_fn=limit)
+
+        for i in range(100):
+            if os.path.exists(path):
+                break
+            time.sleep(0.01)
+
+        socks = []
+        for i in range(40):
+            sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            sock.connect(path)
+            socks.append(sock)
+
+        socks[0].sendall(self.request(1, "privkey", ["-X", "1"]).encode())
+        self.assertTrue(json.loads(socks[0].makefile("r").readline())["result"] == ["0000000000000000000000000000000000000000000000000000000000000001"])
+
+        for sock in socks[:-1]:
+            sock.close()
+
+        # The last connection waited in the backlog.
+        socks[-1].sendall(self.request(2, "privkey", ["-X", "1"]).encode())
+        self.assertTrue(json.loads(socks[-1].makefile("r").readline())["result"] == ["0000000000000000000000000000000000000000000000000000000000000001"])
+
+        socks[-1].close()
+
+        self.assertTrue(server.poll() is None)
+
+        server.terminate()
+
+        self.assertTrue(server.wait(timeout=5) == 0)
+        self.assertFalse(os.path.exists(path))
\ No newline at end of file
@@ -0,0 +1,144 @@
+import struct
+import hashlib
+
+# Writes UTXO snapshot files in the layouts of Bitcoin Core's dumptxoutset,
+# both the current one and the one used before Bitcoin Core 28, for the
+# --create-from-snapshot tests.
+
+NETWORK_MAIN = bytes.fromhex("f9beb4d9")
+NETWORK_TEST = bytes.fromhex("0b110907")
+
+BASE58_ALPHABET = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz"
+BECH32_ALPHABET = "qpzry9x8gf2tvdw0s3jn54khce6mua7l"
+
+
+class Coin:
+
+    def __init__(self, txid, vout, amount, script, height=1, address=None):
+        self.txid = txid
+        self.vout = vout
+        self.amount = amount
+        self.script = script
+        self.height = height
+        self.address = address
+
+    def encode(self):
+        return varint(self.height * 2) + varint(compress_amount(self.amount)) + self.script
+
+
+def p2pkh(txid, vout, amount, hash160):
+    # Compressed script type 0, a public key hash.
+    return Coin(txid, vout, amount, varint(0) + hash160, address=base58check(b"\x00" + hash160))
+
+
+def p2sh(txid, vout, amount, hash160):
+    # Compressed script type 1, a script hash.
+    return Coin(txid, vout, amount, varint(1) + hash160, address=base58check(b"\x05" + hash160))
+
+
+def p2wpkh(txid, vout, amount, hash160):
+    # Other scripts are stored whole, with their length plus 6.
+    script = b"\x00\x14" + hash160
+    return Coin(txid, vout, amount, varint(len(script) + 6) + script, address=segwit_address(0, hash160))
+
+
+def encode(coins, legacy=False, network=NETWORK_MAIN, block_hash=bytes(32)):
+    if legacy:
+        data = bytearray(block_hash + struct.pack("<Q", len(coins)))
+        for coin in coins:
+            data += coin.txid + struct.pack("<I", coin.vout) + coin.encode()
+        return bytes(data)
+
+    data = bytearray(b"utxo\xff" + struct.pack("<H", 2) + network + block_hash + struct.pack("<Q", len(coins)))
+
+    # Coins are grouped by transaction, each group led by its txid and size.
+    i = 0
+    while i < len(coins):
+        j = i
+        while j < len(coins) and coins[j].txid == coins[i].txid:
+            j += 1
+        data += coins[i].txid + compact_size(j - i)
+        for coin in coins[i:j]:
+            data += compact_size(coin.vout) + coin.encode()
+        i = j
+
+    return bytes(data)
+
+
+def varint(n):
+    out = bytearray()
+    while True:
+        out.insert(0, (n & 0x7f) | (0x80 if out else 0))
+        if n <= 0x7f:
+            break
+        n = (n >> 7) - 1
+    return bytes(out)
+
+
+def compact_size(n):
+    if n < 0xfd:
+        return bytes([n])
+    if n <= 0xffff:
+        return b"\xfd" + struct.pack("<H", n)
+    if n <= 0xffffffff:
+        return b"\xfe" + struct.pack("<I", n)
+    return b"\xff" + struct.pack("<Q", n)
+
+
+def compress_amount(n):
+    if n == 0:
+        return 0
+    e = 0
+    while n % 10 == 0 and e < 9:
+        n //= 10
+        e += 1
+    if e < 9:
+        d = n % 10
+        n //= 10
+        return 1 + (n * 9 + d - 1) * 10 + e
+    return 1 + (n - 1) * 10 + 9
+
+
+def base58check(payload):
+    data = payload + hashlib.sha256(hashlib.sha256(payload).digest()).digest()[:4]
+    n = int.from_bytes(data, "big")
+    out = ""
+    while n > 0:
+        n, r = divmod(n, 58)
+        out = BASE58_ALPHABET[r] + out
+    return "1" * (len(data) - len(data.lstrip(b"\x00"))) + out
+
+
+def segwit_address(version, program):
+    data = [version] + convert_bits(program, 8, 5)
+    checksum = bech32_polymod(bech32_hrp_expand("bc") + data + [0] * 6) ^ 1
+    data += [(checksum >> 5 * (5 - i)) & 31 for i in range(6)]
+    return "bc1" + "".join(BECH32_ALPHABET[d] for d in data)
+
+
+def convert_bits(data, from_bits, to_bits):
+    acc, bits, out = 0, 0, []
+    for value in data:
+        acc = (acc << from_bits) | value
+        bits += from_bits
+        while bits >= to_bits:
+            bits -= to_bits
+            out.append((acc >> bits) & ((1 << to_bits) - 1))
+    if bits:
+        out.append((acc << (to_bits - bits)) & ((1 << to_bits) - 1))
+    return out
+
+
+def bech32_hrp_expand(hrp):
+    return [ord(c) >> 5 for c in hrp] + [0] + [ord(c) & 31 for c in hrp]
+
+
+def bech32_polymod(values):
+    generator = [0x3b6a57b2, 0x26508e6d, 0x1ea119fa, 0x3d4233dd, 0x2a1462b3]
+    chk = 1
+    for value in values:
+        top = chk >> 25
+        chk = (chk & 0x1ffffff) << 5 ^ value
+        for i in range(5):
+            chk ^= generator[i] if ((top >> i) & 1) else 0
+    return chk
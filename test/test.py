@@ -1,4 +1,4 @@
-from Tests import Privkey, Pubkey, Address, Balance, Node, Config, Version
+from Tests import Privkey, Pubkey, Address, Balance, Node, Config, Version, Chain, Serve, Lib
 
 test = Privkey()
 test.run_test()
@@ -19,4 +19,13 @@ test = Config()
 test.run_test()
 
 test = Version()
+test.run_test()
+
+test = Chain()
+test.run_test()
+
+test = Serve()
+test.run_test()
+
+test = Lib()
 test.run_test()
\ No newline at end of file